@@ -0,0 +1,528 @@
+#include "progen/TerrainGenerator.h"
+#include "progen/HeightmapIO.h"
+#include "progen/MeshExport.h"
+#include "progen/TerrainTiles.h"
+#include "progen/TileServer.h"
+#include "progen/ThreadPool.h"
+#include "progen/Profiler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+
+#ifdef _WIN32
+#include <direct.h>
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/stat.h>
+#include <sys/resource.h>
+#endif
+
+/*
+	Headless terrain generation for the content pipeline.
+
+	The terrains to generate come from a job file, one terrain per line as key=value pairs on top of the defaults
+	(the same defaults the app starts with), and/or from sweeps over ranges of the noise parameters. With both,
+	every line of the file is swept.
+
+	A fixed number of terrains is generated at once. Every worker owns a TerrainGenerator and keeps its buffers
+	for all the terrains it makes, and the stages of a terrain still split their rows over the shared ThreadPool,
+	which also runs the workers, so the machine is never oversubscribed.
+*/
+
+namespace
+{
+	struct Job
+	{
+		std::string name;
+		std::string heights, biomes; //Height map (and biome map) to mesh instead of the noise
+		GenerationData gData;
+		NoiseData nData;
+	};
+
+	//begin:end[:step], inclusive
+	struct Range
+	{
+		double begin, end, step;
+		bool active;
+	};
+
+	Job defaultJob()
+	{
+		Job job;
+		job.gData.W = 10;
+		job.gData.L = 10;
+		job.gData.numXVertices = 256;
+		job.gData.numZVertices = 256;
+		job.gData.heightMultiplier = 1.0f;
+		job.gData.useFallOff = false;
+		job.gData.analyticNormals = false;
+		//The curve is near zero in [0, 0.3] range (Water) then it increases
+		job.gData.controlPoints[0] = 1.00f;
+		job.gData.controlPoints[1] = 0.0f;
+		job.gData.controlPoints[2] = (float)WATER.getUpperHeight();
+		job.gData.controlPoints[3] = 0.0f;
+		job.gData.erosion.enabled = false;
+		job.gData.erosion.iterations = 50;
+		job.gData.erosion.talus = 0.01f;
+		job.gData.erosion.rate = 1.0f;
+		job.gData.erosion.epsilon = 1e-5f;
+		job.gData.hydrology.enabled = false;
+		job.gData.hydrology.method = FlowMethod::D8;
+		job.gData.hydrology.fillEpsilon = 1e-6f;
+		job.gData.hydrology.riverThreshold = 0.002f;
+		job.nData.scale = 0.3;
+		job.nData.octaves = 3;
+		job.nData.persistence = 0.5;
+		job.nData.lacunarity = 2.0;
+		job.nData.seed = 21;
+		job.nData.offset = glm::vec2(0.0f);
+		job.nData.octaveMode = OctaveMode::Fixed;
+		job.nData.fadeLastOctave = true;
+		job.nData.fractalMode = FractalMode::Fbm;
+		job.nData.warpStrength = 1.0;
+		return job;
+	}
+
+	bool parseRange(const char* text, Range& range)
+	{
+		range.step = 1.0;
+		int fields = std::sscanf(text, "%lf:%lf:%lf", &range.begin, &range.end, &range.step);
+		if (fields == 1)
+			range.end = range.begin;
+		range.active = fields >= 1 && range.step > 0.0 && range.end >= range.begin;
+		return range.active;
+	}
+
+	bool setKey(Job& job, const std::string& key, const std::string& value)
+	{
+		const char* v = value.c_str();
+		GenerationData& g = job.gData;
+		NoiseData& n = job.nData;
+		if (key == "name") job.name = value;
+		else if (key == "heights") job.heights = value;
+		else if (key == "biomes") job.biomes = value;
+		else if (key == "seed") n.seed = std::atoi(v);
+		else if (key == "octaves") n.octaves = std::atoi(v);
+		else if (key == "persistence") n.persistence = std::atof(v);
+		else if (key == "lacunarity") n.lacunarity = std::atof(v);
+		else if (key == "scale") n.scale = std::atof(v);
+		else if (key == "offset_x") n.offset.x = (float)std::atof(v);
+		else if (key == "offset_y") n.offset.y = (float)std::atof(v);
+		else if (key == "band_limited") n.octaveMode = std::atoi(v) != 0 ? OctaveMode::BandLimited : OctaveMode::Fixed;
+		else if (key == "fade_octave") n.fadeLastOctave = std::atoi(v) != 0;
+		else if (key == "fractal")
+		{
+			const char* names[] = { "fbm", "ridged", "hybrid", "warp" };
+			for (int i = 0; i < 4; ++i)
+			{
+				if (value == names[i])
+				{
+					n.fractalMode = (FractalMode)i;
+					return true;
+				}
+			}
+			return false;
+		}
+		else if (key == "warp_strength") n.warpStrength = std::atof(v);
+		else if (key == "size") g.numXVertices = g.numZVertices = std::atoi(v);
+		else if (key == "size_x") g.numXVertices = std::atoi(v);
+		else if (key == "size_z") g.numZVertices = std::atoi(v);
+		else if (key == "width") g.W = std::atoi(v);
+		else if (key == "length") g.L = std::atoi(v);
+		else if (key == "height") g.heightMultiplier = (float)std::atof(v);
+		else if (key == "curve") return std::sscanf(v, "%f,%f,%f,%f", &g.controlPoints[0], &g.controlPoints[1], &g.controlPoints[2], &g.controlPoints[3]) == 4;
+		else if (key == "falloff") g.useFallOff = std::atoi(v) != 0;
+		else if (key == "analytic_normals") g.analyticNormals = std::atoi(v) != 0;
+		else if (key == "erosion") g.erosion.enabled = std::atoi(v) != 0;
+		else if (key == "erosion_iterations") g.erosion.iterations = std::atoi(v);
+		else if (key == "talus") g.erosion.talus = (float)std::atof(v);
+		else if (key == "hydrology") g.hydrology.enabled = std::atoi(v) != 0;
+		else if (key == "dinf") g.hydrology.method = std::atoi(v) != 0 ? FlowMethod::DInfinity : FlowMethod::D8;
+		else if (key == "river_threshold") g.hydrology.riverThreshold = (float)std::atof(v);
+		else return false;
+		return true;
+	}
+
+	bool setAssignment(Job& job, const std::string& assignment)
+	{
+		size_t equals = assignment.find('=');
+		if (equals == std::string::npos || !setKey(job, assignment.substr(0, equals), assignment.substr(equals + 1)))
+		{
+			std::printf("Unknown setting: %s\n", assignment.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	//Lines starting with # and empty lines are skipped
+	bool readJobs(const char* path, const Job& defaults, std::vector<Job>& jobs)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			std::printf("Could not open %s\n", path);
+			return false;
+		}
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream tokens(line);
+			std::string token;
+			if (!(tokens >> token) || token[0] == '#')
+				continue;
+			Job job = defaults;
+			do
+			{
+				if (!setAssignment(job, token))
+					return false;
+			} while (tokens >> token);
+			jobs.push_back(job);
+		}
+		return true;
+	}
+
+	//Every job times every combination of the active ranges
+	void sweep(std::vector<Job>& jobs, const Range& seeds, const Range& octaves, const Range& persistence, const Range& lacunarity)
+	{
+		std::vector<Job> swept;
+		for (const Job& base : jobs)
+		{
+			Range s = seeds.active ? seeds : Range{ (double)base.nData.seed, (double)base.nData.seed, 1.0, true };
+			Range o = octaves.active ? octaves : Range{ (double)base.nData.octaves, (double)base.nData.octaves, 1.0, true };
+			Range p = persistence.active ? persistence : Range{ base.nData.persistence, base.nData.persistence, 1.0, true };
+			Range l = lacunarity.active ? lacunarity : Range{ base.nData.lacunarity, base.nData.lacunarity, 1.0, true };
+			//Half a step of slack so that the end is hit despite the rounding of the steps
+			for (double seed = s.begin; seed <= s.end + 0.5 * s.step; seed += s.step)
+				for (double octave = o.begin; octave <= o.end + 0.5 * o.step; octave += o.step)
+					for (double pers = p.begin; pers <= p.end + 0.5 * p.step; pers += p.step)
+						for (double lac = l.begin; lac <= l.end + 0.5 * l.step; lac += l.step)
+						{
+							Job job = base;
+							job.nData.seed = (int)std::lround(seed);
+							job.nData.octaves = (int)std::lround(octave);
+							job.nData.persistence = pers;
+							job.nData.lacunarity = lac;
+							swept.push_back(job);
+						}
+		}
+		jobs.swap(swept);
+	}
+
+	void makeDirectory(const std::string& path)
+	{
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+
+	//Largest resident set of the process so far, in bytes
+	size_t peakResidentBytes()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			return counters.PeakWorkingSetSize;
+		return 0;
+#else
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0;
+#ifdef __APPLE__
+		return (size_t)usage.ru_maxrss;
+#else
+		return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+	}
+
+	TileServer* activeServer = nullptr;
+
+	void stopServer(int)
+	{
+		if (activeServer != nullptr)
+			activeServer->stop();
+	}
+
+	//Serves the tiles of the jobs until interrupted, the misses fill the cache
+	int serve(const std::vector<Job>& jobs, TileCache& cache, int tileCells, int noiseLevel, const std::string& address)
+	{
+		TileServer server(cache);
+		for (const Job& job : jobs)
+		{
+			if (!job.heights.empty())
+			{
+				std::printf("%s: loaded height maps are not tiled, not served\n", job.name.c_str());
+				continue;
+			}
+			uint64_t parameters = server.addTerrain(job.name, job.gData, job.nData, tileCells, noiseLevel);
+			std::printf("%s: /tiles/%016llx/<lod>/<x>/<z>\n", job.name.c_str(), (unsigned long long)parameters);
+		}
+		if (!server.listen(address))
+			return 1;
+		std::printf("Serving on %s, Ctrl+C stops\n", server.getAddress().c_str());
+		std::fflush(stdout);
+		activeServer = &server;
+		std::signal(SIGINT, stopServer);
+		std::signal(SIGTERM, stopServer);
+		server.run();
+		activeServer = nullptr;
+		TileServerStats stats = server.getStats();
+		std::printf("%llu requests: %llu hits, %llu misses, %llu coalesced, %llu errors, %.1f MB sent\n",
+			(unsigned long long)stats.requests, (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+			(unsigned long long)stats.coalesced, (unsigned long long)stats.errors, stats.bytesSent / (1024.0 * 1024.0));
+		return 0;
+	}
+
+	void printUsage()
+	{
+		std::printf(
+			"BatchGenerator [options]\n"
+			"  --jobs <file>           terrains to generate, one per line as key=value pairs\n"
+			"  --set <key=value>       changes the defaults every terrain starts from\n"
+			"  --seeds a:b[:step]      sweeps the seed (also --octaves, --persistence, --lacunarity)\n"
+			"  --workers <n>           terrains generated at once (default: pool threads + 1)\n"
+			"  --out <dir>             output directory (default: batch)\n"
+			"  --mesh <ply|glb>        also writes the grid mesh, streamed from the heights\n"
+			"  --chunk <cells>         writes the mesh as chunks of cells x cells, one file per chunk\n"
+			"  --heights <pgm|raw|pgth|pghc> format of the height maps (default: pgm, pgth is tiled with the biome IDs,\n"
+			"                          pghc is compressed to the precision of the 16-bit ones)\n"
+			"  --biomes                also writes the biome IDs as 8-bit PGMs\n"
+			"  --no-heights            does not write the height maps\n"
+			"  --cache <dir>           fetches every tile of the terrains through a tile cache instead of writing files\n"
+			"  --cache-size <MB>       size of the tile cache (default: 1024)\n"
+			"  --cache-error <units>   largest error of the cached heights in world units (default: 0, exact)\n"
+			"  --tiles <cells>         cells per tile side (default: 256)\n"
+			"  --noise-level <lod>     samples the tile pyramid levels from lod up straight from the noise (default: 0, all\n"
+			"                          levels are reduced from the full terrain)\n"
+			"  --serve <address>       serves the tiles of the terrains through the cache over HTTP, on a loopback port\n"
+			"                          or on unix:<path>, until interrupted (needs --cache)\n"
+			"keys: name heights=<file> biomes=<file> (meshes a saved height map instead of the noise) seed octaves band_limited fade_octave fractal=fbm|ridged|hybrid|warp warp_strength persistence lacunarity scale offset_x offset_y size size_x size_z width length\n"
+			"      height curve=x1,y1,x2,y2 falloff analytic_normals erosion erosion_iterations talus hydrology dinf river_threshold\n");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	PROFILE_THREAD("main");
+#ifdef PROGEN_PROFILING
+	//PROGEN_TRACE=<file> traces the batch and writes it at the end
+	const char* tracePath = std::getenv("PROGEN_TRACE");
+	if (tracePath != nullptr)
+		Profiler::global().setTracing(true);
+#endif
+	Job defaults = defaultJob();
+	const char* jobPath = nullptr;
+	Range seeds = {}, octaves = {}, persistence = {}, lacunarity = {};
+	int workerCount = (int)ThreadPool::global().getThreadCount() + 1;
+	std::string outDir = "batch";
+	bool writeHeights = true, writeBiomes = false, writeMesh = false;
+	std::string heightsFormat = "pgm";
+	std::string cacheDir;
+	double cacheMB = 1024.0;
+	float cacheError = 0.0f;
+	std::string serveAddress;
+	int tileCells = 256;
+	int noiseLevel = 0;
+	MeshFormat meshFormat = MeshFormat::PLY;
+	int chunkCells = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		bool valid = true;
+		if (arg == "--help")
+		{
+			printUsage();
+			return 0;
+		}
+		else if (arg == "--jobs" && hasValue)
+			jobPath = argv[++i];
+		else if (arg == "--set" && hasValue)
+			valid = setAssignment(defaults, argv[++i]);
+		else if (arg == "--seeds" && hasValue)
+			valid = parseRange(argv[++i], seeds);
+		else if (arg == "--octaves" && hasValue)
+			valid = parseRange(argv[++i], octaves);
+		else if (arg == "--persistence" && hasValue)
+			valid = parseRange(argv[++i], persistence);
+		else if (arg == "--lacunarity" && hasValue)
+			valid = parseRange(argv[++i], lacunarity);
+		else if (arg == "--workers" && hasValue)
+			valid = (workerCount = std::atoi(argv[++i])) > 0;
+		else if (arg == "--out" && hasValue)
+			outDir = argv[++i];
+		else if (arg == "--mesh" && hasValue)
+		{
+			std::string format = argv[++i];
+			writeMesh = true;
+			meshFormat = format == "glb" ? MeshFormat::GLB : MeshFormat::PLY;
+			valid = format == "glb" || format == "ply";
+		}
+		else if (arg == "--chunk" && hasValue)
+			valid = (chunkCells = std::atoi(argv[++i])) > 0;
+		else if (arg == "--heights" && hasValue)
+		{
+			heightsFormat = argv[++i];
+			valid = heightsFormat == "pgm" || heightsFormat == "raw" || heightsFormat == "pgth" || heightsFormat == "pghc";
+		}
+		else if (arg == "--biomes")
+			writeBiomes = true;
+		else if (arg == "--cache" && hasValue)
+			cacheDir = argv[++i];
+		else if (arg == "--cache-size" && hasValue)
+			valid = (cacheMB = std::atof(argv[++i])) > 0.0;
+		else if (arg == "--cache-error" && hasValue)
+			valid = (cacheError = (float)std::atof(argv[++i])) >= 0.0f;
+		else if (arg == "--serve" && hasValue)
+			serveAddress = argv[++i];
+		else if (arg == "--tiles" && hasValue)
+			valid = (tileCells = std::atoi(argv[++i])) > 0;
+		else if (arg == "--noise-level" && hasValue)
+			valid = (noiseLevel = std::atoi(argv[++i])) >= 0;
+		else if (arg == "--no-heights")
+			writeHeights = false;
+		else
+			valid = false;
+		if (!valid)
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	std::vector<Job> jobs;
+	if (jobPath != nullptr)
+	{
+		if (!readJobs(jobPath, defaults, jobs))
+			return 1;
+	}
+	else
+		jobs.push_back(defaults);
+	sweep(jobs, seeds, octaves, persistence, lacunarity);
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		if (jobs[i].name.empty())
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "terrain_%05zu", i);
+			jobs[i].name = name;
+		}
+		jobs[i].nData.W = jobs[i].gData.numXVertices;
+		jobs[i].nData.H = jobs[i].gData.numZVertices;
+	}
+	TileCache cache;
+	cache.setHeightError(cacheError);
+	if (!cacheDir.empty() && !cache.open(cacheDir, (uint64_t)(cacheMB * 1024.0 * 1024.0)))
+	{
+		std::printf("Could not open the tile cache %s\n", cacheDir.c_str());
+		return 1;
+	}
+	if (!serveAddress.empty())
+	{
+		if (cacheDir.empty())
+		{
+			std::printf("--serve needs a tile cache (--cache <dir>)\n");
+			return 1;
+		}
+		return serve(jobs, cache, tileCells, noiseLevel, serveAddress);
+	}
+	if (cacheDir.empty() && (writeHeights || writeBiomes || writeMesh))
+		makeDirectory(outDir);
+	std::printf("%zu terrains on %d workers\n", jobs.size(), workerCount);
+
+	std::atomic<size_t> nextJob(0), failures(0), samples(0);
+	auto start = std::chrono::steady_clock::now();
+	ThreadPool::global().parallelFor(0, workerCount, [&](int begin, int end)
+	{
+		for (int worker = begin; worker < end; ++worker)
+		{
+			TerrainGenerator generator;
+			for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+			{
+				const Job& job = jobs[i];
+				//A streamed world only asks for tiles, the misses generate the terrain and fill the cache
+				if (!cacheDir.empty())
+				{
+					if (!job.heights.empty())
+					{
+						std::printf("%s: loaded height maps are not tiled\n", job.name.c_str());
+						++failures;
+						continue;
+					}
+					TerrainTiles tiles(cache, job.gData, job.nData, tileCells, noiseLevel);
+					TerrainTile tile;
+					for (int z = 0; z < tiles.getTilesZ(); ++z)
+						for (int x = 0; x < tiles.getTilesX(); ++x)
+						{
+							tiles.getTile(x, z, tile);
+							samples += tile.heights.size();
+						}
+					continue;
+				}
+				std::string base = outDir + "/" + job.name;
+				//The vertex counts follow a loaded height map
+				GenerationData gData = job.gData;
+				if (job.heights.empty())
+					generator.generateHeights(gData, job.nData);
+				else if (!generator.loadHeights(job.heights.c_str(), gData, job.biomes.empty() ? nullptr : job.biomes.c_str()))
+				{
+					std::printf("Could not read %s\n", job.heights.c_str());
+					++failures;
+					continue;
+				}
+				generator.applyHeightCurve(gData);
+				bool written = true;
+				//The height map before the height curve, so it can be loaded again
+				if (writeHeights)
+					written &= generator.saveHeights((base + "." + heightsFormat).c_str());
+				if (writeBiomes)
+					written &= HeightmapIO::writeBiomePGM((base + "_biomes.pgm").c_str(), generator.getBiomeMap(), gData.numXVertices, gData.numZVertices);
+				if (writeMesh)
+				{
+					GridMeshView view(generator.getScaledHeights(), generator.getBiomeMap(), generator.getBiomes(), (float)gData.W, (float)gData.L);
+					if (chunkCells > 0)
+						written &= MeshExport::writeChunks(view, chunkCells, meshFormat, base) == 0;
+					else
+						written &= MeshExport::write((base + "." + MeshExport::getExtension(meshFormat)).c_str(), view, meshFormat);
+				}
+				if (!written)
+				{
+					std::printf("Could not write %s\n", base.c_str());
+					++failures;
+				}
+				samples += generator.getHeightMap().size();
+			}
+		}
+	}, 1);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::printf("%zu terrains in %.2f s: %.2f terrains/s, %.1f M samples/s, peak RSS %.1f MB\n", jobs.size(), seconds,
+		jobs.size() / seconds, samples.load() / seconds * 1e-6, peakResidentBytes() / (1024.0 * 1024.0));
+	if (!cacheDir.empty())
+	{
+		TileCacheStats stats = cache.getStats();
+		uint64_t requests = stats.hits + stats.misses;
+		std::printf("Tile cache: %llu hits, %llu misses (%.1f%% hit rate), %llu written, %llu evicted, %llu tiles in %.1f MB\n",
+			(unsigned long long)stats.hits, (unsigned long long)stats.misses, requests > 0 ? 100.0 * stats.hits / requests : 0.0,
+			(unsigned long long)stats.writes, (unsigned long long)stats.evictions, (unsigned long long)stats.tiles, stats.bytes / (1024.0 * 1024.0));
+	}
+#ifdef PROGEN_PROFILING
+	if (tracePath != nullptr && Profiler::global().writeChromeTrace(tracePath))
+		std::printf("Trace written to %s\n", tracePath);
+#endif
+	return failures > 0 ? 1 : 0;
+}
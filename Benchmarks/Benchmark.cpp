@@ -0,0 +1,110 @@
+#include "Benchmark.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+
+BenchmarkRunner::BenchmarkRunner()
+{}
+
+const BenchmarkResult& BenchmarkRunner::run(const std::string& name, const std::function<size_t()>& func, int repetitions)
+{
+	//Warm-up: first touch of the buffers, caches and the thread pool
+	func();
+
+	std::vector<double> times;
+	size_t items = 0;
+	for (int i = 0; i < repetitions; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		items = func();
+		auto end = std::chrono::steady_clock::now();
+		times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	std::sort(times.begin(), times.end());
+
+	BenchmarkResult result;
+	result.name = name;
+	result.items = items;
+	result.repetitions = repetitions;
+	result.medianMs = times[times.size() / 2];
+	result.minMs = times.front();
+	result.nsPerItem = items > 0 ? result.medianMs * 1e6 / items : 0.0;
+	result.itemsPerSecond = result.medianMs > 0.0 ? items / (result.medianMs * 1e-3) : 0.0;
+	results.push_back(result);
+
+	std::printf("%-48s %12.3f ms %12.2f ns/item %14.0f items/s\n", name.c_str(), result.medianMs, result.nsPerItem, result.itemsPerSecond);
+	std::fflush(stdout);
+	return results.back();
+}
+
+void BenchmarkRunner::printTable() const
+{
+	std::printf("\n%-48s %12s %12s %14s\n", "benchmark", "median ms", "ns/item", "items/s");
+	for (const BenchmarkResult& r : results)
+		std::printf("%-48s %12.3f %12.2f %14.0f\n", r.name.c_str(), r.medianMs, r.nsPerItem, r.itemsPerSecond);
+}
+
+const std::vector<BenchmarkResult>& BenchmarkRunner::getResults() const
+{
+	return results;
+}
+
+void BenchmarkRunner::addFilter(const std::string& filter)
+{
+	filters.push_back(filter);
+}
+
+bool BenchmarkRunner::isSelected(const std::string& group) const
+{
+	if (filters.empty())
+		return true;
+	for (const std::string& filter : filters)
+		if (group.find(filter) != std::string::npos)
+			return true;
+	return false;
+}
+
+bool BenchmarkRunner::writeJson(const char* path) const
+{
+	std::FILE* file = std::fopen(path, "w");
+	if (file == nullptr)
+		return false;
+
+	char date[32] = "";
+	std::time_t now = std::time(nullptr);
+	std::tm* utc = std::gmtime(&now);
+	if (utc != nullptr)
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", utc);
+#if defined(_MSC_VER)
+	const char* compiler = "msvc";
+#elif defined(__clang__)
+	const char* compiler = "clang";
+#elif defined(__GNUC__)
+	const char* compiler = "gcc";
+#else
+	const char* compiler = "unknown";
+#endif
+#ifdef NDEBUG
+	const char* build = "release";
+#else
+	const char* build = "debug";
+#endif
+
+	//Names are plain ASCII without quotes, they are written as they are
+	std::fprintf(file, "{\n\t\"context\": {\"date\": \"%s\", \"compiler\": \"%s\", \"build\": \"%s\", \"hardware_threads\": %u},\n",
+		date, compiler, build, std::thread::hardware_concurrency());
+	std::fprintf(file, "\t\"benchmarks\": [");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchmarkResult& r = results[i];
+		std::fprintf(file, "%s\n\t\t{\"name\": \"%s\", \"items\": %zu, \"repetitions\": %d, \"median_ms\": %.6f, \"min_ms\": %.6f, "
+			"\"ns_per_item\": %.4f, \"items_per_second\": %.1f}",
+			i > 0 ? "," : "", r.name.c_str(), r.items, r.repetitions, r.medianMs, r.minMs, r.nsPerItem, r.itemsPerSecond);
+	}
+	std::fprintf(file, "\n\t]\n}\n");
+	bool written = std::ferror(file) == 0;
+	return std::fclose(file) == 0 && written;
+}
@@ -0,0 +1,46 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+/*
+	A small self-contained benchmark harness, so the benchmarks need nothing but the engine sources.
+
+	Every case is a function that runs the measured work once and returns how many items it processed
+	(samples, rays, triangles...). It is repeated a few times after a warm-up run and the median is reported.
+
+	Cases are named "Group/case/parameters". Groups can be selected with filters, and the results written as JSON
+	so that runs of different versions can be compared by a script.
+*/
+
+struct BenchmarkResult
+{
+	std::string name;
+	size_t items; //Items processed by a single repetition
+	int repetitions;
+	double medianMs; //Median wall time of a repetition
+	double minMs;
+	double nsPerItem;
+	double itemsPerSecond;
+};
+
+class BenchmarkRunner
+{
+public:
+	BenchmarkRunner();
+	const BenchmarkResult& run(const std::string& name, const std::function<size_t()>& func, int repetitions = 5);
+	void printTable() const;
+	const std::vector<BenchmarkResult>& getResults() const;
+	//A group runs if its name contains one of the filters, everything runs without filters
+	void addFilter(const std::string& filter);
+	bool isSelected(const std::string& group) const;
+	bool writeJson(const char* path) const;
+private:
+	std::vector<BenchmarkResult> results;
+	std::vector<std::string> filters;
+};
+
+#endif
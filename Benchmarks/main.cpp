@@ -0,0 +1,1425 @@
+//Headless benchmarks of the generation stages. No window or OpenGL context is created.
+
+#include "progen/PerlinNoise.h"
+#include "progen/HeightField.h"
+#include "progen/FalloffMap.h"
+#include "progen/HeightCurve.h"
+#include "progen/MeshBuilder.h"
+#include "progen/Biome.h"
+#include "progen/TerrainQuery.h"
+#include "progen/PoissonScatter.h"
+#include "progen/RTINMesher.h"
+#include "progen/VertexCache.h"
+#include "progen/ClusterSet.h"
+#include "progen/HorizonCuller.h"
+#include "progen/BufferAllocator.h"
+#include "progen/MeshExport.h"
+#include "progen/HeightmapIO.h"
+#include "progen/TiledHeightmap.h"
+#include "progen/TerrainTiles.h"
+#include "progen/HeightCodec.h"
+#include "progen/TileServer.h"
+#include "progen/TilePyramid.h"
+#include "progen/Profiler.h"
+
+#include "Benchmark.h"
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <glm/gtc/matrix_transform.hpp>
+
+
+/*
+	Noise heights scaled to world units, like the ones the app meshes.
+*/
+HeightField makeHeights(int resolution, float heightMultiplier)
+{
+	NoiseData nData;
+	nData.W = resolution;
+	nData.H = resolution;
+	nData.seed = 21;
+	nData.scale = 0.3;
+	nData.octaves = 5;
+	nData.persistence = 0.5;
+	nData.lacunarity = 2.0;
+	nData.offset = glm::vec2(0.0f);
+	nData.octaveMode = OctaveMode::Fixed;
+	nData.fadeLastOctave = false;
+	nData.fractalMode = FractalMode::Fbm;
+	nData.warpStrength = 0.0;
+
+	PerlinNoise noise;
+	HeightField heights = noise.generateNoiseMap(nData);
+	for (size_t i = 0; i < heights.size(); ++i)
+		heights.data()[i] *= heightMultiplier;
+	return heights;
+}
+
+/*
+	Raw gradient noise: samples along rows like generateNoiseMap takes them, without the octave loop.
+*/
+void benchmarkNoise(BenchmarkRunner& runner)
+{
+	PerlinNoise noise;
+	const int side = 512;
+	double checksum = 0.0;
+	runner.run("PerlinNoise/noise", [&]()
+	{
+		double sum = 0.0;
+		for (int y = 0; y < side; ++y)
+			for (int x = 0; x < side; ++x)
+				sum += noise.noise(x * 0.0137 + 1234.5, y * 0.0137 - 987.25, 0.0);
+		checksum = sum;
+		return (size_t)side * side;
+	});
+	std::printf("  checksum %.6f\n", checksum);
+	//The same samples through the batched kernel, a row at a time
+	std::vector<double> rowX(side), rowY(side), rowValues(side);
+	runner.run("PerlinNoise/noise_batched", [&]()
+	{
+		double sum = 0.0;
+		for (int y = 0; y < side; ++y)
+		{
+			for (int x = 0; x < side; ++x)
+			{
+				rowX[x] = x * 0.0137 + 1234.5;
+				rowY[x] = y * 0.0137 - 987.25;
+			}
+			noise.noise(rowX.data(), rowY.data(), rowValues.data(), side);
+			for (int x = 0; x < side; ++x)
+				sum += rowValues[x];
+		}
+		checksum = sum;
+		return (size_t)side * side;
+	});
+	std::printf("  checksum %.6f\n", checksum);
+
+	//Noise maps at the resolutions and octave counts the app offers. Items are samples of the map.
+	const int resolutions[] = { 257, 513, 1025 };
+	const int octaves[] = { 1, 4, 8 };
+	for (int resolution : resolutions)
+	{
+		for (int octaveCount : octaves)
+		{
+			NoiseData nData;
+			nData.W = resolution;
+			nData.H = resolution;
+			nData.seed = 21;
+			nData.scale = 0.3;
+			nData.octaves = octaveCount;
+			nData.persistence = 0.5;
+			nData.lacunarity = 2.0;
+			nData.offset = glm::vec2(0.0f);
+			nData.octaveMode = OctaveMode::Fixed;
+			nData.fadeLastOctave = false;
+			nData.fractalMode = FractalMode::Fbm;
+			nData.warpStrength = 0.0;
+			std::string name = "PerlinNoise/generateNoiseMap/" + std::to_string(resolution) + "/octaves_" + std::to_string(octaveCount);
+			runner.run(name, [&]()
+			{
+				HeightField map = noise.generateNoiseMap(nData);
+				return map.size();
+			});
+		}
+	}
+
+	//8 octaves on coarse maps (previews, far tiles), where the finest octaves are finer than the vertices.
+	//All of them against the band limited ones, with the fade. Items are samples of the map.
+	const int coarseResolutions[] = { 65, 129, 257, 513 };
+	for (int resolution : coarseResolutions)
+	{
+		NoiseData nData = {};
+		nData.W = resolution;
+		nData.H = resolution;
+		nData.seed = 21;
+		nData.scale = 0.3;
+		nData.octaves = 8;
+		nData.persistence = 0.5;
+		nData.lacunarity = 2.0;
+		nData.fadeLastOctave = true;
+		double fixedMs = 0.0;
+		for (OctaveMode mode : { OctaveMode::Fixed, OctaveMode::BandLimited })
+		{
+			nData.octaveMode = mode;
+			std::string name = "PerlinNoise/octaves_8/" + std::to_string(resolution) + (mode == OctaveMode::Fixed ? "/fixed" : "/band_limited");
+			HeightField map;
+			const BenchmarkResult& result = runner.run(name, [&]()
+			{
+				noise.generateNoiseMap(nData, map);
+				return map.size();
+			});
+			if (mode == OctaveMode::Fixed)
+				fixedMs = result.medianMs;
+			else
+				std::printf("  %d: %d of 8 octaves, last one weighted %.2f, %.2fx faster\n", resolution, PerlinNoise::bandLimitedOctaves(nData, 1.0),
+					PerlinNoise::lastOctaveWeight(nData, 1.0), fixedMs / result.medianMs);
+		}
+	}
+
+	//The fractal modes on a 1025 x 1025 map with 5 octaves. The multifractals evaluate as many octaves as fBm, the
+	//domain warp three times as many. Items are samples of the map.
+	const char* fractalNames[] = { "fbm", "ridged", "hybrid", "warp" };
+	double fbmMs = 0.0;
+	for (int mode = 0; mode < 4; ++mode)
+	{
+		NoiseData nData = {};
+		nData.W = 1025;
+		nData.H = 1025;
+		nData.seed = 21;
+		nData.scale = 0.3;
+		nData.octaves = 5;
+		nData.persistence = 0.5;
+		nData.lacunarity = 2.0;
+		nData.fractalMode = (FractalMode)mode;
+		nData.warpStrength = 1.0;
+		HeightField map;
+		const BenchmarkResult& result = runner.run(std::string("PerlinNoise/fractal/1025/") + fractalNames[mode], [&]()
+		{
+			noise.generateNoiseMap(nData, map);
+			return map.size();
+		});
+		if (mode == 0)
+			fbmMs = result.medianMs;
+		else
+			std::printf("  %s: %.2fx the time of fbm\n", fractalNames[mode], result.medianMs / fbmMs);
+	}
+}
+
+void benchmarkFalloff(BenchmarkRunner& runner)
+{
+	FalloffMap falloff;
+	const int resolutions[] = { 256, 1024 };
+	for (int resolution : resolutions)
+	{
+		runner.run("FalloffMap/generate/" + std::to_string(resolution), [&]()
+		{
+			std::vector<std::vector<double>> map = falloff.generate(resolution, resolution);
+			return (size_t)resolution * resolution;
+		});
+	}
+}
+
+/*
+	The CPU stages between the noise map and the upload, in the order Terrain runs them, with the app's biomes
+	and height curve. Items are samples for the per-sample stages and triangles for the normals.
+*/
+void benchmarkMeshStages(BenchmarkRunner& runner)
+{
+	Biome water(0.0, 0.3, glm::vec3(0.1, 0.4, 0.6));
+	Biome grass(0.31, 0.6, glm::vec3(0.37, 0.502, 0.22));
+	Biome land(0.61, 0.89, glm::vec3(0.3, 0.2, 0.0));
+	Biome snow(0.9, 1.0, glm::vec3(1.0, 1.0, 1.0));
+	std::vector<Biome*> biomes = { &water, &grass, &land, &snow };
+	const float controlPoints[4] = { 1.0f, 0.0f, 0.3f, 0.0f };
+
+	const int resolutions[] = { 256, 1024 };
+	for (int resolution : resolutions)
+	{
+		std::string suffix = "/" + std::to_string(resolution);
+		HeightField heights = makeHeights(resolution, 1.0f);
+		size_t samples = heights.size();
+		std::vector<unsigned char> biomeMap;
+		std::vector<Vertex> vertices;
+		std::vector<glm::ivec3> tris;
+		HeightField scaledHeights;
+
+		HeightCurve curve;
+		runner.run("MeshStages/height_curve" + suffix, [&]()
+		{
+			curve.set(controlPoints);
+			MeshBuilder::applyHeightCurve(heights, curve, 10.0f, scaledHeights);
+			return samples;
+		});
+		runner.run("MeshStages/classify_biomes" + suffix, [&]()
+		{
+			Biome::classify(heights, biomes, biomeMap);
+			return samples;
+		});
+		runner.run("MeshStages/build_vertices" + suffix, [&]()
+		{
+			MeshBuilder::buildVertices(scaledHeights, biomeMap, biomes, 100.0f, 100.0f, vertices);
+			return samples;
+		});
+		runner.run("MeshStages/build_indices" + suffix, [&]()
+		{
+			MeshBuilder::buildGridIndices(resolution, resolution, tris);
+			return samples;
+		});
+		//Every repetition starts from the fresh vertices, the copy is part of the measured time
+		std::vector<Vertex> fresh = vertices;
+		runner.run("MeshStages/compute_normals" + suffix, [&]()
+		{
+			vertices = fresh;
+			MeshBuilder::computeNormals(vertices, tris);
+			return tris.size();
+		});
+		double heightSum = 0.0;
+		for (size_t i = 0; i < samples; ++i)
+			heightSum += scaledHeights.data()[i];
+		std::printf("  %d x %d: %zu triangles, mean final height %.4f\n", resolution, resolution, tris.size(), heightSum / samples);
+	}
+}
+
+/*
+	Normals of a 1025 x 1025 terrain with the falloff and the app's height curve, from the triangles and from the
+	derivatives of the noise (GenerationData::analyticNormals). generate_heights includes the derivatives of the noise
+	and of the falloff, build_mesh the normals. Items are samples. The two sets of normals are compared: they differ where
+	the triangles cut across the curvature, and where the height curve's table steps flatten the triangles.
+*/
+void benchmarkAnalyticNormals(BenchmarkRunner& runner)
+{
+	GenerationData gData = {};
+	gData.W = 100;
+	gData.L = 100;
+	gData.numXVertices = 1025;
+	gData.numZVertices = 1025;
+	gData.heightMultiplier = 10.0f;
+	const float controlPoints[4] = { 1.0f, 0.0f, 0.3f, 0.0f };
+	std::memcpy(gData.controlPoints, controlPoints, sizeof(controlPoints));
+	gData.useFallOff = true;
+	NoiseData nData = {};
+	nData.W = gData.numXVertices;
+	nData.H = gData.numZVertices;
+	nData.seed = 21;
+	nData.scale = 0.3;
+	nData.octaves = 5;
+	nData.persistence = 0.5;
+	nData.lacunarity = 2.0;
+
+	std::vector<glm::vec3> normals[2];
+	for (int analytic = 0; analytic < 2; ++analytic)
+	{
+		std::string mode = analytic ? "/analytic" : "/triangles";
+		gData.analyticNormals = analytic != 0;
+		TerrainGenerator generator;
+		size_t samples = (size_t)gData.numXVertices * gData.numZVertices;
+		runner.run("AnalyticNormals/generate_heights" + mode, [&]()
+		{
+			generator.generateHeights(gData, nData);
+			return samples;
+		});
+		generator.applyHeightCurve(gData);
+		runner.run("AnalyticNormals/build_mesh" + mode, [&]()
+		{
+			generator.buildMesh(gData);
+			return samples;
+		});
+		for (const Vertex& v : generator.getVertices())
+			normals[analytic].push_back(v.normal);
+	}
+	std::vector<float> angles(normals[0].size());
+	double sum = 0.0;
+	for (size_t i = 0; i < angles.size(); ++i)
+	{
+		angles[i] = glm::degrees(std::acos(std::min(glm::dot(normals[0][i], normals[1][i]), 1.0f)));
+		sum += angles[i];
+	}
+	std::sort(angles.begin(), angles.end());
+	std::printf("  analytic against triangle normals: mean %.3f deg, 99th percentile %.3f deg, max %.3f deg\n",
+		sum / angles.size(), angles[angles.size() * 99 / 100], angles.back());
+}
+
+/*
+	A terrain shaped like the one the app generates on a 100 x 100 patch.
+*/
+TerrainQuery makeQuery(int resolution, float heightMultiplier)
+{
+	TerrainQuery query;
+	query.build(makeHeights(resolution, heightMultiplier), 100.0f, 100.0f);
+	return query;
+}
+
+/*
+	Camera style rays: from above the terrain towards random ground points (picking), and rays
+	that start near the ground and look towards the horizon (collision / line of sight, the slow case).
+*/
+std::vector<Ray> makeRays(const TerrainQuery& query, size_t count, bool grazing, unsigned seed)
+{
+	std::mt19937 mt(seed);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+	std::vector<Ray> rays(count);
+	for (Ray& ray : rays)
+	{
+		if (grazing)
+		{
+			ray.origin = glm::vec3(dist(mt) * 45.0f, 0.0f, dist(mt) * 45.0f);
+			ray.origin.y = query.getHeight(ray.origin.x, ray.origin.z) + 1.0f;
+			ray.dir = glm::normalize(glm::vec3(dist(mt), -0.02f - 0.05f * std::fabs(dist(mt)), dist(mt)));
+		}
+		else
+		{
+			ray.origin = glm::vec3(0.0f, 30.0f, 70.0f);
+			glm::vec3 target(dist(mt) * 50.0f, 0.0f, dist(mt) * 50.0f);
+			ray.dir = glm::normalize(target - ray.origin);
+		}
+		ray.maxT = 300.0f;
+	}
+	return rays;
+}
+
+void benchmarkTerrainQuery(BenchmarkRunner& runner)
+{
+	TerrainQuery query = makeQuery(1024, 10.0f);
+	//Marching step of a quarter cell, fine enough to agree with the exact hit most of the time
+	float step = 0.25f * std::min(query.getCellSize().x, query.getCellSize().y);
+
+	const char* kinds[2] = { "picking", "grazing" };
+	for (int k = 0; k < 2; ++k)
+	{
+		std::vector<Ray> rays = makeRays(query, 4096, k == 1, 7 + k);
+		std::vector<RayHit> hierarchical(rays.size()), marching(rays.size());
+		std::string prefix = std::string("TerrainQuery/raycast/") + kinds[k];
+
+		runner.run(prefix + "/hierarchical", [&]()
+		{
+			for (size_t i = 0; i < rays.size(); ++i)
+				query.raycast(rays[i].origin, rays[i].dir, rays[i].maxT, hierarchical[i]);
+			return rays.size();
+		});
+		runner.run(prefix + "/hierarchical_batched", [&]()
+		{
+			query.raycast(rays.data(), hierarchical.data(), rays.size());
+			return rays.size();
+		});
+		runner.run(prefix + "/marching", [&]()
+		{
+			for (size_t i = 0; i < rays.size(); ++i)
+				query.raycastMarching(rays[i].origin, rays[i].dir, rays[i].maxT, step, marching[i]);
+			return rays.size();
+		}, 3);
+
+		//Both have to find the same hits, up to the marching step. At grazing angles marching can step over
+		//a thin sliver of a ridge, so an occasional mismatch there is the reference missing the hit.
+		size_t mismatches = 0;
+		float maxError = 0.0f;
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			if (hierarchical[i].hit != marching[i].hit)
+				++mismatches;
+			else if (hierarchical[i].hit)
+				maxError = std::max(maxError, glm::length(hierarchical[i].position - marching[i].position));
+		}
+		size_t hitCount = std::count_if(hierarchical.begin(), hierarchical.end(), [](const RayHit& h) { return h.hit; });
+		std::printf("  %s: %zu hits, %zu hit mismatches, max hit distance %.4f\n", kinds[k], hitCount, mismatches, maxError);
+	}
+
+	//A 4097 x 4097 grid, where the cell coordinates are large enough that a float offset of a fraction of a cell no
+	//longer moves a point off a cell border. Picking rays against the marching reference on a subset.
+	{
+		TerrainQuery large = makeQuery(4097, 10.0f);
+		float largeStep = 0.25f * std::min(large.getCellSize().x, large.getCellSize().y);
+		std::vector<Ray> rays = makeRays(large, 1024, false, 11);
+		std::vector<RayHit> hierarchical(rays.size()), marching(128);
+		runner.run("TerrainQuery/raycast/picking_4097/hierarchical", [&]()
+		{
+			large.raycast(rays.data(), hierarchical.data(), rays.size());
+			return rays.size();
+		});
+		size_t mismatches = 0;
+		float maxError = 0.0f;
+		for (size_t i = 0; i < marching.size(); ++i)
+		{
+			large.raycastMarching(rays[i].origin, rays[i].dir, rays[i].maxT, largeStep, marching[i]);
+			if (hierarchical[i].hit != marching[i].hit)
+				++mismatches;
+			else if (hierarchical[i].hit)
+				maxError = std::max(maxError, glm::length(hierarchical[i].position - marching[i].position));
+		}
+		size_t hitCount = std::count_if(hierarchical.begin(), hierarchical.end(), [](const RayHit& h) { return h.hit; });
+		std::printf("  picking_4097: %zu of %zu hits, %zu hit mismatches in the first %zu, max hit distance %.4f\n", hitCount, rays.size(),
+			mismatches, marching.size(), maxError);
+	}
+
+	std::mt19937 mt(3);
+	std::uniform_real_distribution<float> dist(-50.0f, 50.0f);
+	std::vector<glm::vec2> positions(1 << 16);
+	for (glm::vec2& p : positions)
+		p = glm::vec2(dist(mt), dist(mt));
+	std::vector<float> heights(positions.size());
+
+	runner.run("TerrainQuery/getHeight", [&]()
+	{
+		for (size_t i = 0; i < positions.size(); ++i)
+			heights[i] = query.getHeight(positions[i].x, positions[i].y);
+		return positions.size();
+	});
+	runner.run("TerrainQuery/getHeights_batched", [&]()
+	{
+		query.getHeights(positions.data(), heights.data(), positions.size());
+		return positions.size();
+	});
+}
+
+/*
+	Vegetation scattering over the whole map. Biomes are a plain height classification, trees stay off the lowest band.
+*/
+void benchmarkScatter(BenchmarkRunner& runner)
+{
+	TerrainQuery query = makeQuery(512, 10.0f);
+	glm::ivec2 samples = query.getSampleCount();
+	glm::vec2 cell = query.getCellSize();
+	std::vector<unsigned char> biomeIDs((size_t)samples.x * samples.y);
+	for (int z = 0; z < samples.y; ++z)
+	{
+		for (int x = 0; x < samples.x; ++x)
+		{
+			float h = query.getHeight(x * cell.x - 50.0f, z * cell.y - 50.0f) / 10.0f;
+			biomeIDs[(size_t)z * samples.x + x] = h < 0.3f ? 0 : h < 0.6f ? 1 : 2;
+		}
+	}
+
+	ScatterLayer layer;
+	layer.density = 2.0f;
+	layer.maxSlope = 30.0f;
+	layer.biomeMask = (1u << 1) | (1u << 2);
+	layer.minScale = 0.5f;
+	layer.maxScale = 1.5f;
+
+	PoissonScatter scatter;
+	const float spacings[2] = { 0.3f, 0.1f };
+	for (float spacing : spacings)
+	{
+		layer.minDistance = spacing;
+		char name[64];
+		std::snprintf(name, sizeof(name), "PoissonScatter/candidates/spacing_%.1f", spacing);
+		runner.run(name, [&]()
+		{
+			scatter.scatter(layer, 7, query, biomeIDs);
+			return scatter.getCandidateCount();
+		}, 3);
+		std::printf("  %zu instances from %zu candidates in %zu tiles\n", scatter.getInstanceCount(), scatter.getCandidateCount(), scatter.getTiles().size());
+	}
+}
+
+/*
+	Error map precomputation and mesh extraction for a few thresholds. The default height curve flattens everything
+	under 0.3 to the water level, which is where the adaptive mesh saves the most.
+*/
+void benchmarkRTIN(BenchmarkRunner& runner)
+{
+	HeightField heights = makeHeights(1025, 1.0f);
+	for (size_t i = 0; i < heights.size(); ++i)
+		heights.data()[i] = std::max(heights.data()[i] - 0.3f, 0.0f) * 10.0f;
+
+	RTINMesher mesher;
+	runner.run("RTIN/build/1025", [&]()
+	{
+		mesher.build(heights);
+		return heights.size();
+	});
+
+	std::vector<glm::ivec3> tris;
+	std::vector<int> vertexSamples;
+	const float maxErrors[4] = { 0.0f, 0.01f, 0.05f, 0.2f };
+	for (float maxError : maxErrors)
+	{
+		char name[64];
+		std::snprintf(name, sizeof(name), "RTIN/extract/max_error_%.2f", maxError);
+		runner.run(name, [&]()
+		{
+			mesher.extract(maxError, tris, vertexSamples);
+			return tris.size();
+		});
+		RTINStats stats = mesher.measure(heights, tris, vertexSamples);
+		std::printf("  %zu triangles (%.1f%% of the grid), %zu vertices, max error %.4f, rms error %.5f\n", stats.triangles,
+			100.0 * stats.triangles / stats.gridTriangles, stats.vertices, stats.maxError, stats.rmsError);
+	}
+}
+
+/*
+	Triangle orders for the post-transform cache, measured with the FIFO simulator: the row-major grid the terrain
+	used to emit, grid strips, and Forsyth's optimizer on the grid and on an RTIN mesh.
+*/
+void benchmarkVertexCache(BenchmarkRunner& runner)
+{
+	const int size = 1025;
+	std::vector<glm::ivec3> rowMajor;
+	rowMajor.reserve((size_t)(size - 1) * (size - 1) * 2);
+	for (int z = 0; z < size - 1; ++z)
+	{
+		for (int x = 0; x < size - 1; ++x)
+		{
+			int vi = z * size + x;
+			rowMajor.push_back(glm::ivec3(vi, vi + size, vi + size + 1));
+			rowMajor.push_back(glm::ivec3(vi, vi + size + 1, vi + 1));
+		}
+	}
+
+	HeightField heights = makeHeights(size, 1.0f);
+	for (size_t i = 0; i < heights.size(); ++i)
+		heights.data()[i] = std::max(heights.data()[i] - 0.3f, 0.0f) * 10.0f;
+	RTINMesher mesher;
+	mesher.build(heights);
+	std::vector<glm::ivec3> adaptive;
+	std::vector<int> vertexSamples;
+	mesher.extract(0.01f, adaptive, vertexSamples);
+
+	auto report = [](const char* name, const std::vector<glm::ivec3>& tris, size_t vertexCount)
+	{
+		VertexCacheStats stats = VertexCache::simulate(tris, vertexCount);
+		std::printf("  %-24s ACMR %.3f  ATVR %.3f\n", name, stats.acmr, stats.atvr);
+	};
+	report("grid/row_major", rowMajor, heights.size());
+	report("rtin/extracted", adaptive, vertexSamples.size());
+
+	std::vector<glm::ivec3> tris;
+	runner.run("VertexCache/grid_strips", [&]()
+	{
+		VertexCache::buildGridStrips(size, size, tris);
+		return tris.size();
+	});
+	report("grid/strips", tris, heights.size());
+
+	VertexCache optimizer;
+	runner.run("VertexCache/forsyth/grid", [&]()
+	{
+		tris = rowMajor;
+		optimizer.optimize(tris, heights.size());
+		return tris.size();
+	}, 3);
+	report("grid/forsyth", tris, heights.size());
+
+	runner.run("VertexCache/forsyth/rtin", [&]()
+	{
+		tris = adaptive;
+		optimizer.optimize(tris, vertexSamples.size());
+		return tris.size();
+	}, 3);
+	report("rtin/forsyth", tris, vertexSamples.size());
+
+	runner.run("VertexCache/simulate", [&]()
+	{
+		VertexCache::simulate(rowMajor, heights.size());
+		return rowMajor.size();
+	});
+}
+
+/*
+	Cluster partitioning of a grid and of an RTIN mesh, and culling from cameras looking over the terrain.
+*/
+void benchmarkClusters(BenchmarkRunner& runner)
+{
+	const int size = 513;
+	HeightField heights = makeHeights(size, 1.0f);
+	std::vector<Vertex> vertices(heights.size());
+	for (int z = 0; z < size; ++z)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			Vertex& v = vertices[(size_t)z * size + x];
+			v.pos = glm::vec3(x * 100.0f / (size - 1) - 50.0f, std::max(heights.at(x, z) - 0.3f, 0.0f) * 20.0f, z * 100.0f / (size - 1) - 50.0f);
+			heights.at(x, z) = v.pos.y;
+		}
+	}
+
+	ClusterSet clusters;
+	std::vector<glm::ivec3> tris;
+	runner.run("ClusterSet/build_grid/513", [&]()
+	{
+		clusters.buildGrid(vertices, size, size, tris);
+		return tris.size();
+	});
+
+	RTINMesher mesher;
+	mesher.build(heights);
+	std::vector<glm::ivec3> adaptive;
+	std::vector<int> vertexSamples;
+	mesher.extract(0.01f, adaptive, vertexSamples);
+	std::vector<Vertex> adaptiveVertices(vertexSamples.size());
+	for (size_t i = 0; i < vertexSamples.size(); ++i)
+		adaptiveVertices[i] = vertices[vertexSamples[i]];
+	ClusterSet adaptiveClusters;
+	runner.run("ClusterSet/build/rtin", [&]()
+	{
+		tris = adaptive;
+		adaptiveClusters.build(adaptiveVertices, tris);
+		return tris.size();
+	});
+	std::printf("  grid: %zu clusters, rtin: %zu clusters for %zu triangles\n", clusters.getClusters().size(),
+		adaptiveClusters.getClusters().size(), adaptive.size());
+
+	//Cameras a little above the ground, looking at random points of the terrain
+	std::mt19937 mt(5);
+	std::uniform_real_distribution<float> dist(-45.0f, 45.0f);
+	std::vector<glm::mat4> views(64);
+	std::vector<glm::vec3> eyes(views.size());
+	for (size_t i = 0; i < views.size(); ++i)
+	{
+		eyes[i] = glm::vec3(dist(mt), 3.0f + std::fabs(dist(mt)) * 0.2f, dist(mt));
+		views[i] = glm::lookAt(eyes[i], glm::vec3(dist(mt), 0.0f, dist(mt)), glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	std::vector<ClusterDrawRange> ranges;
+	size_t visible = 0, rangeCount = 0;
+	runner.run("ClusterSet/cull/grid", [&]()
+	{
+		visible = rangeCount = 0;
+		for (size_t i = 0; i < views.size(); ++i)
+		{
+			visible += clusters.cull(Frustum(projection * views[i]), eyes[i], ranges);
+			rangeCount += ranges.size();
+		}
+		return views.size() * clusters.getClusters().size();
+	});
+	std::printf("  %.1f%% of the clusters visible, %.1f draw ranges per view\n",
+		100.0 * visible / (views.size() * clusters.getClusters().size()), (double)rangeCount / views.size());
+}
+
+/*
+	Brute force reference for the horizon culler: a patch is visible if a ray from the eye reaches any of a few
+	samples x samples points on its surface without hitting the terrain first.
+*/
+void referenceVisibility(const HorizonCuller& culler, const TerrainQuery& query, const glm::vec3& eye, int samples, std::vector<unsigned char>& visible)
+{
+	int patchesX = culler.getPatchCountX();
+	int patchesZ = culler.getPatchCountZ();
+	std::vector<Ray> rays((size_t)patchesX * patchesZ * samples * samples);
+	size_t r = 0;
+	for (int pz = 0; pz < patchesZ; ++pz)
+	{
+		for (int px = 0; px < patchesX; ++px)
+		{
+			glm::vec3 boundsMin, boundsMax;
+			culler.getPatchBounds(px, pz, boundsMin, boundsMax);
+			for (int j = 0; j < samples; ++j)
+			{
+				for (int i = 0; i < samples; ++i)
+				{
+					float x = boundsMin.x + (boundsMax.x - boundsMin.x) * i / (samples - 1);
+					float z = boundsMin.z + (boundsMax.z - boundsMin.z) * j / (samples - 1);
+					//Slightly above the surface, so the target itself does not count as a hit
+					glm::vec3 target(x, query.getHeight(x, z) + 1e-3f, z);
+					rays[r].origin = eye;
+					rays[r].dir = target - eye;
+					rays[r].maxT = 1.0f;
+					++r;
+				}
+			}
+		}
+	}
+	std::vector<RayHit> hits(rays.size());
+	query.raycast(rays.data(), hits.data(), rays.size());
+
+	visible.assign((size_t)patchesX * patchesZ, 0);
+	size_t perPatch = (size_t)samples * samples;
+	for (size_t i = 0; i < rays.size(); ++i)
+		if (!hits[i].hit || hits[i].t >= 1.0f - 1e-4f)
+			visible[i / perPatch] = 1;
+}
+
+/*
+	Scripted camera path close to the ground around the center of the map, where hills hide most of the terrain.
+	The culler must never hide a patch the reference sees.
+*/
+void benchmarkHorizonCulling(BenchmarkRunner& runner)
+{
+	const int size = 513;
+	HeightField heights = makeHeights(size, 1.0f);
+	for (size_t i = 0; i < heights.size(); ++i)
+		heights.data()[i] = std::max(heights.data()[i] - 0.3f, 0.0f) * 20.0f;
+	HorizonCuller culler;
+	culler.build(heights, 100.0f, 100.0f);
+	TerrainQuery query;
+	query.build(heights, 100.0f, 100.0f);
+
+	std::vector<glm::vec3> path(16);
+	for (size_t i = 0; i < path.size(); ++i)
+	{
+		float angle = 2.0f * 3.14159265f * i / path.size();
+		glm::vec3 p(30.0f * std::cos(angle), 0.0f, 30.0f * std::sin(angle));
+		p.y = query.getHeight(p.x, p.z) + 1.5f;
+		path[i] = p;
+	}
+
+	size_t patchCount = (size_t)culler.getPatchCountX() * culler.getPatchCountZ();
+	runner.run("HorizonCuller/cull/path", [&]()
+	{
+		for (const glm::vec3& eye : path)
+			culler.cull(eye);
+		return path.size() * patchCount;
+	});
+
+	size_t culledVisible = 0, referenceVisible = 0, violations = 0;
+	std::vector<unsigned char> reference;
+	for (const glm::vec3& eye : path)
+	{
+		culledVisible += culler.cull(eye);
+		referenceVisibility(culler, query, eye, 5, reference);
+		for (int pz = 0; pz < culler.getPatchCountZ(); ++pz)
+		{
+			for (int px = 0; px < culler.getPatchCountX(); ++px)
+			{
+				bool seen = reference[(size_t)pz * culler.getPatchCountX() + px] != 0;
+				referenceVisible += seen ? 1 : 0;
+				if (seen && !culler.isPatchVisible(px, pz))
+					++violations;
+			}
+		}
+	}
+	std::printf("  visible patches: culler %.1f%%, reference %.1f%%, hidden but seen by the reference: %zu\n",
+		100.0 * culledVisible / (path.size() * patchCount), 100.0 * referenceVisible / (path.size() * patchCount), violations);
+}
+
+/*
+	Chunk streaming pattern for the shared geometry buffers: chunks of a few sizes are freed and allocated again at
+	random. Reports the cost per operation and how fragmented the buffer ends up.
+*/
+void benchmarkBufferAllocator(BenchmarkRunner& runner)
+{
+	const size_t capacity = 8 << 20; //About 70% full on average
+	const size_t chunkSizes[] = { 17 * 17, 33 * 33, 65 * 65, 129 * 129 };
+	const int chunkCount = 1024;
+	const int operations = 100000;
+	BufferAllocator allocator;
+	std::vector<size_t> offsets(chunkCount), sizes(chunkCount);
+	size_t failures = 0;
+	runner.run("BufferAllocator/churn", [&]()
+	{
+		allocator.reset(capacity);
+		std::mt19937 rng(7);
+		for (int i = 0; i < chunkCount; ++i)
+		{
+			sizes[i] = chunkSizes[rng() % 4];
+			offsets[i] = allocator.allocate(sizes[i]);
+		}
+		failures = 0;
+		for (int op = 0; op < operations; ++op)
+		{
+			int i = rng() % chunkCount;
+			allocator.free(offsets[i], sizes[i]);
+			sizes[i] = chunkSizes[rng() % 4];
+			offsets[i] = allocator.allocate(sizes[i]);
+			failures += offsets[i] == BufferAllocator::INVALID_OFFSET ? 1 : 0;
+		}
+		return (size_t)operations;
+	});
+	std::printf("  used %.1f%%, %zu free ranges, largest free %.1f%% of the free space, %zu failed allocations\n",
+		100.0 * allocator.getUsed() / capacity, allocator.getFreeRangeCount(),
+		100.0 * allocator.getLargestFree() / (capacity - allocator.getUsed()), failures);
+}
+
+/*
+	Whole file into memory, empty if it could not be read.
+*/
+void readFile(const char* path, std::vector<char>& bytes)
+{
+	bytes.clear();
+	std::FILE* file = std::fopen(path, "rb");
+	if (file == nullptr)
+		return;
+	std::fseek(file, 0, SEEK_END);
+	long size = std::ftell(file);
+	std::fseek(file, 0, SEEK_SET);
+	bytes.resize(size > 0 ? (size_t)size : 0);
+	if (std::fread(bytes.data(), 1, bytes.size(), file) != bytes.size())
+		bytes.clear();
+	std::fclose(file);
+}
+
+/*
+	Streaming the grid mesh of the final heights into files, whole and as chunks written in parallel.
+	The streamed file is compared with one written from the built mesh (MeshBuilder), they have to be the same bytes.
+*/
+void benchmarkMeshExport(BenchmarkRunner& runner)
+{
+	Biome water(0.0, 0.3, glm::vec3(0.1, 0.4, 0.6));
+	Biome grass(0.31, 0.6, glm::vec3(0.37, 0.502, 0.22));
+	Biome land(0.61, 0.89, glm::vec3(0.3, 0.2, 0.0));
+	Biome snow(0.9, 1.0, glm::vec3(1.0, 1.0, 1.0));
+	std::vector<Biome*> biomes = { &water, &grass, &land, &snow };
+	const int resolution = 1025;
+	HeightField heights = makeHeights(resolution, 1.0f);
+	std::vector<unsigned char> biomeMap;
+	Biome::classify(heights, biomes, biomeMap);
+	for (size_t i = 0; i < heights.size(); ++i)
+		heights.data()[i] *= 10.0f;
+	GridMeshView view(heights, biomeMap, biomes, 100.0f, 100.0f);
+	size_t vertices = view.getVertexCount();
+	bool written = true;
+
+	runner.run("MeshExport/ply/1025", [&]()
+	{
+		written &= MeshExport::writePLY("benchmark_mesh.ply", view);
+		return vertices;
+	});
+	runner.run("MeshExport/glb/1025", [&]()
+	{
+		written &= MeshExport::writeGLB("benchmark_mesh.glb", view);
+		return vertices;
+	});
+	runner.run("MeshExport/glb_chunks_256/1025", [&]()
+	{
+		written &= MeshExport::writeChunks(view, 256, MeshFormat::GLB, "benchmark_chunk") == 0;
+		return vertices;
+	});
+
+	std::vector<Vertex> built;
+	std::vector<glm::ivec3> tris;
+	MeshBuilder::buildVertices(heights, biomeMap, biomes, 100.0f, 100.0f, built);
+	MeshBuilder::buildGridIndices(resolution, resolution, tris);
+	MeshBuilder::computeNormals(built, tris);
+	written &= MeshExport::writeGLB("benchmark_mesh_built.glb", built, tris);
+	std::vector<char> streamed, reference;
+	readFile("benchmark_mesh.glb", streamed);
+	readFile("benchmark_mesh_built.glb", reference);
+	std::printf("  %s, glb %.1f MB, streamed %s the built mesh\n", written ? "all files written" : "some files not written",
+		streamed.size() / (1024.0 * 1024.0), streamed == reference && !streamed.empty() ? "matches" : "DOES NOT MATCH");
+	std::remove("benchmark_mesh.ply");
+	std::remove("benchmark_mesh.glb");
+	std::remove("benchmark_mesh_built.glb");
+	for (int cz = 0; cz < 4; ++cz)
+		for (int cx = 0; cx < 4; ++cx)
+			std::remove(("benchmark_chunk_" + std::to_string(cx) + "_" + std::to_string(cz) + ".glb").c_str());
+}
+
+/*
+	Saving and loading a 4097 x 4097 height map, against generating it from the noise. The files were just written,
+	so the reads come from the page cache: this is the cost of mapping and converting, the disk comes on top.
+	The largest difference to the original heights has to stay within a 16-bit step (half a step plus float rounding).
+*/
+void benchmarkHeightmapIO(BenchmarkRunner& runner)
+{
+	const int resolution = 4097;
+	HeightField heights;
+	runner.run("HeightmapIO/noise/4097", [&]()
+	{
+		heights = makeHeights(resolution, 1.0f);
+		return heights.size();
+	});
+	std::vector<unsigned char> biomeMap(heights.size());
+	for (size_t i = 0; i < biomeMap.size(); ++i)
+		biomeMap[i] = (unsigned char)(heights.data()[i] * 3.99f);
+	bool written = true, read = true;
+	runner.run("HeightmapIO/write_pgm/4097", [&]()
+	{
+		written &= HeightmapIO::writePGM("benchmark_heights.pgm", heights);
+		return heights.size();
+	});
+	runner.run("HeightmapIO/write_raw/4097", [&]()
+	{
+		written &= HeightmapIO::writeRAW("benchmark_heights.raw", heights);
+		return heights.size();
+	});
+	runner.run("HeightmapIO/write_pgth/4097", [&]()
+	{
+		written &= TiledHeightmap::write("benchmark_heights.pgth", heights, 0.0f, 1.0f, &biomeMap);
+		return heights.size();
+	});
+
+	HeightField loaded;
+	float maxError = 0.0f;
+	auto measure = [&]()
+	{
+		read &= loaded.getWidth() == heights.getWidth() && loaded.getHeight() == heights.getHeight();
+		for (size_t i = 0; read && i < heights.size(); ++i)
+			maxError = std::max(maxError, std::fabs(std::min(std::max(heights.data()[i], 0.0f), 1.0f) - loaded.data()[i]));
+	};
+	runner.run("HeightmapIO/read_pgm/4097", [&]()
+	{
+		read &= HeightmapIO::readPGM("benchmark_heights.pgm", loaded);
+		return heights.size();
+	});
+	measure();
+	runner.run("HeightmapIO/read_raw/4097", [&]()
+	{
+		read &= HeightmapIO::readRAW("benchmark_heights.raw", 0, 0, loaded);
+		return heights.size();
+	});
+	measure();
+	std::vector<unsigned char> loadedBiomes;
+	runner.run("HeightmapIO/read_pgth/4097", [&]()
+	{
+		TiledHeightmap tiled;
+		read &= tiled.open("benchmark_heights.pgth");
+		tiled.read(loaded);
+		tiled.readBiomes(loadedBiomes);
+		return heights.size();
+	});
+	measure();
+	read &= loadedBiomes == biomeMap;
+	std::printf("  %s, %s, max error %.3g (a step is %.3g)\n", written ? "all files written" : "some files not written",
+		read ? "all files read back" : "SOME FILES NOT READ BACK", maxError, 1.0f / 65535.0f);
+	std::remove("benchmark_heights.pgm");
+	std::remove("benchmark_heights.raw");
+	std::remove("benchmark_heights.pgth");
+}
+
+/*
+	The tiles of a 1025 x 1025 terrain through the disk cache: every tile missed (the terrain is generated and all
+	its tiles written) against every tile read back, one at a time and batched on the IO threads.
+	Items are tiles. The compressed size is compared with the raw floats, normals and IDs.
+*/
+void benchmarkTileCache(BenchmarkRunner& runner)
+{
+	GenerationData gData = {};
+	gData.W = 100;
+	gData.L = 100;
+	gData.numXVertices = 1025;
+	gData.numZVertices = 1025;
+	gData.heightMultiplier = 10.0f;
+	const float controlPoints[4] = { 1.0f, 0.0f, 0.3f, 0.0f };
+	std::memcpy(gData.controlPoints, controlPoints, sizeof(controlPoints));
+	NoiseData nData = {};
+	nData.seed = 21;
+	nData.scale = 0.3;
+	nData.octaves = 5;
+	nData.persistence = 0.5;
+	nData.lacunarity = 2.0;
+
+	TileCache cache;
+	if (!cache.open("benchmark_tiles", 0))
+	{
+		std::printf("  could not open benchmark_tiles\n");
+		return;
+	}
+	TerrainTiles tiles(cache, gData, nData, 128);
+	size_t tileCount = (size_t)tiles.getTilesX() * tiles.getTilesZ();
+	TerrainTile tile;
+	runner.run("TileCache/miss/1025", [&]()
+	{
+		cache.clear();
+		tiles.getTile(0, 0, tile);
+		return tileCount;
+	});
+	runner.run("TileCache/hit/1025", [&]()
+	{
+		for (int z = 0; z < tiles.getTilesZ(); ++z)
+			for (int x = 0; x < tiles.getTilesX(); ++x)
+				tiles.getTile(x, z, tile);
+		return tileCount;
+	});
+	std::vector<TileKey> keys;
+	for (int z = 0; z < tiles.getTilesZ(); ++z)
+		for (int x = 0; x < tiles.getTilesX(); ++x)
+			keys.push_back(tiles.getKey(x, z));
+	std::vector<TerrainTile> batch(keys.size());
+	std::unique_ptr<bool[]> hits(new bool[keys.size()]);
+	runner.run("TileCache/hit_batched/1025", [&]()
+	{
+		cache.read(keys.data(), batch.data(), hits.get(), keys.size());
+		return tileCount;
+	});
+
+	//Normals are the only lossy part
+	TerrainTile generated;
+	cache.clear();
+	tiles.getTile(3, 2, generated);
+	tiles.getTile(3, 2, tile);
+	float maxAngle = 0.0f;
+	for (size_t i = 0; i < tile.normals.size(); ++i)
+		maxAngle = std::max(maxAngle, std::acos(std::min(glm::dot(tile.normals[i], generated.normals[i]), 1.0f)));
+	bool lossless = tile.heights.size() == generated.heights.size() && tile.biomes == generated.biomes &&
+		std::memcmp(tile.heights.data(), generated.heights.data(), tile.heights.size() * sizeof(float)) == 0;
+	TileCacheStats stats = cache.getStats();
+	//The pyramid levels are cached with the full resolution tiles, they add the height bounds
+	double rawBytes = 0.0;
+	for (int lod = 0; lod < tiles.getLevelCount(); ++lod)
+	{
+		double samples = (double)TilePyramid::levelSize(gData.numXVertices, lod) * TilePyramid::levelSize(gData.numZVertices, lod);
+		rawBytes += samples * (sizeof(float) * (lod == 0 ? 1 : 3) + sizeof(glm::vec3) + 1);
+	}
+	std::printf("  %zu tiles and their pyramid, %.1f MB cached (raw %.1f MB, %.2fx), heights and biomes %s, max normal error %.4f deg\n", tileCount,
+		stats.bytes / (1024.0 * 1024.0), rawBytes / (1024.0 * 1024.0), rawBytes / stats.bytes, lossless ? "exact" : "NOT EXACT", glm::degrees(maxAngle));
+	cache.clear();
+	//Removes the empty directory where remove can (POSIX)
+	std::remove("benchmark_tiles");
+}
+
+/*
+	HeightCodec on a 4097 x 4097 terrain with heights up to 100 world units, exact and at a few error bounds.
+	Encoding and decoding run on one thread, decode speed is reported in GB/s of floats written. Every decoded height
+	has to be within the bound (identical for the exact one), and the size is compared with the raw floats.
+*/
+void benchmarkHeightCodec(BenchmarkRunner& runner)
+{
+	const int resolution = 4097;
+	HeightField heights = makeHeights(resolution, 100.0f);
+	const float errors[] = { 0.0f, 0.001f, 0.01f, 0.05f };
+	std::vector<unsigned char> bytes;
+	HeightField decoded;
+	for (float maxError : errors)
+	{
+		char name[64];
+		std::snprintf(name, sizeof(name), "HeightCodec/encode/%g", maxError);
+		runner.run(name, [&]()
+		{
+			bytes.clear();
+			HeightCodec::encode(heights, maxError, bytes);
+			return heights.size();
+		});
+		bool valid = true;
+		std::snprintf(name, sizeof(name), "HeightCodec/decode/%g", maxError);
+		const BenchmarkResult& result = runner.run(name, [&]()
+		{
+			valid &= HeightCodec::decode(bytes.data(), bytes.size(), decoded);
+			return heights.size();
+		});
+		double gbPerSecond = heights.size() * sizeof(float) / (result.medianMs * 1e6);
+
+		float worst = 0.0f;
+		valid &= decoded.getWidth() == heights.getWidth() && decoded.getHeight() == heights.getHeight();
+		for (size_t i = 0; valid && i < heights.size(); ++i)
+			worst = std::max(worst, std::fabs(decoded.data()[i] - heights.data()[i]));
+		bool withinBound = valid && (maxError > 0.0f ? worst <= maxError :
+			std::memcmp(decoded.data(), heights.data(), heights.size() * sizeof(float)) == 0);
+		std::printf("  max error %g: %.2f bits per height, %.2fx smaller than floats, decode %.2f GB/s, %s (worst %.3g)\n",
+			maxError, bytes.size() * 8.0 / heights.size(), (double)heights.size() * sizeof(float) / bytes.size(), gbPerSecond,
+			withinBound ? "within the bound" : "OUT OF THE BOUND", worst);
+	}
+}
+
+/*
+	The tiles of a 1025 x 1025 terrain (16 tiles of 256 cells) through a TileServer on the loopback interface, and on
+	a Unix domain socket where there are some. The burst starts from an empty cache: 8 clients ask for every tile in
+	the same order, the first tile is coalesced and the whole burst has to cost one generation. The hits are keep-alive requests of cached tiles, sent with sendfile,
+	the last ones while 16 other keep-alive connections sit idle.
+	Items are tiles. A served tile has to decode to the one in the cache.
+*/
+void benchmarkTileServer(BenchmarkRunner& runner)
+{
+	GenerationData gData = {};
+	gData.W = 100;
+	gData.L = 100;
+	gData.numXVertices = 1025;
+	gData.numZVertices = 1025;
+	gData.heightMultiplier = 10.0f;
+	const float controlPoints[4] = { 1.0f, 0.0f, 0.3f, 0.0f };
+	std::memcpy(gData.controlPoints, controlPoints, sizeof(controlPoints));
+	NoiseData nData = {};
+	nData.seed = 21;
+	nData.scale = 0.3;
+	nData.octaves = 5;
+	nData.persistence = 0.5;
+	nData.lacunarity = 2.0;
+
+	TileCache cache;
+	if (!cache.open("benchmark_server_tiles", 0))
+	{
+		std::printf("  could not open benchmark_server_tiles\n");
+		return;
+	}
+	std::vector<std::string> addresses = { "0" };
+#ifndef _WIN32
+	addresses.push_back("unix:benchmark_tiles.sock");
+#endif
+	for (const std::string& listenAddress : addresses)
+	{
+		TileServer server(cache);
+		uint64_t parameters = server.addTerrain("benchmark", gData, nData, 256);
+		if (!server.listen(listenAddress))
+			continue;
+		std::thread serverThread([&]() { server.run(); });
+		std::string address = server.getAddress();
+		const char* kind = listenAddress == "0" ? "tcp" : "unix";
+		char prefix[64];
+		std::snprintf(prefix, sizeof(prefix), "/tiles/%016llx/0/", (unsigned long long)parameters);
+		const int tilesPerSide = 4, clientCount = 8;
+		auto target = [&](int t) { return prefix + std::to_string(t % tilesPerSide) + "/" + std::to_string(t / tilesPerSide); };
+
+		std::atomic<int> failed(0);
+		auto fetchAll = [&](int clients)
+		{
+			std::vector<std::thread> threads;
+			for (int c = 0; c < clients; ++c)
+				threads.emplace_back([&, c]()
+				{
+					TileClient client;
+					std::vector<unsigned char> body;
+					client.connect(address);
+					for (int t = 0; t < tilesPerSide * tilesPerSide; ++t)
+						failed += client.get(target(t), body) == 200 ? 0 : 1;
+				});
+			for (std::thread& thread : threads)
+				thread.join();
+		};
+		TileServerStats before = server.getStats();
+		runner.run(std::string("TileServer/") + kind + "/cold_burst_8_clients", [&]()
+		{
+			cache.clear();
+			fetchAll(clientCount);
+			return (size_t)(tilesPerSide * tilesPerSide * clientCount);
+		}, 3);
+		TileServerStats burst = server.getStats();
+		runner.run(std::string("TileServer/") + kind + "/hit", [&]()
+		{
+			fetchAll(1);
+			return (size_t)(tilesPerSide * tilesPerSide);
+		});
+		runner.run(std::string("TileServer/") + kind + "/hit_8_clients", [&]()
+		{
+			fetchAll(clientCount);
+			return (size_t)(tilesPerSide * tilesPerSide * clientCount);
+		});
+		//Twice as many idle keep-alive connections as workers must not keep a request waiting
+		runner.run(std::string("TileServer/") + kind + "/hit_16_idle_connections", [&]()
+		{
+			std::vector<std::unique_ptr<TileClient>> idleClients;
+			std::vector<unsigned char> body;
+			for (int c = 0; c < 2 * clientCount; ++c)
+			{
+				idleClients.emplace_back(new TileClient());
+				idleClients.back()->connect(address);
+				failed += idleClients.back()->get(target(c), body) == 200 ? 0 : 1;
+			}
+			fetchAll(1);
+			return (size_t)(2 * clientCount + tilesPerSide * tilesPerSide);
+		}, 3);
+
+		TileClient client;
+		std::vector<unsigned char> body;
+		TerrainTile served, cached;
+		bool same = client.connect(address) && client.get(target(6), body) == 200 && TileCache::decode(body.data(), body.size(), served) &&
+			cache.read({ parameters, 0, 6 % tilesPerSide, 6 / tilesPerSide }, cached) && served.heights.size() == cached.heights.size() &&
+			std::memcmp(served.heights.data(), cached.heights.data(), cached.heights.size() * sizeof(float)) == 0;
+		int missing = client.get(prefix + std::string("9/9"), body);
+		client.close();
+		server.stop();
+		serverThread.join();
+		TileServerStats stats = server.getStats();
+		//4 bursts ran (the warm-up and 3 repetitions)
+		std::printf("  %s: 4 bursts, %llu generations, %llu misses, %llu coalesced; %.1f MB sent; %d failed requests; served tile %s; missing tile %d\n",
+			kind, (unsigned long long)(burst.generations - before.generations), (unsigned long long)(burst.misses - before.misses),
+			(unsigned long long)(burst.coalesced - before.coalesced),
+			stats.bytesSent / (1024.0 * 1024.0), failed.load(), same ? "decodes to the cached one" : "DIFFERS FROM THE CACHED ONE", missing);
+	}
+	cache.clear();
+	std::remove("benchmark_server_tiles");
+}
+
+/*
+	TilePyramid of a 4097 x 4097 terrain (heights up to 100 world units): every level down to 257 x 257 reduced from the
+	full terrain, against the 1025 x 1025 and 513 x 513 levels sampled straight from band limited noise. Items are
+	samples of the full terrain for the builds and of the level for the noise. The reduced levels have to bound the
+	heights (a coarse cell's minimum and maximum hold every fine height under it, checked on the first level). The noise
+	levels are compared with the reduced averages.
+	Then the coarsest tile of a 1025 x 1025 TerrainTiles from an empty cache, through the full terrain and through
+	a noise level, items are tiles.
+*/
+void benchmarkTilePyramid(BenchmarkRunner& runner)
+{
+	const int resolution = 4097;
+	NoiseData nData = {};
+	nData.W = resolution;
+	nData.H = resolution;
+	nData.seed = 21;
+	nData.scale = 0.3;
+	nData.octaves = 8;
+	nData.persistence = 0.5;
+	nData.lacunarity = 2.0;
+	GenerationData gData = {};
+	gData.W = 100;
+	gData.L = 100;
+	gData.numXVertices = resolution;
+	gData.numZVertices = resolution;
+	gData.heightMultiplier = 100.0f;
+	//A straight height curve, the noise levels are then comparable to the scaled heights
+	const float controlPoints[4] = { 0.25f, 0.25f, 0.75f, 0.75f };
+	std::memcpy(gData.controlPoints, controlPoints, sizeof(controlPoints));
+
+	PerlinNoise noise;
+	HeightField heights = noise.generateNoiseMap(nData);
+	std::vector<Biome*> biomes = { &WATER, &GRASS, &LAND, &SNOW };
+	std::vector<unsigned char> biomeMap;
+	Biome::classify(heights, biomes, biomeMap);
+	HeightCurve curve(gData.controlPoints);
+	for (size_t i = 0; i < heights.size(); ++i)
+		heights.data()[i] = curve.evaluate(heights.data()[i]) * gData.heightMultiplier;
+
+	const int levels = TilePyramid::levelCount(resolution, resolution, 256);
+	TilePyramid pyramid;
+	runner.run("TilePyramid/build/4097", [&]()
+	{
+		pyramid.build(heights, biomeMap, levels);
+		return heights.size();
+	});
+	const PyramidLevel& first = pyramid.getLevel(1);
+	bool bounded = true;
+	for (int z = 0; z < resolution && bounded; ++z)
+		for (int x = 0; x < resolution; ++x)
+		{
+			int cx = std::min(x / 2, first.average.getWidth() - 2), cz = std::min(z / 2, first.average.getHeight() - 2);
+			float low = std::min(std::min(first.minimum.at(cx, cz), first.minimum.at(cx + 1, cz)), std::min(first.minimum.at(cx, cz + 1), first.minimum.at(cx + 1, cz + 1)));
+			float high = std::max(std::max(first.maximum.at(cx, cz), first.maximum.at(cx + 1, cz)), std::max(first.maximum.at(cx, cz + 1), first.maximum.at(cx + 1, cz + 1)));
+			bounded &= low <= heights.at(x, z) && heights.at(x, z) <= high;
+		}
+	std::printf("  %d levels down to %d x %d, first level bounds %s\n", levels, pyramid.getLevel(levels - 1).average.getWidth(),
+		pyramid.getLevel(levels - 1).average.getHeight(), bounded ? "hold" : "DO NOT HOLD");
+
+	const int noiseLevels[] = { 2, 3 };
+	for (int lod : noiseLevels)
+	{
+		TilePyramid sampled;
+		int side = TilePyramid::levelSize(resolution, lod);
+		runner.run("TilePyramid/noise_level/" + std::to_string(side), [&]()
+		{
+			sampled.generate(gData, nData, biomes, lod, lod + 1);
+			return (size_t)side * side;
+		});
+		const HeightField& reduced = pyramid.getLevel(lod).average;
+		const HeightField& direct = sampled.getLevel(lod).average;
+		double squares = 0.0;
+		for (size_t i = 0; i < reduced.size(); ++i)
+			squares += (double)(direct.data()[i] - reduced.data()[i]) * (direct.data()[i] - reduced.data()[i]);
+		std::printf("  level %d from %d of %d octaves, RMS difference to the reduced level %.3f units\n", lod,
+			PerlinNoise::bandLimitedOctaves(nData, 1 << lod), nData.octaves, std::sqrt(squares / reduced.size()));
+	}
+
+	TileCache cache;
+	if (!cache.open("benchmark_pyramid_tiles", 0))
+	{
+		std::printf("  could not open benchmark_pyramid_tiles\n");
+		return;
+	}
+	gData.numXVertices = 1025;
+	gData.numZVertices = 1025;
+	for (int noiseLevel = 0; noiseLevel <= 2; noiseLevel += 2)
+	{
+		TerrainTiles tiles(cache, gData, nData, 128, noiseLevel);
+		int coarsest = tiles.getLevelCount() - 1;
+		TerrainTile tile;
+		bool found = true;
+		runner.run("TilePyramid/far_tile_cold/" + std::string(noiseLevel == 0 ? "reduced" : "noise_level_2"), [&]()
+		{
+			cache.clear();
+			found &= tiles.getTile(0, 0, tile, coarsest);
+			return (size_t)1;
+		});
+		std::printf("  level %d tile %d x %d %s\n", coarsest, tile.heights.getWidth(), tile.heights.getHeight(), found ? "generated" : "MISSING");
+	}
+	cache.clear();
+	std::remove("benchmark_pyramid_tiles");
+}
+
+#ifdef PROGEN_PROFILING
+/*
+	Cost of an empty zone, which is all the profiler adds around the profiled code. With tracing on the zone is also
+	appended to the trace buffer of the thread. The target is below 50 ns per zone. Two clock reads are nearly all of
+	it, so the cost of a clock read is reported as well: reading the time stamp counter is much slower in a VM, where
+	the clock alone can take the zone to the target.
+	The noise map afterwards is traced from the worker threads and written to a trace file.
+*/
+void benchmarkProfiler(BenchmarkRunner& runner)
+{
+	const int zones = 1000000;
+	Profiler& profiler = Profiler::global();
+	PROFILE_THREAD("main");
+	uint64_t sink = 0;
+	runner.run("Profiler/clock", [&]()
+	{
+		for (int i = 0; i < zones; ++i)
+			sink += Profiler::now();
+		return (size_t)zones;
+	});
+	runner.run("Profiler/zone", [&]()
+	{
+		for (int i = 0; i < zones; ++i)
+		{
+			PROFILE_ZONE("benchmark zone");
+		}
+		return (size_t)zones;
+	});
+	profiler.setTracing(true);
+	runner.run("Profiler/zone_traced", [&]()
+	{
+		for (int i = 0; i < zones; ++i)
+		{
+			PROFILE_ZONE("benchmark zone");
+		}
+		return (size_t)zones;
+	});
+	profiler.setTracing(false);
+
+	profiler.setTracing(true);
+	makeHeights(1025, 10.0f);
+	profiler.setTracing(false);
+	const char* path = "benchmark_trace.json";
+	std::FILE* file = profiler.writeChromeTrace(path) ? std::fopen(path, "rb") : nullptr;
+	if (file == nullptr)
+	{
+		std::printf("  could not write %s\n", path);
+		return;
+	}
+	std::fseek(file, 0, SEEK_END);
+	std::printf("  noise map trace: %s, %ld bytes (clock checksum %llu)\n", path, std::ftell(file), (unsigned long long)(sink & 0xff));
+	std::fclose(file);
+}
+#endif
+
+void printUsage()
+{
+	std::printf("Benchmarks [--filter <group>]... [--json <file>]\n");
+	std::printf("  --filter  runs only the groups whose name contains the text, can be given more than once\n");
+	std::printf("  --json    also writes the results as JSON\n");
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkRunner runner;
+	const char* jsonPath = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			runner.addFilter(argv[++i]);
+		else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			jsonPath = argv[++i];
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (runner.isSelected("PerlinNoise"))
+		benchmarkNoise(runner);
+	if (runner.isSelected("FalloffMap"))
+		benchmarkFalloff(runner);
+	if (runner.isSelected("MeshStages"))
+		benchmarkMeshStages(runner);
+	if (runner.isSelected("AnalyticNormals"))
+		benchmarkAnalyticNormals(runner);
+	if (runner.isSelected("TerrainQuery"))
+		benchmarkTerrainQuery(runner);
+	if (runner.isSelected("PoissonScatter"))
+		benchmarkScatter(runner);
+	if (runner.isSelected("RTIN"))
+		benchmarkRTIN(runner);
+	if (runner.isSelected("VertexCache"))
+		benchmarkVertexCache(runner);
+	if (runner.isSelected("ClusterSet"))
+		benchmarkClusters(runner);
+	if (runner.isSelected("HorizonCuller"))
+		benchmarkHorizonCulling(runner);
+	if (runner.isSelected("BufferAllocator"))
+		benchmarkBufferAllocator(runner);
+	if (runner.isSelected("MeshExport"))
+		benchmarkMeshExport(runner);
+	if (runner.isSelected("HeightmapIO"))
+		benchmarkHeightmapIO(runner);
+	if (runner.isSelected("TileCache"))
+		benchmarkTileCache(runner);
+	if (runner.isSelected("HeightCodec"))
+		benchmarkHeightCodec(runner);
+	if (runner.isSelected("TileServer"))
+		benchmarkTileServer(runner);
+	if (runner.isSelected("TilePyramid"))
+		benchmarkTilePyramid(runner);
+#ifdef PROGEN_PROFILING
+	if (runner.isSelected("Profiler"))
+		benchmarkProfiler(runner);
+#endif
+	runner.printTable();
+	if (jsonPath != nullptr && !runner.writeJson(jsonPath))
+	{
+		std::printf("Could not write %s\n", jsonPath);
+		return 1;
+	}
+	return 0;
+}
@@ -44,3 +44,27 @@ double Biome::getUpperHeight() const
 {
 	return upperHeight;
 }
+
+void Biome::classify(const HeightField& heightMap, const std::vector<Biome*>& biomes, std::vector<unsigned char>& biomeMap)
+{
+	biomeMap.resize(heightMap.size());
+	for (int z = 0; z < heightMap.getHeight(); ++z)
+	{
+		const float* row = heightMap.row(z);
+		unsigned char* ids = biomeMap.data() + (size_t)z * heightMap.getWidth();
+		for (int x = 0; x < heightMap.getWidth(); ++x)
+		{
+			//Traverse biomes and see which biome fit. The last one takes whatever is left.
+			unsigned char id = (unsigned char)(biomes.size() - 1);
+			for (size_t b = 0; b < biomes.size(); ++b)
+			{
+				if (biomes[b]->inRange(row[x]))
+				{
+					id = (unsigned char)b;
+					break;
+				}
+			}
+			ids[x] = id;
+		}
+	}
+}
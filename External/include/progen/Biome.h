@@ -3,6 +3,9 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <vector>
+
+#include "HeightField.h"
 
 /*
 	Biome is a base class that will be the parent of all other biomes.
@@ -18,6 +21,8 @@ public:
 	glm::vec3 getColor() const;
 	double getLowerHeight() const;
 	double getUpperHeight() const;
+	//Index of the biome of every sample in the range [0.0,1.0]. The first biome in range wins, the last one takes the rest.
+	static void classify(const HeightField& heightMap, const std::vector<Biome*>& biomes, std::vector<unsigned char>& biomeMap);
 private:
 	double lowerHeight, upperHeight;
 	double range; // (upper-lower)
@@ -0,0 +1,104 @@
+#include "BufferAllocator.h"
+
+#include <algorithm>
+#include <iterator>
+#include <cassert>
+
+BufferAllocator::BufferAllocator(size_t capacity)
+	:
+	capacity(0),
+	used(0)
+{
+	reset(capacity);
+}
+
+void BufferAllocator::reset(size_t newCapacity)
+{
+	freeRanges.clear();
+	capacity = newCapacity;
+	used = 0;
+	if (capacity > 0)
+		freeRanges[0] = capacity;
+}
+
+size_t BufferAllocator::allocate(size_t count)
+{
+	if (count == 0)
+		return INVALID_OFFSET;
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+	{
+		if (it->second < count)
+			continue;
+		size_t offset = it->first;
+		size_t remaining = it->second - count;
+		freeRanges.erase(it);
+		if (remaining > 0)
+			freeRanges[offset + count] = remaining;
+		used += count;
+		return offset;
+	}
+	return INVALID_OFFSET;
+}
+
+void BufferAllocator::free(size_t offset, size_t count)
+{
+	if (count == 0 || offset == INVALID_OFFSET)
+		return;
+	assert(offset + count <= capacity);
+	used -= count;
+
+	auto next = freeRanges.lower_bound(offset);
+	//Merge with the range that ends where this one starts
+	if (next != freeRanges.begin())
+	{
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= offset);
+		if (prev->first + prev->second == offset)
+		{
+			offset = prev->first;
+			count += prev->second;
+			freeRanges.erase(prev);
+		}
+	}
+	//And with the one that starts where it ends
+	if (next != freeRanges.end() && offset + count == next->first)
+	{
+		count += next->second;
+		freeRanges.erase(next);
+	}
+	freeRanges[offset] = count;
+}
+
+void BufferAllocator::grow(size_t newCapacity)
+{
+	if (newCapacity <= capacity)
+		return;
+	size_t oldCapacity = capacity;
+	capacity = newCapacity;
+	//The new tail goes in as a freed range, so it merges with a free range that ends at the old capacity
+	used += newCapacity - oldCapacity;
+	free(oldCapacity, newCapacity - oldCapacity);
+}
+
+size_t BufferAllocator::getCapacity() const
+{
+	return capacity;
+}
+
+size_t BufferAllocator::getUsed() const
+{
+	return used;
+}
+
+size_t BufferAllocator::getLargestFree() const
+{
+	size_t largest = 0;
+	for (const auto& range : freeRanges)
+		largest = std::max(largest, range.second);
+	return largest;
+}
+
+size_t BufferAllocator::getFreeRangeCount() const
+{
+	return freeRanges.size();
+}
@@ -0,0 +1,38 @@
+#ifndef BUFFER_ALLOCATOR_H
+#define BUFFER_ALLOCATOR_H
+
+#include <map>
+#include <cstddef>
+
+/*
+	Sub-allocation of ranges inside one large buffer, in elements (vertices, indices) rather than bytes, so every
+	range is naturally aligned for its element type.
+
+	First fit over a free list ordered by offset. Freed ranges merge with their free neighbours, so a chunk that is
+	regenerated with the same size lands back in its old place and the buffer does not fragment over time.
+	Pure bookkeeping, it never touches OpenGL.
+*/
+
+class BufferAllocator
+{
+public:
+	static const size_t INVALID_OFFSET = (size_t)-1;
+
+	explicit BufferAllocator(size_t capacity = 0);
+	void reset(size_t capacity);
+	//Returns INVALID_OFFSET if no free range is large enough
+	size_t allocate(size_t count);
+	void free(size_t offset, size_t count);
+	//Adds space at the end, after the buffer behind it grew
+	void grow(size_t newCapacity);
+	size_t getCapacity() const;
+	size_t getUsed() const;
+	size_t getLargestFree() const;
+	size_t getFreeRangeCount() const;
+private:
+	std::map<size_t, size_t> freeRanges; //offset -> count
+	size_t capacity;
+	size_t used;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "BufferedWriter.h"
+
+#include <cstring>
+
+BufferedWriter::BufferedWriter(size_t bufferSize)
+	:
+	file(nullptr),
+	buffer(bufferSize),
+	used(0),
+	bytesWritten(0),
+	failed(false)
+{}
+
+BufferedWriter::~BufferedWriter()
+{
+	close();
+}
+
+bool BufferedWriter::open(const char* path)
+{
+	close();
+	file = std::fopen(path, "wb");
+	used = 0;
+	bytesWritten = 0;
+	failed = file == nullptr;
+	if (file != nullptr)
+		std::setvbuf(file, nullptr, _IONBF, 0);
+	return !failed;
+}
+
+void BufferedWriter::write(const void* data, size_t size)
+{
+	bytesWritten += size;
+	if (used + size <= buffer.size())
+	{
+		std::memcpy(buffer.data() + used, data, size);
+		used += size;
+		return;
+	}
+	flush();
+	if (size >= buffer.size())
+	{
+		if (file == nullptr || std::fwrite(data, 1, size, file) != size)
+			failed = true;
+		return;
+	}
+	std::memcpy(buffer.data(), data, size);
+	used = size;
+}
+
+void BufferedWriter::writeZeros(size_t size)
+{
+	static const char zeros[64] = {};
+	while (size > 0)
+	{
+		size_t piece = size < sizeof(zeros) ? size : sizeof(zeros);
+		write(zeros, piece);
+		size -= piece;
+	}
+}
+
+size_t BufferedWriter::getBytesWritten() const
+{
+	return bytesWritten;
+}
+
+void BufferedWriter::flush()
+{
+	if (used > 0 && (file == nullptr || std::fwrite(buffer.data(), 1, used, file) != used))
+		failed = true;
+	used = 0;
+}
+
+bool BufferedWriter::close()
+{
+	if (file == nullptr)
+		return !failed;
+	flush();
+	if (std::fclose(file) != 0)
+		failed = true;
+	file = nullptr;
+	return !failed;
+}
@@ -0,0 +1,39 @@
+#ifndef BUFFERED_WRITER_H
+#define BUFFERED_WRITER_H
+
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+
+/*
+	Binary file output through one large buffer, for the exporters that write millions of small records.
+	The C stream buffer is turned off since every write is already batched here. Writes larger than the buffer
+	go to the file directly. Errors are remembered and reported by close().
+*/
+
+class BufferedWriter
+{
+public:
+	explicit BufferedWriter(size_t bufferSize = 1 << 20);
+	~BufferedWriter();
+	BufferedWriter(const BufferedWriter&) = delete;
+	BufferedWriter& operator=(const BufferedWriter&) = delete;
+	bool open(const char* path);
+	void write(const void* data, size_t size);
+	template<class T>
+	void writeValue(const T& value) { write(&value, sizeof(T)); }
+	void writeZeros(size_t size);
+	size_t getBytesWritten() const;
+	//Flushes and closes the file. False if anything failed since open.
+	bool close();
+private:
+	void flush();
+private:
+	std::FILE* file;
+	std::vector<char> buffer;
+	size_t used;
+	size_t bytesWritten;
+	bool failed;
+};
+
+#endif
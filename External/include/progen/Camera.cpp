@@ -35,6 +35,11 @@ glm::mat4 Camera::getViewMatrix() const
 	return glm::lookAt(position, position + front, worldUp);
 }
 
+glm::mat4 Camera::getProjectionMatrix() const
+{
+	return glm::perspective(glm::radians(fov), (float)SCR_WIDTH / SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+}
+
 float Camera::getFov() const
 {
 	return fov;
@@ -50,6 +55,11 @@ glm::vec3 Camera::getFront() const
 	return front;
 }
 
+void Camera::setPosition(const glm::vec3& pos)
+{
+	position = pos;
+}
+
 void Camera::setSpeed(float speed_in)
 {
 	movementSpeed = speed_in;
@@ -25,6 +25,8 @@ constexpr float PITCH = 0.0f;
 constexpr float SPEED = 5.0f;
 constexpr float SENSIVITY = 0.05f;
 constexpr float FOV = 45.0f; 
+constexpr float NEAR_PLANE = 0.1f;
+constexpr float FAR_PLANE = 100.0f;
 
 class Camera
 {
@@ -35,11 +37,13 @@ public:
 	//Getters
 	//Will be used to pass the view matrix to the shaders
 	glm::mat4 getViewMatrix() const;
+	glm::mat4 getProjectionMatrix() const;
 	float getFov() const;
 	glm::vec3 getPosition() const;
 	glm::vec3 getFront() const;
 
 	//Setters
+	void setPosition(const glm::vec3& pos);
 	void setSpeed(float speed_in);
 	void setSensivity(float sensivity_in);
 	void setZoom(float zoom_in);
@@ -0,0 +1,245 @@
+#include "ClusterSet.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+namespace
+{
+	//Roughly this many triangles per tile of build(), a few clusters each
+	const int TRIANGLES_PER_TILE = 1024;
+	const int MAX_TILES_PER_SIDE = 64;
+}
+
+ClusterSet::ClusterSet()
+{}
+
+void ClusterSet::clear()
+{
+	clusters.clear();
+}
+
+const std::vector<Cluster>& ClusterSet::getClusters() const
+{
+	return clusters;
+}
+
+void ClusterSet::computeBounds(Cluster& cluster, const std::vector<Vertex>& vertices, const std::vector<glm::ivec3>& tris) const
+{
+	cluster.boundsMin = glm::vec3(FLT_MAX);
+	cluster.boundsMax = glm::vec3(-FLT_MAX);
+	glm::vec3 normalSum(0.0f);
+	for (unsigned int t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; ++t)
+	{
+		const glm::vec3& a = vertices[tris[t].x].pos;
+		const glm::vec3& b = vertices[tris[t].y].pos;
+		const glm::vec3& c = vertices[tris[t].z].pos;
+		cluster.boundsMin = glm::min(cluster.boundsMin, glm::min(a, glm::min(b, c)));
+		cluster.boundsMax = glm::max(cluster.boundsMax, glm::max(a, glm::max(b, c)));
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float length = glm::length(n);
+		if (length > 0.0f)
+			normalSum += n / length;
+	}
+
+	cluster.center = 0.5f * (cluster.boundsMin + cluster.boundsMax);
+	cluster.radius = 0.0f;
+	for (unsigned int t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; ++t)
+		for (int k = 0; k < 3; ++k)
+			cluster.radius = std::max(cluster.radius, glm::length(vertices[tris[t][k]].pos - cluster.center));
+
+	//Normal cone: the widest face normal decides the angle. Cones of more than ~84 degrees would hardly ever cull.
+	float sumLength = glm::length(normalSum);
+	cluster.coneAxis = sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f, 1.0f, 0.0f);
+	float minDot = 1.0f;
+	for (unsigned int t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount && sumLength > 0.0f; ++t)
+	{
+		const glm::vec3& a = vertices[tris[t].x].pos;
+		glm::vec3 n = glm::cross(vertices[tris[t].y].pos - a, vertices[tris[t].z].pos - a);
+		float length = glm::length(n);
+		if (length > 0.0f)
+			minDot = std::min(minDot, glm::dot(n / length, cluster.coneAxis));
+	}
+	cluster.coneCutoff = sumLength > 0.0f && minDot > 0.1f ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+}
+
+void ClusterSet::buildGrid(const std::vector<Vertex>& vertices, int numX, int numZ, std::vector<glm::ivec3>& tris)
+{
+	clusters.clear();
+	if (numX < 2 || numZ < 2)
+		return;
+
+	int cellsX = numX - 1;
+	int cellsZ = numZ - 1;
+	int tilesX = (cellsX + TILE_CELLS - 1) / TILE_CELLS;
+	int tilesZ = (cellsZ + TILE_CELLS - 1) / TILE_CELLS;
+	clusters.resize((size_t)tilesX * tilesZ);
+	unsigned int first = 0;
+	for (int tz = 0; tz < tilesZ; ++tz)
+	{
+		for (int tx = 0; tx < tilesX; ++tx)
+		{
+			int w = std::min(TILE_CELLS, cellsX - tx * TILE_CELLS);
+			int h = std::min(TILE_CELLS, cellsZ - tz * TILE_CELLS);
+			Cluster& cluster = clusters[(size_t)tz * tilesX + tx];
+			cluster.firstTriangle = first;
+			cluster.triangleCount = (unsigned int)(2 * w * h);
+			cluster.vertexCount = (unsigned int)((w + 1) * (h + 1));
+			first += cluster.triangleCount;
+		}
+	}
+
+	reordered.resize(first);
+	ThreadPool::global().parallelFor(0, (int)clusters.size(), [&](int begin, int end)
+	{
+		PROFILE_ZONE("cluster tiles");
+		for (int i = begin; i < end; ++i)
+		{
+			Cluster& cluster = clusters[i];
+			int x0 = (i % tilesX) * TILE_CELLS;
+			int z0 = (i / tilesX) * TILE_CELLS;
+			int w = std::min(TILE_CELLS, cellsX - x0);
+			int h = std::min(TILE_CELLS, cellsZ - z0);
+			glm::ivec3* out = reordered.data() + cluster.firstTriangle;
+			for (int z = z0; z < z0 + h; ++z)
+			{
+				for (int x = x0; x < x0 + w; ++x)
+				{
+					//Same triangles as the row-major generation, oriented counter-clockwise
+					int vi = z * numX + x;
+					*out++ = glm::ivec3(vi, vi + numX, vi + numX + 1);
+					*out++ = glm::ivec3(vi, vi + numX + 1, vi + 1);
+				}
+			}
+			computeBounds(cluster, vertices, reordered);
+		}
+	}, 16);
+	tris.swap(reordered);
+}
+
+void ClusterSet::build(const std::vector<Vertex>& vertices, std::vector<glm::ivec3>& tris)
+{
+	clusters.clear();
+	if (tris.empty())
+		return;
+
+	glm::vec2 minXZ(FLT_MAX), maxXZ(-FLT_MAX);
+	for (const Vertex& v : vertices)
+	{
+		minXZ = glm::min(minXZ, glm::vec2(v.pos.x, v.pos.z));
+		maxXZ = glm::max(maxXZ, glm::vec2(v.pos.x, v.pos.z));
+	}
+	int tilesPerSide = (int)std::sqrt((double)tris.size() / TRIANGLES_PER_TILE);
+	tilesPerSide = std::min(std::max(tilesPerSide, 1), MAX_TILES_PER_SIDE);
+	glm::vec2 toTile = (float)tilesPerSide / glm::max(maxXZ - minXZ, glm::vec2(1e-6f));
+
+	//Counting sort of the triangles by the tile of their centroid, stable so an optimized order survives inside a tile
+	int tileCount = tilesPerSide * tilesPerSide;
+	tileOf.resize(tris.size());
+	tileOffsets.assign(tileCount + 1, 0);
+	for (size_t t = 0; t < tris.size(); ++t)
+	{
+		glm::vec3 centroid = (vertices[tris[t].x].pos + vertices[tris[t].y].pos + vertices[tris[t].z].pos) / 3.0f;
+		int tx = std::min((int)((centroid.x - minXZ.x) * toTile.x), tilesPerSide - 1);
+		int tz = std::min((int)((centroid.z - minXZ.y) * toTile.y), tilesPerSide - 1);
+		tileOf[t] = tz * tilesPerSide + tx;
+		++tileOffsets[tileOf[t] + 1];
+	}
+	for (int i = 0; i < tileCount; ++i)
+		tileOffsets[i + 1] += tileOffsets[i];
+	reordered.resize(tris.size());
+	{
+		std::vector<unsigned int> next(tileOffsets.begin(), tileOffsets.end() - 1);
+		for (size_t t = 0; t < tris.size(); ++t)
+			reordered[next[tileOf[t]]++] = tris[t];
+	}
+
+	//Every tile is cut into clusters on its own. A cluster ends when the next triangle would break a limit.
+	std::vector<std::vector<Cluster>> tileClusters(tileCount);
+	ThreadPool::global().parallelFor(0, tileCount, [&](int begin, int end)
+	{
+		PROFILE_ZONE("cluster tiles");
+		for (int tile = begin; tile < end; ++tile)
+		{
+			std::vector<Cluster>& out = tileClusters[tile];
+			int clusterVertices[MAX_VERTICES];
+			Cluster current = {};
+			current.firstTriangle = tileOffsets[tile];
+			for (unsigned int t = tileOffsets[tile]; t < tileOffsets[tile + 1]; ++t)
+			{
+				int added[3];
+				int addedCount = 0;
+				for (int k = 0; k < 3; ++k)
+				{
+					int v = reordered[t][k];
+					if (std::find(clusterVertices, clusterVertices + current.vertexCount, v) == clusterVertices + current.vertexCount
+						&& std::find(added, added + addedCount, v) == added + addedCount)
+						added[addedCount++] = v;
+				}
+				if (current.vertexCount + addedCount > MAX_VERTICES || current.triangleCount + 1 > MAX_TRIANGLES)
+				{
+					out.push_back(current);
+					current = Cluster();
+					current.firstTriangle = t;
+					addedCount = 0;
+					for (int k = 0; k < 3; ++k)
+					{
+						int v = reordered[t][k];
+						if (std::find(added, added + addedCount, v) == added + addedCount)
+							added[addedCount++] = v;
+					}
+				}
+				for (int k = 0; k < addedCount; ++k)
+					clusterVertices[current.vertexCount++] = added[k];
+				++current.triangleCount;
+			}
+			if (current.triangleCount > 0)
+				out.push_back(current);
+			for (Cluster& cluster : out)
+				computeBounds(cluster, vertices, reordered);
+		}
+	});
+
+	for (const std::vector<Cluster>& tile : tileClusters)
+		clusters.insert(clusters.end(), tile.begin(), tile.end());
+	tris.swap(reordered);
+}
+
+size_t ClusterSet::cull(const Camera& camera, std::vector<ClusterDrawRange>& ranges, const HorizonCuller* horizon) const
+{
+	return cull(Frustum(camera.getProjectionMatrix() * camera.getViewMatrix()), camera.getPosition(), ranges, horizon);
+}
+
+size_t ClusterSet::cull(const Frustum& frustum, const glm::vec3& cameraPos, std::vector<ClusterDrawRange>& ranges, const HorizonCuller* horizon) const
+{
+	ranges.clear();
+	size_t visible = 0;
+	for (const Cluster& cluster : clusters)
+	{
+		if (frustum.testAABB(cluster.boundsMin, cluster.boundsMax) == FrustumTest::OUTSIDE)
+			continue;
+		//Back facing: every face normal points away from the camera for every point of the bounding sphere
+		glm::vec3 toCluster = cluster.center - cameraPos;
+		if (glm::dot(toCluster, cluster.coneAxis) >= cluster.coneCutoff * glm::length(toCluster) + cluster.radius)
+			continue;
+		if (horizon && !horizon->isVisible(cluster.boundsMin, cluster.boundsMax))
+			continue;
+
+		++visible;
+		unsigned int firstIndex = 3 * cluster.firstTriangle;
+		if (!ranges.empty() && ranges.back().firstIndex + ranges.back().indexCount == firstIndex)
+		{
+			ranges.back().indexCount += 3 * cluster.triangleCount;
+		}
+		else
+		{
+			ClusterDrawRange range;
+			range.firstIndex = firstIndex;
+			range.indexCount = 3 * cluster.triangleCount;
+			ranges.push_back(range);
+		}
+	}
+	return visible;
+}
@@ -0,0 +1,77 @@
+#ifndef CLUSTER_SET_H
+#define CLUSTER_SET_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+#include "Camera.h"
+#include "Frustum.h"
+#include "HorizonCuller.h"
+
+/*
+	A small piece of the terrain mesh: a contiguous range of the triangle list with at most MAX_VERTICES distinct
+	vertices and MAX_TRIANGLES triangles, the sizes mesh shaders like.
+*/
+struct Cluster
+{
+	unsigned int firstTriangle;
+	unsigned int triangleCount;
+	unsigned int vertexCount;
+	glm::vec3 boundsMin, boundsMax;
+	glm::vec3 center;
+	float radius;
+	//Every face normal of the cluster is within the cone around coneAxis. coneCutoff is the sine of the cone's
+	//half angle, 1 if the cone is too wide to ever cull.
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+//Consecutive visible clusters are merged into one range of the index buffer
+struct ClusterDrawRange
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+};
+
+
+/*
+	Splits the terrain triangles into clusters and culls them against the camera.
+
+	buildGrid() handles the regular grid analytically: tiles of TILE_CELLS x TILE_CELLS cells have exactly 64 vertices
+	and 98 triangles. build() handles any mesh (the RTIN output): triangles are binned into square tiles over the
+	xz plane by their centroid, keeping their relative order, and every tile is cut greedily into clusters.
+	Either way the tiles are processed in parallel and the triangle list is rewritten so every cluster is contiguous.
+
+	cull() rejects clusters outside the frustum and clusters that only have back faces towards the camera. Given a
+	horizon culler that was updated for the same camera, it also rejects the clusters hidden behind the terrain.
+
+	REFERENCE: Kapoulkine - meshoptimizer, cluster bounds and cone culling (2019)
+*/
+
+class ClusterSet
+{
+public:
+	static const unsigned int MAX_VERTICES = 64;
+	static const unsigned int MAX_TRIANGLES = 124;
+	static const int TILE_CELLS = 7;
+
+	ClusterSet();
+	void buildGrid(const std::vector<Vertex>& vertices, int numX, int numZ, std::vector<glm::ivec3>& tris);
+	void build(const std::vector<Vertex>& vertices, std::vector<glm::ivec3>& tris);
+	void clear();
+	const std::vector<Cluster>& getClusters() const;
+	//Fills ranges with the visible parts of the index buffer. Returns the number of visible clusters.
+	size_t cull(const Camera& camera, std::vector<ClusterDrawRange>& ranges, const HorizonCuller* horizon = nullptr) const;
+	size_t cull(const Frustum& frustum, const glm::vec3& cameraPos, std::vector<ClusterDrawRange>& ranges, const HorizonCuller* horizon = nullptr) const;
+private:
+	void computeBounds(Cluster& cluster, const std::vector<Vertex>& vertices, const std::vector<glm::ivec3>& tris) const;
+private:
+	std::vector<Cluster> clusters;
+	std::vector<glm::ivec3> reordered; //Scratch for the rewritten triangle list
+	std::vector<int> tileOf; //Scratch: tile of every triangle
+	std::vector<unsigned int> tileOffsets;
+};
+
+#endif
@@ -1,10 +1,15 @@
 #include "FalloffMap.h"
+#include "Profiler.h"
+
+#include <cmath>
+#include <algorithm>
 
 FalloffMap::FalloffMap()
 {}
 
 std::vector<std::vector<double>> FalloffMap::generate(int W, int H)
 {
+	PROFILE_ZONE("falloff");
 	std::vector<std::vector<double>> falloffMap(H, std::vector<double>(W));
 	for (int i = 0; i < H; ++i)
 	{
@@ -21,6 +26,17 @@ std::vector<std::vector<double>> FalloffMap::generate(int W, int H)
 	return falloffMap;
 }
 
+glm::dvec2 FalloffMap::gradient(int j, int i, int W, int H)
+{
+	double x = (j / (double)W) * 2 - 1;
+	double y = (i / (double)H) * 2 - 1;
+	//Only the coordinate that is the max moves the value
+	double slope = derivative(std::max(fabs(x), fabs(y)));
+	if (fabs(x) >= fabs(y))
+		return glm::dvec2(slope * (x < 0 ? -2.0 : 2.0) / W, 0.0);
+	return glm::dvec2(0.0, slope * (y < 0 ? -2.0 : 2.0) / H);
+}
+
 double FalloffMap::evaluate(double value)
 {
 	double a = 3;
@@ -28,3 +44,16 @@ double FalloffMap::evaluate(double value)
 
 	return pow(value, a) / (pow(value, a) + pow(b - b * value, a));
 }
+
+double FalloffMap::derivative(double value)
+{
+	double a = 3;
+	double b = 2.2;
+
+	//Quotient rule on evaluate
+	double p = pow(value, a);
+	double q = pow(b - b * value, a);
+	double dp = a * pow(value, a - 1);
+	double dq = -a * b * pow(b - b * value, a - 1);
+	return (dp * q - p * dq) / ((p + q) * (p + q));
+}
@@ -2,14 +2,18 @@
 #define FALLOFFMAP_H
 
 #include <vector>
+#include <glm/glm.hpp>
 
 class FalloffMap
 {
 public:
 	FalloffMap();
 	std::vector<std::vector<double> >generate(int W, int H);
+	//Derivatives of the value generate gives at (x, z) along x and z, per vertex
+	glm::dvec2 gradient(int x, int z, int W, int H);
 private:
 	double evaluate(double value);
+	double derivative(double value);
 };
 
 
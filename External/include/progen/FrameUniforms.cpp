@@ -0,0 +1,40 @@
+#include "FrameUniforms.h"
+
+FrameUniforms::FrameUniforms()
+	:
+	data()
+{
+	glGenBuffers(1, &UBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+}
+
+FrameUniforms::~FrameUniforms()
+{
+	glDeleteBuffers(1, &UBO);
+}
+
+bool FrameUniforms::attach(const Shader& shader) const
+{
+	return shader.bindUniformBlock("FrameData", BINDING);
+}
+
+void FrameUniforms::update(const Camera& camera, const glm::vec3& lightDir, const glm::vec3& lightColor)
+{
+	data.PV = camera.getProjectionMatrix() * camera.getViewMatrix();
+	data.cameraPos = glm::vec4(camera.getPosition(), 1.0f);
+	data.lightDir = glm::vec4(lightDir, 0.0f);
+	data.lightColor = glm::vec4(lightColor, 0.0f);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+}
+
+const FrameData& FrameUniforms::getData() const
+{
+	return data;
+}
@@ -0,0 +1,51 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "Shader.h"
+
+/*
+	Per frame data shared by every program through a uniform buffer, uploaded once per frame instead of once per
+	program and draw. Shaders declare the same std140 block:
+
+	layout (std140) uniform FrameData
+	{
+		mat4 PV;
+		vec4 cameraPos;
+		vec4 lightDir;
+		vec4 lightColor;
+	};
+
+	and attach() binds it to BINDING. vec3 values are padded to vec4 as std140 lays them out.
+*/
+
+struct FrameData
+{
+	glm::mat4 PV;
+	glm::vec4 cameraPos;
+	glm::vec4 lightDir;
+	glm::vec4 lightColor;
+};
+
+class FrameUniforms
+{
+public:
+	static const GLuint BINDING = 0;
+
+	FrameUniforms();
+	~FrameUniforms();
+	FrameUniforms(const FrameUniforms&) = delete;
+	FrameUniforms& operator=(const FrameUniforms&) = delete;
+	//Binds the FrameData block of the program to the buffer. Returns false if the program does not use it.
+	bool attach(const Shader& shader) const;
+	void update(const Camera& camera, const glm::vec3& lightDir, const glm::vec3& lightColor);
+	const FrameData& getData() const;
+private:
+	GLuint UBO;
+	FrameData data;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "Frustum.h"
+
+Frustum::Frustum()
+{
+	for (glm::vec4& plane : planes)
+		plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::Frustum(const glm::mat4& PV)
+{
+	update(PV);
+}
+
+void Frustum::update(const glm::mat4& PV)
+{
+	//glm is column major, so row i of the matrix is (PV[0][i], PV[1][i], PV[2][i], PV[3][i])
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i)
+		rows[i] = glm::vec4(PV[0][i], PV[1][i], PV[2][i], PV[3][i]);
+
+	planes[0] = rows[3] + rows[0]; //Left
+	planes[1] = rows[3] - rows[0]; //Right
+	planes[2] = rows[3] + rows[1]; //Bottom
+	planes[3] = rows[3] - rows[1]; //Top
+	planes[4] = rows[3] + rows[2]; //Near
+	planes[5] = rows[3] - rows[2]; //Far
+	for (glm::vec4& plane : planes)
+		plane /= glm::length(glm::vec3(plane));
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const
+{
+	for (const glm::vec4& plane : planes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	}
+	return true;
+}
+
+FrustumTest Frustum::testAABB(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+	FrustumTest result = FrustumTest::INSIDE;
+	for (const glm::vec4& plane : planes)
+	{
+		//Corner furthest along the plane normal decides if the box is outside, the nearest one if it is cut
+		glm::vec3 positive(plane.x >= 0.0f ? boxMax.x : boxMin.x, plane.y >= 0.0f ? boxMax.y : boxMin.y, plane.z >= 0.0f ? boxMax.z : boxMin.z);
+		glm::vec3 negative(plane.x >= 0.0f ? boxMin.x : boxMax.x, plane.y >= 0.0f ? boxMin.y : boxMax.y, plane.z >= 0.0f ? boxMin.z : boxMax.z);
+		if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+			return FrustumTest::OUTSIDE;
+		if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f)
+			result = FrustumTest::INTERSECTS;
+	}
+	return result;
+}
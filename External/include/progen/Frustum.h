@@ -0,0 +1,32 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+/*
+	The 6 planes of a view frustum, extracted from a projection * view matrix.
+	Planes point inwards and are normalized, so plane distances are in world units.
+
+	REFERENCE: Gribb, Hartmann - Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix (2001)
+*/
+
+enum class FrustumTest
+{
+	OUTSIDE,
+	INTERSECTS,
+	INSIDE
+};
+
+class Frustum
+{
+public:
+	Frustum();
+	explicit Frustum(const glm::mat4& PV);
+	void update(const glm::mat4& PV);
+	bool intersectsSphere(const glm::vec3& center, float radius) const;
+	FrustumTest testAABB(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+private:
+	glm::vec4 planes[6]; //(normal, d): dot(normal, p) + d >= 0 inside
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "GLExtensions.h"
+
+#include <cstring>
+
+GLExtensions::GLExtensions()
+	:
+	programBinary(false),
+	bufferStorage(false),
+	multiDrawIndirect(false),
+	baseInstance(false),
+	shaderStorageBuffer(false),
+	getProgramBinary(nullptr),
+	programBinaryUpload(nullptr),
+	programParameteri(nullptr),
+	bufferStorageAlloc(nullptr),
+	multiDrawElementsIndirect(nullptr)
+{}
+
+GLExtensions& GLExtensions::instance()
+{
+	static GLExtensions extensions;
+	return extensions;
+}
+
+const GLExtensions& GLExtensions::get()
+{
+	return instance();
+}
+
+bool GLExtensions::hasExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension && std::strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+void GLExtensions::load(GLADloadproc loader)
+{
+	GLExtensions& ext = instance();
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	int version = major * 10 + minor;
+
+	const char* strings[] = { (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION) };
+	ext.driver.clear();
+	for (const char* s : strings)
+	{
+		if (!ext.driver.empty())
+			ext.driver += " | ";
+		ext.driver += s ? s : "";
+	}
+
+	ext.getProgramBinary = (PFNGLGETPROGRAMBINARYPROC)loader("glGetProgramBinary");
+	ext.programBinaryUpload = (PFNGLPROGRAMBINARYPROC)loader("glProgramBinary");
+	ext.programParameteri = (PFNGLPROGRAMPARAMETERIPROC)loader("glProgramParameteri");
+	ext.bufferStorageAlloc = (PFNGLBUFFERSTORAGEPROC)loader("glBufferStorage");
+	ext.multiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)loader("glMultiDrawElementsIndirect");
+
+	//A driver may export an entry point it does not support, so the version or the extension string decides
+	GLint binaryFormats = 0;
+	if (version >= 41 || hasExtension("GL_ARB_get_program_binary"))
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+	ext.programBinary = binaryFormats > 0 && ext.getProgramBinary && ext.programBinaryUpload && ext.programParameteri;
+	ext.bufferStorage = (version >= 44 || hasExtension("GL_ARB_buffer_storage")) && ext.bufferStorageAlloc;
+	ext.multiDrawIndirect = (version >= 43 || hasExtension("GL_ARB_multi_draw_indirect")) && ext.multiDrawElementsIndirect;
+	ext.baseInstance = version >= 42 || hasExtension("GL_ARB_base_instance");
+	ext.shaderStorageBuffer = version >= 43 || hasExtension("GL_ARB_shader_storage_buffer_object");
+}
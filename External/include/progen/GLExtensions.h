@@ -0,0 +1,67 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+#include <string>
+
+/*
+	Entry points and enums newer than the OpenGL 3.3 core that glad was generated for.
+
+	The context is created as 3.3 core, but the drivers expose the later features as extensions (or as core when the
+	context is newer). load() resolves them with the same loader glad uses and records which features are usable, so
+	callers check a flag and keep their 3.3 path as the fallback.
+*/
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+
+class GLExtensions
+{
+public:
+	//Call once after glad is loaded, with the current context
+	static void load(GLADloadproc loader);
+	static const GLExtensions& get();
+	static bool hasExtension(const char* name);
+public:
+	bool programBinary; //ARB_get_program_binary with at least one binary format
+	bool bufferStorage; //ARB_buffer_storage (persistent mapping)
+	bool multiDrawIndirect; //ARB_multi_draw_indirect
+	bool baseInstance; //ARB_base_instance, without it the baseInstance of indirect commands is ignored
+	bool shaderStorageBuffer; //ARB_shader_storage_buffer_object
+	std::string driver; //Vendor, renderer and version strings. Program binaries are only valid for the same driver.
+
+	PFNGLGETPROGRAMBINARYPROC getProgramBinary;
+	PFNGLPROGRAMBINARYPROC programBinaryUpload;
+	PFNGLPROGRAMPARAMETERIPROC programParameteri;
+	PFNGLBUFFERSTORAGEPROC bufferStorageAlloc;
+	PFNGLMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect;
+private:
+	GLExtensions();
+	static GLExtensions& instance();
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include "GpuProfiler.h"
+
+#ifdef PROGEN_PROFILING
+
+GpuProfiler::GpuProfiler()
+	:
+	created(false),
+	frame(0),
+	activeZone(-1),
+	nestedDepth(0)
+{
+	for (ZoneQueries& zone : zones)
+	{
+		zone.queries[0] = zone.queries[1] = 0;
+		zone.issued[0] = zone.issued[1] = false;
+	}
+}
+
+GpuProfiler& GpuProfiler::global()
+{
+	static GpuProfiler profiler;
+	return profiler;
+}
+
+void GpuProfiler::begin(int zone)
+{
+	if (activeZone >= 0)
+	{
+		++nestedDepth;
+		return;
+	}
+	if (!created)
+	{
+		for (ZoneQueries& z : zones)
+			glGenQueries(2, z.queries);
+		created = true;
+	}
+	int set = frame & 1;
+	glBeginQuery(GL_TIME_ELAPSED, zones[zone].queries[set]);
+	zones[zone].issued[set] = true;
+	activeZone = zone;
+}
+
+void GpuProfiler::end()
+{
+	if (nestedDepth > 0)
+	{
+		--nestedDepth;
+		return;
+	}
+	if (activeZone < 0)
+		return;
+	glEndQuery(GL_TIME_ELAPSED);
+	activeZone = -1;
+}
+
+void GpuProfiler::endFrame()
+{
+	if (!created)
+		return;
+	//Queries issued the frame before this one
+	int set = (frame + 1) & 1;
+	for (int i = 0; i < Profiler::MAX_ZONES; ++i)
+	{
+		ZoneQueries& zone = zones[i];
+		if (!zone.issued[set])
+			continue;
+		GLint available = 0;
+		glGetQueryObjectiv(zone.queries[set], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(zone.queries[set], GL_QUERY_RESULT, &elapsed);
+			Profiler::global().recordGpu(i, elapsed * 1e-6);
+		}
+		zone.issued[set] = false;
+	}
+	++frame;
+}
+
+#endif
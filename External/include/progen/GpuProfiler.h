@@ -0,0 +1,63 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include "Profiler.h"
+
+#ifdef PROGEN_PROFILING
+
+#include <glad/glad.h>
+
+/*
+	GPU timings of profiler zones with GL_TIME_ELAPSED queries.
+
+	Every zone has two query objects and uses them on alternate frames. endFrame() reads the queries of the previous
+	frame, which the GPU has normally finished by then, and only if their results are available, so reading never
+	stalls the pipeline; a result that is not ready yet is skipped. Time elapsed queries cannot nest, so a GPU zone
+	opened inside another one is not timed.
+*/
+
+class GpuProfiler
+{
+public:
+	static GpuProfiler& global();
+	void begin(int zone);
+	void end();
+	//Collects the last frame's results into the profiler and flips the query set
+	void endFrame();
+private:
+	GpuProfiler();
+	struct ZoneQueries
+	{
+		GLuint queries[2];
+		bool issued[2];
+	};
+private:
+	ZoneQueries zones[Profiler::MAX_ZONES];
+	bool created;
+	int frame;
+	int activeZone;
+	int nestedDepth; //Zones opened inside the active one, they are not timed
+};
+
+class GpuProfileZone
+{
+public:
+	explicit GpuProfileZone(int zone) { GpuProfiler::global().begin(zone); }
+	~GpuProfileZone() { GpuProfiler::global().end(); }
+	GpuProfileZone(const GpuProfileZone&) = delete;
+	GpuProfileZone& operator=(const GpuProfileZone&) = delete;
+};
+
+#define PROFILE_GPU_ZONE(name) \
+	static const int PROGEN_PROFILE_CONCAT(profileGpuZoneId, __LINE__) = Profiler::global().registerZone(name); \
+	GpuProfileZone PROGEN_PROFILE_CONCAT(profileGpuZone, __LINE__)(PROGEN_PROFILE_CONCAT(profileGpuZoneId, __LINE__))
+#define PROFILE_GPU_FRAME() GpuProfiler::global().endFrame()
+
+#else
+
+#define PROFILE_GPU_ZONE(name)
+#define PROFILE_GPU_FRAME()
+
+#endif
+
+#endif
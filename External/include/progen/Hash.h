@@ -0,0 +1,35 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/*
+	64 bit FNV-1a, for cache keys. Not meant to resist collisions on purpose, only to tell inputs apart.
+	Hashes chain: pass the previous result as the seed to hash several pieces as one stream.
+*/
+
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+const uint64_t FNV_PRIME = 1099511628211ull;
+
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = FNV_OFFSET_BASIS)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+inline uint64_t hashString(const std::string& s, uint64_t seed = FNV_OFFSET_BASIS)
+{
+	//The length goes in as well, so "ab" + "c" and "a" + "bc" differ
+	uint64_t length = s.size();
+	return hashBytes(s.data(), s.size(), hashBytes(&length, sizeof(length), seed));
+}
+
+#endif
@@ -0,0 +1,524 @@
+#include "HeightCodec.h"
+#include "Simd.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//The bit reader loads 64-bit words straight from the bytes, which is little endian on every target (x86, ARM)
+
+namespace
+{
+	const uint32_t CODEC_MAGIC = 0x43484750; //"PGHC"
+	const uint16_t CODEC_VERSION = 1;
+	const uint16_t MODE_QUANTIZED = 0;
+	const uint16_t MODE_LOSSLESS = 1;
+	const int BLOCK = 64; //Residuals sharing a Rice parameter
+	const int ESCAPE = 12; //Quotients from here on are stored raw
+	const size_t PADDING = 16; //Zero bytes after the codes, the reader loads whole words and buffers up to 8 bytes ahead
+	const int STREAMS = 4; //Row z goes to stream z % STREAMS, the decoder interleaves them
+
+	struct CodecHeader
+	{
+		uint32_t magic;
+		uint16_t version;
+		uint16_t mode;
+		uint32_t width;
+		uint32_t height;
+		float low;
+		float step;
+		uint32_t streamBytes[STREAMS]; //Rice codes of each stream, without the padding
+	};
+	static_assert(sizeof(CodecHeader) == 40, "The codec header is 40 bytes");
+
+	inline int countTrailingZeros(uint64_t v)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanForward64(&index, v);
+		return (int)index;
+#elif defined(__GNUC__)
+		return __builtin_ctzll(v);
+#else
+		int n = 0;
+		while ((v & 1) == 0)
+		{
+			v >>= 1;
+			++n;
+		}
+		return n;
+#endif
+	}
+
+	//Float bits in an order that follows the values
+	inline uint32_t orderedBits(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+	}
+
+	inline float fromOrderedBits(uint32_t ordered)
+	{
+		uint32_t bits = (ordered & 0x80000000u) ? (ordered & 0x7fffffffu) : ~ordered;
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	inline float dequantize(uint32_t q, float low, float step)
+	{
+		return low + (float)(int32_t)q * step;
+	}
+
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(std::vector<unsigned char>& out) : out(out), acc(0), count(0) {}
+		//bits <= 32
+		void put(uint64_t value, int bits)
+		{
+			acc |= value << count;
+			count += bits;
+			while (count >= 8)
+			{
+				out.push_back((unsigned char)acc);
+				acc >>= 8;
+				count -= 8;
+			}
+		}
+		void flush()
+		{
+			if (count > 0)
+				out.push_back((unsigned char)acc);
+			acc = 0;
+			count = 0;
+		}
+	private:
+		std::vector<unsigned char>& out;
+		uint64_t acc;
+		int count;
+	};
+
+	//Keeps 56 to 63 bits ready after a refill, enough for any code but the raw 32 bits of an escape
+	class BitReader
+	{
+	public:
+		//Empty, every refill fails
+		BitReader() : data(nullptr), lastWord(0), next(1), buffer(0), count(0) {}
+		BitReader(const unsigned char* data, size_t size) : data(data), lastWord(size - sizeof(uint64_t)), next(0), buffer(0), count(0) {}
+		//False once the codes are used up, only damaged data gets there
+		bool refill()
+		{
+			if (next > lastWord)
+				return false;
+			refillUnchecked();
+			return true;
+		}
+		//Without the check, for blocks that canReadBlock said fit
+		void refillUnchecked()
+		{
+			uint64_t word;
+			std::memcpy(&word, data + next, sizeof(word));
+			buffer |= word << count;
+			next += (63 - count) >> 3;
+			count |= 56;
+		}
+		//A block of escapes only (5 bits for k, then ESCAPE + 1 + 32 bits per code) stays in the codes
+		bool canReadBlock() const { return next + (5 + BLOCK * (ESCAPE + 1 + 32) + 7) / 8 + 8 <= lastWord; }
+		uint64_t peek() const { return buffer; }
+		void skip(int bits)
+		{
+			buffer >>= bits;
+			count -= bits;
+		}
+	private:
+		const unsigned char* data;
+		size_t lastWord; //Last byte a word may start at
+		size_t next; //First byte not in the buffer
+		uint64_t buffer;
+		int count;
+	};
+
+	//Needs ESCAPE + 1 + k bits in the buffer. An escape refills for its raw bits and again after them, so the buffer
+	//holds as many bits afterwards as a refill leaves.
+	template<bool checked>
+	inline bool readCode(BitReader& reader, int k, uint32_t& zigzag)
+	{
+		uint64_t word = reader.peek();
+		//The bit at ESCAPE stops the count on damaged data, valid escapes have it set anyway
+		int q = countTrailingZeros(word | (1ull << ESCAPE));
+		if (q < ESCAPE)
+		{
+			zigzag = ((uint32_t)q << k) | (uint32_t)((word >> (q + 1)) & ((1ull << k) - 1));
+			reader.skip(q + 1 + k);
+			return true;
+		}
+		reader.skip(ESCAPE + 1);
+		if (checked && !reader.refill())
+			return false;
+		if (!checked)
+			reader.refillUnchecked();
+		zigzag = (uint32_t)reader.peek();
+		reader.skip(32);
+		if (!checked)
+			reader.refillUnchecked();
+		return !checked || reader.refill();
+	}
+
+	//Codes that fit in the 56 bits of one refill, none of them longer than ESCAPE + 1 + k
+	int codesPerRefill(int k)
+	{
+		return std::max(56 / (ESCAPE + 1 + k), 1);
+	}
+
+	//One block of the 4 streams with a refill for every `codes` codes of each. Without bound checks, the readers have
+	//to canReadBlock.
+	template<int codes>
+	void readBlocks(BitReader* readers, const int* k, uint32_t* const* zigzags, int x, int n)
+	{
+		BitReader r0 = readers[0], r1 = readers[1], r2 = readers[2], r3 = readers[3];
+		int i = x;
+		for (; i + codes <= x + n; i += codes)
+		{
+			r0.refillUnchecked();
+			r1.refillUnchecked();
+			r2.refillUnchecked();
+			r3.refillUnchecked();
+			for (int c = 0; c < codes; ++c)
+			{
+				readCode<false>(r0, k[0], zigzags[0][i + c]);
+				readCode<false>(r1, k[1], zigzags[1][i + c]);
+				readCode<false>(r2, k[2], zigzags[2][i + c]);
+				readCode<false>(r3, k[3], zigzags[3][i + c]);
+			}
+		}
+		for (; i < x + n; ++i)
+		{
+			r0.refillUnchecked();
+			r1.refillUnchecked();
+			r2.refillUnchecked();
+			r3.refillUnchecked();
+			readCode<false>(r0, k[0], zigzags[0][i]);
+			readCode<false>(r1, k[1], zigzags[1][i]);
+			readCode<false>(r2, k[2], zigzags[2][i]);
+			readCode<false>(r3, k[3], zigzags[3][i]);
+		}
+		readers[0] = r0;
+		readers[1] = r1;
+		readers[2] = r2;
+		readers[3] = r3;
+	}
+
+	//The zigzagged residuals of rows z to z + count - 1, one row per stream. The codes of the rows are independent, so
+	//decoding them side by side keeps several counts of trailing zeros in flight instead of one long chain.
+	bool readRows(BitReader* readers, int count, int W, uint32_t* const* zigzags)
+	{
+		int k[STREAMS];
+		for (int x = 0; x < W; x += BLOCK)
+		{
+			int n = std::min(BLOCK, W - x);
+			for (int s = 0; s < count; ++s)
+			{
+				if (!readers[s].refill())
+					return false;
+				k[s] = (int)(readers[s].peek() & 31);
+				readers[s].skip(5);
+			}
+			if (count == STREAMS && readers[0].canReadBlock() && readers[1].canReadBlock() &&
+				readers[2].canReadBlock() && readers[3].canReadBlock())
+			{
+				int codes = codesPerRefill(std::max(std::max(k[0], k[1]), std::max(k[2], k[3])));
+				if (codes >= 3)
+					readBlocks<3>(readers, k, zigzags, x, n);
+				else if (codes == 2)
+					readBlocks<2>(readers, k, zigzags, x, n);
+				else
+					readBlocks<1>(readers, k, zigzags, x, n);
+			}
+			else
+			{
+				//The last blocks of the streams, or a pass with less than STREAMS rows left
+				for (int s = 0; s < count; ++s)
+					for (int i = x; i < x + n; ++i)
+						if (!readers[s].refill() || !readCode<true>(readers[s], k[s], zigzags[s][i]))
+							return false;
+			}
+		}
+		return true;
+	}
+
+	int riceCost(const uint32_t* values, int count, int k)
+	{
+		int bits = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			uint32_t q = values[i] >> k;
+			bits += q < (uint32_t)ESCAPE ? (int)q + 1 + k : ESCAPE + 1 + 32;
+		}
+		return bits;
+	}
+
+	//k from the mean, then the neighbours are tried as well
+	int chooseRiceParameter(const uint32_t* values, int count)
+	{
+		uint64_t sum = 0;
+		for (int i = 0; i < count; ++i)
+			sum += values[i];
+		uint64_t mean = sum / count;
+		int estimate = 0;
+		while (estimate < 31 && (2ull << estimate) <= mean)
+			++estimate;
+		int best = estimate, bestCost = riceCost(values, count, estimate);
+		for (int k = std::max(estimate - 2, 0); k <= std::min(estimate + 2, 31); ++k)
+		{
+			int cost = riceCost(values, count, k);
+			if (cost < bestCost)
+			{
+				best = k;
+				bestCost = cost;
+			}
+		}
+		return best;
+	}
+
+	void writeBlock(BitWriter& writer, const uint32_t* values, int count)
+	{
+		int k = chooseRiceParameter(values, count);
+		writer.put((uint64_t)k, 5);
+		uint32_t mask = (uint32_t)((1ull << k) - 1);
+		for (int i = 0; i < count; ++i)
+		{
+			uint32_t q = values[i] >> k;
+			if (q < (uint32_t)ESCAPE)
+			{
+				writer.put(1ull << q, (int)q + 1);
+				writer.put(values[i] & mask, k);
+			}
+			else
+			{
+				writer.put(1ull << ESCAPE, ESCAPE + 1);
+				writer.put(values[i], 32);
+			}
+		}
+	}
+
+	//Integers of the plane in row-major order, as the encoder produced them
+	bool quantize(const HeightField& heights, float maxError, float& low, float& step, std::vector<uint32_t>& values)
+	{
+		float high = -FLT_MAX;
+		low = FLT_MAX;
+		for (size_t i = 0; i < heights.size(); ++i)
+		{
+			low = std::min(low, heights.data()[i]);
+			high = std::max(high, heights.data()[i]);
+		}
+		//Heights half way between two steps are only within the bound of either if the dequantization does not round
+		//away from them, so the steps leave a few float ulps of the largest height to spare
+		float slack = 4.0f * FLT_EPSILON * std::max(std::fabs(low), std::fabs(high));
+		step = 2.0f * (maxError - slack);
+		if (!(step > 0.0f) || !((double)high - low < (double)step * (1u << 30)))
+			return false;
+		values.resize(heights.size());
+		for (size_t i = 0; i < heights.size(); ++i)
+		{
+			float h = heights.data()[i];
+			int32_t q = (int32_t)std::llround(((double)h - low) / step);
+			//Float rounding in the dequantization may push the nearest step out of the bound, its neighbours may not
+			if (!(std::fabs(dequantize((uint32_t)q, low, step) - h) <= maxError))
+			{
+				if (std::fabs(dequantize((uint32_t)(q - 1), low, step) - h) <= maxError)
+					--q;
+				else if (std::fabs(dequantize((uint32_t)(q + 1), low, step) - h) <= maxError)
+					++q;
+				else
+					return false;
+			}
+			values[i] = (uint32_t)q;
+		}
+		return true;
+	}
+
+	//cur[x + 1] = cur[x] + residual[x] + up[x + 1] - up[x], with cur[0] = up[0] = 0. The inverse of the planar predictor.
+	//The residuals are undone from their zigzag here, where it takes a few vector instructions per 4.
+	void reconstructRow(const uint32_t* zigzags, const uint32_t* up, uint32_t* cur, int W)
+	{
+		int x = 0;
+#ifdef PROGEN_SSE2
+		const __m128i one = _mm_set1_epi32(1);
+		__m128i carry = _mm_setzero_si128();
+		for (; x + 4 <= W; x += 4)
+		{
+			__m128i zigzag = _mm_loadu_si128((const __m128i*)(zigzags + x));
+			__m128i r = _mm_xor_si128(_mm_srli_epi32(zigzag, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zigzag, one)));
+			__m128i b = _mm_loadu_si128((const __m128i*)(up + x + 1));
+			__m128i c = _mm_loadu_si128((const __m128i*)(up + x));
+			__m128i d = _mm_add_epi32(r, _mm_sub_epi32(b, c));
+			//Inclusive prefix sum of the 4 lanes, plus the last value of the previous 4
+			d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+			d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+			d = _mm_add_epi32(d, carry);
+			_mm_storeu_si128((__m128i*)(cur + x + 1), d);
+			carry = _mm_shuffle_epi32(d, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+#endif
+		for (; x < W; ++x)
+			cur[x + 1] = cur[x] + ((zigzags[x] >> 1) ^ (0u - (zigzags[x] & 1u))) + up[x + 1] - up[x];
+	}
+
+	void convertRow(const uint32_t* values, float* out, int W, bool lossless, float low, float step)
+	{
+		int x = 0;
+#ifdef PROGEN_SSE2
+		if (lossless)
+		{
+			const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+			for (; x + 4 <= W; x += 4)
+			{
+				__m128i o = _mm_loadu_si128((const __m128i*)(values + x));
+				//Ordered values below the sign bit were negative and get all bits flipped, the others only the sign
+				__m128i negative = _mm_srai_epi32(_mm_xor_si128(o, sign), 31);
+				__m128i bits = _mm_xor_si128(o, _mm_or_si128(negative, sign));
+				_mm_storeu_ps(out + x, _mm_castsi128_ps(bits));
+			}
+		}
+		else
+		{
+			const __m128 lowV = _mm_set1_ps(low);
+			const __m128 stepV = _mm_set1_ps(step);
+			for (; x + 4 <= W; x += 4)
+			{
+				__m128 q = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(values + x)));
+				_mm_storeu_ps(out + x, _mm_add_ps(lowV, _mm_mul_ps(q, stepV)));
+			}
+		}
+#endif
+		for (; x < W; ++x)
+			out[x] = lossless ? fromOrderedBits(values[x]) : dequantize(values[x], low, step);
+	}
+}
+
+void HeightCodec::encode(const HeightField& heights, float maxError, std::vector<unsigned char>& bytes)
+{
+	int W = heights.getWidth();
+	int H = heights.getHeight();
+	CodecHeader header = {};
+	header.magic = CODEC_MAGIC;
+	header.version = CODEC_VERSION;
+	header.width = (uint32_t)W;
+	header.height = (uint32_t)H;
+
+	std::vector<uint32_t> values;
+	bool quantized = quantize(heights, maxError, header.low, header.step, values);
+	if (!quantized)
+	{
+		values.resize(heights.size());
+		for (size_t i = 0; i < heights.size(); ++i)
+			values[i] = orderedBits(heights.data()[i]);
+		header.low = 0.0f;
+		header.step = 0.0f;
+	}
+	header.mode = quantized ? MODE_QUANTIZED : MODE_LOSSLESS;
+
+	//Residuals against the plane through the left, upper and upper-left neighbours, zigzagged. Blocks do not cross rows.
+	std::vector<unsigned char> streams[STREAMS];
+	std::vector<BitWriter> writers;
+	for (int s = 0; s < STREAMS; ++s)
+		writers.emplace_back(streams[s]);
+	uint32_t block[BLOCK];
+	int blockCount = 0;
+	for (int z = 0; z < H; ++z)
+	{
+		const uint32_t* cur = values.data() + (size_t)z * W;
+		const uint32_t* up = z > 0 ? cur - W : nullptr;
+		for (int x = 0; x < W; ++x)
+		{
+			uint32_t a = x > 0 ? cur[x - 1] : 0;
+			uint32_t b = up != nullptr ? up[x] : 0;
+			uint32_t c = up != nullptr && x > 0 ? up[x - 1] : 0;
+			int32_t residual = (int32_t)(cur[x] - (a + b - c));
+			block[blockCount++] = ((uint32_t)residual << 1) ^ (uint32_t)(residual >> 31);
+			if (blockCount == BLOCK || x == W - 1)
+			{
+				writeBlock(writers[z % STREAMS], block, blockCount);
+				blockCount = 0;
+			}
+		}
+	}
+
+	for (int s = 0; s < STREAMS; ++s)
+	{
+		writers[s].flush();
+		header.streamBytes[s] = (uint32_t)streams[s].size();
+	}
+	bytes.insert(bytes.end(), (const unsigned char*)&header, (const unsigned char*)&header + sizeof(header));
+	for (int s = 0; s < STREAMS; ++s)
+	{
+		bytes.insert(bytes.end(), streams[s].begin(), streams[s].end());
+		bytes.insert(bytes.end(), PADDING, 0);
+	}
+}
+
+bool HeightCodec::decode(const unsigned char* bytes, size_t size, HeightField& heights)
+{
+	CodecHeader header;
+	if (size < sizeof(header))
+		return false;
+	std::memcpy(&header, bytes, sizeof(header));
+	if (header.magic != CODEC_MAGIC || header.version != CODEC_VERSION || header.mode > MODE_LOSSLESS)
+		return false;
+	BitReader readers[STREAMS];
+	size_t offset = sizeof(header);
+	for (int s = 0; s < STREAMS; ++s)
+	{
+		size_t streamSize = (size_t)header.streamBytes[s] + PADDING;
+		if (offset + streamSize > size)
+			return false;
+		readers[s] = BitReader(bytes + offset, streamSize);
+		offset += streamSize;
+	}
+	//Every height takes at least one bit, which also keeps a damaged size from allocating a huge plane
+	if (offset != size || (uint64_t)header.width * header.height > (uint64_t)(size - sizeof(header)) * 8 ||
+		header.width > 0x7fffffffu || header.height > 0x7fffffffu)
+		return false;
+	int W = (int)header.width;
+	int H = (int)header.height;
+	bool lossless = header.mode == MODE_LOSSLESS;
+	if (heights.getWidth() != W || heights.getHeight() != H)
+		heights.resize(W, H);
+
+	//Two rows of integers with a zero in front, and the residuals of the rows of one pass over the streams
+	std::vector<uint32_t> rowA(W + 1, 0), rowB(W + 1, 0), zigzagRows((size_t)STREAMS * W);
+	uint32_t* zigzags[STREAMS];
+	for (int s = 0; s < STREAMS; ++s)
+		zigzags[s] = zigzagRows.data() + (size_t)s * W;
+	uint32_t* up = rowA.data();
+	uint32_t* cur = rowB.data();
+	for (int z = 0; z < H; z += STREAMS)
+	{
+		int count = std::min(STREAMS, H - z);
+		if (!readRows(readers, count, W, zigzags))
+			return false;
+		for (int s = 0; s < count; ++s)
+		{
+			reconstructRow(zigzags[s], up, cur, W);
+			convertRow(cur + 1, heights.row(z + s), W, lossless, header.low, header.step);
+			std::swap(up, cur);
+		}
+	}
+	return true;
+}
+
+bool HeightCodec::isLossless(const unsigned char* bytes, size_t size)
+{
+	CodecHeader header;
+	if (size < sizeof(header))
+		return false;
+	std::memcpy(&header, bytes, sizeof(header));
+	return header.magic == CODEC_MAGIC && header.mode == MODE_LOSSLESS;
+}
@@ -0,0 +1,38 @@
+#ifndef HEIGHT_CODEC_H
+#define HEIGHT_CODEC_H
+
+#include <vector>
+#include <cstddef>
+
+#include "HeightField.h"
+
+/*
+	Compression of height planes for the tile cache and the height map files. No dependencies.
+
+	1) The heights are quantized to integers with steps of just under 2 * maxError above the lowest height, so every
+	   decoded height is within maxError of the original (checked per sample while encoding). A maxError of 0, or one too
+	   small for float precision over the range of the map, keeps the exact floats instead, as integers that are
+	   ordered like the values.
+	2) Each integer is predicted from the plane through its left, upper and upper-left neighbours (left + up - upLeft),
+	   which is exact on slopes, and only the residual is kept. The planar predictor is used instead of Paeth/MED
+	   since its inverse is a vertical add and a horizontal prefix sum, which run 4 samples at a time (SSE2).
+	3) The zigzagged residuals are Golomb-Rice coded in blocks of 64 (within a row) with the best k of each block.
+	   Quotients of 12 and up are escaped to 32 raw bits, so a cliff costs a few bytes instead of a long unary run.
+
+	The rows are spread over 4 independent code streams (row z in stream z % 4). Decoding reads the codes of 4 rows side
+	by side, with 64-bit loads, a count of trailing zeros per value and a refill for every few values, then rebuilds the
+	rows with the vector predictor inverse and conversion. That is about 1 GB/s of floats on one core.
+*/
+
+class HeightCodec
+{
+public:
+	//Appends the encoded plane to bytes
+	static void encode(const HeightField& heights, float maxError, std::vector<unsigned char>& bytes);
+	//size has to be exactly the size of one encoded plane
+	static bool decode(const unsigned char* bytes, size_t size, HeightField& heights);
+	//True if the plane was stored exactly (maxError 0 or too small to quantize)
+	static bool isLossless(const unsigned char* bytes, size_t size);
+};
+
+#endif
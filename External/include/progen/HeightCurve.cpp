@@ -0,0 +1,37 @@
+#include "HeightCurve.h"
+
+HeightCurve::HeightCurve()
+{
+	const float linear[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+	set(linear);
+}
+
+HeightCurve::HeightCurve(const float controlPoints[4])
+{
+	set(controlPoints);
+}
+
+void HeightCurve::set(const float controlPoints[4])
+{
+	//Same arithmetic as bezier_table in curveEditor.cpp, only the y coordinates are needed
+	Y[0] = 0.0f;
+	Y[1] = controlPoints[1];
+	Y[2] = controlPoints[3];
+	Y[3] = 1.0f;
+	for (int step = 0; step <= STEPS; ++step)
+	{
+		float t = (float)step / (float)STEPS;
+		float k0 = (1 - t) * (1 - t) * (1 - t);
+		float k1 = 3 * (1 - t) * (1 - t) * t;
+		float k2 = 3 * (1 - t) * t * t;
+		float k3 = t * t * t;
+		table[step] = k0 * Y[0] + k1 * Y[1] + k2 * Y[2] + k3 * Y[3];
+	}
+}
+
+float HeightCurve::derivative(float t) const
+{
+	if (t < 0.0f || t > 1.0f)
+		return 0.0f;
+	return 3 * (1 - t) * (1 - t) * (Y[1] - Y[0]) + 6 * (1 - t) * t * (Y[2] - Y[1]) + 3 * t * t * (Y[3] - Y[2]);
+}
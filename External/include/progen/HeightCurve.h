@@ -0,0 +1,33 @@
+#ifndef HEIGHT_CURVE_H
+#define HEIGHT_CURVE_H
+
+/*
+	The height curve of the curve editor without ImGui, so it can be used outside of the app.
+
+	ImGui::BezierValue builds a table of the whole curve on every call and picks the closest step, which is far too
+	slow to call per vertex. HeightCurve builds the same table once for the control points and looks the heights up,
+	so the results are the same as BezierValue's.
+*/
+
+class HeightCurve
+{
+public:
+	static const int STEPS = 256;
+
+	HeightCurve();
+	//controlPoints: (x1,y1,x2,y2) of the cubic Bezier from (0,0) to (1,1)
+	explicit HeightCurve(const float controlPoints[4]);
+	void set(const float controlPoints[4]);
+	//t is clamped to [0,1]
+	float evaluate(float t) const
+	{
+		return table[(int)((t < 0 ? 0 : t > 1 ? 1 : t) * STEPS)];
+	}
+	//Slope of the curve the table samples, 0 outside of [0,1] where evaluate is clamped
+	float derivative(float t) const;
+private:
+	float table[STEPS + 1];
+	float Y[4];
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "HeightField.h"
+
+#include <utility>
+
+HeightField::HeightField()
+	:
+	W(0),
+	H(0)
+{}
+
+HeightField::HeightField(int W_in, int H_in, float value)
+	:
+	W(W_in),
+	H(H_in),
+	heights((size_t)W_in * H_in, value)
+{}
+
+void HeightField::resize(int W_in, int H_in, float value)
+{
+	W = W_in;
+	H = H_in;
+	heights.assign((size_t)W * H, value);
+}
+
+void HeightField::swap(HeightField& other)
+{
+	std::swap(W, other.W);
+	std::swap(H, other.H);
+	heights.swap(other.heights);
+}
+
+int HeightField::getWidth() const
+{
+	return W;
+}
+
+int HeightField::getHeight() const
+{
+	return H;
+}
+
+size_t HeightField::size() const
+{
+	return heights.size();
+}
+
+float* HeightField::data()
+{
+	return heights.data();
+}
+
+const float* HeightField::data() const
+{
+	return heights.data();
+}
@@ -0,0 +1,37 @@
+#ifndef HEIGHT_FIELD_H
+#define HEIGHT_FIELD_H
+
+#include <vector>
+#include <cstddef>
+
+/*
+	Contiguous row-major height plane.
+	Row z starts at data() + z * W, so a whole map is a single allocation and rows can be handed
+	to SIMD kernels or worker threads as plain pointers.
+
+	W is the number of samples in the x axis (numXVertices), H is the number of samples in the z axis (numZVertices).
+*/
+
+class HeightField
+{
+public:
+	HeightField();
+	HeightField(int W_in, int H_in, float value = 0.0f);
+	void resize(int W_in, int H_in, float value = 0.0f);
+	void swap(HeightField& other);
+	int getWidth() const;
+	int getHeight() const;
+	size_t size() const;
+	//Accessors are kept in the header since they are called per sample in the hot loops
+	float& at(int x, int z) { return heights[(size_t)z * W + x]; }
+	float at(int x, int z) const { return heights[(size_t)z * W + x]; }
+	float* row(int z) { return heights.data() + (size_t)z * W; }
+	const float* row(int z) const { return heights.data() + (size_t)z * W; }
+	float* data();
+	const float* data() const;
+private:
+	int W, H;
+	std::vector<float> heights;
+};
+
+#endif
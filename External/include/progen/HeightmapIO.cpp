@@ -0,0 +1,192 @@
+#include "HeightmapIO.h"
+#include "MappedFile.h"
+#include "BufferedWriter.h"
+#include "HeightCodec.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+namespace
+{
+	/*
+		Header of a binary PGM: magic, width, height and maxval separated by whitespace or comments, then exactly one
+		whitespace character before the samples.
+	*/
+	bool parsePGMHeader(const MappedFile& file, int& W, int& H, int& maxValue, size_t& offset)
+	{
+		const unsigned char* data = file.data();
+		size_t size = file.size();
+		if (size < 2 || data[0] != 'P' || data[1] != '5')
+			return false;
+		size_t pos = 2;
+		int values[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			while (pos < size && (std::isspace(data[pos]) || data[pos] == '#'))
+			{
+				if (data[pos] == '#')
+					while (pos < size && data[pos] != '\n')
+						++pos;
+				else
+					++pos;
+			}
+			if (pos >= size || !std::isdigit(data[pos]))
+				return false;
+			long value = 0;
+			while (pos < size && std::isdigit(data[pos]) && value < (1 << 30))
+				value = value * 10 + (data[pos++] - '0');
+			values[i] = (int)value;
+		}
+		if (pos >= size || !std::isspace(data[pos]))
+			return false;
+		W = values[0];
+		H = values[1];
+		maxValue = values[2];
+		offset = pos + 1;
+		int bytesPerSample = maxValue > 255 ? 2 : 1;
+		return W > 0 && H > 0 && maxValue > 0 && maxValue <= 65535 && offset + (size_t)W * H * bytesPerSample <= size;
+	}
+
+	void writeHeightRows(BufferedWriter& out, const HeightField& heights, float low, float high, bool bigEndian)
+	{
+		int W = heights.getWidth();
+		float scale = high > low ? 65535.0f / (high - low) : 0.0f;
+		std::vector<unsigned char> row((size_t)W * 2);
+		for (int z = 0; z < heights.getHeight(); ++z)
+		{
+			const float* in = heights.row(z);
+			for (int x = 0; x < W; ++x)
+			{
+				uint16_t sample = HeightmapIO::toSample(in[x], low, scale);
+				row[2 * x + (bigEndian ? 0 : 1)] = (unsigned char)(sample >> 8);
+				row[2 * x + (bigEndian ? 1 : 0)] = (unsigned char)(sample & 0xff);
+			}
+			out.write(row.data(), row.size());
+		}
+	}
+
+	//Samples of the mapped file into the height field, rows split over the ThreadPool
+	void readHeightRows(const unsigned char* samples, int bytesPerSample, bool bigEndian, float low, float step, HeightField& heights)
+	{
+		int W = heights.getWidth();
+		ThreadPool::global().parallelFor(0, heights.getHeight(), [&](int begin, int end)
+		{
+			PROFILE_ZONE("read rows");
+			for (int z = begin; z < end; ++z)
+			{
+				const unsigned char* in = samples + (size_t)z * W * bytesPerSample;
+				float* out = heights.row(z);
+				if (bytesPerSample == 1)
+					for (int x = 0; x < W; ++x)
+						out[x] = HeightmapIO::fromSample(in[x], low, step);
+				else if (bigEndian)
+					for (int x = 0; x < W; ++x)
+						out[x] = HeightmapIO::fromSample((uint16_t)(in[2 * x] << 8 | in[2 * x + 1]), low, step);
+				else
+					for (int x = 0; x < W; ++x)
+						out[x] = HeightmapIO::fromSample((uint16_t)(in[2 * x] | in[2 * x + 1] << 8), low, step);
+			}
+		}, 64);
+	}
+}
+
+bool HeightmapIO::writePGM(const char* path, const HeightField& heights, float low, float high)
+{
+	BufferedWriter out;
+	if (!out.open(path))
+		return false;
+	char header[64];
+	int size = std::snprintf(header, sizeof(header), "P5\n%d %d\n65535\n", heights.getWidth(), heights.getHeight());
+	out.write(header, (size_t)size);
+	writeHeightRows(out, heights, low, high, true);
+	return out.close();
+}
+
+bool HeightmapIO::readPGM(const char* path, HeightField& heights, float low, float high)
+{
+	PROFILE_ZONE("read pgm");
+	MappedFile file;
+	int W, H, maxValue;
+	size_t offset;
+	if (!file.open(path) || !parsePGMHeader(file, W, H, maxValue, offset))
+		return false;
+	heights.resize(W, H);
+	readHeightRows(file.data() + offset, maxValue > 255 ? 2 : 1, true, low, (high - low) / maxValue, heights);
+	return true;
+}
+
+bool HeightmapIO::writeRAW(const char* path, const HeightField& heights, float low, float high)
+{
+	BufferedWriter out;
+	if (!out.open(path))
+		return false;
+	writeHeightRows(out, heights, low, high, false);
+	return out.close();
+}
+
+bool HeightmapIO::readRAW(const char* path, int W, int H, HeightField& heights, float low, float high)
+{
+	PROFILE_ZONE("read raw");
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+	size_t samples = file.size() / 2;
+	if (W <= 0 || H <= 0)
+	{
+		W = 1;
+		while ((size_t)(W + 1) * (W + 1) <= samples)
+			++W;
+		H = W;
+	}
+	if ((size_t)W * H != samples || file.size() % 2 != 0)
+		return false;
+	heights.resize(W, H);
+	readHeightRows(file.data(), 2, false, low, (high - low) / 65535.0f, heights);
+	return true;
+}
+
+bool HeightmapIO::writeCompressed(const char* path, const HeightField& heights, float maxError)
+{
+	std::vector<unsigned char> bytes;
+	HeightCodec::encode(heights, maxError, bytes);
+	BufferedWriter out;
+	if (!out.open(path))
+		return false;
+	out.write(bytes.data(), bytes.size());
+	return out.close();
+}
+
+bool HeightmapIO::readCompressed(const char* path, HeightField& heights)
+{
+	PROFILE_ZONE("read compressed");
+	MappedFile file;
+	return file.open(path) && HeightCodec::decode(file.data(), file.size(), heights);
+}
+
+bool HeightmapIO::writeBiomePGM(const char* path, const std::vector<unsigned char>& biomeMap, int W, int H)
+{
+	if (biomeMap.size() != (size_t)W * H)
+		return false;
+	BufferedWriter out;
+	if (!out.open(path))
+		return false;
+	char header[64];
+	int size = std::snprintf(header, sizeof(header), "P5\n%d %d\n255\n", W, H);
+	out.write(header, (size_t)size);
+	out.write(biomeMap.data(), biomeMap.size());
+	return out.close();
+}
+
+bool HeightmapIO::readBiomePGM(const char* path, std::vector<unsigned char>& biomeMap, int& W, int& H)
+{
+	MappedFile file;
+	int maxValue;
+	size_t offset;
+	if (!file.open(path) || !parsePGMHeader(file, W, H, maxValue, offset) || maxValue > 255)
+		return false;
+	biomeMap.assign(file.data() + offset, file.data() + offset + (size_t)W * H);
+	return true;
+}
@@ -0,0 +1,47 @@
+#ifndef HEIGHTMAP_IO_H
+#define HEIGHTMAP_IO_H
+
+#include <vector>
+#include <cstdint>
+
+#include "HeightField.h"
+
+/*
+	Height maps and biome maps as images for other tools.
+
+	Heights are mapped linearly from [low, high] to [0, 65535] and clamped. The generator exchanges its height map,
+	so the defaults are [0, 1].
+	PGM is the binary 16-bit grayscale P5 (maxval 65535, big endian samples as the format requires), 8-bit PGMs are
+	read as well. RAW is headerless 16-bit little endian, the usual terrain tool layout. Reading a RAW with a W and H
+	of 0 takes a square map from the file size.
+	Compressed files (.pghc) are one HeightCodec plane of the floats themselves, exact with a maxError of 0.
+	Biome maps are 8-bit PGMs of the biome IDs (BiomeID).
+
+	Files are read through a MappedFile and converted in bands of rows on the ThreadPool.
+	Very large maps should use TiledHeightmap instead.
+*/
+
+class HeightmapIO
+{
+public:
+	static bool writePGM(const char* path, const HeightField& heights, float low = 0.0f, float high = 1.0f);
+	static bool readPGM(const char* path, HeightField& heights, float low = 0.0f, float high = 1.0f);
+	static bool writeRAW(const char* path, const HeightField& heights, float low = 0.0f, float high = 1.0f);
+	static bool readRAW(const char* path, int W, int H, HeightField& heights, float low = 0.0f, float high = 1.0f);
+	static bool writeCompressed(const char* path, const HeightField& heights, float maxError = 0.0f);
+	static bool readCompressed(const char* path, HeightField& heights);
+	static bool writeBiomePGM(const char* path, const std::vector<unsigned char>& biomeMap, int W, int H);
+	static bool readBiomePGM(const char* path, std::vector<unsigned char>& biomeMap, int& W, int& H);
+	//Kept in the header since they are called per sample
+	static uint16_t toSample(float height, float low, float scale)
+	{
+		float v = (height - low) * scale;
+		return v <= 0.0f ? (uint16_t)0 : v >= 65535.0f ? (uint16_t)65535 : (uint16_t)(v + 0.5f);
+	}
+	static float fromSample(uint16_t sample, float low, float step)
+	{
+		return low + sample * step;
+	}
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "HorizonCuller.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+	const float BINS_PER_RADIAN = HorizonCuller::BIN_COUNT / (2.0f * PI);
+
+	float wrapAngle(float a)
+	{
+		while (a > PI)
+			a -= 2.0f * PI;
+		while (a <= -PI)
+			a += 2.0f * PI;
+		return a;
+	}
+}
+
+HorizonCuller::HorizonCuller()
+	:
+	patchesX(0),
+	patchesZ(0),
+	origin(0.0f),
+	patchSize(0.0f)
+{}
+
+void HorizonCuller::build(const HeightField& heights, float W, float L)
+{
+	clear();
+	int cellsX = heights.getWidth() - 1;
+	int cellsZ = heights.getHeight() - 1;
+	if (cellsX < 1 || cellsZ < 1)
+		return;
+
+	patchesX = (cellsX + PATCH_CELLS - 1) / PATCH_CELLS;
+	patchesZ = (cellsZ + PATCH_CELLS - 1) / PATCH_CELLS;
+	glm::vec2 cellSize(W / cellsX, L / cellsZ);
+	patchSize = cellSize * (float)PATCH_CELLS;
+	origin = glm::vec2(-0.5f * W, -0.5f * L);
+	patches.resize((size_t)patchesX * patchesZ);
+	visible.assign(patches.size(), 1);
+
+	//Bilinear cells stay between the min and max of their corners, so the samples give the exact range of the surface
+	ThreadPool::global().parallelFor(0, patchesZ, [&](int begin, int end)
+	{
+		for (int pz = begin; pz < end; ++pz)
+		{
+			for (int px = 0; px < patchesX; ++px)
+			{
+				int x0 = px * PATCH_CELLS, x1 = std::min(x0 + PATCH_CELLS, cellsX);
+				int z0 = pz * PATCH_CELLS, z1 = std::min(z0 + PATCH_CELLS, cellsZ);
+				Patch& patch = patches[(size_t)pz * patchesX + px];
+				patch.minX = origin.x + x0 * cellSize.x;
+				patch.maxX = origin.x + x1 * cellSize.x;
+				patch.minZ = origin.y + z0 * cellSize.y;
+				patch.maxZ = origin.y + z1 * cellSize.y;
+				patch.minY = FLT_MAX;
+				patch.maxY = -FLT_MAX;
+				for (int z = z0; z <= z1; ++z)
+				{
+					const float* row = heights.row(z);
+					for (int x = x0; x <= x1; ++x)
+					{
+						patch.minY = std::min(patch.minY, row[x]);
+						patch.maxY = std::max(patch.maxY, row[x]);
+					}
+				}
+			}
+		}
+	});
+}
+
+void HorizonCuller::clear()
+{
+	patches.clear();
+	visible.clear();
+	patchesX = patchesZ = 0;
+}
+
+bool HorizonCuller::isValid() const
+{
+	return !patches.empty();
+}
+
+bool HorizonCuller::angularSpan(const Patch& patch, const glm::vec3& eye, float& binBegin, float& binEnd) const
+{
+	if (eye.x >= patch.minX && eye.x <= patch.maxX && eye.z >= patch.minZ && eye.z <= patch.maxZ)
+		return false;
+
+	//Seen from outside the box spans less than pi, so the corners measured from the direction of its center give the range
+	float center = std::atan2(0.5f * (patch.minZ + patch.maxZ) - eye.z, 0.5f * (patch.minX + patch.maxX) - eye.x);
+	float lo = FLT_MAX, hi = -FLT_MAX;
+	const float xs[2] = { patch.minX, patch.maxX };
+	const float zs[2] = { patch.minZ, patch.maxZ };
+	for (float x : xs)
+	{
+		for (float z : zs)
+		{
+			float relative = wrapAngle(std::atan2(z - eye.z, x - eye.x) - center);
+			lo = std::min(lo, relative);
+			hi = std::max(hi, relative);
+		}
+	}
+	//Bins start at -pi
+	binBegin = (center + lo + PI) * BINS_PER_RADIAN;
+	binEnd = (center + hi + PI) * BINS_PER_RADIAN;
+	if (binBegin < 0.0f)
+	{
+		binBegin += BIN_COUNT;
+		binEnd += BIN_COUNT;
+	}
+	return true;
+}
+
+void HorizonCuller::addOccluder(const Patch& patch, const glm::vec3& eye)
+{
+	float binBegin, binEnd;
+	if (!angularSpan(patch, eye, binBegin, binEnd))
+		return;
+
+	//A ray crosses the patch somewhere between the nearest and the farthest point, so the slope that surely passes
+	//under minY there is the flattest one over that range
+	float dx = std::max(std::max(patch.minX - eye.x, eye.x - patch.maxX), 0.0f);
+	float dz = std::max(std::max(patch.minZ - eye.z, eye.z - patch.maxZ), 0.0f);
+	float nearest = std::sqrt(dx * dx + dz * dz);
+	float fx = std::max(std::fabs(patch.minX - eye.x), std::fabs(patch.maxX - eye.x));
+	float fz = std::max(std::fabs(patch.minZ - eye.z), std::fabs(patch.maxZ - eye.z));
+	float farthest = std::sqrt(fx * fx + fz * fz);
+	float rise = patch.minY - eye.y;
+	float slope = rise >= 0.0f ? rise / farthest : rise / std::max(nearest, 1e-6f);
+
+	//Only bins covered completely
+	for (int b = (int)std::ceil(binBegin); b + 1 <= (int)std::floor(binEnd); ++b)
+	{
+		float& h = horizon[b % BIN_COUNT];
+		h = std::max(h, slope);
+	}
+}
+
+size_t HorizonCuller::cull(const glm::vec3& eye)
+{
+	if (!isValid())
+		return 0;
+
+	horizon.assign(BIN_COUNT, -FLT_MAX);
+	order.resize(patches.size());
+	for (size_t i = 0; i < patches.size(); ++i)
+	{
+		const Patch& patch = patches[i];
+		float dx = std::max(std::max(patch.minX - eye.x, eye.x - patch.maxX), 0.0f);
+		float dz = std::max(std::max(patch.minZ - eye.z, eye.z - patch.maxZ), 0.0f);
+		order[i] = std::make_pair(std::sqrt(dx * dx + dz * dz), (int)i);
+	}
+	std::sort(order.begin(), order.end());
+
+	pending.clear();
+	size_t visibleCount = 0;
+	for (const std::pair<float, int>& entry : order)
+	{
+		float nearest = entry.first;
+		const Patch& patch = patches[entry.second];
+
+		//Occluders that lie completely in front of this patch go into the horizon
+		while (!pending.empty() && pending.front().farthest <= nearest)
+		{
+			addOccluder(patches[pending.front().patch], eye);
+			std::pop_heap(pending.begin(), pending.end());
+			pending.pop_back();
+		}
+
+		bool isVisible = true;
+		float binBegin, binEnd;
+		if (angularSpan(patch, eye, binBegin, binEnd))
+		{
+			//Steepest slope to the top of the patch
+			float fx = std::max(std::fabs(patch.minX - eye.x), std::fabs(patch.maxX - eye.x));
+			float fz = std::max(std::fabs(patch.minZ - eye.z), std::fabs(patch.maxZ - eye.z));
+			float farthest = std::sqrt(fx * fx + fz * fz);
+			float rise = patch.maxY - eye.y;
+			float slope = rise >= 0.0f ? rise / std::max(nearest, 1e-6f) : rise / farthest;
+
+			isVisible = false;
+			for (int b = (int)std::floor(binBegin); b <= (int)std::floor(binEnd) && !isVisible; ++b)
+				isVisible = slope >= horizon[b % BIN_COUNT];
+
+			Pending occluder;
+			occluder.farthest = farthest;
+			occluder.patch = entry.second;
+			pending.push_back(occluder);
+			std::push_heap(pending.begin(), pending.end());
+		}
+		visible[entry.second] = isVisible ? 1 : 0;
+		if (isVisible)
+			++visibleCount;
+	}
+	return visibleCount;
+}
+
+bool HorizonCuller::isPatchVisible(int px, int pz) const
+{
+	return visible[(size_t)pz * patchesX + px] != 0;
+}
+
+bool HorizonCuller::isVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	if (!isValid())
+		return true;
+
+	int px0 = std::max((int)std::floor((boundsMin.x - origin.x) / patchSize.x), 0);
+	int px1 = std::min((int)std::floor((boundsMax.x - origin.x) / patchSize.x), patchesX - 1);
+	int pz0 = std::max((int)std::floor((boundsMin.z - origin.y) / patchSize.y), 0);
+	int pz1 = std::min((int)std::floor((boundsMax.z - origin.y) / patchSize.y), patchesZ - 1);
+	for (int pz = pz0; pz <= pz1; ++pz)
+		for (int px = px0; px <= px1; ++px)
+			if (visible[(size_t)pz * patchesX + px])
+				return true;
+	return px0 > px1 || pz0 > pz1;
+}
+
+int HorizonCuller::getPatchCountX() const
+{
+	return patchesX;
+}
+
+int HorizonCuller::getPatchCountZ() const
+{
+	return patchesZ;
+}
+
+void HorizonCuller::getPatchBounds(int px, int pz, glm::vec3& boundsMin, glm::vec3& boundsMax) const
+{
+	const Patch& patch = patches[(size_t)pz * patchesX + px];
+	boundsMin = glm::vec3(patch.minX, patch.minY, patch.minZ);
+	boundsMax = glm::vec3(patch.maxX, patch.maxY, patch.maxZ);
+}
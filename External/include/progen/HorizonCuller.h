@@ -0,0 +1,73 @@
+#ifndef HORIZON_CULLER_H
+#define HORIZON_CULLER_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "HeightField.h"
+
+/*
+	Occlusion culling of terrain patches against a 1D horizon around the camera.
+
+	The terrain is split into patches of PATCH_CELLS x PATCH_CELLS cells with the min and max height of the surface
+	over each one. cull() walks the patches front to back. The horizon holds, per azimuth bin, the steepest slope
+	(height over distance) below which every ray is known to be blocked. A patch is hidden if the slope to its top
+	stays under the horizon in every bin it covers. Afterwards the patch itself becomes an occluder.
+
+	Two things keep it conservative:
+	- A patch occludes with its min height (the whole footprint is at least that high) and only in the bins it
+	  covers completely. Using the max height would hide things behind the peaks of its own surface.
+	- An occluder is added to the horizon only once the patches still to be tested are all farther than its farthest
+	  point, so nothing is ever hidden by something behind it.
+
+	REFERENCE: Downs, Moller, Sequin - Occlusion Horizons for Driving through Urban Scenery (2001)
+*/
+
+class HorizonCuller
+{
+public:
+	static const int PATCH_CELLS = 8;
+	static const int BIN_COUNT = 2048;
+
+	HorizonCuller();
+	//Scaled heights of the terrain (the ones the mesh uses), centered at the origin with W x L extents
+	void build(const HeightField& heights, float W, float L);
+	void clear();
+	bool isValid() const;
+	//Updates the visibility of every patch for the given eye position. Returns the number of visible patches.
+	size_t cull(const glm::vec3& eye);
+	bool isPatchVisible(int px, int pz) const;
+	//Whether any patch under the xz extents of the box was visible in the last cull
+	bool isVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+	int getPatchCountX() const;
+	int getPatchCountZ() const;
+	//World bounds of a patch
+	void getPatchBounds(int px, int pz, glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+private:
+	struct Patch
+	{
+		float minX, minZ, maxX, maxZ;
+		float minY, maxY;
+	};
+	struct Pending
+	{
+		float farthest;
+		int patch;
+		bool operator<(const Pending& other) const { return farthest > other.farthest; } //Min-heap on farthest
+	};
+	//Azimuth range of the patch seen from the eye, in bins (unwrapped, end can pass BIN_COUNT). False if the eye is above the patch.
+	bool angularSpan(const Patch& patch, const glm::vec3& eye, float& binBegin, float& binEnd) const;
+	void addOccluder(const Patch& patch, const glm::vec3& eye);
+private:
+	std::vector<Patch> patches;
+	int patchesX, patchesZ;
+	glm::vec2 origin; //World corner of patch (0, 0)
+	glm::vec2 patchSize;
+	std::vector<float> horizon;
+	std::vector<unsigned char> visible;
+	std::vector<std::pair<float, int>> order; //Scratch: nearest distance and patch, sorted front to back
+	std::vector<Pending> pending;
+};
+
+#endif
@@ -0,0 +1,388 @@
+#include "Hydrology.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+
+namespace
+{
+	//Neighbours in counter-clockwise order starting from +x. Even indices are cardinal, odd ones diagonal.
+	const int DX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+	const int DZ[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+	const float DIST[8] = { 1.0f, 1.41421356f, 1.0f, 1.41421356f, 1.0f, 1.41421356f, 1.0f, 1.41421356f };
+	//D-Infinity facets: each one is spanned by a cardinal and a diagonal neighbour
+	const int FACET_CARDINAL[8] = { 0, 2, 2, 4, 4, 6, 6, 0 };
+	const int FACET_DIAGONAL[8] = { 1, 1, 3, 3, 5, 5, 7, 7 };
+
+	const unsigned char NO_FLOW = 255;
+	//Donor counts need 4 bits. The high bit marks cells that had no donors at all, where the sweep starts.
+	const unsigned char SOURCE_BIT = 0x80;
+	const unsigned char COUNT_MASK = 0x7f;
+
+	const float QUARTER_PI = 0.78539816f;
+
+	inline void atomicAdd(std::atomic<float>& target, float value)
+	{
+		float old = target.load(std::memory_order_relaxed);
+		while (!target.compare_exchange_weak(old, old + value, std::memory_order_relaxed))
+			;
+	}
+}
+
+Hydrology::Hydrology()
+	:
+	W(0),
+	H(0),
+	flowMethod(FlowMethod::D8),
+	cellCapacity(0)
+{}
+
+void Hydrology::reserveCells(size_t cellCount)
+{
+	if (cellCount <= cellCapacity)
+		return;
+	donors.reset(new std::atomic<unsigned char>[cellCount]);
+	accumulation.reset(new std::atomic<float>[cellCount]);
+	cellCapacity = cellCount;
+}
+
+void Hydrology::fillDepressions(HeightField& heightMap, float epsilon)
+{
+	PROFILE_ZONE("hydrology");
+	W = heightMap.getWidth();
+	H = heightMap.getHeight();
+	size_t cellCount = (size_t)W * H;
+	reserveCells(cellCount);
+
+	//donors doubles as the closed set here
+	std::atomic<unsigned char>* closed = donors.get();
+	for (size_t i = 0; i < cellCount; ++i)
+		closed[i].store(0, std::memory_order_relaxed);
+
+	float* h = heightMap.data();
+	//Min-heap on (height, index). The height is stored next to the index, looking it up in the map on every
+	//comparison costs about 40% of the fill on a 2049^2 map.
+	std::greater<FloodNode> higher;
+	//Every cell is queued at most once, so neither queue ever needs more than cellCount entries
+	auto push = [cellCount](auto& queue, auto entry)
+	{
+		if (queue.size() == queue.capacity())
+			queue.reserve(std::min(std::max(queue.size() * 2, (size_t)1024), cellCount));
+		queue.push_back(entry);
+	};
+	openCells.clear();
+	pitCells.clear();
+	size_t pitHead = 0;
+
+	//The map edges are where the water leaves the map, flooding starts from them
+	for (int z = 0; z < H; ++z)
+	{
+		for (int x = 0; x < W; ++x)
+		{
+			if (x == 0 || z == 0 || x == W - 1 || z == H - 1)
+			{
+				uint32_t cell = (uint32_t)((size_t)z * W + x);
+				closed[cell].store(1, std::memory_order_relaxed);
+				push(openCells, FloodNode(h[cell], cell));
+			}
+		}
+	}
+	std::make_heap(openCells.begin(), openCells.end(), higher);
+
+	while (!openCells.empty() || pitHead < pitCells.size())
+	{
+		uint32_t cell;
+		if (pitHead < pitCells.size())
+		{
+			cell = pitCells[pitHead++];
+			//A drained pit queue starts over, it only holds the cells of the depression being flooded
+			if (pitHead == pitCells.size())
+			{
+				pitCells.clear();
+				pitHead = 0;
+			}
+		}
+		else
+		{
+			std::pop_heap(openCells.begin(), openCells.end(), higher);
+			cell = openCells.back().second;
+			openCells.pop_back();
+		}
+
+		int x = cell % W;
+		int z = cell / W;
+		float hc = h[cell];
+		//The epsilon variant: pits are raised slightly above their spill cell instead of being made perfectly flat
+		float raised = std::max(std::nextafter(hc, FLT_MAX), hc + epsilon);
+		for (int k = 0; k < 8; ++k)
+		{
+			int nx = x + DX[k];
+			int nz = z + DZ[k];
+			if (nx < 0 || nz < 0 || nx >= W || nz >= H)
+				continue;
+			uint32_t n = (uint32_t)((size_t)nz * W + nx);
+			if (closed[n].load(std::memory_order_relaxed))
+				continue;
+			closed[n].store(1, std::memory_order_relaxed);
+			if (h[n] <= hc)
+			{
+				h[n] = raised;
+				push(pitCells, n);
+			}
+			else
+			{
+				push(openCells, FloodNode(h[n], n));
+				std::push_heap(openCells.begin(), openCells.end(), higher);
+			}
+		}
+	}
+}
+
+void Hydrology::computeFlow(const HeightField& heightMap, FlowMethod method)
+{
+	PROFILE_ZONE("flow");
+	W = heightMap.getWidth();
+	H = heightMap.getHeight();
+	flowMethod = method;
+	size_t cellCount = (size_t)W * H;
+	reserveCells(cellCount);
+	flowCode.resize(cellCount);
+	if (flowMethod == FlowMethod::DInfinity)
+		flowFraction.resize(cellCount);
+
+	ThreadPool& pool = ThreadPool::global();
+	pool.parallelFor(0, H, [&](int zBegin, int zEnd)
+	{
+		PROFILE_ZONE("flow rows");
+		if (flowMethod == FlowMethod::D8)
+			computeD8(heightMap, zBegin, zEnd);
+		else
+			computeDInfinity(heightMap, zBegin, zEnd);
+	}, 16);
+	//Every donor count has to be known before any walk starts
+	pool.parallelFor(0, H, [&](int zBegin, int zEnd)
+	{
+		PROFILE_ZONE("donor rows");
+		countDonors(zBegin, zEnd);
+	}, 16);
+	pool.parallelFor(0, H, [&](int zBegin, int zEnd)
+	{
+		PROFILE_ZONE("accumulate rows");
+		accumulate(zBegin, zEnd);
+	}, 16);
+}
+
+void Hydrology::computeD8(const HeightField& heightMap, int zBegin, int zEnd)
+{
+	for (int z = zBegin; z < zEnd; ++z)
+	{
+		for (int x = 0; x < W; ++x)
+		{
+			size_t cell = (size_t)z * W + x;
+			flowCode[cell] = NO_FLOW;
+			//Edge cells drain off the map
+			if (x == 0 || z == 0 || x == W - 1 || z == H - 1)
+				continue;
+
+			float h0 = heightMap.at(x, z);
+			float steepest = 0.0f;
+			for (int k = 0; k < 8; ++k)
+			{
+				float slope = (h0 - heightMap.at(x + DX[k], z + DZ[k])) / DIST[k];
+				if (slope > steepest)
+				{
+					steepest = slope;
+					flowCode[cell] = (unsigned char)k;
+				}
+			}
+		}
+	}
+}
+
+void Hydrology::computeDInfinity(const HeightField& heightMap, int zBegin, int zEnd)
+{
+	for (int z = zBegin; z < zEnd; ++z)
+	{
+		for (int x = 0; x < W; ++x)
+		{
+			size_t cell = (size_t)z * W + x;
+			flowCode[cell] = NO_FLOW;
+			flowFraction[cell] = 0;
+			if (x == 0 || z == 0 || x == W - 1 || z == H - 1)
+				continue;
+
+			float e0 = heightMap.at(x, z);
+			float steepest = 0.0f;
+			float bestAngle = 0.0f;
+			for (int f = 0; f < 8; ++f)
+			{
+				int c = FACET_CARDINAL[f];
+				int d = FACET_DIAGONAL[f];
+				float e1 = heightMap.at(x + DX[c], z + DZ[c]);
+				float e2 = heightMap.at(x + DX[d], z + DZ[d]);
+				//Slope along the cardinal edge and across to the diagonal, unit cell spacing
+				float s1 = e0 - e1;
+				float s2 = e1 - e2;
+				float angle = std::atan2(s2, s1);
+				float slope = std::sqrt(s1 * s1 + s2 * s2);
+				//Keep the direction inside the facet
+				if (angle < 0.0f)
+				{
+					angle = 0.0f;
+					slope = s1;
+				}
+				else if (angle > QUARTER_PI)
+				{
+					angle = QUARTER_PI;
+					slope = (e0 - e2) / DIST[1];
+				}
+				if (slope > steepest)
+				{
+					steepest = slope;
+					bestAngle = angle;
+					flowCode[cell] = (unsigned char)f;
+				}
+			}
+			//The closer the direction is to the cardinal edge, the more the cardinal neighbour gets
+			if (flowCode[cell] != NO_FLOW)
+				flowFraction[cell] = (unsigned char)std::lround((1.0f - bestAngle / QUARTER_PI) * 255.0f);
+		}
+	}
+}
+
+int Hydrology::getReceivers(size_t cell, size_t receivers[2], float fractions[2]) const
+{
+	unsigned char code = flowCode[cell];
+	if (code == NO_FLOW)
+		return 0;
+
+	if (flowMethod == FlowMethod::D8)
+	{
+		receivers[0] = cell + (ptrdiff_t)DZ[code] * W + DX[code];
+		fractions[0] = 1.0f;
+		return 1;
+	}
+
+	int c = FACET_CARDINAL[code];
+	int d = FACET_DIAGONAL[code];
+	size_t cardinal = cell + (ptrdiff_t)DZ[c] * W + DX[c];
+	size_t diagonal = cell + (ptrdiff_t)DZ[d] * W + DX[d];
+	unsigned char share = flowFraction[cell];
+	if (share == 255)
+	{
+		receivers[0] = cardinal;
+		fractions[0] = 1.0f;
+		return 1;
+	}
+	if (share == 0)
+	{
+		receivers[0] = diagonal;
+		fractions[0] = 1.0f;
+		return 1;
+	}
+	receivers[0] = cardinal;
+	fractions[0] = share / 255.0f;
+	receivers[1] = diagonal;
+	fractions[1] = 1.0f - fractions[0];
+	return 2;
+}
+
+void Hydrology::countDonors(int zBegin, int zEnd)
+{
+	size_t receivers[2];
+	float fractions[2];
+	for (int z = zBegin; z < zEnd; ++z)
+	{
+		for (int x = 0; x < W; ++x)
+		{
+			size_t cell = (size_t)z * W + x;
+			//Gather instead of scatter, so no atomics are needed to count
+			unsigned char count = 0;
+			for (int k = 0; k < 8; ++k)
+			{
+				int nx = x + DX[k];
+				int nz = z + DZ[k];
+				if (nx < 0 || nz < 0 || nx >= W || nz >= H)
+					continue;
+				size_t neighbour = (size_t)nz * W + nx;
+				int n = getReceivers(neighbour, receivers, fractions);
+				for (int r = 0; r < n; ++r)
+				{
+					if (receivers[r] == cell)
+						++count;
+				}
+			}
+			donors[cell].store(count == 0 ? SOURCE_BIT : count, std::memory_order_relaxed);
+			accumulation[cell].store(1.0f, std::memory_order_relaxed);
+		}
+	}
+}
+
+void Hydrology::accumulate(int zBegin, int zEnd)
+{
+	size_t receivers[2];
+	float fractions[2];
+	std::vector<size_t> walk;
+	for (int z = zBegin; z < zEnd; ++z)
+	{
+		for (int x = 0; x < W; ++x)
+		{
+			size_t start = (size_t)z * W + x;
+			if (donors[start].load(std::memory_order_relaxed) != SOURCE_BIT)
+				continue;
+
+			//Walk downstream. A receiver is continued only when this walk delivered its last missing donor,
+			//at that point every upstream contribution has been added to it.
+			walk.push_back(start);
+			while (!walk.empty())
+			{
+				size_t cell = walk.back();
+				walk.pop_back();
+				float area = accumulation[cell].load(std::memory_order_relaxed);
+				int n = getReceivers(cell, receivers, fractions);
+				for (int r = 0; r < n; ++r)
+				{
+					atomicAdd(accumulation[receivers[r]], area * fractions[r]);
+					//acq_rel makes the adds of all donors visible to the walk that finishes the receiver
+					if ((donors[receivers[r]].fetch_sub(1, std::memory_order_acq_rel) & COUNT_MASK) == 1)
+						walk.push_back(receivers[r]);
+				}
+			}
+		}
+	}
+}
+
+float Hydrology::getAccumulation(int x, int z) const
+{
+	return accumulation[(size_t)z * W + x].load(std::memory_order_relaxed);
+}
+
+size_t Hydrology::markRivers(float riverThreshold, std::vector<unsigned char>& biomeIDs, unsigned char riverID) const
+{
+	float threshold = riverThreshold * (float)W * (float)H;
+	std::atomic<size_t> riverCells(0);
+	ThreadPool::global().parallelFor(0, H, [&](int zBegin, int zEnd)
+	{
+		size_t count = 0;
+		for (size_t cell = (size_t)zBegin * W; cell < (size_t)zEnd * W; ++cell)
+		{
+			if (accumulation[cell].load(std::memory_order_relaxed) > threshold)
+			{
+				biomeIDs[cell] = riverID;
+				++count;
+			}
+		}
+		riverCells += count;
+	}, 16);
+	return riverCells.load();
+}
+
+size_t Hydrology::estimateMemory(int W, int H)
+{
+	//flow code + D-Inf fraction + donors + float accumulation + both flood queues at their cap
+	return (size_t)W * H * (sizeof(unsigned char) * 3 + sizeof(float) + sizeof(FloodNode) + sizeof(uint32_t));
+}
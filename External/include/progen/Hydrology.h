@@ -0,0 +1,86 @@
+#ifndef HYDROLOGY_H
+#define HYDROLOGY_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "HeightField.h"
+
+enum class FlowMethod
+{
+	D8, //All the flow goes to the steepest of the 8 neighbours
+	DInfinity //Flow is split between the two neighbours of the steepest triangular facet (Tarboton)
+};
+
+/*
+	Necessary data needed for river extraction
+*/
+struct HydrologyData
+{
+	bool enabled;
+	FlowMethod method;
+	float fillEpsilon; //Minimal drop enforced across filled depressions so that every cell drains
+	float riverThreshold; //Fraction of the map area that has to drain through a cell to make it a river
+};
+
+
+/*
+	Hydrologically consistent heights and flow accumulation over a HeightField.
+
+	1) fillDepressions: Priority-Flood+Epsilon. The map is flooded inwards from its edges in order of elevation.
+	   Every cell that would be a pit is raised just above the cell it was reached from, so afterwards every interior
+	   cell has a strictly lower neighbour and all flow reaches the map edge.
+	2) computeFlow: flow directions (D8 or D-Infinity) and then accumulation. Accumulation is a topologically ordered
+	   sweep: every cell counts its donors, cells without donors start walks downstream, and a cell is continued only by
+	   the thread whose contribution brings its donor count to zero. No recursion, so it works on any grid size.
+
+	The flow buffers take 7 bytes per cell on top of the 4 byte height plane (flow code, D-Inf fraction, closed
+	flag/donor count sharing one buffer, float accumulation). Every cell is queued once at most, so the flood queues
+	are each capped at one entry per cell: the heap takes up to 8 bytes per cell (height and index) and the pit queue
+	up to 4 on a flat or ocean-edged map, far less on rolling terrain. That bounds a 8192^2 map to 23 bytes per cell
+	with the heights, about 1.5 GB.
+	The buffers are kept between calls so regenerating does not reallocate them.
+
+	REFERENCES:
+	Barnes, Lehman, Mulla - Priority-Flood: An Optimal Depression-Filling and Watershed-Labeling Algorithm (2014)
+	Tarboton - A new method for the determination of flow directions and upslope areas in grid DEMs (1997)
+*/
+
+class Hydrology
+{
+public:
+	Hydrology();
+	void fillDepressions(HeightField& heightMap, float epsilon);
+	void computeFlow(const HeightField& heightMap, FlowMethod method);
+	//Upstream area of each cell, counted in cells (the cell itself included). Valid after computeFlow.
+	float getAccumulation(int x, int z) const;
+	//Overwrites biomeIDs of the cells whose upstream area exceeds riverThreshold * W * H. Returns the number of river cells.
+	size_t markRivers(float riverThreshold, std::vector<unsigned char>& biomeIDs, unsigned char riverID) const;
+	//Bytes the flow buffers and the flood queues can hold at most for a W x H map, without the heights
+	static size_t estimateMemory(int W, int H);
+private:
+	void reserveCells(size_t cellCount);
+	void computeD8(const HeightField& heightMap, int zBegin, int zEnd);
+	void computeDInfinity(const HeightField& heightMap, int zBegin, int zEnd);
+	void countDonors(int zBegin, int zEnd);
+	void accumulate(int zBegin, int zEnd);
+	//Receivers of a cell (at most 2) and the fraction of the flow each gets. Returns the receiver count.
+	int getReceivers(size_t cell, size_t receivers[2], float fractions[2]) const;
+private:
+	int W, H;
+	FlowMethod flowMethod;
+	std::vector<unsigned char> flowCode; //D8: neighbour index, D-Inf: facet index, NO_FLOW for outlets
+	std::vector<unsigned char> flowFraction; //D-Inf only: share of the cardinal neighbour of the facet, quantized to 1/255
+	std::unique_ptr<std::atomic<unsigned char>[]> donors; //Closed flags while filling, donor counts while accumulating
+	std::unique_ptr<std::atomic<float>[]> accumulation;
+	size_t cellCapacity; //Allocated size of donors and accumulation
+	typedef std::pair<float, uint32_t> FloodNode; //Height and index of a queued cell
+	std::vector<FloodNode> openCells; //Priority-Flood heap, lowest cell on top
+	std::vector<uint32_t> pitCells; //Cells raised to drain a depression, flooded in FIFO order
+};
+
+#endif
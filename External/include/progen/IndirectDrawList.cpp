@@ -0,0 +1,133 @@
+#include "IndirectDrawList.h"
+#include "GLExtensions.h"
+
+#include <cstring>
+
+IndirectDrawList::IndirectDrawList()
+	:
+	commandBuffer(0),
+	dataBuffer(0),
+	drawIndexBuffer(0),
+	capacity(0)
+{
+	if (!isIndirectSupported())
+		return;
+	glGenBuffers(1, &commandBuffer);
+	glGenBuffers(1, &dataBuffer);
+	glGenBuffers(1, &drawIndexBuffer);
+}
+
+IndirectDrawList::~IndirectDrawList()
+{
+	if (!isIndirectSupported())
+		return;
+	glDeleteBuffers(1, &commandBuffer);
+	glDeleteBuffers(1, &dataBuffer);
+	glDeleteBuffers(1, &drawIndexBuffer);
+}
+
+bool IndirectDrawList::isIndirectSupported()
+{
+	const GLExtensions& ext = GLExtensions::get();
+	return ext.multiDrawIndirect && ext.baseInstance && ext.shaderStorageBuffer;
+}
+
+void IndirectDrawList::clear()
+{
+	commands.clear();
+	drawData.clear();
+}
+
+void IndirectDrawList::add(GLuint indexCount, GLuint firstIndex, GLint baseVertex, const DrawData& data)
+{
+	DrawElementsIndirectCommand command;
+	command.count = indexCount;
+	command.instanceCount = 1;
+	command.firstIndex = firstIndex;
+	command.baseVertex = baseVertex;
+	command.baseInstance = (GLuint)commands.size();
+	commands.push_back(command);
+	drawData.push_back(data);
+}
+
+size_t IndirectDrawList::getDrawCount() const
+{
+	return commands.size();
+}
+
+void IndirectDrawList::reserveBuffers(size_t drawCount)
+{
+	if (drawCount <= capacity)
+		return;
+	capacity = drawCount + drawCount / 2;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, capacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, dataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(DrawData), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	std::vector<GLuint> indices(capacity);
+	for (size_t i = 0; i < capacity; ++i)
+		indices[i] = (GLuint)i;
+	glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void IndirectDrawList::submitIndirect()
+{
+	if (commands.empty() || !isIndirectSupported())
+		return;
+	reserveBuffers(commands.size());
+
+	//Orphaned every frame, the previous frame's draws may still be reading them
+	size_t commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, capacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commandBytes, commands.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, dataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(DrawData), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, drawData.size() * sizeof(DrawData), drawData.data());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, dataBuffer);
+
+	//The draw index buffer can be reallocated, so the attribute is pointed at it every time
+	glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+	glEnableVertexAttribArray(DRAW_INDEX_LOCATION);
+	glVertexAttribIPointer(DRAW_INDEX_LOCATION, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+	glVertexAttribDivisor(DRAW_INDEX_LOCATION, 1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	GLExtensions::get().multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)0, (GLsizei)commands.size(), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void IndirectDrawList::submitLoop(Shader& shader, UniformHandle modelHandle)
+{
+	size_t begin = 0;
+	while (begin < commands.size())
+	{
+		//Run of draws with the same per-draw data
+		size_t end = begin + 1;
+		while (end < commands.size() && std::memcmp(&drawData[end], &drawData[begin], sizeof(DrawData)) == 0)
+			++end;
+
+		const glm::vec4& ts = drawData[begin].translationScale;
+		glm::mat4 model(ts.w);
+		model[3] = glm::vec4(ts.x, ts.y, ts.z, 1.0f);
+		shader.setMat4(modelHandle, model);
+
+		size_t runLength = end - begin;
+		counts.resize(runLength);
+		offsets.resize(runLength);
+		baseVertices.resize(runLength);
+		for (size_t i = 0; i < runLength; ++i)
+		{
+			const DrawElementsIndirectCommand& command = commands[begin + i];
+			counts[i] = (GLsizei)command.count;
+			offsets[i] = (const void*)(sizeof(GLuint) * command.firstIndex);
+			baseVertices[i] = command.baseVertex;
+		}
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), (GLsizei)runLength, baseVertices.data());
+		begin = end;
+	}
+}
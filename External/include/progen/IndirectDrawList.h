@@ -0,0 +1,71 @@
+#ifndef INDIRECT_DRAW_LIST_H
+#define INDIRECT_DRAW_LIST_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+#include "Shader.h"
+
+/*
+	Collects the draws of a frame (ranges of the shared index buffer, see UploadManager) and submits them at once.
+
+	With ARB_multi_draw_indirect and shader storage buffers the commands go into a GL_DRAW_INDIRECT_BUFFER and the
+	per-draw data into an SSBO, and a single glMultiDrawElementsIndirect draws everything. The shader finds its
+	per-draw data through the draw index attribute: it reads a static 0, 1, 2... buffer with divisor 1, and every
+	command's baseInstance is its own index (gl_DrawID needs GL 4.6, this works from 4.3 on).
+
+	Without them the list falls back to a loop: consecutive draws that share their per-draw data become one
+	glMultiDrawElementsBaseVertex call after setting the data as a uniform.
+*/
+
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+//std430 layout of the per-draw SSBO entry, see Shaders/terrainIndirect
+struct DrawData
+{
+	glm::vec4 translationScale; //World offset of the chunk and its uniform scale
+};
+
+class IndirectDrawList
+{
+public:
+	static const GLuint DRAW_INDEX_LOCATION = 3; //Vertex attribute of the draw index
+	static const GLuint DRAW_DATA_BINDING = 1; //SSBO binding point of the per-draw data
+
+	IndirectDrawList();
+	~IndirectDrawList();
+	IndirectDrawList(const IndirectDrawList&) = delete;
+	IndirectDrawList& operator=(const IndirectDrawList&) = delete;
+	//Whether the driver supports the single call path
+	static bool isIndirectSupported();
+	void clear();
+	void add(GLuint indexCount, GLuint firstIndex, GLint baseVertex, const DrawData& data);
+	size_t getDrawCount() const;
+	//Draws with the indirect shader through one glMultiDrawElementsIndirect. The VAO of the geometry must be bound.
+	void submitIndirect();
+	//Loop fallback: the shader gets the per-draw data as the model matrix uniform
+	void submitLoop(Shader& shader, UniformHandle modelHandle);
+private:
+	void reserveBuffers(size_t drawCount);
+private:
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<DrawData> drawData;
+	//Scratch of the fallback
+	std::vector<GLsizei> counts;
+	std::vector<const void*> offsets;
+	std::vector<GLint> baseVertices;
+
+	GLuint commandBuffer, dataBuffer, drawIndexBuffer;
+	size_t capacity; //Draws the GPU buffers hold
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "InstancedMesh.h"
+
+#include <algorithm>
+#include <glm/glm.hpp>
+
+InstancedMesh::InstancedMesh()
+	:
+	indexCount(0),
+	instanceCapacity(0),
+	instanceCount(0),
+	boundingRadius(0.0f)
+{
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+	glGenBuffers(1, &instanceVBO);
+
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	//POSITION
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	//NORMALS
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+	//Color
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+
+	//Per instance: position and scale, then yaw
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(ScatterInstance), (void*)offsetof(ScatterInstance, position));
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(ScatterInstance), (void*)offsetof(ScatterInstance, yaw));
+	glVertexAttribDivisor(4, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+InstancedMesh::~InstancedMesh()
+{
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &EBO);
+	glDeleteBuffers(1, &instanceVBO);
+}
+
+void InstancedMesh::setMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+{
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	indexCount = (GLsizei)indices.size();
+	boundingRadius = 0.0f;
+	for (const Vertex& v : vertices)
+		boundingRadius = std::max(boundingRadius, glm::length(v.pos));
+}
+
+void InstancedMesh::setInstances(const ScatterInstance* instances, size_t count)
+{
+	instanceCount = count;
+	if (count == 0)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	//Grow with some headroom so turning the camera does not reallocate every frame
+	if (count > instanceCapacity)
+		instanceCapacity = count + count / 2;
+	//Fresh storage every update (orphaning), the GPU may still be reading the previous one
+	glBufferData(GL_ARRAY_BUFFER, sizeof(ScatterInstance) * instanceCapacity, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(ScatterInstance) * count, instances);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstancedMesh::render() const
+{
+	if (instanceCount == 0 || indexCount == 0)
+		return;
+	glBindVertexArray(VAO);
+	glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, (GLsizei)instanceCount);
+}
+
+float InstancedMesh::getBoundingRadius() const
+{
+	return boundingRadius;
+}
@@ -0,0 +1,39 @@
+#ifndef INSTANCED_MESH_H
+#define INSTANCED_MESH_H
+
+#include <glad/glad.h>
+#include <vector>
+#include <cstddef>
+
+#include "Vertex.h"
+#include "PoissonScatter.h"
+
+/*
+	A small mesh drawn many times with a single glDrawElementsInstanced call.
+
+	Vertex attributes 0-2 are the usual Vertex layout. The instance buffer feeds attribute 3 (position, scale) and
+	attribute 4 (yaw) once per instance, straight from ScatterInstance. The instance buffer only grows, smaller
+	updates are uploaded into the existing storage after orphaning it, so the driver never waits for the last frame.
+*/
+
+class InstancedMesh
+{
+public:
+	InstancedMesh();
+	~InstancedMesh();
+	InstancedMesh(const InstancedMesh&) = delete;
+	InstancedMesh& operator=(const InstancedMesh&) = delete;
+	void setMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+	void setInstances(const ScatterInstance* instances, size_t count);
+	void render() const;
+	//Radius around the mesh origin (the base of the object) that holds every vertex at scale 1
+	float getBoundingRadius() const;
+private:
+	GLuint VAO, VBO, EBO, instanceVBO;
+	GLsizei indexCount;
+	size_t instanceCapacity;
+	size_t instanceCount;
+	float boundingRadius;
+};
+
+#endif
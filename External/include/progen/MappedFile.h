@@ -0,0 +1,33 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+/*
+	A whole file mapped read-only into memory (mmap, or a file mapping on Windows).
+	Pages are only read from the disk when they are touched, so large rasters can be opened instantly and read
+	from several threads at once without any copies. The mapping is hinted as sequential.
+*/
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	bool open(const char* path);
+	void close();
+	bool isOpen() const;
+	const unsigned char* data() const;
+	size_t size() const;
+private:
+	const unsigned char* bytes;
+	size_t length;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "MeshBuilder.h"
+#include "ThreadPool.h"
+
+void MeshBuilder::applyHeightCurve(const HeightField& heightMap, const HeightCurve& curve, float heightMultiplier, HeightField& scaledHeights)
+{
+	if (scaledHeights.getWidth() != heightMap.getWidth() || scaledHeights.getHeight() != heightMap.getHeight())
+		scaledHeights.resize(heightMap.getWidth(), heightMap.getHeight());
+	const float* in = heightMap.data();
+	float* out = scaledHeights.data();
+	for (size_t i = 0; i < heightMap.size(); ++i)
+		out[i] = curve.evaluate(in[i]) * heightMultiplier;
+}
+
+void MeshBuilder::buildVertices(const HeightField& scaledHeights, const std::vector<unsigned char>& biomeMap, const std::vector<Biome*>& biomes,
+	float W, float L, std::vector<Vertex>& vertices)
+{
+	int numX = scaledHeights.getWidth();
+	int numZ = scaledHeights.getHeight();
+	vertices.resize(scaledHeights.size());
+	//The colors are looked up once instead of through the virtual biomes per vertex
+	std::vector<glm::vec3> colors(biomes.size());
+	for (size_t b = 0; b < biomes.size(); ++b)
+		colors[b] = biomes[b]->getColor();
+
+	//Generate from top-left to bottom-right. (If thinked in 2D)
+	for (int z = 0; z < numZ; ++z)
+	{
+		const float* heights = scaledHeights.row(z);
+		Vertex* out = vertices.data() + (size_t)z * numX;
+		const unsigned char* ids = biomeMap.data() + (size_t)z * numX;
+		for (int x = 0; x < numX; ++x)
+		{
+			out[x].pos = gridPosition(x, z, numX, numZ, W, L, heights[x]);
+			out[x].normal = glm::vec3(0.0f, 1.0f, 0.0f);
+			out[x].color = colors[ids[x]];
+		}
+	}
+}
+
+void MeshBuilder::buildGridIndices(int numX, int numZ, std::vector<glm::ivec3>& tris)
+{
+	tris.clear();
+	if (numX < 2 || numZ < 2)
+		return;
+	tris.resize((size_t)2 * (numX - 1) * (numZ - 1));
+	glm::ivec3* out = tris.data();
+	//Quads (2 triangles) in the following fashion:
+	/*
+			 i  i+1
+			 ^___^
+			 |\  |
+			 | \ |
+	(i+numX)>|__\|
+	*/
+	for (int z = 0; z + 1 < numZ; ++z)
+	{
+		for (int x = 0; x + 1 < numX; ++x)
+		{
+			int i = z * numX + x;
+			//Oriented counter-clockwise
+			*out++ = glm::ivec3(i, i + numX, i + numX + 1);
+			*out++ = glm::ivec3(i, i + numX + 1, i + 1);
+		}
+	}
+}
+
+void MeshBuilder::computeNormals(std::vector<Vertex>& vertices, const std::vector<glm::ivec3>& tris)
+{
+	//Traverse each triangle and compute face normal
+	for (const glm::ivec3& tri : tris)
+	{
+		Vertex& v1 = vertices[tri[0]];
+		Vertex& v2 = vertices[tri[1]];
+		Vertex& v3 = vertices[tri[2]];
+		//Triangle vertices are oriented counter-clockwise
+		glm::vec3 n = glm::normalize(glm::cross(v2.pos - v1.pos, v3.pos - v1.pos));
+		//Accumulate normals in incident vertices
+		v1.normal += n;
+		v2.normal += n;
+		v3.normal += n;
+	}
+
+	//Normalize the normals
+	for (Vertex& v : vertices)
+		v.normal = glm::normalize(v.normal);
+}
+
+void MeshBuilder::computeAnalyticNormals(const HeightField& heightMap, const HeightField& gradientX, const HeightField& gradientZ,
+	const HeightCurve& curve, float heightMultiplier, float W, float L, std::vector<Vertex>& vertices)
+{
+	int numX = heightMap.getWidth();
+	int numZ = heightMap.getHeight();
+	//From per vertex to per world unit
+	float toWorldX = numX > 1 ? (numX - 1) / W : 0.0f;
+	float toWorldZ = numZ > 1 ? (numZ - 1) / L : 0.0f;
+	ThreadPool::global().parallelFor(0, numZ, [&](int zBegin, int zEnd)
+	{
+		for (int z = zBegin; z < zEnd; ++z)
+		{
+			const float* heights = heightMap.row(z);
+			const float* dx = gradientX.row(z);
+			const float* dz = gradientZ.row(z);
+			Vertex* out = vertices.data() + (size_t)z * numX;
+			for (int x = 0; x < numX; ++x)
+			{
+				//The surface is y = curve(h(x, z)) * heightMultiplier, its normal is (-dy/dx, 1, -dy/dz)
+				float slope = curve.derivative(heights[x]) * heightMultiplier;
+				out[x].normal = glm::normalize(glm::vec3(-slope * dx[x] * toWorldX, 1.0f, -slope * dz[x] * toWorldZ));
+			}
+		}
+	}, 16);
+}
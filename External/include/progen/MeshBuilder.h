@@ -0,0 +1,52 @@
+#ifndef MESH_BUILDER_H
+#define MESH_BUILDER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+#include "HeightField.h"
+#include "HeightCurve.h"
+#include "Biome.h"
+
+/*
+	The CPU side of turning a height map into the terrain mesh, without any OpenGL, so the stages can be run
+	and measured on their own (Benchmarks) as well as by Terrain.
+
+	applyHeightCurve runs the normalized heights through the height curve and scales them to world units.
+	buildVertices places the final heights on a W x L patch centered at the origin and colors them by their biome.
+	buildGridIndices gives the two counter-clockwise triangles of every cell in row-major order.
+	computeNormals adds the face normals to the normals the vertices have and normalizes them. buildVertices starts
+	every normal pointing up.
+	computeAnalyticNormals sets the normals from the derivatives of the height map instead (PerlinNoise gives them with
+	the noise), chained through the height curve. Every vertex only needs its own sample, no triangles or neighbours.
+	gridPosition is where buildVertices puts grid point (x, z). The streaming exporters (MeshExport) place their
+	vertices with it too, so both give the same floats.
+*/
+
+class MeshBuilder
+{
+public:
+	static void applyHeightCurve(const HeightField& heightMap, const HeightCurve& curve, float heightMultiplier, HeightField& scaledHeights);
+	static void buildVertices(const HeightField& scaledHeights, const std::vector<unsigned char>& biomeMap, const std::vector<Biome*>& biomes,
+		float W, float L, std::vector<Vertex>& vertices);
+	static void buildGridIndices(int numX, int numZ, std::vector<glm::ivec3>& tris);
+	static void computeNormals(std::vector<Vertex>& vertices, const std::vector<glm::ivec3>& tris);
+	//gradientX and gradientZ: derivatives of heightMap along x and z per vertex, W x L as in buildVertices
+	static void computeAnalyticNormals(const HeightField& heightMap, const HeightField& gradientX, const HeightField& gradientZ,
+		const HeightCurve& curve, float heightMultiplier, float W, float L, std::vector<Vertex>& vertices);
+	//Kept in the header since it is called per vertex
+	static glm::vec3 gridPosition(int x, int z, int numX, int numZ, float W, float L, float height)
+	{
+		//Generate the normalized point and cast it back in range [-W/2,-L/2:W/2,L/2]
+		glm::vec3 p = glm::vec3(x / (float)(numX - 1), 0.0, z / (float)(numZ - 1));
+		p.x *= W;
+		p.z *= L;
+		p.x -= W / 2.0;
+		p.z -= L / 2.0;
+		p.y = height;
+		return p;
+	}
+};
+
+#endif
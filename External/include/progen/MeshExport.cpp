@@ -0,0 +1,413 @@
+#include "MeshExport.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+
+#include "BufferedWriter.h"
+#include "MeshBuilder.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+//Both formats are little endian. The records are written straight from memory, which is little endian on every target (x86, ARM).
+
+namespace
+{
+	/*
+		Produces the vertices of a GridMeshView one row at a time. The face normals of the two cell rows around the
+		current vertex row are kept, so every face normal is computed once.
+	*/
+	class GridVertexStream
+	{
+	public:
+		explicit GridVertexStream(const GridMeshView& view)
+			:
+			view(view),
+			numX(view.heights.getWidth()),
+			numZ(view.heights.getHeight()),
+			z(view.z0),
+			faceX0(std::max(view.x0 - 1, 0)),
+			faceX1(std::min(view.x1, numX - 1)),
+			row(view.x1 - view.x0),
+			colors(view.biomes.size())
+		{
+			for (size_t b = 0; b < view.biomes.size(); ++b)
+				colors[b] = view.biomes[b]->getColor();
+			size_t faceCount = faceX1 > faceX0 ? (size_t)2 * (faceX1 - faceX0) : 0;
+			above.resize(faceCount);
+			below.resize(faceCount);
+			if (z > 0)
+				computeFaceRow(z - 1, below);
+		}
+
+		//Vertices of the next row of the window
+		const Vertex* nextRow()
+		{
+			//The cells below the previous row are above this one
+			above.swap(below);
+			if (z < numZ - 1)
+				computeFaceRow(z, below);
+			const float* heights = view.heights.row(z);
+			const unsigned char* ids = view.biomeMap.data() + (size_t)z * numX;
+			for (int x = view.x0; x < view.x1; ++x)
+			{
+				Vertex& v = row[x - view.x0];
+				v.pos = MeshBuilder::gridPosition(x, z, numX, numZ, view.W, view.L, heights[x]);
+				v.color = colors[ids[x]];
+				//Incident faces in the order MeshBuilder::buildGridIndices emits them
+				glm::vec3 n = glm::vec3(0.0f, 1.0f, 0.0f);
+				if (z > 0)
+				{
+					if (x > 0)
+					{
+						n += face(above, x - 1, 0);
+						n += face(above, x - 1, 1);
+					}
+					if (x < numX - 1)
+						n += face(above, x, 0);
+				}
+				if (z < numZ - 1)
+				{
+					if (x > 0)
+						n += face(below, x - 1, 1);
+					if (x < numX - 1)
+					{
+						n += face(below, x, 0);
+						n += face(below, x, 1);
+					}
+				}
+				v.normal = glm::normalize(n);
+			}
+			++z;
+			return row.data();
+		}
+	private:
+		const glm::vec3& face(const std::vector<glm::vec3>& faces, int cx, int t) const
+		{
+			return faces[(size_t)2 * (cx - faceX0) + t];
+		}
+
+		void computeFaceRow(int cz, std::vector<glm::vec3>& faces) const
+		{
+			const float* top = view.heights.row(cz);
+			const float* bottom = view.heights.row(cz + 1);
+			for (int cx = faceX0; cx < faceX1; ++cx)
+			{
+				glm::vec3 tl = MeshBuilder::gridPosition(cx, cz, numX, numZ, view.W, view.L, top[cx]);
+				glm::vec3 tr = MeshBuilder::gridPosition(cx + 1, cz, numX, numZ, view.W, view.L, top[cx + 1]);
+				glm::vec3 bl = MeshBuilder::gridPosition(cx, cz + 1, numX, numZ, view.W, view.L, bottom[cx]);
+				glm::vec3 br = MeshBuilder::gridPosition(cx + 1, cz + 1, numX, numZ, view.W, view.L, bottom[cx + 1]);
+				glm::vec3* out = &faces[(size_t)2 * (cx - faceX0)];
+				out[0] = glm::normalize(glm::cross(bl - tl, br - tl));
+				out[1] = glm::normalize(glm::cross(br - tl, tr - tl));
+			}
+		}
+	private:
+		const GridMeshView& view;
+		int numX, numZ;
+		int z; //Next row
+		int faceX0, faceX1; //Cells whose face normals are kept
+		std::vector<glm::vec3> above, below; //Two normals per cell of the cell rows above and below the current row
+		std::vector<Vertex> row;
+		std::vector<glm::vec3> colors;
+	};
+
+	//Calls func(a, b, c) with the window local indices of every triangle of the view, in MeshBuilder::buildGridIndices order
+	template<class Func>
+	void forEachGridTriangle(const GridMeshView& view, Func func)
+	{
+		uint32_t rowSize = (uint32_t)(view.x1 - view.x0);
+		for (int z = view.z0; z + 1 < view.z1; ++z)
+		{
+			uint32_t i = (uint32_t)(z - view.z0) * rowSize;
+			for (int x = view.x0; x + 1 < view.x1; ++x, ++i)
+			{
+				func(i, i + rowSize, i + rowSize + 1);
+				func(i, i + rowSize + 1, i + 1);
+			}
+		}
+	}
+
+	void writePLYHeader(BufferedWriter& out, size_t vertexCount, size_t triangleCount)
+	{
+		char header[512];
+		int size = std::snprintf(header, sizeof(header),
+			"ply\n"
+			"format binary_little_endian 1.0\n"
+			"comment ProceduralGeneration terrain\n"
+			"element vertex %llu\n"
+			"property float x\nproperty float y\nproperty float z\n"
+			"property float nx\nproperty float ny\nproperty float nz\n"
+			"property uchar red\nproperty uchar green\nproperty uchar blue\n"
+			"element face %llu\n"
+			"property list uchar uint vertex_indices\n"
+			"end_header\n",
+			(unsigned long long)vertexCount, (unsigned long long)triangleCount);
+		out.write(header, (size_t)size);
+	}
+
+	unsigned char toByte(float c)
+	{
+		return (unsigned char)std::lround(std::min(std::max(c, 0.0f), 1.0f) * 255.0f);
+	}
+
+	//27 bytes per vertex, the PLY records are packed
+	void writePLYVertices(BufferedWriter& out, const Vertex* vertices, size_t count)
+	{
+		unsigned char record[27];
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Vertex& v = vertices[i];
+			std::memcpy(record, &v.pos, 12);
+			std::memcpy(record + 12, &v.normal, 12);
+			record[24] = toByte(v.color.r);
+			record[25] = toByte(v.color.g);
+			record[26] = toByte(v.color.b);
+			out.write(record, sizeof(record));
+		}
+	}
+
+	void writePLYTriangle(BufferedWriter& out, uint32_t a, uint32_t b, uint32_t c)
+	{
+		unsigned char record[13];
+		record[0] = 3;
+		std::memcpy(record + 1, &a, 4);
+		std::memcpy(record + 5, &b, 4);
+		std::memcpy(record + 9, &c, 4);
+		out.write(record, sizeof(record));
+	}
+
+	/*
+		Header, JSON chunk and the header of the BIN chunk of a GLB with one interleaved vertex buffer followed by the
+		indices. The sizes are known from the counts, so the binary data can be streamed behind it.
+		False if the file would not fit the 32-bit sizes of the format.
+	*/
+	bool writeGLBHeader(BufferedWriter& out, size_t vertexCount, size_t indexCount, const glm::vec3& minPos, const glm::vec3& maxPos)
+	{
+		const uint64_t vertexBytes = (uint64_t)vertexCount * sizeof(Vertex);
+		const uint64_t indexBytes = (uint64_t)indexCount * sizeof(uint32_t);
+		const uint64_t binBytes = vertexBytes + indexBytes;
+		char json[2048];
+		int jsonSize = std::snprintf(json, sizeof(json),
+			"{\"asset\":{\"version\":\"2.0\",\"generator\":\"ProceduralGeneration\"},"
+			"\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+			"\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"COLOR_0\":2},\"indices\":3,\"mode\":4}]}],"
+			"\"buffers\":[{\"byteLength\":%llu}],"
+			"\"bufferViews\":["
+			"{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%llu,\"byteStride\":%u,\"target\":34962},"
+			"{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu,\"target\":34963}],"
+			"\"accessors\":["
+			"{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},"
+			"{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\"},"
+			"{\"bufferView\":0,\"byteOffset\":24,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\"},"
+			"{\"bufferView\":1,\"byteOffset\":0,\"componentType\":5125,\"count\":%llu,\"type\":\"SCALAR\"}]}",
+			(unsigned long long)binBytes,
+			(unsigned long long)vertexBytes, (unsigned)sizeof(Vertex),
+			(unsigned long long)vertexBytes, (unsigned long long)indexBytes,
+			(unsigned long long)vertexCount, minPos.x, minPos.y, minPos.z, maxPos.x, maxPos.y, maxPos.z,
+			(unsigned long long)vertexCount, (unsigned long long)vertexCount, (unsigned long long)indexCount);
+		//Chunks are 4 byte aligned, JSON is padded with spaces
+		uint32_t jsonPadded = ((uint32_t)jsonSize + 3u) & ~3u;
+		uint64_t total = 12 + 8 + (uint64_t)jsonPadded + 8 + binBytes;
+		if (total > UINT32_MAX)
+		{
+			std::cout << "ERROR::MESH_EXPORT::GLB_TOO_LARGE->" << total << " bytes, export it in chunks" << std::endl;
+			return false;
+		}
+		const uint32_t header[3] = { 0x46546C67u /*glTF*/, 2u, (uint32_t)total };
+		out.write(header, sizeof(header));
+		const uint32_t jsonChunk[2] = { jsonPadded, 0x4E4F534Au /*JSON*/ };
+		out.write(jsonChunk, sizeof(jsonChunk));
+		out.write(json, (size_t)jsonSize);
+		out.write("   ", jsonPadded - (uint32_t)jsonSize);
+		//Vertex (36 bytes) and indices (4 bytes) keep the binary chunk aligned without padding
+		const uint32_t binChunk[2] = { (uint32_t)binBytes, 0x004E4942u /*BIN*/ };
+		out.write(binChunk, sizeof(binChunk));
+		return true;
+	}
+
+	void gridBounds(const GridMeshView& view, glm::vec3& minPos, glm::vec3& maxPos)
+	{
+		int numX = view.heights.getWidth();
+		int numZ = view.heights.getHeight();
+		float minH = FLT_MAX, maxH = -FLT_MAX;
+		for (int z = view.z0; z < view.z1; ++z)
+		{
+			const float* heights = view.heights.row(z);
+			for (int x = view.x0; x < view.x1; ++x)
+			{
+				minH = std::min(minH, heights[x]);
+				maxH = std::max(maxH, heights[x]);
+			}
+		}
+		minPos = MeshBuilder::gridPosition(view.x0, view.z0, numX, numZ, view.W, view.L, minH);
+		maxPos = MeshBuilder::gridPosition(view.x1 - 1, view.z1 - 1, numX, numZ, view.W, view.L, maxH);
+	}
+}
+
+
+GridMeshView::GridMeshView(const HeightField& heights, const std::vector<unsigned char>& biomeMap, const std::vector<Biome*>& biomes, float W, float L)
+	:
+	heights(heights),
+	biomeMap(biomeMap),
+	biomes(biomes),
+	W(W),
+	L(L),
+	x0(0),
+	z0(0),
+	x1(heights.getWidth()),
+	z1(heights.getHeight())
+{}
+
+GridMeshView GridMeshView::window(int x0, int z0, int x1, int z1) const
+{
+	GridMeshView view(*this);
+	view.x0 = std::max(x0, 0);
+	view.z0 = std::max(z0, 0);
+	view.x1 = std::min(x1, heights.getWidth());
+	view.z1 = std::min(z1, heights.getHeight());
+	return view;
+}
+
+size_t GridMeshView::getVertexCount() const
+{
+	if (x1 <= x0 || z1 <= z0)
+		return 0;
+	return (size_t)(x1 - x0) * (z1 - z0);
+}
+
+size_t GridMeshView::getTriangleCount() const
+{
+	if (x1 - x0 < 2 || z1 - z0 < 2)
+		return 0;
+	return (size_t)2 * (x1 - x0 - 1) * (z1 - z0 - 1);
+}
+
+
+bool MeshExport::write(const char* path, const GridMeshView& view, MeshFormat format)
+{
+	return format == MeshFormat::GLB ? writeGLB(path, view) : writePLY(path, view);
+}
+
+bool MeshExport::writePLY(const char* path, const GridMeshView& view)
+{
+	PROFILE_ZONE("export ply");
+	if (view.getTriangleCount() == 0)
+		return false;
+	BufferedWriter out;
+	if (!out.open(path))
+		return false;
+	writePLYHeader(out, view.getVertexCount(), view.getTriangleCount());
+	GridVertexStream stream(view);
+	for (int z = view.z0; z < view.z1; ++z)
+		writePLYVertices(out, stream.nextRow(), (size_t)(view.x1 - view.x0));
+	forEachGridTriangle(view, [&out](uint32_t a, uint32_t b, uint32_t c) { writePLYTriangle(out, a, b, c); });
+	return out.close();
+}
+
+bool MeshExport::writeGLB(const char* path, const GridMeshView& view)
+{
+	PROFILE_ZONE("export glb");
+	if (view.getTriangleCount() == 0)
+		return false;
+	glm::vec3 minPos, maxPos;
+	gridBounds(view, minPos, maxPos);
+	BufferedWriter out;
+	if (!out.open(path))
+		return false;
+	if (!writeGLBHeader(out, view.getVertexCount(), 3 * view.getTriangleCount(), minPos, maxPos))
+	{
+		out.close();
+		std::remove(path);
+		return false;
+	}
+	GridVertexStream stream(view);
+	//The Vertex layout is the interleaved buffer view
+	for (int z = view.z0; z < view.z1; ++z)
+		out.write(stream.nextRow(), (size_t)(view.x1 - view.x0) * sizeof(Vertex));
+	forEachGridTriangle(view, [&out](uint32_t a, uint32_t b, uint32_t c)
+	{
+		const uint32_t tri[3] = { a, b, c };
+		out.write(tri, sizeof(tri));
+	});
+	return out.close();
+}
+
+bool MeshExport::writePLY(const char* path, const std::vector<Vertex>& vertices, const std::vector<glm::ivec3>& tris)
+{
+	PROFILE_ZONE("export ply");
+	BufferedWriter out;
+	if (!out.open(path))
+		return false;
+	writePLYHeader(out, vertices.size(), tris.size());
+	writePLYVertices(out, vertices.data(), vertices.size());
+	for (const glm::ivec3& tri : tris)
+		writePLYTriangle(out, (uint32_t)tri.x, (uint32_t)tri.y, (uint32_t)tri.z);
+	return out.close();
+}
+
+bool MeshExport::writeGLB(const char* path, const std::vector<Vertex>& vertices, const std::vector<glm::ivec3>& tris)
+{
+	PROFILE_ZONE("export glb");
+	if (vertices.empty() || tris.empty())
+		return false;
+	glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+	for (const Vertex& v : vertices)
+	{
+		minPos = glm::min(minPos, v.pos);
+		maxPos = glm::max(maxPos, v.pos);
+	}
+	BufferedWriter out;
+	if (!out.open(path))
+		return false;
+	if (!writeGLBHeader(out, vertices.size(), 3 * tris.size(), minPos, maxPos))
+	{
+		out.close();
+		std::remove(path);
+		return false;
+	}
+	out.write(vertices.data(), vertices.size() * sizeof(Vertex));
+	//glm::ivec3 is three packed 32-bit ints, the same bytes as the unsigned indices
+	out.write(tris.data(), tris.size() * sizeof(glm::ivec3));
+	return out.close();
+}
+
+size_t MeshExport::writeChunks(const GridMeshView& view, int chunkCells, MeshFormat format, const std::string& prefix)
+{
+	chunkCells = std::max(chunkCells, 1);
+	int cellsX = view.x1 - view.x0 - 1;
+	int cellsZ = view.z1 - view.z0 - 1;
+	if (cellsX < 1 || cellsZ < 1)
+		return 0;
+	int chunksX = (cellsX + chunkCells - 1) / chunkCells;
+	int chunksZ = (cellsZ + chunkCells - 1) / chunkCells;
+	std::atomic<size_t> failed(0);
+	//One file per job, the chunks are large enough to not need batching
+	ThreadPool::global().parallelFor(0, chunksX * chunksZ, [&](int begin, int end)
+	{
+		PROFILE_ZONE("export chunks");
+		for (int c = begin; c < end; ++c)
+		{
+			int cx = c % chunksX;
+			int cz = c / chunksX;
+			//Chunks share the vertices on their borders
+			int x0 = view.x0 + cx * chunkCells;
+			int z0 = view.z0 + cz * chunkCells;
+			GridMeshView chunk = view.window(x0, z0, std::min(x0 + chunkCells + 1, view.x1), std::min(z0 + chunkCells + 1, view.z1));
+			std::string path = prefix + "_" + std::to_string(cx) + "_" + std::to_string(cz) + "." + getExtension(format);
+			if (!write(path.c_str(), chunk, format))
+				++failed;
+		}
+	}, 1);
+	return failed.load();
+}
+
+const char* MeshExport::getExtension(MeshFormat format)
+{
+	return format == MeshFormat::GLB ? "glb" : "ply";
+}
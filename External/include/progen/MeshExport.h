@@ -0,0 +1,66 @@
+#ifndef MESH_EXPORT_H
+#define MESH_EXPORT_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+#include "HeightField.h"
+#include "Biome.h"
+
+enum class MeshFormat
+{
+	PLY, //Binary little endian PLY, positions and normals as floats, colors as bytes
+	GLB //Binary glTF 2.0, one interleaved vertex buffer (the Vertex layout) and 32-bit indices
+};
+
+
+/*
+	A window of the grid mesh MeshBuilder would build from the final heights, without building it.
+	The window covers the vertices [x0, x1) x [z0, z1) of the whole grid. Normals at its border still
+	see the faces outside of it, so neighbouring windows (chunks) meet without seams.
+*/
+class GridMeshView
+{
+public:
+	GridMeshView(const HeightField& heights, const std::vector<unsigned char>& biomeMap, const std::vector<Biome*>& biomes, float W, float L);
+	GridMeshView window(int x0, int z0, int x1, int z1) const;
+	size_t getVertexCount() const;
+	size_t getTriangleCount() const;
+public:
+	const HeightField& heights; //Final heights in world units
+	const std::vector<unsigned char>& biomeMap;
+	const std::vector<Biome*>& biomes;
+	float W, L; //Extent of the whole terrain
+	int x0, z0, x1, z1;
+};
+
+
+/*
+	Mesh files for other tools.
+
+	The grid variants stream the mesh straight from the heights in row order through a BufferedWriter. Every row of
+	vertices is built with its normals (the same sums MeshBuilder::computeNormals does, in the same order) from the face
+	normals of the cell rows above and below it, and the indices are generated as they are written. Nothing of the size
+	of the vertex data is ever allocated, so a 16k x 16k terrain exports in a few rows of memory.
+	The vertex data variants write a mesh that is already built (the adaptive mesh of Terrain).
+
+	GLB stores the whole binary chunk behind 32-bit sizes, so a single file is limited to 4 GB. Larger terrains have to be
+	written as chunks. writeChunks splits the view into chunks of chunkCells x chunkCells cells, named
+	<prefix>_<cx>_<cz>.<ply|glb>, and writes them in parallel on the ThreadPool. It returns the number of chunks that failed.
+*/
+
+class MeshExport
+{
+public:
+	static bool write(const char* path, const GridMeshView& view, MeshFormat format);
+	static bool writePLY(const char* path, const GridMeshView& view);
+	static bool writeGLB(const char* path, const GridMeshView& view);
+	static bool writePLY(const char* path, const std::vector<Vertex>& vertices, const std::vector<glm::ivec3>& tris);
+	static bool writeGLB(const char* path, const std::vector<Vertex>& vertices, const std::vector<glm::ivec3>& tris);
+	static size_t writeChunks(const GridMeshView& view, int chunkCells, MeshFormat format, const std::string& prefix);
+	static const char* getExtension(MeshFormat format);
+};
+
+#endif
@@ -1,5 +1,24 @@
 #include "PerlinNoise.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Simd.h"
 
+#include <mutex>
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	//Samples of a row evaluated together, the buffers of a tile stay in the L1 cache
+	const int TILE_SAMPLES = 64;
+	//Musgrave's constants for the multifractals ("Texturing & Modeling: A Procedural Approach")
+	const double RIDGE_OFFSET = 1.0;
+	const double RIDGE_GAIN = 2.0;
+	const double HYBRID_OFFSET = 0.7;
+	//Weights of x and y in grad for each hash, at z = 0
+	const double GRADIENT_X[16] = { 1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0, 1, 0, -1, 0 };
+	const double GRADIENT_Y[16] = { 1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1, 1, -1, 1, -1 };
+}
 
 PerlinNoise::PerlinNoise()
 {
@@ -55,20 +74,203 @@ double PerlinNoise::noise(double x, double y, double z) const
 }
 
 
-std::vector<std::vector<double>> PerlinNoise::generateNoiseMap(const NoiseData& noiseData) const
+double PerlinNoise::noise(double x, double y, glm::dvec2& gradient) const
+{
+	int X = (int)floor(x) & 255;
+	int Y = (int)floor(y) & 255;
+	x -= floor(x);
+	y -= floor(y);
+	double u = fade(x);
+	double v = fade(y);
+	double du = fadeDerivative(x);
+	double dv = fadeDerivative(y);
+
+	//At z = 0 the corners of the upper face are weighted by fade(0) = 0, only the lower four are left
+	int A = p[X] + Y;
+	int B = p[X + 1] + Y;
+	glm::dvec2 gAA = gradientOf(p[p[A]]), gBA = gradientOf(p[p[B]]), gAB = gradientOf(p[p[A + 1]]), gBB = gradientOf(p[p[B + 1]]);
+	double a = gAA.x * x + gAA.y * y;
+	double b = gBA.x * (x - 1) + gBA.y * y;
+	double c = gAB.x * x + gAB.y * (y - 1);
+	double d = gBB.x * (x - 1) + gBB.y * (y - 1);
+	double lower = lerp(u, a, b);
+	double upper = lerp(u, c, d);
+
+	//Product rule: the blended corner gradients, plus the change of the blend weights
+	gradient = (1 - v) * ((1 - u) * gAA + u * gBA) + v * ((1 - u) * gAB + u * gBB);
+	gradient.x += du * lerp(v, b - a, d - c);
+	gradient.y += dv * (upper - lower);
+	return lerp(v, lower, upper);
+}
+
+
+void PerlinNoise::noise(const double* x, const double* y, double* values, int count, double* gradientX, double* gradientY) const
+{
+	bool gradients = gradientX != nullptr && gradientY != nullptr;
+	int i = 0;
+#ifdef PROGEN_SSE2
+	//The same operations in the same order as noise(x, y, 0) and noise(x, y, gradient), so they give the same bits
+	const int* perm = p.data();
+	const __m128d one = _mm_set1_pd(1.0);
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128d px = _mm_loadu_pd(x + i);
+		__m128d py = _mm_loadu_pd(y + i);
+		//floor: truncate, then step down where that rounded a negative coordinate up
+		__m128d fx = _mm_cvtepi32_pd(_mm_cvttpd_epi32(px));
+		__m128d fy = _mm_cvtepi32_pd(_mm_cvttpd_epi32(py));
+		fx = _mm_sub_pd(fx, _mm_and_pd(_mm_cmpgt_pd(fx, px), one));
+		fy = _mm_sub_pd(fy, _mm_and_pd(_mm_cmpgt_pd(fy, py), one));
+		__m128i cellX = _mm_cvttpd_epi32(fx);
+		__m128i cellY = _mm_cvttpd_epi32(fy);
+
+		//Hashes of the 4 corners of the lower face for both points, the gathers stay scalar
+		int h[2][4];
+		for (int lane = 0; lane < 2; ++lane)
+		{
+			int X = _mm_cvtsi128_si32(lane == 0 ? cellX : _mm_srli_si128(cellX, 4)) & 255;
+			int Y = _mm_cvtsi128_si32(lane == 0 ? cellY : _mm_srli_si128(cellY, 4)) & 255;
+			int A = perm[X] + Y;
+			int B = perm[X + 1] + Y;
+			h[lane][0] = perm[perm[A]] & 15;
+			h[lane][1] = perm[perm[B]] & 15;
+			h[lane][2] = perm[perm[A + 1]] & 15;
+			h[lane][3] = perm[perm[B + 1]] & 15;
+		}
+
+		__m128d dx = _mm_sub_pd(px, fx);
+		__m128d dy = _mm_sub_pd(py, fy);
+		__m128d dx1 = _mm_sub_pd(dx, one);
+		__m128d dy1 = _mm_sub_pd(dy, one);
+		__m128d corner[4], gx[4], gy[4];
+		const __m128d cornerX[4] = { dx, dx1, dx, dx1 };
+		const __m128d cornerY[4] = { dy, dy, dy1, dy1 };
+		for (int c = 0; c < 4; ++c)
+		{
+			gx[c] = _mm_set_pd(GRADIENT_X[h[1][c]], GRADIENT_X[h[0][c]]);
+			gy[c] = _mm_set_pd(GRADIENT_Y[h[1][c]], GRADIENT_Y[h[0][c]]);
+			corner[c] = _mm_add_pd(_mm_mul_pd(gx[c], cornerX[c]), _mm_mul_pd(gy[c], cornerY[c]));
+		}
+
+		//fade(t) = t * t * t * (t * (t * 6 - 15) + 10)
+		const __m128d six = _mm_set1_pd(6.0), fifteen = _mm_set1_pd(15.0), ten = _mm_set1_pd(10.0);
+		__m128d u = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(dx, dx), dx), _mm_add_pd(_mm_mul_pd(dx, _mm_sub_pd(_mm_mul_pd(dx, six), fifteen)), ten));
+		__m128d v = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(dy, dy), dy), _mm_add_pd(_mm_mul_pd(dy, _mm_sub_pd(_mm_mul_pd(dy, six), fifteen)), ten));
+		__m128d lower = _mm_add_pd(corner[0], _mm_mul_pd(u, _mm_sub_pd(corner[1], corner[0])));
+		__m128d upper = _mm_add_pd(corner[2], _mm_mul_pd(u, _mm_sub_pd(corner[3], corner[2])));
+		_mm_storeu_pd(values + i, _mm_add_pd(lower, _mm_mul_pd(v, _mm_sub_pd(upper, lower))));
+		if (!gradients)
+			continue;
+
+		//Blended corner gradients plus the change of the blend weights, as in noise(x, y, gradient)
+		const __m128d two = _mm_set1_pd(2.0), thirty = _mm_set1_pd(30.0);
+		__m128d du = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(thirty, dx), dx), _mm_add_pd(_mm_mul_pd(dx, _mm_sub_pd(dx, two)), one));
+		__m128d dv = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(thirty, dy), dy), _mm_add_pd(_mm_mul_pd(dy, _mm_sub_pd(dy, two)), one));
+		__m128d u1 = _mm_sub_pd(one, u);
+		__m128d v1 = _mm_sub_pd(one, v);
+		__m128d blendX = _mm_add_pd(_mm_mul_pd(v1, _mm_add_pd(_mm_mul_pd(u1, gx[0]), _mm_mul_pd(u, gx[1]))),
+			_mm_mul_pd(v, _mm_add_pd(_mm_mul_pd(u1, gx[2]), _mm_mul_pd(u, gx[3]))));
+		__m128d blendY = _mm_add_pd(_mm_mul_pd(v1, _mm_add_pd(_mm_mul_pd(u1, gy[0]), _mm_mul_pd(u, gy[1]))),
+			_mm_mul_pd(v, _mm_add_pd(_mm_mul_pd(u1, gy[2]), _mm_mul_pd(u, gy[3]))));
+		__m128d ba = _mm_sub_pd(corner[1], corner[0]);
+		__m128d dc = _mm_sub_pd(corner[3], corner[2]);
+		_mm_storeu_pd(gradientX + i, _mm_add_pd(blendX, _mm_mul_pd(du, _mm_add_pd(ba, _mm_mul_pd(v, _mm_sub_pd(dc, ba))))));
+		_mm_storeu_pd(gradientY + i, _mm_add_pd(blendY, _mm_mul_pd(dv, _mm_sub_pd(upper, lower))));
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		if (gradients)
+		{
+			glm::dvec2 gradient;
+			values[i] = noise(x[i], y[i], gradient);
+			gradientX[i] = gradient.x;
+			gradientY[i] = gradient.y;
+		}
+		else
+			values[i] = noise(x[i], y[i], 0.0);
+	}
+}
+
+
+HeightField PerlinNoise::generateNoiseMap(const NoiseData& noiseData) const
 {
-	std::vector<std::vector<double>> noiseMap(noiseData.H, std::vector<double>(noiseData.W));
+	HeightField noiseMap;
+	generateNoiseMap(noiseData, noiseMap);
+	return noiseMap;
+}
+
+void PerlinNoise::generateNoiseMap(const NoiseData& noiseData, HeightField& noiseMap) const
+{
+	generateNoiseMap(noiseData, 1, noiseMap);
+}
+
+double PerlinNoise::octaveLimit(const NoiseData& noiseData, double spacing)
+{
+	//Octave i advances lacunarity^i / (W * scale) noise cells per vertex, a noise cell has to span two samples.
+	//The shorter side of the map has the larger step.
+	double cellsPerSample = spacing / (std::max(std::min(noiseData.W, noiseData.H), 1) * noiseData.scale);
+	//Without a lacunarity above 1 every octave has the frequency of the first one
+	if (noiseData.lacunarity <= 1.0)
+		return cellsPerSample <= 0.5 ? (double)noiseData.octaves : -1.0;
+	return std::log(0.5 / cellsPerSample) / std::log(noiseData.lacunarity);
+}
+
+int PerlinNoise::bandLimitedOctaves(const NoiseData& noiseData, double spacing)
+{
+	double limit = octaveLimit(noiseData, spacing);
+	return limit < 0.0 ? 1 : (int)std::min(std::floor(limit) + 1.0, (double)std::max(noiseData.octaves, 1));
+}
+
+double PerlinNoise::lastOctaveWeight(const NoiseData& noiseData, double spacing)
+{
+	int octaves = bandLimitedOctaves(noiseData, spacing);
+	if (!noiseData.fadeLastOctave || octaves <= 1 || octaves >= noiseData.octaves)
+		return 1.0;
+	//0 when the octave is just resolved, 1 when the next one is
+	double t = octaveLimit(noiseData, spacing) - (octaves - 1);
+	return t * t * (3.0 - 2.0 * t);
+}
+
+void PerlinNoise::generateNoiseMap(const NoiseData& noiseData, int step, HeightField& noiseMap) const
+{
+	generate(noiseData, step, noiseMap, nullptr, nullptr);
+}
+
+void PerlinNoise::generateNoiseMap(const NoiseData& noiseData, HeightField& noiseMap, HeightField& gradientX, HeightField& gradientZ) const
+{
+	generate(noiseData, 1, noiseMap, &gradientX, &gradientZ);
+}
+
+void PerlinNoise::generate(const NoiseData& noiseData, int step, HeightField& noiseMap, HeightField* gradientX, HeightField* gradientZ) const
+{
+	PROFILE_ZONE("noise");
+	step = std::max(step, 1);
+	FractalMode mode = noiseData.fractalMode;
+	int octaveCount = noiseData.octaves;
+	double lastWeight = 1.0;
+	if (noiseData.octaveMode == OctaveMode::BandLimited)
+	{
+		octaveCount = std::min(bandLimitedOctaves(noiseData, step), noiseData.octaves);
+		lastWeight = lastOctaveWeight(noiseData, step);
+	}
+	int mapW = (noiseData.W - 1) / step + 1;
+	int mapH = (noiseData.H - 1) / step + 1;
+	if (noiseMap.getWidth() != mapW || noiseMap.getHeight() != mapH)
+		noiseMap.resize(mapW, mapH);
+	bool gradients = gradientX != nullptr && gradientZ != nullptr && mode == FractalMode::Fbm;
+	if (gradients && (gradientX->getWidth() != mapW || gradientX->getHeight() != mapH))
+		gradientX->resize(mapW, mapH);
+	if (gradients && (gradientZ->getWidth() != mapW || gradientZ->getHeight() != mapH))
+		gradientZ->resize(mapW, mapH);
 	std::mt19937 mt(noiseData.seed);
 	std::uniform_real_distribution<double> dist(-10000, 10000);
 	//We want to each octave to be sampled from a different location of the Perlin Noise Map
-	//So each octave will use an offset
-	std::vector<glm::vec2> octaveOffsets(noiseData.octaves);
-
-	double halfW = noiseData.W / 2;
-	double halfH = noiseData.H / 2;
+	//So each octave will use an offset. The two warp fields come after the octaves, from the same sequence.
+	int fields = mode == FractalMode::DomainWarp ? 3 : 1;
+	std::vector<glm::vec2> octaveOffsets(noiseData.octaves * fields);
 
-
-	for (int i = 0; i < noiseData.octaves; ++i)
+	for (int i = 0; i < noiseData.octaves * fields; ++i)
 	{
 		double offsetX = dist(mt);
 		double offsetY = dist(mt);
@@ -79,48 +281,183 @@ std::vector<std::vector<double>> PerlinNoise::generateNoiseMap(const NoiseData&
 	//Will be used to normalize the map
 	double minHeight, maxHeight;
 	minHeight = DBL_MAX;
-	maxHeight = DBL_MIN;
+	maxHeight = -DBL_MAX;
 
-	for (int y = 0; y < noiseData.H; ++y)
+	//Rows are independent, each band keeps its own range and merges it at the end
+	std::mutex rangeMutex;
+	ThreadPool::global().parallelFor(0, mapH, [&](int yBegin, int yEnd)
 	{
-		for (int x = 0; x < noiseData.W; ++x)
+		PROFILE_ZONE("noise rows");
+		double bandMin = DBL_MAX;
+		double bandMax = -DBL_MAX;
+		for (int y = yBegin; y < yEnd; ++y)
 		{
-			//Each noise value will consists of octaves whose frequencies and amplitudes
-			//are increased/decreased by the effect of lacunarity and persistence
-			double amplitude = 1.0;
-			double frequency = 1.0;
-			double noiseHeight = 0.0; //Will be accumulated from octaves
-			for (int i = 0; i < noiseData.octaves; ++i)
-			{
-				//Frequency increases the range we take our values from the Noise Map
-				//Offset is a random seeded pseudo value so that we offset the octave we take
-				//our value from.
-				//Also we center the our samples at the center of the map
-				double sampleX = ((x - halfW) / noiseData.W / noiseData.scale) * frequency + octaveOffsets[i].x;
-				double sampleY = ((y - halfH) / noiseData.H / noiseData.scale) * frequency + octaveOffsets[i].y;
-
-				//For now using 0 as Z value
-				double noiseVal = noise(sampleX, sampleY, 0.0);
-				noiseHeight += noiseVal * amplitude;
-				amplitude *= noiseData.persistence;
-				frequency *= noiseData.lacunarity;
-			}
-
-			noiseMap[y][x] = noiseHeight;
-			maxHeight = std::max(noiseHeight, maxHeight);
-			minHeight = std::min(noiseHeight, minHeight);
+			double rowMin, rowMax;
+			generateRow(noiseData, step, y, octaveCount, lastWeight, octaveOffsets.data(), noiseMap.row(y), rowMin, rowMax,
+				gradients ? gradientX->row(y) : nullptr, gradients ? gradientZ->row(y) : nullptr);
+			bandMax = std::max(rowMax, bandMax);
+			bandMin = std::min(rowMin, bandMin);
+		}
+		std::lock_guard<std::mutex> lock(rangeMutex);
+		maxHeight = std::max(bandMax, maxHeight);
+		minHeight = std::min(bandMin, minHeight);
+	}, 16);
 
+	//Normalize the map so that it is mapped between 0.0 and 1.0 
+	for (int y = 0; y < mapH; ++y)
+	{
+		float* row = noiseMap.row(y);
+		for (int x = 0; x < mapW; ++x)
+			row[x] = (float)inverseLerp(minHeight, maxHeight, row[x]);
+	}
+	//The normalization scales the derivatives too
+	if (gradients)
+	{
+		float toNormalized = (float)(1.0 / (maxHeight - minHeight));
+		for (size_t i = 0; i < noiseMap.size(); ++i)
+		{
+			gradientX->data()[i] *= toNormalized;
+			gradientZ->data()[i] *= toNormalized;
 		}
 	}
 
-	//Normalize the map so that it is mapped between 0.0 and 1.0 
-	for (int y = 0; y < noiseData.H; ++y)
+}
+
+void PerlinNoise::generateRow(const NoiseData& noiseData, int step, int y, int octaveCount, double lastWeight, const glm::vec2* octaveOffsets,
+	float* row, double& rowMin, double& rowMax, float* gradientRowX, float* gradientRowZ) const
+{
+	int mapW = (noiseData.W - 1) / step + 1;
+	bool gradients = gradientRowX != nullptr && gradientRowZ != nullptr;
+	//Noise units per map vertex, the derivatives of the octaves are per noise unit
+	double toVertexX = step / (noiseData.W * noiseData.scale);
+	double toVertexZ = step / (noiseData.H * noiseData.scale);
+	double halfW = noiseData.W / 2;
+	double halfH = noiseData.H / 2;
+	//Centered on the map, in cells of the first octave
+	double pointZ = (y * step - halfH) / noiseData.H / noiseData.scale;
+	//The warp fields are divided by their largest possible value, so warpStrength does not depend on the octaves
+	double warpScale = 0.0;
+	if (noiseData.fractalMode == FractalMode::DomainWarp)
 	{
-		for (int x = 0; x < noiseData.W; ++x)
-			noiseMap[y][x] = inverseLerp(minHeight, maxHeight, noiseMap[y][x]);
+		double amplitude = 1.0, amplitudeSum = 0.0;
+		for (int i = 0; i < octaveCount; ++i, amplitude *= noiseData.persistence)
+			amplitudeSum += i + 1 == octaveCount ? amplitude * lastWeight : amplitude;
+		warpScale = amplitudeSum > 0.0 ? noiseData.warpStrength / amplitudeSum : 0.0;
 	}
 
-	return noiseMap;
+	double pointX[TILE_SAMPLES], pointY[TILE_SAMPLES], warpX[TILE_SAMPLES], warpY[TILE_SAMPLES], values[TILE_SAMPLES];
+	double valueGradientX[TILE_SAMPLES], valueGradientY[TILE_SAMPLES];
+	rowMin = DBL_MAX;
+	rowMax = -DBL_MAX;
+	for (int x0 = 0; x0 < mapW; x0 += TILE_SAMPLES)
+	{
+		int count = std::min(TILE_SAMPLES, mapW - x0);
+		for (int j = 0; j < count; ++j)
+		{
+			pointX[j] = ((x0 + j) * step - halfW) / noiseData.W / noiseData.scale;
+			pointY[j] = pointZ;
+		}
+		FractalMode mode = noiseData.fractalMode;
+		if (mode == FractalMode::DomainWarp)
+		{
+			//q = fbm(p + k * (fbm1(p), fbm2(p))), the two fields use the offsets after the ones of the octaves
+			fractal(FractalMode::Fbm, pointX, pointY, count, octaveCount, noiseData.persistence, noiseData.lacunarity, lastWeight,
+				octaveOffsets + noiseData.octaves, warpX);
+			fractal(FractalMode::Fbm, pointX, pointY, count, octaveCount, noiseData.persistence, noiseData.lacunarity, lastWeight,
+				octaveOffsets + 2 * noiseData.octaves, warpY);
+			for (int j = 0; j < count; ++j)
+			{
+				pointX[j] += warpScale * warpX[j];
+				pointY[j] += warpScale * warpY[j];
+			}
+			mode = FractalMode::Fbm;
+		}
+		fractal(mode, pointX, pointY, count, octaveCount, noiseData.persistence, noiseData.lacunarity, lastWeight, octaveOffsets, values,
+			gradients ? valueGradientX : nullptr, gradients ? valueGradientY : nullptr);
+		for (int j = 0; j < count; ++j)
+		{
+			row[x0 + j] = (float)values[j];
+			rowMax = std::max(values[j], rowMax);
+			rowMin = std::min(values[j], rowMin);
+		}
+		if (gradients)
+		{
+			for (int j = 0; j < count; ++j)
+			{
+				gradientRowX[x0 + j] = (float)(valueGradientX[j] * toVertexX);
+				gradientRowZ[x0 + j] = (float)(valueGradientY[j] * toVertexZ);
+			}
+		}
+	}
+}
+
+void PerlinNoise::fractal(FractalMode mode, const double* x, const double* y, int count, int octaveCount, double persistence, double lacunarity,
+	double lastWeight, const glm::vec2* octaveOffsets, double* values, double* gradientX, double* gradientY) const
+{
+	bool gradients = gradientX != nullptr && gradientY != nullptr && mode == FractalMode::Fbm;
+	double sampleX[TILE_SAMPLES], sampleY[TILE_SAMPLES], octave[TILE_SAMPLES], octaveGradientX[TILE_SAMPLES], octaveGradientY[TILE_SAMPLES];
+	//Multifractals only: how much the octaves so far let the next one through
+	double weight[TILE_SAMPLES];
+	for (int j = 0; j < count; ++j)
+	{
+		values[j] = 0.0;
+		weight[j] = 1.0;
+		if (gradients)
+			gradientX[j] = gradientY[j] = 0.0;
+	}
+	double amplitude = 1.0;
+	double frequency = 1.0;
+	for (int i = 0; i < octaveCount; ++i)
+	{
+		//Each octave samples its own part of the noise, at a frequency raised by lacunarity and an amplitude
+		//lowered by persistence
+		for (int j = 0; j < count; ++j)
+		{
+			sampleX[j] = x[j] * frequency + octaveOffsets[i].x;
+			sampleY[j] = y[j] * frequency + octaveOffsets[i].y;
+		}
+		noise(sampleX, sampleY, octave, count, gradients ? octaveGradientX : nullptr, gradients ? octaveGradientY : nullptr);
+		double octaveWeight = i + 1 == octaveCount ? amplitude * lastWeight : amplitude;
+		switch (mode)
+		{
+		case FractalMode::RidgedMultifractal:
+			//Creases where the noise crosses 0 become ridges, and only octaves on a ridge add detail
+			for (int j = 0; j < count; ++j)
+			{
+				double signal = RIDGE_OFFSET - std::abs(octave[j]);
+				signal *= signal * weight[j];
+				values[j] += signal * octaveWeight;
+				weight[j] = std::min(std::max(signal * RIDGE_GAIN, 0.0), 1.0);
+			}
+			break;
+		case FractalMode::HybridMultifractal:
+			//The running product of the octaves damps the detail in the low places
+			for (int j = 0; j < count; ++j)
+			{
+				double signal = (octave[j] + HYBRID_OFFSET) * octaveWeight;
+				weight[j] = std::min(weight[j], 1.0);
+				values[j] += weight[j] * signal;
+				weight[j] *= signal;
+			}
+			break;
+		default:
+			for (int j = 0; j < count; ++j)
+				values[j] += octave[j] * octaveWeight;
+			//An octave's derivatives are scaled by its frequency
+			if (gradients)
+			{
+				double gradientWeight = octaveWeight * frequency;
+				for (int j = 0; j < count; ++j)
+				{
+					gradientX[j] += octaveGradientX[j] * gradientWeight;
+					gradientY[j] += octaveGradientY[j] * gradientWeight;
+				}
+			}
+			break;
+		}
+		amplitude *= persistence;
+		frequency *= lacunarity;
+	}
 }
 
 double PerlinNoise::fade(double t) const
@@ -128,6 +465,17 @@ double PerlinNoise::fade(double t) const
 	return t * t * t * (t * (t * 6 - 15) + 10);;
 }
 
+double PerlinNoise::fadeDerivative(double t) const
+{
+	return 30 * t * t * (t * (t - 2) + 1);
+}
+
+glm::dvec2 PerlinNoise::gradientOf(int hash) const
+{
+	//The x and y weights grad gives the point, z is 0 here
+	return glm::dvec2(GRADIENT_X[hash & 15], GRADIENT_Y[hash & 15]);
+}
+
 double PerlinNoise::lerp(double t, double a, double b) const
 {
 	return a + t * (b - a);
@@ -6,6 +6,22 @@
 #include <random>
 #include <glm/glm.hpp>
 
+#include "HeightField.h"
+
+
+enum class OctaveMode
+{
+	Fixed, //Every octave is summed, whatever the spacing of the samples
+	BandLimited //Octaves finer than the samples can hold are dropped (PerlinNoise::bandLimitedOctaves)
+};
+
+enum class FractalMode
+{
+	Fbm, //Sum of the octaves (fractional Brownian motion)
+	RidgedMultifractal, //Sharp ridges from the inverted absolute noise, each octave weighted by the one before it
+	HybridMultifractal, //Smooth valleys and rough peaks, each octave weighted by the running sum
+	DomainWarp //fBm sampled at points moved by two other fBm fields, warpStrength first octave cells far
+};
 
 /*
 	Necessary data needed for Noise Map Generation
@@ -21,6 +37,10 @@ struct NoiseData
 	double persistence;
 	double lacunarity;
 	glm::vec2 offset;
+	OctaveMode octaveMode;
+	bool fadeLastOctave; //Band limited only: the last octave fades in as the samples get closer, instead of popping in
+	FractalMode fractalMode;
+	double warpStrength; //DomainWarp only: the k of fbm(p + k * fbm(p)), in cells of the first octave
 };
 
 
@@ -33,6 +53,10 @@ struct NoiseData
 	Generating the Noise Map
 	REFERENCE: Sebastian Lague's Procedural Terrain Generation Series
 	Youtube Channel: https://www.youtube.com/channel/UCmtyQOKKmrMVaKuRXz02jbQ
+
+	The maps are generated a row tile at a time: the sample points of a tile go through the batched noise octave by
+	octave, and NoiseData::fractalMode combines the octaves as fBm or as Musgrave's ridged and hybrid multifractals.
+	DomainWarp evaluates the two warp fields of a tile just before the fBm that samples them.
 */
 
 
@@ -42,15 +66,49 @@ public:
 	PerlinNoise();
 	//in our case Z is not important 
 	double noise(double x, double y, double z) const;
-	std::vector<std::vector<double>> generateNoiseMap(const NoiseData& noiseData) const;
+	//noise(x, y, 0) with its derivatives along x and y
+	double noise(double x, double y, glm::dvec2& gradient) const;
+	//values[i] = noise(x[i], y[i], 0), two points at a time (SSE2). With gradientX and gradientY, also the derivatives
+	//noise(x[i], y[i], gradient) gives.
+	void noise(const double* x, const double* y, double* values, int count, double* gradientX = nullptr, double* gradientY = nullptr) const;
+	HeightField generateNoiseMap(const NoiseData& noiseData) const;
+	//Same as above into an existing map, which is only reallocated if its size changes
+	void generateNoiseMap(const NoiseData& noiseData, HeightField& noiseMap) const;
+	//Every step-th vertex of the map noiseData describes, the band limited octaves are the ones that step resolves.
+	//The map is ((W - 1) / step + 1) x ((H - 1) / step + 1), the samples lie where the full map has them.
+	void generateNoiseMap(const NoiseData& noiseData, int step, HeightField& noiseMap) const;
+	//Also gives the derivatives of the normalized map along x and z (per vertex), summed through the octaves in the
+	//same pass as the heights. fBm only: with the other fractal modes the map is generated and the derivatives are left
+	//as they are.
+	void generateNoiseMap(const NoiseData& noiseData, HeightField& noiseMap, HeightField& gradientX, HeightField& gradientZ) const;
+	//Octaves of noiseData whose features are still two samples wide when samples are spacing vertices apart,
+	//the finer ones would only alias. At least one.
+	static int bandLimitedOctaves(const NoiseData& noiseData, double spacing);
+	//Weight of the last band limited octave with fadeLastOctave, 1 without it or when every octave is kept
+	static double lastOctaveWeight(const NoiseData& noiseData, double spacing);
 
 private:
 	std::vector<int> p; //Permutation vector
 private:
+	void generate(const NoiseData& noiseData, int step, HeightField& noiseMap, HeightField* gradientX, HeightField* gradientZ) const;
+	//One row of the map, in tiles of a few dozen samples: every octave of a tile runs through the batched noise, and the
+	//warp of a tile is evaluated right before it, so the intermediate values never leave the cache. Gives the range of
+	//the row before normalization. The derivatives per vertex, before normalization, go to the gradient rows if given.
+	void generateRow(const NoiseData& noiseData, int step, int y, int octaveCount, double lastWeight, const glm::vec2* octaveOffsets,
+		float* row, double& rowMin, double& rowMax, float* gradientRowX = nullptr, float* gradientRowZ = nullptr) const;
+	//Fractal sum of the octaves at count points (x[i], y[i]) in first octave units, into values. fBm also sums the
+	//derivatives per first octave unit into gradientX and gradientY if given.
+	void fractal(FractalMode mode, const double* x, const double* y, int count, int octaveCount, double persistence, double lacunarity,
+		double lastWeight, const glm::vec2* octaveOffsets, double* values, double* gradientX = nullptr, double* gradientY = nullptr) const;
 	double fade(double t) const;
+	double fadeDerivative(double t) const;
+	//Weights of x and y in grad for the hash
+	glm::dvec2 gradientOf(int hash) const;
 	double lerp(double t, double a, double b) const;
 	double inverseLerp(double a, double b, double val) const;
 	double grad(int hash, double x, double y, double z) const;
+	//Index of the finest octave the samples resolve, fractional, below 0 when not even the first one is
+	static double octaveLimit(const NoiseData& noiseData, double spacing);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "PoissonScatter.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cfloat>
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+
+	//Small PCG style generator. Seeded per tile, so the result does not depend on which thread runs a tile.
+	struct TileRandom
+	{
+		uint32_t state;
+
+		TileRandom(uint32_t seed)
+			:
+			state(seed)
+		{}
+
+		uint32_t next()
+		{
+			state = state * 747796405u + 2891336453u;
+			uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+			return (word >> 22u) ^ word;
+		}
+
+		//Uniform in [0, 1)
+		float uniform()
+		{
+			return (next() >> 8) * (1.0f / 16777216.0f);
+		}
+	};
+
+	uint32_t hashTile(uint32_t seed, int tx, int tz)
+	{
+		uint32_t h = seed * 0x9E3779B9u ^ (uint32_t)tx * 0x85EBCA6Bu ^ (uint32_t)tz * 0xC2B2AE35u;
+		h ^= h >> 16;
+		h *= 0x7FEB352Du;
+		h ^= h >> 15;
+		return h;
+	}
+}
+
+PoissonScatter::PoissonScatter()
+	:
+	gridW(0),
+	gridH(0),
+	tilesX(0),
+	tilesZ(0),
+	cellSize(0.0f),
+	origin(0.0f),
+	extent(0.0f),
+	instanceCount(0),
+	candidateCount(0)
+{}
+
+void PoissonScatter::clear()
+{
+	tiles.clear();
+	instanceCount = 0;
+	candidateCount = 0;
+}
+
+size_t PoissonScatter::scatter(const ScatterLayer& layer, unsigned int seed, const TerrainQuery& query, const std::vector<unsigned char>& biomeIDs)
+{
+	clear();
+	glm::ivec2 samples = query.getSampleCount();
+	if (!query.isValid() || biomeIDs.size() != (size_t)samples.x * samples.y || layer.minDistance <= 0.0f || layer.density <= 0.0f)
+		return 0;
+
+	extent = query.getExtent();
+	origin = -0.5f * extent;
+
+	float minDistance = layer.minDistance;
+	cellSize = minDistance / std::sqrt(2.0f);
+	double cells = std::ceil(extent.x / cellSize) * std::ceil(extent.y / cellSize);
+	if (cells > (double)MAX_GRID_CELLS)
+	{
+		minDistance *= (float)std::sqrt(cells / MAX_GRID_CELLS);
+		cellSize = minDistance / std::sqrt(2.0f);
+	}
+	gridW = std::max((int)std::ceil(extent.x / cellSize), 1);
+	gridH = std::max((int)std::ceil(extent.y / cellSize), 1);
+	tilesX = (gridW + TILE_CELLS - 1) / TILE_CELLS;
+	tilesZ = (gridH + TILE_CELLS - 1) / TILE_CELLS;
+
+	//Buffers only grow, the next scatter reuses them
+	size_t slotsPerTile = (size_t)TILE_CELLS * TILE_CELLS;
+	grid.assign((size_t)gridW * gridH, -1);
+	if (instances.size() < slotsPerTile * tilesX * tilesZ)
+		instances.resize(slotsPerTile * tilesX * tilesZ);
+	tiles.resize((size_t)tilesX * tilesZ);
+
+	ScatterLayer clamped = layer;
+	clamped.minDistance = minDistance;
+	for (int tz = 0; tz < tilesZ; ++tz)
+	{
+		for (int tx = 0; tx < tilesX; ++tx)
+		{
+			int cellsX = std::min(TILE_CELLS, gridW - tx * TILE_CELLS);
+			int cellsZ = std::min(TILE_CELLS, gridH - tz * TILE_CELLS);
+			candidateCount += (size_t)(clamped.density * cellsX * cellsZ);
+		}
+	}
+
+	//Tiles of one phase are never neighbours, so they can be filled at the same time
+	std::vector<glm::ivec2> phaseTiles;
+	phaseTiles.reserve(tiles.size() / 4 + 1);
+	for (int phase = 0; phase < 4; ++phase)
+	{
+		phaseTiles.clear();
+		for (int tz = phase / 2; tz < tilesZ; tz += 2)
+			for (int tx = phase % 2; tx < tilesX; tx += 2)
+				phaseTiles.push_back(glm::ivec2(tx, tz));
+
+		ThreadPool::global().parallelFor(0, (int)phaseTiles.size(), [&](int begin, int end)
+		{
+			PROFILE_ZONE("scatter tiles");
+			for (int i = begin; i < end; ++i)
+				scatterTile(phaseTiles[i].x, phaseTiles[i].y, clamped, seed, query, biomeIDs);
+		});
+	}
+
+	compact();
+	return instanceCount;
+}
+
+void PoissonScatter::scatterTile(int tx, int tz, const ScatterLayer& layer, unsigned int seed, const TerrainQuery& query, const std::vector<unsigned char>& biomeIDs)
+{
+	ScatterTile& tile = tiles[(size_t)tz * tilesX + tx];
+	tile.begin = ((size_t)tz * tilesX + tx) * TILE_CELLS * TILE_CELLS;
+	tile.count = 0;
+	tile.boundsMin = glm::vec3(FLT_MAX);
+	tile.boundsMax = glm::vec3(-FLT_MAX);
+	tile.maxScale = 0.0f;
+
+	int cx0 = tx * TILE_CELLS;
+	int cz0 = tz * TILE_CELLS;
+	int cx1 = std::min(cx0 + TILE_CELLS, gridW);
+	int cz1 = std::min(cz0 + TILE_CELLS, gridH);
+	//World rectangle of the tile, the last cells can stick out of the terrain
+	float x0 = origin.x + cx0 * cellSize;
+	float z0 = origin.y + cz0 * cellSize;
+	float sizeX = std::min(origin.x + cx1 * cellSize, origin.x + extent.x) - x0;
+	float sizeZ = std::min(origin.y + cz1 * cellSize, origin.y + extent.y) - z0;
+
+	float minDistance2 = layer.minDistance * layer.minDistance;
+	float minNormalY = std::cos(layer.maxSlope * PI / 180.0f);
+	int biomeRowLength = query.getSampleCount().x;
+	size_t candidates = (size_t)(layer.density * (cx1 - cx0) * (cz1 - cz0));
+
+	TileRandom rng(hashTile(seed, tx, tz));
+	for (size_t c = 0; c < candidates; ++c)
+	{
+		float x = x0 + rng.uniform() * sizeX;
+		float z = z0 + rng.uniform() * sizeZ;
+		//Rounding can put a candidate on the edge of the tile in the cell next to it, on either side
+		int gx = std::max(std::min((int)((x - origin.x) / cellSize), cx1 - 1), cx0);
+		int gz = std::max(std::min((int)((z - origin.y) / cellSize), cz1 - 1), cz0);
+		int& slot = grid[(size_t)gz * gridW + gx];
+		if (slot >= 0)
+			continue;
+
+		glm::ivec2 sample = query.getNearestSample(x, z);
+		unsigned int biome = biomeIDs[(size_t)sample.y * biomeRowLength + sample.x];
+		if (biome >= 32 || !(layer.biomeMask & (1u << biome)))
+			continue;
+
+		//Only the 5x5 cells around can hold an instance closer than minDistance
+		bool tooClose = false;
+		for (int nz = std::max(gz - 2, 0); nz <= std::min(gz + 2, gridH - 1) && !tooClose; ++nz)
+		{
+			for (int nx = std::max(gx - 2, 0); nx <= std::min(gx + 2, gridW - 1); ++nx)
+			{
+				int other = grid[(size_t)nz * gridW + nx];
+				if (other < 0)
+					continue;
+				float dx = instances[other].position.x - x;
+				float dz = instances[other].position.z - z;
+				if (dx * dx + dz * dz < minDistance2)
+				{
+					tooClose = true;
+					break;
+				}
+			}
+		}
+		if (tooClose)
+			continue;
+
+		if (query.getNormal(x, z).y < minNormalY)
+			continue;
+
+		ScatterInstance& instance = instances[tile.begin + tile.count];
+		instance.position = glm::vec3(x, query.getHeight(x, z), z);
+		instance.scale = layer.minScale + (layer.maxScale - layer.minScale) * rng.uniform();
+		instance.yaw = 2.0f * PI * rng.uniform();
+		slot = (int)(tile.begin + tile.count);
+		++tile.count;
+
+		tile.boundsMin = glm::min(tile.boundsMin, instance.position);
+		tile.boundsMax = glm::max(tile.boundsMax, instance.position);
+		tile.maxScale = std::max(tile.maxScale, instance.scale);
+	}
+}
+
+void PoissonScatter::compact()
+{
+	//Moves every tile's instances to the front. Destinations never pass their sources, so it works in place.
+	size_t next = 0;
+	size_t kept = 0;
+	for (ScatterTile& tile : tiles)
+	{
+		if (tile.count == 0)
+			continue;
+		std::copy(instances.begin() + tile.begin, instances.begin() + tile.begin + tile.count, instances.begin() + next);
+		tile.begin = next;
+		next += tile.count;
+		tiles[kept++] = tile;
+	}
+	tiles.resize(kept);
+	instanceCount = next;
+}
+
+size_t PoissonScatter::getInstanceCount() const
+{
+	return instanceCount;
+}
+
+size_t PoissonScatter::getCandidateCount() const
+{
+	return candidateCount;
+}
+
+const ScatterInstance* PoissonScatter::getInstances() const
+{
+	return instances.data();
+}
+
+const std::vector<ScatterTile>& PoissonScatter::getTiles() const
+{
+	return tiles;
+}
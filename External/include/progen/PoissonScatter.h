@@ -0,0 +1,93 @@
+#ifndef POISSON_SCATTER_H
+#define POISSON_SCATTER_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "TerrainQuery.h"
+
+/*
+	Parameters of one kind of scattered object (trees, rocks...)
+*/
+struct ScatterLayer
+{
+	float minDistance; //Poisson-disk radius: no two instances are closer than this (world units)
+	float density; //Candidates thrown per background grid cell. Higher fills the disk packing closer to maximal.
+	float maxSlope; //Steepest ground (degrees) an instance can stand on
+	unsigned int biomeMask; //Bit i set: allowed on biome ID i
+	float minScale, maxScale;
+};
+
+/*
+	Placement of one instance: position on the ground, uniform scale and rotation around the y axis.
+	This is exactly the per-instance vertex attribute layout, so culled instances are copied straight into the GPU buffer.
+*/
+struct ScatterInstance
+{
+	glm::vec3 position;
+	float scale;
+	float yaw;
+};
+
+/*
+	Instances of a tile are contiguous. The bounds are of the instance positions, callers grow them by the mesh size.
+*/
+struct ScatterTile
+{
+	size_t begin;
+	size_t count;
+	glm::vec3 boundsMin, boundsMax;
+	float maxScale;
+};
+
+
+/*
+	Poisson-disk scattering over the terrain by dart throwing on a background grid.
+
+	The grid has cells of minDistance / sqrt(2), so a cell holds at most one instance and a candidate only has to be
+	checked against the 5x5 cells around it. Candidates are drawn uniformly inside TILE_CELLS x TILE_CELLS tiles and
+	rejected, cheapest test first, if their cell is taken, the biome under them is not in the mask, an instance is
+	closer than minDistance or the ground is too steep.
+
+	Tiles are processed in 4 phases by the parity of their (x, z) coordinates. Tiles of the same phase are a whole
+	tile apart and never look at each other's cells, so every phase runs in parallel on the ThreadPool while the
+	result stays independent of the thread count.
+
+	Every grid cell owns one instance slot, so all the memory is allocated up front per scatter call and reused by
+	the next one: no allocation per instance or per candidate. Afterwards the tiles are compacted in place.
+*/
+
+class PoissonScatter
+{
+public:
+	//Width in grid cells of a tile that is handled by one job
+	static constexpr int TILE_CELLS = 32;
+	//Upper bound for the background grid. minDistance is raised if the terrain would need more cells.
+	static constexpr size_t MAX_GRID_CELLS = size_t(1) << 22;
+
+	PoissonScatter();
+	//biomeIDs holds one ID per height sample of the query. Returns the number of instances.
+	size_t scatter(const ScatterLayer& layer, unsigned int seed, const TerrainQuery& query, const std::vector<unsigned char>& biomeIDs);
+	void clear();
+	size_t getInstanceCount() const;
+	size_t getCandidateCount() const;
+	const ScatterInstance* getInstances() const;
+	const std::vector<ScatterTile>& getTiles() const;
+private:
+	void scatterTile(int tx, int tz, const ScatterLayer& layer, unsigned int seed, const TerrainQuery& query, const std::vector<unsigned char>& biomeIDs);
+	void compact();
+private:
+	int gridW, gridH;
+	int tilesX, tilesZ;
+	float cellSize;
+	glm::vec2 origin; //World position of the corner of grid cell (0, 0)
+	glm::vec2 extent; //World extents of the terrain
+	std::vector<int> grid; //Slot of the instance in every cell, -1 if empty
+	std::vector<ScatterInstance> instances; //TILE_CELLS^2 slots per tile until compacted
+	std::vector<ScatterTile> tiles;
+	size_t instanceCount;
+	size_t candidateCount;
+};
+
+#endif
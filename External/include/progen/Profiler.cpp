@@ -0,0 +1,363 @@
+#include "Profiler.h"
+
+#ifdef PROGEN_PROFILING
+
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define PROGEN_PROFILER_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROGEN_PROFILER_TSC
+#endif
+
+thread_local Profiler::TraceBuffer* Profiler::localBuffer = nullptr;
+thread_local const char* Profiler::localName = nullptr;
+
+Profiler::SampleRing::SampleRing()
+	:
+	writes(0)
+{
+	for (std::atomic<float>& sample : samples)
+		sample.store(0.0f, std::memory_order_relaxed);
+}
+
+void Profiler::SampleRing::push(float value)
+{
+	//Not a read-modify-write, a locked increment costs as much as the rest of the zone. Two threads finishing a zone
+	//of the same name at once can overwrite each other's sample, which only drops a point from the history.
+	uint32_t index = writes.load(std::memory_order_relaxed);
+	samples[index % HISTORY].store(value, std::memory_order_relaxed);
+	writes.store(index + 1, std::memory_order_relaxed);
+}
+
+int Profiler::SampleRing::copy(float* out) const
+{
+	uint32_t count = writes.load(std::memory_order_relaxed);
+	int n = (int)std::min<uint32_t>(count, HISTORY);
+	uint32_t first = count - n;
+	for (int i = 0; i < n; ++i)
+		out[i] = samples[(first + i) % HISTORY].load(std::memory_order_relaxed);
+	return n;
+}
+
+Profiler::TraceBuffer::TraceBuffer(int threadId, const char* name)
+	:
+	writes(0),
+	name(name),
+	threadId(threadId)
+{}
+
+void Profiler::TraceBuffer::push(int zone, uint64_t beginNs, uint64_t endNs)
+{
+	//Only the owning thread writes, the release publishes the event to writeChromeTrace
+	uint32_t index = writes.load(std::memory_order_relaxed);
+	TraceEvent& event = events[index % TRACE_CAPACITY];
+	event.begin = beginNs;
+	event.end = endNs;
+	event.zone = zone;
+	writes.store(index + 1, std::memory_order_release);
+}
+
+Profiler::Profiler()
+	:
+	zoneCount(0),
+	counterCount(0),
+	lastFrame(now()),
+	tracing(false),
+	traceStart(0)
+{
+	for (Zone& zone : zones)
+		zone.name = nullptr;
+	for (int i = 0; i < MAX_COUNTERS; ++i)
+	{
+		counterNames[i] = nullptr;
+		counters[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+Profiler& Profiler::global()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+namespace
+{
+	uint64_t steadyNow()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+#ifdef PROGEN_PROFILER_TSC
+	//Two clock reads are most of the cost of a zone, and the time stamp counter is a lot cheaper to read than
+	//steady_clock. Its rate is measured against steady_clock once, so the results stay in steady_clock ns.
+	struct TickClock
+	{
+		uint64_t tickOrigin, nsOrigin;
+		double nsPerTick;
+		TickClock()
+		{
+			nsOrigin = steadyNow();
+			tickOrigin = __rdtsc();
+			uint64_t ns;
+			do
+				ns = steadyNow();
+			while (ns - nsOrigin < 2000000);
+			nsPerTick = (double)(ns - nsOrigin) / (double)(__rdtsc() - tickOrigin);
+		}
+	};
+
+	const TickClock& tickClock()
+	{
+		static const TickClock clock;
+		return clock;
+	}
+#endif
+
+	double nsPerTick()
+	{
+#ifdef PROGEN_PROFILER_TSC
+		return tickClock().nsPerTick;
+#else
+		return 1.0;
+#endif
+	}
+}
+
+uint64_t Profiler::now()
+{
+	return ticksToNs(ticks());
+}
+
+uint64_t Profiler::ticks()
+{
+#ifdef PROGEN_PROFILER_TSC
+	return __rdtsc();
+#else
+	return steadyNow();
+#endif
+}
+
+uint64_t Profiler::ticksToNs(uint64_t ticks)
+{
+#ifdef PROGEN_PROFILER_TSC
+	const TickClock& clock = tickClock();
+	return clock.nsOrigin + (uint64_t)((double)(int64_t)(ticks - clock.tickOrigin) * clock.nsPerTick);
+#else
+	return ticks;
+#endif
+}
+
+int Profiler::registerZone(const char* name)
+{
+	std::lock_guard<std::mutex> lock(registerMutex);
+	int count = zoneCount.load(std::memory_order_relaxed);
+	for (int i = 0; i < count; ++i)
+		if (std::strcmp(zones[i].name, name) == 0)
+			return i;
+	//Out of zones: the last one collects the rest
+	if (count == MAX_ZONES)
+		return MAX_ZONES - 1;
+	zones[count].name = name;
+	zoneCount.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+int Profiler::registerCounter(const char* name)
+{
+	std::lock_guard<std::mutex> lock(registerMutex);
+	int count = counterCount.load(std::memory_order_relaxed);
+	for (int i = 0; i < count; ++i)
+		if (std::strcmp(counterNames[i], name) == 0)
+			return i;
+	//Out of counters: the last one collects the rest
+	if (count == MAX_COUNTERS)
+		return MAX_COUNTERS - 1;
+	counterNames[count] = name;
+	counterCount.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+void Profiler::addCounter(int counter, int64_t delta)
+{
+	counters[counter].fetch_add(delta, std::memory_order_relaxed);
+}
+
+int Profiler::getCounterCount() const
+{
+	return counterCount.load(std::memory_order_acquire);
+}
+
+const char* Profiler::getCounterName(int counter) const
+{
+	return counterNames[counter];
+}
+
+int64_t Profiler::getCounterValue(int counter) const
+{
+	return counters[counter].load(std::memory_order_relaxed);
+}
+
+void Profiler::recordCpu(int zone, uint64_t beginTicks, uint64_t endTicks)
+{
+	zones[zone].cpu.push((float)((double)(endTicks - beginTicks) * nsPerTick() * 1e-6));
+	//Only the trace needs the ends in ns
+	if (tracing.load(std::memory_order_relaxed))
+		threadBuffer().push(zone, ticksToNs(beginTicks), ticksToNs(endTicks));
+}
+
+void Profiler::recordGpu(int zone, double ms)
+{
+	zones[zone].gpu.push((float)ms);
+}
+
+void Profiler::endFrame()
+{
+	uint64_t t = now();
+	frames.push((float)((t - lastFrame) * 1e-6));
+	if (tracing.load(std::memory_order_relaxed))
+		threadBuffer().push(FRAME_ZONE, lastFrame, t);
+	lastFrame = t;
+}
+
+int Profiler::getZoneCount() const
+{
+	return zoneCount.load(std::memory_order_acquire);
+}
+
+const char* Profiler::getZoneName(int zone) const
+{
+	return zones[zone].name;
+}
+
+int Profiler::getCpuHistory(int zone, float* out) const
+{
+	return zones[zone].cpu.copy(out);
+}
+
+int Profiler::getGpuHistory(int zone, float* out) const
+{
+	return zones[zone].gpu.copy(out);
+}
+
+int Profiler::getFrameHistory(float* out) const
+{
+	return frames.copy(out);
+}
+
+void Profiler::setTracing(bool enabled)
+{
+	if (enabled && !tracing.load(std::memory_order_relaxed))
+		traceStart.store(now(), std::memory_order_relaxed);
+	tracing.store(enabled, std::memory_order_relaxed);
+}
+
+bool Profiler::isTracing() const
+{
+	return tracing.load(std::memory_order_relaxed);
+}
+
+void Profiler::setThreadName(const char* name)
+{
+	localName = name;
+	if (localBuffer != nullptr)
+		localBuffer->name.store(name, std::memory_order_relaxed);
+}
+
+Profiler::TraceBuffer& Profiler::threadBuffer()
+{
+	if (localBuffer == nullptr)
+	{
+		//Buffers outlive their threads so that the events of finished threads can still be written
+		std::lock_guard<std::mutex> lock(registerMutex);
+		traceBuffers.emplace_back(new TraceBuffer((int)traceBuffers.size() + 1, localName != nullptr ? localName : "thread"));
+		localBuffer = traceBuffers.back().get();
+	}
+	return *localBuffer;
+}
+
+namespace
+{
+	void writeJsonString(std::FILE* file, const char* text)
+	{
+		std::fputc('"', file);
+		for (const char* c = text; *c != '\0'; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+				std::fputc('\\', file);
+			if ((unsigned char)*c >= 0x20)
+				std::fputc(*c, file);
+		}
+		std::fputc('"', file);
+	}
+}
+
+bool Profiler::writeChromeTrace(const char* path) const
+{
+	std::FILE* file = std::fopen(path, "w");
+	if (file == nullptr)
+		return false;
+	uint64_t start = traceStart.load(std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(registerMutex);
+	std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ProceduralGeneration\"}}");
+
+	std::vector<TraceEvent> events;
+	for (size_t b = 0; b < traceBuffers.size(); ++b)
+	{
+		const TraceBuffer& buffer = *traceBuffers[b];
+		//Threads sharing a name are numbered in the order they first traced
+		const char* name = buffer.name.load(std::memory_order_relaxed);
+		int sameName = 0;
+		for (size_t other = 0; other < b; ++other)
+			sameName += std::strcmp(traceBuffers[other]->name.load(std::memory_order_relaxed), name) == 0 ? 1 : 0;
+		char threadName[128];
+		if (sameName > 0)
+			std::snprintf(threadName, sizeof(threadName), "%s %d", name, sameName + 1);
+		else
+			std::snprintf(threadName, sizeof(threadName), "%s", name);
+		std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", buffer.threadId);
+		writeJsonString(file, threadName);
+		std::fprintf(file, "}}");
+
+		//The owner keeps writing while the events are copied. Whatever it may have overwritten in the meantime
+		//is dropped by checking the write count again after the copy.
+		uint32_t writes = buffer.writes.load(std::memory_order_acquire);
+		uint32_t count = std::min(writes, TRACE_CAPACITY);
+		events.resize(count);
+		for (uint32_t i = 0; i < count; ++i)
+			events[i] = buffer.events[(writes - count + i) % TRACE_CAPACITY];
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint32_t overwritten = std::min(buffer.writes.load(std::memory_order_relaxed) - writes, count);
+
+		for (uint32_t i = overwritten; i < count; ++i)
+		{
+			const TraceEvent& event = events[i];
+			if (event.begin < start)
+				continue;
+			const char* zoneName = event.zone == FRAME_ZONE ? "frame" : zones[event.zone].name;
+			std::fprintf(file, ",\n{\"name\":");
+			writeJsonString(file, zoneName);
+			std::fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				event.zone == FRAME_ZONE ? "frame" : "zone", buffer.threadId, (event.begin - start) * 1e-3, (event.end - event.begin) * 1e-3);
+		}
+	}
+	//Counters as one sample each, at the time of the dump
+	double dumpTime = (now() - start) * 1e-3;
+	for (int c = 0; c < getCounterCount(); ++c)
+	{
+		std::fprintf(file, ",\n{\"name\":");
+		writeJsonString(file, counterNames[c]);
+		std::fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%lld}}", dumpTime, (long long)getCounterValue(c));
+	}
+	std::fprintf(file, "\n]}\n");
+	bool written = std::ferror(file) == 0;
+	return std::fclose(file) == 0 && written;
+}
+
+#endif
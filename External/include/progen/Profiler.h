@@ -0,0 +1,165 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+
+/*
+	Lightweight CPU profiling with named zones.
+
+	PROFILE_ZONE("name") times the rest of the enclosing scope. Every finished zone writes its duration into a ring
+	of the last HISTORY samples of that zone, so zones that run once per regeneration (noise, erosion...) and zones
+	that run every frame (draw) are shown the same way. Zones with the same name share their ring. Recording is
+	relaxed atomic loads and stores, without a read-modify-write, so zones may run on the worker threads. Two zones of
+	the same name finishing at the same time can overwrite each other's sample, which drops a point of the history.
+	An empty zone costs two reads of the time stamp counter and a few ns more, so the clock decides: in a VM where a
+	read takes 21-24 ns the Profiler benchmark measures 42-50 ns per zone.
+	PROFILE_FRAME() closes a frame and records the frame time. GPU timings (GpuProfiler) are kept next to the CPU
+	ones of the zone with the same name.
+
+	While tracing is on every finished zone is also appended to a buffer owned by the thread it ran on, with its
+	begin and end time. A buffer has a single writer, so appending is a plain store and a release increment, and
+	it keeps the last TRACE_CAPACITY events of its thread. writeChromeTrace dumps the events recorded since tracing
+	was turned on in the Chrome trace event format, which chrome://tracing and Perfetto load as a timeline with
+	one track per thread. PROFILE_THREAD("name") names the track of the calling thread.
+
+	PROFILE_COUNT("name", n) adds n to a named counter (cache hits, bytes read...). Counters are relaxed atomics,
+	shown next to the zones and written to the trace with their value at the time of the dump.
+
+	Everything compiles out unless PROGEN_PROFILING is defined: the macros expand to nothing and the classes
+	are not declared, so profiled code has no cost in release builds.
+*/
+
+#ifdef PROGEN_PROFILING
+
+class Profiler
+{
+public:
+	static const int MAX_ZONES = 64;
+	static const int HISTORY = 256;
+	static const uint32_t TRACE_CAPACITY = 1 << 16; //Events kept per thread
+	static const int MAX_COUNTERS = 32;
+
+	static Profiler& global();
+	//Zone id for the name, registered on first use. The name must outlive the profiler (a literal).
+	int registerZone(const char* name);
+	//Nanoseconds on a steady clock
+	static uint64_t now();
+	//The raw clock now() converts, the time stamp counter where there is one. Cheaper to read, zones record ticks.
+	static uint64_t ticks();
+	static uint64_t ticksToNs(uint64_t ticks);
+	void recordCpu(int zone, uint64_t beginTicks, uint64_t endTicks);
+	void recordGpu(int zone, double ms);
+	void endFrame();
+
+	int getZoneCount() const;
+	const char* getZoneName(int zone) const;
+	//Copies up to HISTORY samples in ms, oldest first. Returns the number of samples.
+	int getCpuHistory(int zone, float* out) const;
+	int getGpuHistory(int zone, float* out) const;
+	int getFrameHistory(float* out) const;
+
+	//Counter id for the name, registered on first use. The name must outlive the profiler (a literal).
+	int registerCounter(const char* name);
+	void addCounter(int counter, int64_t delta);
+	int getCounterCount() const;
+	const char* getCounterName(int counter) const;
+	int64_t getCounterValue(int counter) const;
+
+	//Turning tracing on starts a new capture, the events of earlier captures are not written anymore
+	void setTracing(bool enabled);
+	bool isTracing() const;
+	//The name has to outlive the profiler (a literal). Threads with the same name are numbered in the trace.
+	void setThreadName(const char* name);
+	//Writes the current capture as Chrome trace event JSON. Safe while other threads keep recording.
+	bool writeChromeTrace(const char* path) const;
+private:
+	struct SampleRing
+	{
+		std::atomic<uint32_t> writes;
+		std::atomic<float> samples[HISTORY];
+		SampleRing();
+		void push(float value);
+		int copy(float* out) const;
+	};
+	struct Zone
+	{
+		const char* name;
+		SampleRing cpu;
+		SampleRing gpu;
+	};
+	struct TraceEvent
+	{
+		uint64_t begin, end;
+		int zone; //FRAME_ZONE for the frames
+	};
+	struct TraceBuffer
+	{
+		TraceEvent events[TRACE_CAPACITY];
+		std::atomic<uint32_t> writes;
+		std::atomic<const char*> name;
+		int threadId;
+		TraceBuffer(int threadId, const char* name);
+		void push(int zone, uint64_t beginNs, uint64_t endNs);
+	};
+	static const int FRAME_ZONE = -1;
+	Profiler();
+	//Buffer of the calling thread, created on its first traced zone
+	TraceBuffer& threadBuffer();
+	static thread_local TraceBuffer* localBuffer;
+	static thread_local const char* localName;
+private:
+	Zone zones[MAX_ZONES];
+	std::atomic<int> zoneCount;
+	const char* counterNames[MAX_COUNTERS];
+	std::atomic<int64_t> counters[MAX_COUNTERS];
+	std::atomic<int> counterCount;
+	mutable std::mutex registerMutex;
+	SampleRing frames;
+	uint64_t lastFrame;
+	std::atomic<bool> tracing;
+	std::atomic<uint64_t> traceStart;
+	std::vector<std::unique_ptr<TraceBuffer>> traceBuffers; //Guarded by registerMutex
+};
+
+class ProfileZone
+{
+public:
+	explicit ProfileZone(int zone) : zone(zone), begin(Profiler::ticks()) {}
+	~ProfileZone() { Profiler::global().recordCpu(zone, begin, Profiler::ticks()); }
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+private:
+	int zone;
+	uint64_t begin;
+};
+
+#define PROGEN_PROFILE_CONCAT_INNER(a, b) a##b
+#define PROGEN_PROFILE_CONCAT(a, b) PROGEN_PROFILE_CONCAT_INNER(a, b)
+//The id lookup runs once per call site
+#define PROFILE_ZONE(name) \
+	static const int PROGEN_PROFILE_CONCAT(profileZoneId, __LINE__) = Profiler::global().registerZone(name); \
+	ProfileZone PROGEN_PROFILE_CONCAT(profileZone, __LINE__)(PROGEN_PROFILE_CONCAT(profileZoneId, __LINE__))
+#define PROFILE_FRAME() Profiler::global().endFrame()
+#define PROFILE_THREAD(name) Profiler::global().setThreadName(name)
+#define PROFILE_COUNT(name, delta) \
+	do \
+	{ \
+		static const int PROGEN_PROFILE_CONCAT(profileCounterId, __LINE__) = Profiler::global().registerCounter(name); \
+		Profiler::global().addCounter(PROGEN_PROFILE_CONCAT(profileCounterId, __LINE__), (int64_t)(delta)); \
+	} while (false)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_FRAME()
+#define PROFILE_THREAD(name)
+#define PROFILE_COUNT(name, delta)
+
+#endif
+
+#endif
@@ -0,0 +1,147 @@
+#include "ProfilerPanel.h"
+#include "Profiler.h"
+
+#include <ImGui/imgui.h>
+#include <algorithm>
+#include <cstdio>
+
+#ifdef PROGEN_PROFILING
+
+namespace
+{
+	struct Summary
+	{
+		float last, average, max;
+	};
+
+	bool summarize(const float* samples, int count, Summary& summary)
+	{
+		if (count == 0)
+			return false;
+		float sum = 0.0f;
+		summary.max = 0.0f;
+		for (int i = 0; i < count; ++i)
+		{
+			sum += samples[i];
+			summary.max = std::max(summary.max, samples[i]);
+		}
+		summary.last = samples[count - 1];
+		summary.average = sum / count;
+		return true;
+	}
+
+	void drawTime(bool valid, float ms)
+	{
+		ImGui::TableNextColumn();
+		if (valid)
+			ImGui::Text("%.3f", ms);
+		else
+			ImGui::TextDisabled("-");
+	}
+}
+
+void drawProfilerPanel()
+{
+	Profiler& profiler = Profiler::global();
+	static float samples[Profiler::HISTORY];
+	ImGui::Begin("Profiler");
+
+	int frameCount = profiler.getFrameHistory(samples);
+	Summary frame;
+	if (summarize(samples, frameCount, frame))
+	{
+		ImGui::Text("Frame: %.2f ms (avg %.2f, max %.2f)", frame.last, frame.average, frame.max);
+		ImGui::PlotLines("Frame times", samples, frameCount, 0, nullptr, 0.0f, std::max(frame.max, 1.0f), ImVec2(0, 60));
+
+		//Distribution of the frame times in 32 buckets from 0 to the max
+		const int BUCKETS = 32;
+		float histogram[BUCKETS] = {};
+		float bucketWidth = std::max(frame.max, 1e-3f) / BUCKETS;
+		for (int i = 0; i < frameCount; ++i)
+			histogram[std::min((int)(samples[i] / bucketWidth), BUCKETS - 1)] += 1.0f;
+		char overlay[64];
+		std::snprintf(overlay, sizeof(overlay), "0 - %.1f ms", frame.max);
+		ImGui::PlotHistogram("Frame histogram", histogram, BUCKETS, 0, overlay, 0.0f, FLT_MAX, ImVec2(0, 60));
+	}
+
+	//Capture a timeline for chrome://tracing or Perfetto
+	if (!profiler.isTracing())
+	{
+		if (ImGui::Button("Start Trace"))
+			profiler.setTracing(true);
+	}
+	else if (ImGui::Button("Stop Trace"))
+		profiler.setTracing(false);
+	ImGui::SameLine();
+	static bool traceWritten = false, traceFailed = false;
+	if (ImGui::Button("Save Trace"))
+	{
+		traceWritten = profiler.writeChromeTrace("progen_trace.json");
+		traceFailed = !traceWritten;
+	}
+	if (traceWritten)
+	{
+		ImGui::SameLine();
+		ImGui::Text("progen_trace.json");
+	}
+	else if (traceFailed)
+	{
+		ImGui::SameLine();
+		ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Could not write progen_trace.json");
+	}
+
+	ImGui::Separator();
+	if (!ImGui::BeginTable("zones", 7, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV))
+	{
+		ImGui::End();
+		return;
+	}
+	const char* headers[] = { "Zone (ms)", "CPU last", "CPU avg", "CPU max", "GPU last", "GPU avg", "GPU max" };
+	for (const char* header : headers)
+		ImGui::TableSetupColumn(header);
+	ImGui::TableHeadersRow();
+	for (int zone = 0; zone < profiler.getZoneCount(); ++zone)
+	{
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::Text("%s", profiler.getZoneName(zone));
+		Summary cpu, gpu;
+		bool hasCpu = summarize(samples, profiler.getCpuHistory(zone, samples), cpu);
+		drawTime(hasCpu, cpu.last);
+		drawTime(hasCpu, cpu.average);
+		drawTime(hasCpu, cpu.max);
+		bool hasGpu = summarize(samples, profiler.getGpuHistory(zone, samples), gpu);
+		drawTime(hasGpu, gpu.last);
+		drawTime(hasGpu, gpu.average);
+		drawTime(hasGpu, gpu.max);
+	}
+	ImGui::EndTable();
+
+	if (profiler.getCounterCount() > 0 && ImGui::BeginTable("counters", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV))
+	{
+		ImGui::TableSetupColumn("Counter");
+		ImGui::TableSetupColumn("Value");
+		ImGui::TableHeadersRow();
+		for (int counter = 0; counter < profiler.getCounterCount(); ++counter)
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("%s", profiler.getCounterName(counter));
+			ImGui::TableNextColumn();
+			ImGui::Text("%lld", (long long)profiler.getCounterValue(counter));
+		}
+		ImGui::EndTable();
+	}
+	ImGui::End();
+}
+
+#else
+
+void drawProfilerPanel()
+{
+	ImGui::Begin("Profiler");
+	ImGui::TextDisabled("Profiling is compiled out, build with PROGEN_PROFILING");
+	ImGui::End();
+}
+
+#endif
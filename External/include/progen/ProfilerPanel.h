@@ -0,0 +1,11 @@
+#ifndef PROFILER_PANEL_H
+#define PROFILER_PANEL_H
+
+/*
+	ImGui window with the profiler zones: last, average and max CPU and GPU time of every zone over its history,
+	and the frame times as a plot and a histogram. Shows a note when the build has no PROGEN_PROFILING.
+*/
+
+void drawProfilerPanel();
+
+#endif
@@ -0,0 +1,153 @@
+#include "ProgramCache.h"
+#include "GLExtensions.h"
+#include "Hash.h"
+
+#include <cstdio>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	const uint32_t CACHE_MAGIC = 0x42504750; //"PGPB"
+
+	struct CacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t binaryFormat;
+		uint32_t length;
+	};
+
+	void makeDirectory(const std::string& path)
+	{
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+}
+
+ProgramCache::ProgramCache()
+{}
+
+ProgramCache& ProgramCache::global()
+{
+	static ProgramCache cache;
+	return cache;
+}
+
+void ProgramCache::setDirectory(const std::string& dir)
+{
+	directory = dir;
+	if (!directory.empty())
+		makeDirectory(directory);
+}
+
+bool ProgramCache::isEnabled() const
+{
+	return !directory.empty() && GLExtensions::get().programBinary;
+}
+
+uint64_t ProgramCache::makeKey(const std::string* sources, size_t count) const
+{
+	uint32_t version = FORMAT_VERSION;
+	uint64_t key = hashBytes(&version, sizeof(version));
+	key = hashString(GLExtensions::get().driver, key);
+	for (size_t i = 0; i < count; ++i)
+		key = hashString(sources[i], key);
+	return key;
+}
+
+std::string ProgramCache::getPath(uint64_t key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return directory + "/" + name;
+}
+
+void ProgramCache::prepareForLink(GLuint program) const
+{
+	if (isEnabled())
+		GLExtensions::get().programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool ProgramCache::load(uint64_t key, GLuint program) const
+{
+	if (!isEnabled())
+		return false;
+	FILE* file = std::fopen(getPath(key).c_str(), "rb");
+	if (!file)
+		return false;
+
+	CacheHeader header;
+	std::vector<unsigned char> binary;
+	bool valid = std::fread(&header, sizeof(header), 1, file) == 1 && header.magic == CACHE_MAGIC &&
+		header.version == FORMAT_VERSION && header.key == key && header.length > 0;
+	//store writes the header and then exactly the binary, a length that disagrees with the file is a truncated or
+	//corrupt entry and must not size the allocation
+	bool corrupt = false;
+	if (valid)
+	{
+		long start = std::ftell(file);
+		corrupt = start < 0 || std::fseek(file, 0, SEEK_END) != 0 || std::ftell(file) - start != (long)header.length ||
+			std::fseek(file, start, SEEK_SET) != 0;
+		valid = !corrupt;
+	}
+	if (valid)
+	{
+		binary.resize(header.length);
+		valid = std::fread(binary.data(), 1, binary.size(), file) == binary.size();
+	}
+	std::fclose(file);
+	if (corrupt)
+		std::remove(getPath(key).c_str());
+	if (!valid)
+		return false;
+
+	GLExtensions::get().programBinaryUpload(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
+void ProgramCache::store(uint64_t key, GLuint program) const
+{
+	if (!isEnabled())
+		return;
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	CacheHeader header;
+	header.magic = CACHE_MAGIC;
+	header.version = FORMAT_VERSION;
+	header.key = key;
+	header.binaryFormat = 0;
+	std::vector<unsigned char> binary(length);
+	GLsizei written = 0;
+	GLenum binaryFormat = 0;
+	GLExtensions::get().getProgramBinary(program, length, &written, &binaryFormat, binary.data());
+	if (written <= 0)
+		return;
+	header.binaryFormat = binaryFormat;
+	header.length = (uint32_t)written;
+
+	//Written next to the final file and renamed, so a crash never leaves a truncated binary under a valid name
+	std::string path = getPath(key);
+	std::string tempPath = path + ".tmp";
+	FILE* file = std::fopen(tempPath.c_str(), "wb");
+	if (!file)
+		return;
+	bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 && std::fwrite(binary.data(), 1, written, file) == (size_t)written;
+	ok = std::fclose(file) == 0 && ok;
+	std::remove(path.c_str());
+	if (!ok || std::rename(tempPath.c_str(), path.c_str()) != 0)
+		std::remove(tempPath.c_str());
+}
@@ -0,0 +1,39 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/*
+	On-disk cache of linked shader programs (glGetProgramBinary), so later runs skip compiling and linking.
+
+	A program is stored under a key hashed from its sources, the driver strings and FORMAT_VERSION. Any edit of a
+	shader or a driver update gives a new key. The driver may still reject a binary (glProgramBinary leaves the
+	program unlinked), then load() fails and the caller compiles as usual and stores the new binary.
+
+	Disabled when the directory is empty or the driver offers no binary formats.
+*/
+
+class ProgramCache
+{
+public:
+	static const uint32_t FORMAT_VERSION = 1;
+
+	static ProgramCache& global();
+	void setDirectory(const std::string& directory);
+	bool isEnabled() const;
+	uint64_t makeKey(const std::string* sources, size_t count) const;
+	//Must be called before glLinkProgram for the program to be retrievable
+	void prepareForLink(GLuint program) const;
+	bool load(uint64_t key, GLuint program) const;
+	void store(uint64_t key, GLuint program) const;
+private:
+	ProgramCache();
+	std::string getPath(uint64_t key) const;
+private:
+	std::string directory;
+};
+
+#endif
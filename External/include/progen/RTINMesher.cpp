@@ -0,0 +1,178 @@
+#include "RTINMesher.h"
+
+#include <algorithm>
+#include <cmath>
+
+RTINMesher::RTINMesher()
+	:
+	gridSize(0),
+	extraction(0)
+{}
+
+bool RTINMesher::supports(int W, int H)
+{
+	int tileSize = W - 1;
+	return W == H && tileSize >= 2 && (tileSize & (tileSize - 1)) == 0;
+}
+
+bool RTINMesher::isValid() const
+{
+	return gridSize > 0;
+}
+
+bool RTINMesher::build(const HeightField& heights)
+{
+	if (!supports(heights.getWidth(), heights.getHeight()))
+	{
+		gridSize = 0;
+		return false;
+	}
+	gridSize = heights.getWidth();
+	int max = gridSize - 1;
+	errors.assign((size_t)gridSize * gridSize, 0.0f);
+
+	//With max = 2^k the halves are split 2k - 1 times before the triangles are half cells
+	int k = 0;
+	while ((1 << k) < max)
+		++k;
+	int deepest = 2 * k - 1;
+	//Every level needs the finished errors of the level below it
+	for (int depth = deepest; depth >= 0; --depth)
+	{
+		updateErrors(heights.data(), 0, 0, max, max, max, 0, depth, depth < deepest);
+		updateErrors(heights.data(), max, max, 0, 0, 0, max, depth, depth < deepest);
+	}
+	return true;
+}
+
+void RTINMesher::updateErrors(const float* h, int ax, int az, int bx, int bz, int cx, int cz, int depth, bool hasChildren)
+{
+	int mx = (ax + bx) >> 1;
+	int mz = (az + bz) >> 1;
+	if (depth > 0)
+	{
+		updateErrors(h, cx, cz, ax, az, mx, mz, depth - 1, hasChildren);
+		updateErrors(h, bx, bz, cx, cz, mx, mz, depth - 1, hasChildren);
+		return;
+	}
+
+	//Error of replacing the middle of the hypotenuse with the average of its ends
+	size_t middle = (size_t)mz * gridSize + mx;
+	float interpolated = 0.5f * (h[(size_t)az * gridSize + ax] + h[(size_t)bz * gridSize + bx]);
+	float middleError = std::fabs(interpolated - h[middle]);
+	float error = std::max(errors[middle], middleError);
+	if (hasChildren)
+	{
+		//Over a child, this triangle's plane differs from the child's by at most middleError (both are linear and agree at
+		//the other two corners), so middleError plus the child's bound bounds this triangle at every sample
+		size_t left = (size_t)((cz + az) >> 1) * gridSize + ((cx + ax) >> 1);
+		size_t right = (size_t)((bz + cz) >> 1) * gridSize + ((bx + cx) >> 1);
+		error = std::max(error, middleError + std::max(errors[left], errors[right]));
+	}
+	errors[middle] = error;
+}
+
+int RTINMesher::addVertex(int x, int z, std::vector<int>& vertexSamples)
+{
+	int sample = z * gridSize + x;
+	if (vertexStamp[sample] != extraction)
+	{
+		vertexStamp[sample] = extraction;
+		vertexIndex[sample] = (int)vertexSamples.size();
+		vertexSamples.push_back(sample);
+	}
+	return vertexIndex[sample];
+}
+
+void RTINMesher::extractTriangle(int ax, int az, int bx, int bz, int cx, int cz, float maxError, std::vector<glm::ivec3>& tris, std::vector<int>& vertexSamples)
+{
+	int mx = (ax + bx) >> 1;
+	int mz = (az + bz) >> 1;
+	if (std::abs(ax - cx) + std::abs(az - cz) > 1 && errors[(size_t)mz * gridSize + mx] > maxError)
+	{
+		extractTriangle(cx, cz, ax, az, mx, mz, maxError, tris, vertexSamples);
+		extractTriangle(bx, bz, cx, cz, mx, mz, maxError, tris, vertexSamples);
+		return;
+	}
+
+	//Counter-clockwise seen from above (+y), the same winding as the grid triangles
+	if ((bz - az) * (cx - ax) - (bx - ax) * (cz - az) < 0)
+	{
+		std::swap(bx, cx);
+		std::swap(bz, cz);
+	}
+	tris.push_back(glm::ivec3(addVertex(ax, az, vertexSamples), addVertex(bx, bz, vertexSamples), addVertex(cx, cz, vertexSamples)));
+}
+
+void RTINMesher::extract(float maxError, std::vector<glm::ivec3>& tris, std::vector<int>& vertexSamples)
+{
+	tris.clear();
+	vertexSamples.clear();
+	if (!isValid())
+		return;
+
+	//Stamps mark the samples used by this extraction, so the maps are only cleared when the stamp wraps around
+	size_t samples = (size_t)gridSize * gridSize;
+	if (vertexIndex.size() != samples || ++extraction == 0)
+	{
+		vertexIndex.assign(samples, 0);
+		vertexStamp.assign(samples, 0);
+		extraction = 1;
+	}
+	int max = gridSize - 1;
+	extractTriangle(0, 0, max, max, max, 0, maxError, tris, vertexSamples);
+	extractTriangle(max, max, 0, 0, 0, max, maxError, tris, vertexSamples);
+}
+
+RTINStats RTINMesher::measure(const HeightField& heights, const std::vector<glm::ivec3>& tris, const std::vector<int>& vertexSamples)
+{
+	RTINStats stats;
+	stats.vertices = vertexSamples.size();
+	stats.triangles = tris.size();
+	stats.gridTriangles = isValid() ? (size_t)(gridSize - 1) * (gridSize - 1) * 2 : 0;
+	stats.maxError = 0.0f;
+	stats.rmsError = 0.0f;
+	if (!isValid())
+		return stats;
+
+	//Every sample lies in (or on the border of) exactly one triangle's interpolation. Shared borders interpolate the
+	//same way from both sides, so writing the error per sample counts each sample once.
+	sampleErrors.assign((size_t)gridSize * gridSize, 0.0f);
+	for (const glm::ivec3& tri : tris)
+	{
+		glm::ivec2 p[3];
+		float ph[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			int sample = vertexSamples[tri[k]];
+			p[k] = glm::ivec2(sample % gridSize, sample / gridSize);
+			ph[k] = heights.data()[sample];
+		}
+		int area = (p[1].y - p[0].y) * (p[2].x - p[0].x) - (p[1].x - p[0].x) * (p[2].y - p[0].y);
+		int minX = std::min(std::min(p[0].x, p[1].x), p[2].x), maxX = std::max(std::max(p[0].x, p[1].x), p[2].x);
+		int minZ = std::min(std::min(p[0].y, p[1].y), p[2].y), maxZ = std::max(std::max(p[0].y, p[1].y), p[2].y);
+		for (int z = minZ; z <= maxZ; ++z)
+		{
+			for (int x = minX; x <= maxX; ++x)
+			{
+				//Barycentric weights, exact in integers
+				int w0 = (p[2].y - p[1].y) * (x - p[1].x) - (p[2].x - p[1].x) * (z - p[1].y);
+				int w1 = (p[0].y - p[2].y) * (x - p[2].x) - (p[0].x - p[2].x) * (z - p[2].y);
+				int w2 = area - w0 - w1;
+				if (w0 < 0 || w1 < 0 || w2 < 0)
+					continue;
+				float interpolated = (w0 * ph[0] + w1 * ph[1] + w2 * ph[2]) / (float)area;
+				sampleErrors[(size_t)z * gridSize + x] = std::fabs(interpolated - heights.at(x, z));
+			}
+		}
+	}
+
+	double sum = 0.0;
+	for (float e : sampleErrors)
+	{
+		stats.maxError = std::max(stats.maxError, e);
+		sum += (double)e * e;
+	}
+	stats.rmsError = (float)std::sqrt(sum / sampleErrors.size());
+	return stats;
+}
@@ -0,0 +1,62 @@
+#ifndef RTIN_MESHER_H
+#define RTIN_MESHER_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "HeightField.h"
+
+struct RTINStats
+{
+	size_t vertices;
+	size_t triangles;
+	size_t gridTriangles; //Triangles the regular grid would use for the same map
+	float maxError; //Largest vertical distance between the mesh and the height samples
+	float rmsError;
+};
+
+
+/*
+	Right-triangulated irregular network: an error bounded mesh over a (2^k + 1) x (2^k + 1) height map.
+
+	The map is split into two right triangles which are split recursively at the middle of their hypotenuse.
+	build() updates every triangle of the full hierarchy once, finest level first, and stores at each hypotenuse
+	middle a bound on the error that skipping that split would cause, including the errors of everything below it.
+	The two triangles sharing a hypotenuse write the same middle, so the mesh never gets cracks.
+	extract() then descends only while the stored error is above the threshold, in time linear to the output.
+
+	Martini keeps the larger of the middle error and the children's errors, which can let samples inside a kept
+	triangle go past the threshold. Here the middle error is added to the children's bound instead, so maxError
+	really bounds the vertical error at every sample, at the cost of some more triangles.
+
+	REFERENCE: Evans, Kirkpatrick, Townsend - Right-Triangulated Irregular Networks (2001)
+	REFERENCE: Agafonkin - Martini: Real-Time RTIN Terrain Mesh (2019)
+*/
+
+class RTINMesher
+{
+public:
+	RTINMesher();
+	static bool supports(int W, int H);
+	//Precomputes the error map. Returns false if the map is not (2^k + 1) x (2^k + 1).
+	bool build(const HeightField& heights);
+	bool isValid() const;
+	//Triangles are counter-clockwise seen from above, indices go into vertexSamples which holds the sample index (z * W + x) of every vertex
+	void extract(float maxError, std::vector<glm::ivec3>& tris, std::vector<int>& vertexSamples);
+	//Compares an extracted mesh against the height map it was built from
+	RTINStats measure(const HeightField& heights, const std::vector<glm::ivec3>& tris, const std::vector<int>& vertexSamples);
+private:
+	void updateErrors(const float* h, int ax, int az, int bx, int bz, int cx, int cz, int depth, bool hasChildren);
+	void extractTriangle(int ax, int az, int bx, int bz, int cx, int cz, float maxError, std::vector<glm::ivec3>& tris, std::vector<int>& vertexSamples);
+	int addVertex(int x, int z, std::vector<int>& vertexSamples);
+private:
+	int gridSize; //Samples per side, 2^k + 1
+	std::vector<float> errors; //Per sample
+	std::vector<int> vertexIndex; //Sample to output vertex, valid where vertexStamp == extraction
+	std::vector<unsigned int> vertexStamp;
+	unsigned int extraction; //Counts the extractions
+	std::vector<float> sampleErrors; //Scratch for measure
+};
+
+#endif
@@ -1,50 +1,45 @@
 #include "Shader.h"
+#include "ShaderSources.h"
+#include "ProgramCache.h"
 
-//Going to read shaders from the files
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+//Sources come from ShaderSources (embedded or the override directory), the linked program from ProgramCache if possible
 Shader::Shader(const char * vertexPath, const char * fragmentPath, const char* geometryPath)
 {
+	auto start = std::chrono::steady_clock::now();
 	//Retrieve and store the shader codes
-	std::string vertexCode;
-	std::string fragmentCode;
-	std::string geometryCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
-	std::ifstream gShaderFile;
-	//Ensure ifstream objects can throw exceptions. Set the exception masks
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	try
+	std::string codes[3];
+	const char* paths[3] = { vertexPath, fragmentPath, geometryPath };
+	size_t stageCount = geometryPath != nullptr ? 3 : 2;
+	for (size_t i = 0; i < stageCount; ++i)
 	{
-		//Open the files
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		std::stringstream vShaderStream, fShaderStream;
-		//Read file's buffer contents into the streams
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-		//Close the files
-		vShaderFile.close();
-		fShaderFile.close();
-		//Extract the strings from the streams
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-		//If present, also load the geometry shader
-		if (geometryPath != nullptr)
-		{
-			gShaderFile.open(geometryPath);
-			std::stringstream gShaderStream;
-			gShaderStream << gShaderFile.rdbuf();
-			gShaderFile.close();
-			geometryCode = gShaderStream.str();
-		}
-
+		if (!ShaderSources::global().load(paths[i], codes[i]))
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ->" << paths[i] << std::endl;
 	}
-	catch (std::ifstream::failure fail)
+
+	ProgramCache& cache = ProgramCache::global();
+	uint64_t key = cache.makeKey(codes, stageCount);
+	ID = glCreateProgram();
+	bool cached = cache.load(key, ID);
+	if (!cached)
 	{
-		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ->" << fail.what() << std::endl;
+		//A rejected binary leaves the program in a failed state, start over with a clean one
+		glDeleteProgram(ID);
+		ID = glCreateProgram();
+		compileAndLink(codes[0], codes[1], geometryPath != nullptr ? &codes[2] : nullptr);
+		cache.store(key, ID);
 	}
+	introspectUniforms();
 
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Shader " << vertexPath << " + " << fragmentPath << (cached ? ": binary cache hit, " : ": compiled, ") << ms << " ms" << std::endl;
+}
+
+void Shader::compileAndLink(const std::string& vertexCode, const std::string& fragmentCode, const std::string* geometryCode)
+{
 	const char* vShaderCode = vertexCode.c_str();
 	const char* fShaderCode = fragmentCode.c_str();
 	//COMPILE THE SHADERS
@@ -64,34 +59,36 @@ Shader::Shader(const char * vertexPath, const char * fragmentPath, const char* g
 	checkCompileErrors(fragment, "FRAGMENT");
 	//If present compile the geometry shader
 	GLuint geometry;
-	if (geometryPath != nullptr)
+	if (geometryCode != nullptr)
 	{
-		const char* gShaderCode = geometryCode.c_str();
+		const char* gShaderCode = geometryCode->c_str();
 		geometry = glCreateShader(GL_GEOMETRY_SHADER);
 		glShaderSource(geometry, 1, &gShaderCode, NULL);
 		glCompileShader(geometry);
 		checkCompileErrors(geometry, "GEOMETRY");
 	}
-	//Create the shader program
-	ID = glCreateProgram();
+	//Attach to the program
 	glAttachShader(ID, vertex);
 	glAttachShader(ID, fragment);
-	if (geometryPath != nullptr)
+	if (geometryCode != nullptr)
 	{
 		glAttachShader(ID, geometry);
 	}
+	ProgramCache::global().prepareForLink(ID);
 	glLinkProgram(ID);
 	//Check linking errors
 	checkCompileErrors(ID, "PROGRAM");
 
 	//After linking the program we dont need shaders anymore.
+	glDetachShader(ID, vertex);
+	glDetachShader(ID, fragment);
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
-	if (geometryPath != nullptr)
+	if (geometryCode != nullptr)
 	{
+		glDetachShader(ID, geometry);
 		glDeleteShader(geometry);
 	}
-
 }
 
 void Shader::use()
@@ -101,57 +98,111 @@ void Shader::use()
 
 void Shader::setBool(const std::string & name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	glUniform1i(getUniformLocation(name), (int)value);
 }
 
 void Shader::setInt(const std::string & name, int value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform1i(getUniformLocation(name), value);
 }
 
 void Shader::setFloat(const std::string & name, float value) const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform1f(getUniformLocation(name), value);
 }
 
 void Shader::setVec2(const std::string & name, const glm::vec2& value) const
 {
-	glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	glUniform2fv(getUniformLocation(name), 1, &value[0]);
 }
 
 void Shader::setVec2(const std::string & name, float x, float y) const
 {
-	glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+	glUniform2f(getUniformLocation(name), x, y);
 }
 
 void Shader::setVec3(const std::string & name, const glm::vec3 & value) const
 {
-	glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	glUniform3fv(getUniformLocation(name), 1, &value[0]);
 }
 
 void Shader::setVec3(const std::string & name, float x, float y, float z) const
 {
-	glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+	glUniform3f(getUniformLocation(name), x, y, z);
 }
 
 void Shader::setVec4(const std::string & name, const glm::vec4 & value) const
 {
-	glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	glUniform4fv(getUniformLocation(name), 1, &value[0]);
 }
 
 void Shader::setVec4(const std::string & name, float x, float y, float z, float w) const
 {
-	glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+	glUniform4f(getUniformLocation(name), x, y, z, w);
 }
 
 void Shader::setMat3(const std::string & name, const glm::mat3 & matrix) const
 {
-	glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(matrix));
+	glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(matrix));
 }
 
 void Shader::setMat4(const std::string & name, const glm::mat4 & matrix) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(matrix));
+	glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(matrix));
+}
+
+void Shader::setBool(UniformHandle handle, bool value) const
+{
+	glUniform1i(handle.location, (int)value);
+}
+
+void Shader::setInt(UniformHandle handle, int value) const
+{
+	glUniform1i(handle.location, value);
+}
+
+void Shader::setFloat(UniformHandle handle, float value) const
+{
+	glUniform1f(handle.location, value);
+}
+
+void Shader::setVec2(UniformHandle handle, const glm::vec2& value) const
+{
+	glUniform2fv(handle.location, 1, &value[0]);
+}
+
+void Shader::setVec3(UniformHandle handle, const glm::vec3& value) const
+{
+	glUniform3fv(handle.location, 1, &value[0]);
+}
+
+void Shader::setVec4(UniformHandle handle, const glm::vec4& value) const
+{
+	glUniform4fv(handle.location, 1, &value[0]);
+}
+
+void Shader::setMat3(UniformHandle handle, const glm::mat3& matrix) const
+{
+	glUniformMatrix3fv(handle.location, 1, GL_FALSE, glm::value_ptr(matrix));
+}
+
+void Shader::setMat4(UniformHandle handle, const glm::mat4& matrix) const
+{
+	glUniformMatrix4fv(handle.location, 1, GL_FALSE, glm::value_ptr(matrix));
+}
+
+UniformHandle Shader::getUniform(const std::string& name) const
+{
+	return UniformHandle(getUniformLocation(name));
+}
+
+bool Shader::bindUniformBlock(const char* blockName, GLuint binding) const
+{
+	GLuint blockIndex = glGetUniformBlockIndex(ID, blockName);
+	if (blockIndex == GL_INVALID_INDEX)
+		return false;
+	glUniformBlockBinding(ID, blockIndex, binding);
+	return true;
 }
 
 GLuint Shader::getID() const
@@ -186,3 +237,43 @@ void Shader::checkCompileErrors(GLuint IDtoCheck, std::string type) const
 	}
 }
 
+void Shader::introspectUniforms()
+{
+	uniformLocations.clear();
+	GLint uniformCount = 0, maxNameLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &uniformCount);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+	std::vector<char> nameBuffer(std::max(maxNameLength, 1));
+	for (GLint i = 0; i < uniformCount; ++i)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+		std::string name(nameBuffer.data(), length);
+		GLint location = glGetUniformLocation(ID, name.c_str());
+		//Members of uniform blocks have no location
+		if (location < 0)
+			continue;
+		uniformLocations[name] = location;
+		//Arrays of basic types are reported as "name[0]", make "name" and every element resolvable as well. Members of
+		//arrays of structs ("lights[2].color") come one by one and keep their full name.
+		const std::string arrayBase = "[0]";
+		if (name.size() > arrayBase.size() && name.compare(name.size() - arrayBase.size(), arrayBase.size(), arrayBase) == 0)
+		{
+			std::string base = name.substr(0, name.size() - arrayBase.size());
+			uniformLocations[base] = location;
+			for (GLint element = 1; element < size; ++element)
+			{
+				std::string elementName = base + "[" + std::to_string(element) + "]";
+				uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+			}
+		}
+	}
+}
+
+GLint Shader::getUniformLocation(const std::string& name) const
+{
+	auto it = uniformLocations.find(name);
+	return it != uniformLocations.end() ? it->second : -1;
+}
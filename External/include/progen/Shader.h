@@ -12,15 +12,32 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 
+/*
+	Location of a uniform resolved once, so setting it per draw is a plain glUniform call.
+	An invalid handle (uniform not active in the program) is ignored by GL like location -1 always is.
+*/
+struct UniformHandle
+{
+	GLint location;
+
+	UniformHandle() : location(-1) {}
+	explicit UniformHandle(GLint location) : location(location) {}
+	bool isValid() const { return location >= 0; }
+};
 
 class Shader
 {
 public:
-	// constructor reads and builds the shader
+	// constructor reads and builds the shader. Paths are relative to the Shaders folder (see ShaderSources)
 	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
 	// use/activate the shader
 	void use();
+	// Resolves a uniform from the table built at link time. Keep the handle instead of the name for per draw uniforms.
+	UniformHandle getUniform(const std::string& name) const;
+	// Binds a uniform block (e.g. the per frame block) to a binding point. Returns false if the program does not have it.
+	bool bindUniformBlock(const char* blockName, GLuint binding) const;
 	// utility uniform functions. Note that to call these functions, first you have to activate the shader program
 	void setBool(const std::string &name, bool value) const;
 	void setInt(const std::string &name, int value) const;
@@ -33,12 +50,26 @@ public:
 	void setVec4(const std::string& name, float x, float y, float z, float w) const;
 	void setMat3(const std::string& name, const glm::mat3& matrix) const;
 	void setMat4(const std::string& name, const glm::mat4& matrix) const;
+	// same with pre-resolved handles
+	void setBool(UniformHandle handle, bool value) const;
+	void setInt(UniformHandle handle, int value) const;
+	void setFloat(UniformHandle handle, float value) const;
+	void setVec2(UniformHandle handle, const glm::vec2& value) const;
+	void setVec3(UniformHandle handle, const glm::vec3& value) const;
+	void setVec4(UniformHandle handle, const glm::vec4& value) const;
+	void setMat3(UniformHandle handle, const glm::mat3& matrix) const;
+	void setMat4(UniformHandle handle, const glm::mat4& matrix) const;
 	GLuint getID() const;
 private:
+	void compileAndLink(const std::string& vertexCode, const std::string& fragmentCode, const std::string* geometryCode);
 	void checkCompileErrors(GLuint shader, std::string type) const;
+	// fills the name->location table with every active uniform outside of blocks
+	void introspectUniforms();
+	GLint getUniformLocation(const std::string& name) const;
 private:
 	// the program ID
 	GLuint ID;
+	std::unordered_map<std::string, GLint> uniformLocations;
 
 };
 
@@ -0,0 +1,61 @@
+#include "ShaderSources.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+ShaderSources::ShaderSources()
+	:
+	embedded(nullptr),
+	embeddedCount(0)
+{}
+
+ShaderSources& ShaderSources::global()
+{
+	static ShaderSources sources;
+	return sources;
+}
+
+void ShaderSources::setEmbedded(const EmbeddedShader* shaders, size_t count)
+{
+	embedded = shaders;
+	embeddedCount = count;
+}
+
+void ShaderSources::setOverrideDirectory(const std::string& directory)
+{
+	overrideDirectory = directory;
+	if (!overrideDirectory.empty() && overrideDirectory.back() != '/' && overrideDirectory.back() != '\\')
+		overrideDirectory += '/';
+}
+
+const std::string& ShaderSources::getOverrideDirectory() const
+{
+	return overrideDirectory;
+}
+
+bool ShaderSources::readFile(const std::string& path, std::string& contents)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	std::stringstream stream;
+	stream << file.rdbuf();
+	contents = stream.str();
+	return true;
+}
+
+bool ShaderSources::load(const std::string& name, std::string& source) const
+{
+	if (!overrideDirectory.empty() && readFile(overrideDirectory + name, source))
+		return true;
+	for (size_t i = 0; i < embeddedCount; ++i)
+	{
+		if (std::strcmp(embedded[i].name, name.c_str()) == 0)
+		{
+			source = embedded[i].source;
+			return true;
+		}
+	}
+	return readFile(name, source);
+}
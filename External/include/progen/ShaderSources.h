@@ -0,0 +1,40 @@
+#ifndef SHADER_SOURCES_H
+#define SHADER_SOURCES_H
+
+#include <string>
+#include <cstddef>
+
+/*
+	Where the GLSL sources come from.
+
+	Release builds use the sources embedded into the executable at build time (the pre-build step turns the Shaders
+	folder into a table, see Tools/embed_shaders.ps1), so the program does not depend on the working directory.
+	During development an override directory can be set: a file found there wins over the embedded copy, so shaders
+	can be edited without rebuilding. A name that is neither is opened as a plain path.
+*/
+
+struct EmbeddedShader
+{
+	const char* name; //Path relative to the Shaders folder, e.g. "basicLighting/basicLighting.vert"
+	const char* source;
+};
+
+class ShaderSources
+{
+public:
+	static ShaderSources& global();
+	void setEmbedded(const EmbeddedShader* shaders, size_t count);
+	void setOverrideDirectory(const std::string& directory);
+	const std::string& getOverrideDirectory() const;
+	//False if the source was not found anywhere
+	bool load(const std::string& name, std::string& source) const;
+private:
+	ShaderSources();
+	static bool readFile(const std::string& path, std::string& contents);
+private:
+	const EmbeddedShader* embedded;
+	size_t embeddedCount;
+	std::string overrideDirectory;
+};
+
+#endif
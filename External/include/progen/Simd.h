@@ -0,0 +1,14 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+	SSE2 is guaranteed on every x64 target (and enabled by /arch:SSE2 or -msse2 on x86).
+	Kernels that have a vector path test PROGEN_SSE2 and keep a scalar loop for the tails and other targets.
+*/
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PROGEN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#endif
@@ -1,32 +1,78 @@
 #include "Terrain.h"
+#include "GpuProfiler.h"
+
+#include <chrono>
 
 Terrain::Terrain()
+	:
+	vaoGeneration(0),
+	meshStats(),
+	cacheStats(),
+	visibleClusters(0),
+	visiblePatches(0),
+	uniformProgram(0),
+	submitTime(0.0),
+	indirectSubmission(false)
 {
-	biomes.push_back(&WATER);
-	biomes.push_back(&GRASS);
-	biomes.push_back(&LAND);
-	biomes.push_back(&SNOW);
 	createTerrainOpenGLInformation();
 }
 
 
 void Terrain::generate(TerrainData& tData, const NoiseData& nData)
 {
-	std::vector<std::vector<double>> noiseMap = noise.generateNoiseMap(nData);
-	tData.fallOffMap = fallOff.generate(tData.numXVertices, tData.numZVertices);
-	generateTerrain(tData, noiseMap);
+	PROFILE_ZONE("generate");
+	generator.generateHeights(tData, nData);
+	generateTerrain(tData, generator.getHeightMap());
+	scatterVegetation(tData);
+}
+
+bool Terrain::load(TerrainData& tData, const char* path)
+{
+	PROFILE_ZONE("load");
+	if (!generator.loadHeights(path, tData))
+		return false;
+	generateTerrain(tData, generator.getHeightMap());
+	scatterVegetation(tData);
+	return true;
+}
+
+bool Terrain::saveHeights(const char* path) const
+{
+	return generator.saveHeights(path);
+}
+
+void Terrain::scatterVegetation(const TerrainData& tData)
+{
+	//Scattering needs the final surface, so it comes after the query is built
+	if (tData.vegetation.enabled)
+		vegetation.scatter(tData.vegetation, query, generator.getBiomeMap());
+	else
+		vegetation.clear();
 }
 
+/*
+	Regenerating does not reallocate anything on the GPU: the old ranges go back to the shared buffers
+	and the new mesh is streamed into fresh ones.
+*/
 void Terrain::setupOpenGLBuffers()
+{
+	PROFILE_ZONE("upload");
+	uploads.free(geometry);
+	geometry = uploads.allocate(vertexData.size(), 3 * tris.size());
+	uploads.uploadVertices(geometry, vertexData.data(), vertexData.size());
+	uploads.uploadIndices(geometry, (const GLuint*)tris.data(), 3 * tris.size());
+	//The buffers are reallocated if they had to grow
+	if (uploads.getBufferGeneration() != vaoGeneration)
+		setupVertexArray();
+}
+
+void Terrain::setupVertexArray()
 {
 	//Bind VAO
 	glBindVertexArray(terrainVAO);
-	//Bind VBO, send data
-	glBindBuffer(GL_ARRAY_BUFFER, terrainVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
-	//Bind EBO, send indices 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrainEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(glm::ivec3) * tris.size(), tris.data(), GL_STATIC_DRAW);
+	//Vertices of every allocation are addressed with a base vertex, so the attributes start at 0
+	glBindBuffer(GL_ARRAY_BUFFER, uploads.getVertexBuffer());
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uploads.getIndexBuffer());
 
 	//Configure Vertex Attributes
 	//POSITION
@@ -44,27 +90,13 @@ void Terrain::setupOpenGLBuffers()
 	//Data passing and configuration is done 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
+	vaoGeneration = uploads.getBufferGeneration();
 }
 
 void Terrain::computeNormals()
 {
-	//Traverse each triangle and compute face normal
-	for (int i = 0; i < tris.size(); ++i)
-	{
-		Vertex& v1 = vertexData[tris[i][0]];
-		Vertex& v2 = vertexData[tris[i][1]];
-		Vertex& v3 = vertexData[tris[i][2]];
-		//Triangle vertices are oriented counter-clockwise (I have written so while generating triangles)
-		glm::vec3 n = glm::normalize(glm::cross(v2.pos - v1.pos, v3.pos - v1.pos));
-		//Accumulate normals in incident vertices
-		v1.normal += n;
-		v2.normal += n;
-		v3.normal += n;
-	}
-
-	//Normalize the normals
-	for (Vertex& v : vertexData)
-		v.normal = glm::normalize(v.normal);
+	PROFILE_ZONE("normals");
+	MeshBuilder::computeNormals(vertexData, tris);
 }
 
 
@@ -74,132 +106,218 @@ void Terrain::computeNormals()
 
 	If falloff map is enabled then the terrain becomes an island. 
 */
-void Terrain::generateTerrain(TerrainData& tData, const std::vector<std::vector<double>>& heightMap)
+void Terrain::generateTerrain(TerrainData& tData, const HeightField& heightMap)
 {
-	//I am lazy
-	using namespace std;
-	using namespace glm;
+	PROFILE_ZONE("mesh");
+	//Final heights are kept for the queries
+	HeightField scaledHeights;
 
-	//Clear up the previous data
-	vertexData.clear();
-	tris.clear();
-
-
-	int vi = 0; //index of the currently created vertex
-
-	//Generate from top-left to bottom-right. (If thinked in 2D)
-	for (int z = 0; z < tData.numZVertices; ++z)
+	//Height curve and grid connectivity
 	{
-		for (int x = 0; x < tData.numXVertices; ++x)
-		{
-			Vertex v;
-			//Generate the normalized point
-			vec3 p = vec3(x / (float)(tData.numXVertices - 1), 0.0, z / (float)(tData.numZVertices - 1));
-			//Cast it back in range [-W/2,-L/2:W/2,L/2] range	
-			p.x *= tData.W;
-			p.z *= tData.L;
-			p.x -= tData.W / 2.0;
-			p.z -= tData.L / 2.0;
-
-			//If using falloff map the height map value will be updated accordingly
-			//So, at the corners of the terrain the value will be diminished by falloff map
-			//which will give an impression of island to the terrain.
-			double heightValue = heightMap[z][x];
-			if (tData.useFallOff)
-			{
-				heightValue = heightValue - tData.fallOffMap[z][x];
-			}
-
-			//Note that since I scale the heights with height multiplier bellow
-			//Determining biome should come first before setting the actual height
-			//Basically, I first pick the biome in the range [0.0,1.0]
-			//Traverse biomes and see which biome fit
-			for (const Biome* biome : biomes)
-			{
-				if (biome->inRange(heightValue))
-				{
-					v.color = biome->getColor();
-					break;
-				}
-			}
-
-			//Pick the height value from the given height map
-			//p.y = heightMap[z][x];
-			p.y = ImGui::BezierValue(heightValue, tData.controlPoints) * tData.heightMultiplier;
-
-
-
-			vec3 n = vec3(0.0, 1.0, 0.0);
-
-			v.pos = p;
-			v.normal = n;
-
-			//Now generate quads (2 triangles) in the following fashion:
-			/*
-					 i  i+1
-					 ^___^
-					 |\  |
-					 | \ |
-			(i+numXVertices)>|__\|
-			*/
-			if (((vi + 1) % tData.numXVertices != 0) && ((z + 1) < tData.numZVertices))
-			{
-				//Oriented counter-clockwise
-				ivec3 tri1 = ivec3(vi, vi + tData.numXVertices, vi + tData.numXVertices + 1);
-				ivec3 tri2 = ivec3(vi, vi + tData.numXVertices + 1, vi + 1);
-
-				tris.push_back(tri1);
-				tris.push_back(tri2);
-			}
-
-			vertexData.push_back(v);
-			++vi;
-		}
+		PROFILE_ZONE("curve");
+		//Falloff, erosion and rivers are already applied to the height map and the biome map
+		MeshBuilder::applyHeightCurve(heightMap, HeightCurve(tData.controlPoints), tData.heightMultiplier, scaledHeights);
+		MeshBuilder::buildVertices(scaledHeights, generator.getBiomeMap(), generator.getBiomes(), (float)tData.W, (float)tData.L, vertexData);
+		MeshBuilder::buildGridIndices(tData.numXVertices, tData.numZVertices, tris);
 	}
+	//Per sample, so the adaptive mesh keeps the exact normals of the vertices it picks
+	if (generator.hasGradients())
+	{
+		PROFILE_ZONE("normals");
+		MeshBuilder::computeAnalyticNormals(heightMap, generator.getGradientX(), generator.getGradientZ(), HeightCurve(tData.controlPoints),
+			tData.heightMultiplier, (float)tData.W, (float)tData.L, vertexData);
+	}
+
+	meshStats.vertices = vertexData.size();
+	meshStats.triangles = tris.size();
+	meshStats.gridTriangles = tris.size();
+	meshStats.maxError = 0.0f;
+	meshStats.rmsError = 0.0f;
+	//Falls back to the grid if the vertex counts do not fit the RTIN hierarchy
+	bool adaptive = tData.meshType == MeshType::RTIN && rtin.build(scaledHeights);
+	if (adaptive)
+		buildAdaptiveMesh(tData.maxMeshError, scaledHeights);
+	//The grid has a known good order, the adaptive mesh needs the general optimizer
+	if (tData.optimizeVertexCache && adaptive)
+		vertexCache.optimize(tris, vertexData.size());
+	//Clusters keep the optimized order inside their tiles, and grid clusters are small enough to be cache friendly as they are
+	if (tData.clusterCulling && adaptive)
+		clusters.build(vertexData, tris);
+	else if (tData.clusterCulling)
+		clusters.buildGrid(vertexData, tData.numXVertices, tData.numZVertices, tris);
+	else
+		clusters.clear();
+	if (tData.optimizeVertexCache && !adaptive && !tData.clusterCulling)
+		VertexCache::buildGridStrips(tData.numXVertices, tData.numZVertices, tris);
+	cacheStats = VertexCache::simulate(tris, vertexData.size());
+
+	if (tData.clusterCulling && tData.horizonCulling)
+		horizon.build(scaledHeights, (float)tData.W, (float)tData.L);
+	else
+		horizon.clear();
 
 	triCount = tris.size();
+	query.build(std::move(scaledHeights), (float)tData.W, (float)tData.L);
+	//The normals have to be there before the upload
+	if (!generator.hasGradients())
+		computeNormals();
 	setupOpenGLBuffers();
-	computeNormals();
 
 }
 
+/*
+	Replaces the grid triangles with the RTIN mesh and keeps only the vertices it uses.
+*/
+void Terrain::buildAdaptiveMesh(float maxError, const HeightField& scaledHeights)
+{
+	rtin.extract(maxError, tris, vertexSamples);
+	meshStats = rtin.measure(scaledHeights, tris, vertexSamples);
+
+	std::vector<Vertex> adaptive(vertexSamples.size());
+	for (size_t i = 0; i < vertexSamples.size(); ++i)
+		adaptive[i] = vertexData[vertexSamples[i]];
+	vertexData.swap(adaptive);
+}
+
 void Terrain::createTerrainOpenGLInformation()
 {
 	//Now set and configure the data for OpenGL
 	glGenVertexArrays(1, &terrainVAO);
-	glGenBuffers(1, &terrainVBO);
-	glGenBuffers(1, &terrainEBO);
+	setupVertexArray();
 }
 
 Terrain::~Terrain()
 {
 	glDeleteVertexArrays(1, &terrainVAO);
-	glDeleteBuffers(1, &terrainVBO);
-	glDeleteBuffers(1, &terrainEBO);
-}
-
-void Terrain::renderTerrain
-(
-	Shader& shader, 
-	const Camera& camera,
-	const glm::vec3& lightDir,
-	const glm::vec3& lightColor
-) const
-{
-	shader.use();
-	glm::mat4 view = camera.getViewMatrix();
-	glm::mat4 projection = glm::perspective(glm::radians(camera.getFov()), (float)SCR_WIDTH / SCR_HEIGHT, 0.1f, 100.0f);
-	glm::mat4 model = glm::mat4(1.0f);
-	glm::mat4 PV = projection * view;
-	//Matrices
-	shader.setMat4("PVM", PV * model);
-	shader.setMat4("modelMat", model);
-	shader.setMat3("normalTransformation", glm::transpose(glm::inverse(glm::mat3(model))));
-	//Light Properties
-	shader.setVec3("lightDir", lightDir);
-	shader.setVec3("lightColor", lightColor);
+}
+
+void Terrain::renderTerrain(Shader& shader, const Camera& camera, Shader* indirectShader)
+{
+	PROFILE_ZONE("draw");
+	PROFILE_GPU_ZONE("draw");
+	auto submitBegin = std::chrono::steady_clock::now();
 	glBindVertexArray(terrainVAO);
-	glDrawElements(GL_TRIANGLES, 3 * triCount, GL_UNSIGNED_INT, 0);
+	GLint baseVertex = (GLint)geometry.firstVertex;
+	GLuint indexBase = (GLuint)geometry.firstIndex;
+	//Every chunk of the terrain shares the terrain's placement
+	DrawData data;
+	data.translationScale = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	drawList.clear();
+	if (clusters.getClusters().empty())
+	{
+		drawList.add(3 * triCount, indexBase, baseVertex, data);
+	}
+	else
+	{
+		//Only the visible parts of the index buffer
+		const HorizonCuller* occlusion = nullptr;
+		if (horizon.isValid())
+		{
+			visiblePatches = horizon.cull(camera.getPosition());
+			occlusion = &horizon;
+		}
+		visibleClusters = clusters.cull(camera, drawRanges, occlusion);
+		for (const ClusterDrawRange& range : drawRanges)
+			drawList.add(range.indexCount, indexBase + range.firstIndex, baseVertex, data);
+	}
+
+	indirectSubmission = indirectShader != nullptr && IndirectDrawList::isIndirectSupported();
+	if (indirectSubmission)
+	{
+		indirectShader->use();
+		drawList.submitIndirect();
+	}
+	else
+	{
+		shader.use();
+		if (shader.getID() != uniformProgram)
+		{
+			modelHandle = shader.getUniform("modelMat");
+			normalTransformationHandle = shader.getUniform("normalTransformation");
+			uniformProgram = shader.getID();
+		}
+		//Chunks are only translated and uniformly scaled, which leaves the normals alone
+		shader.setMat3(normalTransformationHandle, glm::mat3(1.0f));
+		drawList.submitLoop(shader, modelHandle);
+	}
+	submitTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitBegin).count();
+}
+
+void Terrain::renderVegetation(Shader& shader, const Camera& camera)
+{
+	vegetation.render(shader, camera);
+}
+
+const TerrainQuery& Terrain::getQuery() const
+{
+	return query;
 }
 
+const Vegetation& Terrain::getVegetation() const
+{
+	return vegetation;
+}
 
+const RTINStats& Terrain::getMeshStats() const
+{
+	return meshStats;
+}
+
+const VertexCacheStats& Terrain::getCacheStats() const
+{
+	return cacheStats;
+}
+
+const ClusterSet& Terrain::getClusters() const
+{
+	return clusters;
+}
+
+size_t Terrain::getVisibleClusterCount() const
+{
+	return visibleClusters;
+}
+
+const HorizonCuller& Terrain::getHorizonCuller() const
+{
+	return horizon;
+}
+
+size_t Terrain::getVisiblePatchCount() const
+{
+	return visiblePatches;
+}
+
+void Terrain::endFrame()
+{
+	uploads.endFrame();
+}
+
+const UploadManager& Terrain::getUploads() const
+{
+	return uploads;
+}
+
+bool Terrain::exportMesh(const char* path, MeshFormat format) const
+{
+	if (!query.isValid())
+		return false;
+	glm::vec2 extent = query.getExtent();
+	GridMeshView view(query.getHeights(), generator.getBiomeMap(), generator.getBiomes(), extent.x, extent.y);
+	return MeshExport::write(path, view, format);
+}
+
+double Terrain::getSubmitTime() const
+{
+	return submitTime;
+}
+
+bool Terrain::isIndirectSubmission() const
+{
+	return indirectSubmission;
+}
+
+size_t Terrain::getDrawCount() const
+{
+	return drawList.getDrawCount();
+}
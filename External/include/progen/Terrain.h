@@ -9,57 +9,48 @@
 
 
 #include "Camera.h"
+#include "Vertex.h"
 #include "Utilities.h"
-#include "PerlinNoise.h"
 #include "Shader.h"
 #include "curveEditor.h"
-#include "FalloffMap.h"
+#include "HeightField.h"
+#include "TerrainGenerator.h"
+#include "TerrainQuery.h"
+#include "Vegetation.h"
+#include "MeshExport.h"
+#include "RTINMesher.h"
+#include "VertexCache.h"
+#include "ClusterSet.h"
+#include "HorizonCuller.h"
+#include "UploadManager.h"
+#include "IndirectDrawList.h"
 
 
 
-//Biomes
-#include "Biome.h"
-#include "Water.h"
-#include "Land.h"
-#include "Grass.h"
-#include "Snow.h"
-
-
-
-/*	
-	Vertex data for OpenGL
+/*
+	How the triangles are laid over the height samples
 */
-struct Vertex
+enum class MeshType
 {
-	glm::vec3 pos;
-	glm::vec3 normal;
-	glm::vec3 color;
+	GRID, //Two triangles per cell
+	RTIN //Error bounded adaptive mesh, needs (2^k + 1) x (2^k + 1) vertices
 };
 
-
-
 /*
 	Necessary data needed for Terrain
 */
 
-struct TerrainData
+struct TerrainData : GenerationData
 {
-	std::vector<std::vector<double>> fallOffMap;
-	int W, L; 
-	int numXVertices;
-	int numZVertices;
-	float heightMultiplier;
-	float controlPoints[4]; //Bezier Curve Control Point Data (x1,y1,x2,y2)
-	bool useFallOff;
+	MeshType meshType;
+	float maxMeshError; //Largest vertical error (world units) the RTIN mesh may have
+	bool optimizeVertexCache; //Reorders the triangles for the post-transform cache
+	bool clusterCulling; //Splits the mesh into clusters and draws only the ones facing the camera inside the frustum
+	bool horizonCulling; //Also skips the clusters hidden behind the terrain (needs clusterCulling)
+	VegetationData vegetation;
 };
 
 
-static Water WATER(0.0, 0.3, glm::vec3(0.1, 0.4, 0.6));
-static Grass GRASS(0.31, 0.6, glm::vec3(0.37, 0.502, 0.22));
-static Land LAND(0.61, 0.89, glm::vec3(0.3, 0.2, 0.0));
-static Snow SNOW(0.9, 1.0, glm::vec3(1.0, 1.0, 1.0));
-
-
 /*
 	Class that encapsulates the procedurally generated terrain.
 	Outsiders will only use the class in the following fashion:
@@ -79,25 +70,74 @@ public:
 	Terrain();
 	~Terrain();
 	void generate(TerrainData& tData, const NoiseData& nData);
-	void renderTerrain
-	(Shader& shader, 
-	 const Camera& camera,
-	 const glm::vec3& lightDir,
-	 const glm::vec3& lightColor
-	) const;
+	//Meshes a saved height map instead of the noise (TerrainGenerator::loadHeights), the vertex counts follow the file
+	bool load(TerrainData& tData, const char* path);
+	//Height map and biome IDs of the last terrain, to be loaded again
+	bool saveHeights(const char* path) const;
+	//The projection, view and light come from the per frame uniform block (FrameUniforms).
+	//With an indirect shader (Shaders/terrainIndirect) and driver support every chunk goes out in one call.
+	void renderTerrain(Shader& shader, const Camera& camera, Shader* indirectShader = nullptr);
+	//Trees and rocks, drawn after the terrain with the instanced shader
+	void renderVegetation(Shader& shader, const Camera& camera);
+	//Height and raycast queries against the last generated terrain
+	const TerrainQuery& getQuery() const;
+	const Vegetation& getVegetation() const;
+	//Size and error of the last generated mesh against the height samples
+	const RTINStats& getMeshStats() const;
+	//Simulated post-transform cache behaviour of the last generated index buffer
+	const VertexCacheStats& getCacheStats() const;
+	const ClusterSet& getClusters() const;
+	//Clusters drawn in the last frame
+	size_t getVisibleClusterCount() const;
+	const HorizonCuller& getHorizonCuller() const;
+	//Occlusion patches visible in the last frame
+	size_t getVisiblePatchCount() const;
+	//Call once per frame, after rendering
+	void endFrame();
+	//CPU time of culling and submitting the terrain draws in the last frame, in ms
+	double getSubmitTime() const;
+	bool isIndirectSubmission() const;
+	size_t getDrawCount() const;
+	const UploadManager& getUploads() const;
+	//Writes the full resolution grid of the last generated terrain (not the adaptive mesh), streamed from its heights
+	bool exportMesh(const char* path, MeshFormat format) const;
 private:
-	void generateTerrain(TerrainData& tData, const std::vector<std::vector<double>>& heightMap);
+	void generateTerrain(TerrainData& tData, const HeightField& heightMap);
+	void scatterVegetation(const TerrainData& tData);
+	void buildAdaptiveMesh(float maxError, const HeightField& scaledHeights);
 	void createTerrainOpenGLInformation();
+	//Points the VAO at the current shared buffers
+	void setupVertexArray();
 	void setupOpenGLBuffers();
 	void computeNormals();
 private:
-	GLuint terrainVAO, terrainVBO, terrainEBO;
+	GLuint terrainVAO;
+	UploadManager uploads; //Shared vertex and index buffers, the terrain mesh is one allocation in them
+	GeometryAllocation geometry;
+	unsigned vaoGeneration; //Buffer generation of the uploads the VAO was set up for
 	GLuint triCount;
 	std::vector<Vertex> vertexData; //Total drawing data in the form v1|v2|v3... 
 	std::vector<glm::ivec3> tris;
-	std::vector<Biome*> biomes;
-	PerlinNoise noise; //Noise map generator
-	FalloffMap fallOff; //Falloff map generator
+	std::vector<int> vertexSamples; //Height sample of every vertex of the adaptive mesh
+	RTINMesher rtin;
+	RTINStats meshStats;
+	VertexCache vertexCache;
+	VertexCacheStats cacheStats;
+	ClusterSet clusters;
+	//Culling output, reused every frame
+	std::vector<ClusterDrawRange> drawRanges;
+	IndirectDrawList drawList;
+	size_t visibleClusters;
+	HorizonCuller horizon; //Occlusion by the terrain itself, on top of the cluster culling
+	size_t visiblePatches;
+	//Uniform handles of the program they were resolved for
+	GLuint uniformProgram;
+	UniformHandle modelHandle, normalTransformationHandle;
+	double submitTime;
+	bool indirectSubmission;
+	TerrainGenerator generator; //Noise to biome map. The mesh variants are built here from its height map.
+	TerrainQuery query; //Keeps the final heights after the vertex data is built
+	Vegetation vegetation; //Instances scattered on the final surface
 };
 
 #endif
\ No newline at end of file
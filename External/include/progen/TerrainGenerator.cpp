@@ -0,0 +1,235 @@
+#include "TerrainGenerator.h"
+#include "HeightmapIO.h"
+#include "TiledHeightmap.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+	bool hasExtension(const char* path, const char* extension)
+	{
+		size_t length = std::strlen(path);
+		size_t extensionLength = std::strlen(extension);
+		return length >= extensionLength && std::strcmp(path + length - extensionLength, extension) == 0;
+	}
+}
+
+TerrainGenerator::TerrainGenerator()
+	:
+	gradients(false),
+	fallOffW(0),
+	fallOffH(0)
+{
+	biomes.push_back(&WATER);
+	biomes.push_back(&GRASS);
+	biomes.push_back(&LAND);
+	biomes.push_back(&SNOW);
+}
+
+void TerrainGenerator::generateHeights(const GenerationData& gData, const NoiseData& nData)
+{
+	gradients = gData.analyticNormals && nData.fractalMode == FractalMode::Fbm && !gData.erosion.enabled && !gData.hydrology.enabled;
+	if (gradients)
+		noise.generateNoiseMap(nData, heightMap, gradientX, gradientZ);
+	else
+		noise.generateNoiseMap(nData, heightMap);
+	//Weathering runs on the normalized heights, before the height curve reshapes them
+	if (gData.erosion.enabled)
+		thermalErosion.erode(heightMap, gData.erosion);
+	//If using falloff map the height map value will be updated accordingly
+	//So, at the corners of the terrain the value will be diminished by falloff map
+	//which will give an impression of island to the terrain.
+	if (gData.useFallOff)
+	{
+		if (fallOffW != gData.numXVertices || fallOffH != gData.numZVertices)
+		{
+			fallOffMap = fallOff.generate(gData.numXVertices, gData.numZVertices);
+			fallOffW = gData.numXVertices;
+			fallOffH = gData.numZVertices;
+		}
+		for (int z = 0; z < gData.numZVertices; ++z)
+		{
+			float* row = heightMap.row(z);
+			for (int x = 0; x < gData.numXVertices; ++x)
+				row[x] -= (float)fallOffMap[z][x];
+		}
+		if (gradients)
+		{
+			PROFILE_ZONE("falloff gradient");
+			if (fallOffGradientX.getWidth() != gData.numXVertices || fallOffGradientX.getHeight() != gData.numZVertices)
+			{
+				fallOffGradientX.resize(gData.numXVertices, gData.numZVertices);
+				fallOffGradientZ.resize(gData.numXVertices, gData.numZVertices);
+				ThreadPool::global().parallelFor(0, gData.numZVertices, [&](int zBegin, int zEnd)
+				{
+					for (int z = zBegin; z < zEnd; ++z)
+						for (int x = 0; x < gData.numXVertices; ++x)
+						{
+							glm::dvec2 slope = fallOff.gradient(x, z, gData.numXVertices, gData.numZVertices);
+							fallOffGradientX.at(x, z) = (float)slope.x;
+							fallOffGradientZ.at(x, z) = (float)slope.y;
+						}
+				}, 16);
+			}
+			for (size_t i = 0; i < gradientX.size(); ++i)
+			{
+				gradientX.data()[i] -= fallOffGradientX.data()[i];
+				gradientZ.data()[i] -= fallOffGradientZ.data()[i];
+			}
+		}
+	}
+	//Rivers need heights without pits, so the filled heights are the ones that get meshed
+	if (gData.hydrology.enabled)
+	{
+		hydrology.fillDepressions(heightMap, gData.hydrology.fillEpsilon);
+		hydrology.computeFlow(heightMap, gData.hydrology.method);
+	}
+	{
+		PROFILE_ZONE("biome");
+		Biome::classify(heightMap, biomes, biomeMap);
+	}
+	if (gData.hydrology.enabled)
+		hydrology.markRivers(gData.hydrology.riverThreshold, biomeMap, WATER_ID);
+}
+
+bool TerrainGenerator::loadHeights(const char* path, GenerationData& gData, const char* biomePath)
+{
+	PROFILE_ZONE("load heights");
+	bool loaded = false, hasBiomes = false;
+	if (hasExtension(path, ".pgm"))
+		loaded = HeightmapIO::readPGM(path, heightMap);
+	else if (hasExtension(path, ".raw"))
+		loaded = HeightmapIO::readRAW(path, 0, 0, heightMap);
+	else if (hasExtension(path, ".pghc"))
+		loaded = HeightmapIO::readCompressed(path, heightMap);
+	else
+	{
+		TiledHeightmap tiled;
+		loaded = tiled.open(path);
+		if (loaded)
+		{
+			tiled.read(heightMap);
+			hasBiomes = tiled.hasBiomes();
+			if (hasBiomes)
+				tiled.readBiomes(biomeMap);
+		}
+	}
+	if (!loaded)
+		return false;
+	gradients = false;
+	gData.numXVertices = heightMap.getWidth();
+	gData.numZVertices = heightMap.getHeight();
+	if (!hasBiomes && biomePath != nullptr)
+	{
+		int W, H;
+		hasBiomes = HeightmapIO::readBiomePGM(biomePath, biomeMap, W, H) && W == heightMap.getWidth() && H == heightMap.getHeight();
+	}
+	//The IDs index the biome colors, a map from elsewhere or edited by hand can hold any byte
+	if (hasBiomes)
+	{
+		unsigned char largest = biomeMap.empty() ? 0 : *std::max_element(biomeMap.begin(), biomeMap.end());
+		if (largest >= biomes.size())
+		{
+			std::cout << "ERROR::TERRAIN_GENERATOR::BIOME_ID_OUT_OF_RANGE->" << (int)largest << ", classifying the heights instead" << std::endl;
+			hasBiomes = false;
+		}
+	}
+	if (!hasBiomes)
+	{
+		PROFILE_ZONE("biome");
+		Biome::classify(heightMap, biomes, biomeMap);
+	}
+	return true;
+}
+
+bool TerrainGenerator::saveHeights(const char* path, const char* biomePath) const
+{
+	PROFILE_ZONE("save heights");
+	bool saved;
+	if (hasExtension(path, ".pgm"))
+		saved = HeightmapIO::writePGM(path, heightMap);
+	else if (hasExtension(path, ".raw"))
+		saved = HeightmapIO::writeRAW(path, heightMap);
+	else if (hasExtension(path, ".pghc"))
+		saved = HeightmapIO::writeCompressed(path, heightMap, 0.5f / 65535.0f); //The precision of the 16-bit formats
+	else
+		saved = TiledHeightmap::write(path, heightMap, 0.0f, 1.0f, &biomeMap);
+	if (biomePath != nullptr)
+		saved &= HeightmapIO::writeBiomePGM(biomePath, biomeMap, heightMap.getWidth(), heightMap.getHeight());
+	return saved;
+}
+
+void TerrainGenerator::applyHeightCurve(const GenerationData& gData)
+{
+	PROFILE_ZONE("curve");
+	MeshBuilder::applyHeightCurve(heightMap, HeightCurve(gData.controlPoints), gData.heightMultiplier, scaledHeights);
+}
+
+void TerrainGenerator::buildMesh(const GenerationData& gData)
+{
+	{
+		PROFILE_ZONE("mesh");
+		MeshBuilder::buildVertices(scaledHeights, biomeMap, biomes, (float)gData.W, (float)gData.L, vertices);
+		MeshBuilder::buildGridIndices(scaledHeights.getWidth(), scaledHeights.getHeight(), tris);
+	}
+	PROFILE_ZONE("normals");
+	if (gradients)
+		MeshBuilder::computeAnalyticNormals(heightMap, gradientX, gradientZ, HeightCurve(gData.controlPoints), gData.heightMultiplier,
+			(float)gData.W, (float)gData.L, vertices);
+	else
+		MeshBuilder::computeNormals(vertices, tris);
+}
+
+const HeightField& TerrainGenerator::getHeightMap() const
+{
+	return heightMap;
+}
+
+const HeightField& TerrainGenerator::getScaledHeights() const
+{
+	return scaledHeights;
+}
+
+const std::vector<unsigned char>& TerrainGenerator::getBiomeMap() const
+{
+	return biomeMap;
+}
+
+const std::vector<Biome*>& TerrainGenerator::getBiomes() const
+{
+	return biomes;
+}
+
+const std::vector<Vertex>& TerrainGenerator::getVertices() const
+{
+	return vertices;
+}
+
+const std::vector<glm::ivec3>& TerrainGenerator::getTriangles() const
+{
+	return tris;
+}
+
+const Hydrology& TerrainGenerator::getHydrology() const
+{
+	return hydrology;
+}
+
+bool TerrainGenerator::hasGradients() const
+{
+	return gradients;
+}
+
+const HeightField& TerrainGenerator::getGradientX() const
+{
+	return gradientX;
+}
+
+const HeightField& TerrainGenerator::getGradientZ() const
+{
+	return gradientZ;
+}
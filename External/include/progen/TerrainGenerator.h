@@ -0,0 +1,118 @@
+#ifndef TERRAIN_GENERATOR_H
+#define TERRAIN_GENERATOR_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+#include "HeightField.h"
+#include "PerlinNoise.h"
+#include "FalloffMap.h"
+#include "ThermalErosion.h"
+#include "Hydrology.h"
+#include "HeightCurve.h"
+#include "MeshBuilder.h"
+
+//Biomes
+#include "Biome.h"
+#include "Water.h"
+#include "Land.h"
+#include "Grass.h"
+#include "Snow.h"
+
+/*
+	Settings of the CPU generation stages. TerrainData adds the mesh and rendering options on top of them.
+*/
+struct GenerationData
+{
+	int W, L;
+	int numXVertices;
+	int numZVertices;
+	float heightMultiplier;
+	float controlPoints[4]; //Bezier Curve Control Point Data (x1,y1,x2,y2)
+	bool useFallOff;
+	bool analyticNormals; //Normals from the derivatives of the noise, used for fBm when no erosion or rivers reshape the heights
+	ThermalErosionData erosion;
+	HydrologyData hydrology;
+};
+
+
+static Water WATER(0.0, 0.3, glm::vec3(0.1, 0.4, 0.6));
+static Grass GRASS(0.31, 0.6, glm::vec3(0.37, 0.502, 0.22));
+static Land LAND(0.61, 0.89, glm::vec3(0.3, 0.2, 0.0));
+static Snow SNOW(0.9, 1.0, glm::vec3(1.0, 1.0, 1.0));
+
+//IDs stored in the biome map, in the order the biomes are registered in the TerrainGenerator constructor
+enum BiomeID
+{
+	WATER_ID,
+	GRASS_ID,
+	LAND_ID,
+	SNOW_ID
+};
+
+
+/*
+	Everything from the noise to the grid mesh, without OpenGL, so tools (BatchGenerator) can run it headless.
+
+	generateHeights runs the noise, the erosion, the falloff and the hydrology and classifies the biomes.
+	loadHeights replaces it with a height map saved by saveHeights or made by another tool, picked by the extension:
+	.pgm, .raw and .pghc (HeightmapIO) or .pgth (TiledHeightmap). The file is memory mapped and its rows go straight
+	into the height map, the noise is not run. The biome IDs come from the tiled file or from biomePath (an 8-bit PGM),
+	and are classified from the heights when there are none. The vertex counts of gData are set to the size of the file.
+	applyHeightCurve gives the final heights in world units, and buildMesh turns them into the grid mesh with normals.
+	With analyticNormals the noise also gives the derivatives of the heights, the falloff's are subtracted from them, and
+	the normals come from them (MeshBuilder::computeAnalyticNormals) instead of the triangles. Erosion and rivers move
+	the heights away from the noise, so they keep the triangle normals, as do loaded height maps and the fractal modes
+	other than fBm.
+	Terrain only uses generateHeights, it builds its own mesh variants (RTIN, clusters) from the height map.
+
+	Every buffer is kept for the next call, so a generator that produces many terrains of the same size stops
+	allocating after the first one. A generator is not thread safe, use one per thread. The stages still split
+	their rows over the ThreadPool.
+*/
+
+class TerrainGenerator
+{
+public:
+	TerrainGenerator();
+	void generateHeights(const GenerationData& gData, const NoiseData& nData);
+	bool loadHeights(const char* path, GenerationData& gData, const char* biomePath = nullptr);
+	bool saveHeights(const char* path, const char* biomePath = nullptr) const;
+	void applyHeightCurve(const GenerationData& gData);
+	//Needs applyHeightCurve first
+	void buildMesh(const GenerationData& gData);
+	//Heights in [0.0,1.0] before the height curve, as the biomes were picked from them
+	const HeightField& getHeightMap() const;
+	//Final heights in world units, after applyHeightCurve
+	const HeightField& getScaledHeights() const;
+	const std::vector<unsigned char>& getBiomeMap() const;
+	const std::vector<Biome*>& getBiomes() const;
+	const std::vector<Vertex>& getVertices() const;
+	const std::vector<glm::ivec3>& getTriangles() const;
+	const Hydrology& getHydrology() const;
+	//True when the last generateHeights gave the derivatives of the height map
+	bool hasGradients() const;
+	//Derivatives of the height map along x and z per vertex
+	const HeightField& getGradientX() const;
+	const HeightField& getGradientZ() const;
+private:
+	std::vector<Biome*> biomes;
+	PerlinNoise noise; //Noise map generator
+	FalloffMap fallOff; //Falloff map generator
+	ThermalErosion thermalErosion; //Thermal weathering of the noise map
+	Hydrology hydrology; //Depression filling and flow accumulation for rivers
+	HeightField heightMap;
+	HeightField scaledHeights;
+	HeightField gradientX, gradientZ;
+	bool gradients;
+	std::vector<unsigned char> biomeMap; //Index into biomes for every sample of the height map
+	//The falloff map only depends on the size, it is kept until the size changes, and so are its derivatives
+	std::vector<std::vector<double>> fallOffMap;
+	int fallOffW, fallOffH;
+	HeightField fallOffGradientX, fallOffGradientZ;
+	std::vector<Vertex> vertices;
+	std::vector<glm::ivec3> tris;
+};
+
+#endif
@@ -0,0 +1,385 @@
+#include "TerrainQuery.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+namespace
+{
+	//Below this many queries a batch is not worth waking up the workers
+	const size_t PARALLEL_BATCH = 4096;
+
+	//Smallest root of a*s^2 + b*s + c = 0 in [0, sMax]
+	bool smallestRoot(float a, float b, float c, float sMax, float& s)
+	{
+		if (std::fabs(a) < 1e-12f)
+		{
+			if (std::fabs(b) < 1e-12f)
+				return false;
+			s = -c / b;
+			return s >= 0.0f && s <= sMax;
+		}
+		float disc = b * b - 4.0f * a * c;
+		if (disc < 0.0f)
+			return false;
+		//Numerically stable form of the two roots
+		float q = -0.5f * (b + std::copysign(std::sqrt(disc), b));
+		float r0 = q / a;
+		float r1 = q != 0.0f ? c / q : r0;
+		if (r0 > r1)
+			std::swap(r0, r1);
+		if (r0 >= 0.0f && r0 <= sMax)
+		{
+			s = r0;
+			return true;
+		}
+		if (r1 >= 0.0f && r1 <= sMax)
+		{
+			s = r1;
+			return true;
+		}
+		return false;
+	}
+}
+
+TerrainQuery::TerrainQuery()
+	:
+	worldW(0.0f),
+	worldL(0.0f),
+	toGridScale(0.0f)
+{}
+
+void TerrainQuery::build(HeightField scaledHeights, float W, float L)
+{
+	heights.swap(scaledHeights);
+	worldW = W;
+	worldL = L;
+	if (!isValid())
+	{
+		levels.clear();
+		return;
+	}
+	toGridScale = glm::vec2((heights.getWidth() - 1) / W, (heights.getHeight() - 1) / L);
+	buildPyramid();
+}
+
+bool TerrainQuery::isValid() const
+{
+	return heights.getWidth() >= 2 && heights.getHeight() >= 2 && worldW > 0.0f && worldL > 0.0f;
+}
+
+bool TerrainQuery::contains(float x, float z) const
+{
+	return isValid() && std::fabs(x) <= worldW * 0.5f && std::fabs(z) <= worldL * 0.5f;
+}
+
+glm::vec2 TerrainQuery::getCellSize() const
+{
+	return glm::vec2(1.0f) / toGridScale;
+}
+
+glm::vec2 TerrainQuery::getExtent() const
+{
+	return glm::vec2(worldW, worldL);
+}
+
+glm::ivec2 TerrainQuery::getSampleCount() const
+{
+	return glm::ivec2(heights.getWidth(), heights.getHeight());
+}
+
+const HeightField& TerrainQuery::getHeights() const
+{
+	return heights;
+}
+
+void TerrainQuery::buildPyramid()
+{
+	levels.clear();
+
+	//Level 0: min/max of the 4 corners of every cell
+	Level base;
+	base.W = heights.getWidth() - 1;
+	base.H = heights.getHeight() - 1;
+	base.cells.resize((size_t)base.W * base.H);
+	ThreadPool::global().parallelFor(0, base.H, [&](int zBegin, int zEnd)
+	{
+		for (int z = zBegin; z < zEnd; ++z)
+		{
+			const float* r0 = heights.row(z);
+			const float* r1 = heights.row(z + 1);
+			MinMax* out = base.cells.data() + (size_t)z * base.W;
+			for (int x = 0; x < base.W; ++x)
+			{
+				out[x].minH = std::min(std::min(r0[x], r0[x + 1]), std::min(r1[x], r1[x + 1]));
+				out[x].maxH = std::max(std::max(r0[x], r0[x + 1]), std::max(r1[x], r1[x + 1]));
+			}
+		}
+	}, 64);
+	levels.push_back(std::move(base));
+
+	//Merge 2x2 cells until a single cell covers the whole map
+	while (levels.back().W > 1 || levels.back().H > 1)
+	{
+		const Level& child = levels.back();
+		Level parent;
+		parent.W = (child.W + 1) / 2;
+		parent.H = (child.H + 1) / 2;
+		parent.cells.resize((size_t)parent.W * parent.H);
+		for (int z = 0; z < parent.H; ++z)
+		{
+			for (int x = 0; x < parent.W; ++x)
+			{
+				MinMax merged = { FLT_MAX, -FLT_MAX };
+				for (int cz = 2 * z; cz < std::min(2 * z + 2, child.H); ++cz)
+				{
+					for (int cx = 2 * x; cx < std::min(2 * x + 2, child.W); ++cx)
+					{
+						const MinMax& c = child.cells[(size_t)cz * child.W + cx];
+						merged.minH = std::min(merged.minH, c.minH);
+						merged.maxH = std::max(merged.maxH, c.maxH);
+					}
+				}
+				parent.cells[(size_t)z * parent.W + x] = merged;
+			}
+		}
+		levels.push_back(std::move(parent));
+	}
+}
+
+float TerrainQuery::getHeight(float x, float z) const
+{
+	if (!isValid())
+		return 0.0f;
+
+	//World to grid space, clamped to the terrain
+	float gx = std::min(std::max((x + worldW * 0.5f) * toGridScale.x, 0.0f), (float)(heights.getWidth() - 1));
+	float gz = std::min(std::max((z + worldL * 0.5f) * toGridScale.y, 0.0f), (float)(heights.getHeight() - 1));
+	int cx = std::min((int)gx, heights.getWidth() - 2);
+	int cz = std::min((int)gz, heights.getHeight() - 2);
+	float u = gx - cx;
+	float v = gz - cz;
+
+	const float* r0 = heights.row(cz);
+	const float* r1 = heights.row(cz + 1);
+	float h0 = r0[cx] + (r0[cx + 1] - r0[cx]) * u;
+	float h1 = r1[cx] + (r1[cx + 1] - r1[cx]) * u;
+	return h0 + (h1 - h0) * v;
+}
+
+glm::vec3 TerrainQuery::getNormal(float x, float z) const
+{
+	if (!isValid())
+		return glm::vec3(0.0f, 1.0f, 0.0f);
+
+	glm::vec2 cell = getCellSize();
+	float dx = getHeight(x + cell.x, z) - getHeight(x - cell.x, z);
+	float dz = getHeight(x, z + cell.y) - getHeight(x, z - cell.y);
+	return glm::normalize(glm::vec3(-dx / (2.0f * cell.x), 1.0f, -dz / (2.0f * cell.y)));
+}
+
+glm::ivec2 TerrainQuery::getNearestSample(float x, float z) const
+{
+	if (!isValid())
+		return glm::ivec2(0);
+
+	int i = (int)std::floor((x + worldW * 0.5f) * toGridScale.x + 0.5f);
+	int j = (int)std::floor((z + worldL * 0.5f) * toGridScale.y + 0.5f);
+	return glm::ivec2(std::min(std::max(i, 0), heights.getWidth() - 1), std::min(std::max(j, 0), heights.getHeight() - 1));
+}
+
+bool TerrainQuery::intersectCell(int cx, int cz, const glm::vec3& o, const glm::vec3& d, float tBegin, float tEnd, float& tHit) const
+{
+	const float* r0 = heights.row(cz);
+	const float* r1 = heights.row(cz + 1);
+	//h(u,v) = a + b*u + c*v + e*u*v over the cell
+	float a = r0[cx];
+	float b = r0[cx + 1] - r0[cx];
+	float c = r1[cx] - r0[cx];
+	float e = r0[cx] - r0[cx + 1] - r1[cx] + r1[cx + 1];
+
+	//Parametrize from the cell entry point for precision, s = t - tBegin
+	float u = o.x + d.x * tBegin - cx;
+	float v = o.z + d.z * tBegin - cz;
+	float y = o.y + d.y * tBegin;
+
+	//f(s) = ray height - surface height
+	float C = y - (a + b * u + c * v + e * u * v);
+	if (C <= 0.0f)
+	{
+		tHit = tBegin;
+		return true;
+	}
+	float B = d.y - (b * d.x + c * d.z + e * (u * d.z + v * d.x));
+	float A = -e * d.x * d.z;
+	float s;
+	if (!smallestRoot(A, B, C, tEnd - tBegin, s))
+		return false;
+	tHit = tBegin + s;
+	return true;
+}
+
+bool TerrainQuery::raycast(const glm::vec3& origin, const glm::vec3& dir, float maxT, RayHit& hit) const
+{
+	hit.hit = false;
+	if (!isValid())
+		return false;
+
+	//Grid space: x and z are sample indices, y stays in world units. t is the same in both spaces.
+	glm::vec3 o((origin.x + worldW * 0.5f) * toGridScale.x, origin.y, (origin.z + worldL * 0.5f) * toGridScale.y);
+	glm::vec3 d(dir.x * toGridScale.x, dir.y, dir.z * toGridScale.y);
+
+	//Clip against the bounding box of the whole terrain. The terrain is solid below its surface, so the box is open
+	//downwards and a ray entering through a side below the surface hits that side.
+	const Level& top = levels.back();
+	glm::vec3 boxMin(0.0f, -FLT_MAX, 0.0f);
+	glm::vec3 boxMax((float)levels[0].W, top.cells[0].maxH, (float)levels[0].H);
+	float tBegin = 0.0f;
+	float tEnd = maxT;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (std::fabs(d[axis]) < 1e-12f)
+		{
+			if (o[axis] < boxMin[axis] || o[axis] > boxMax[axis])
+				return false;
+			continue;
+		}
+		float t0 = (boxMin[axis] - o[axis]) / d[axis];
+		float t1 = (boxMax[axis] - o[axis]) / d[axis];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		tBegin = std::max(tBegin, t0);
+		tEnd = std::min(tEnd, t1);
+	}
+	if (tBegin > tEnd)
+		return false;
+
+	//The walk keeps the level 0 cell the ray is in as integers, a level's cell is that index shifted by the level.
+	//Leaving a cell steps the index across the crossed border, so points on a border never have to be rounded to a
+	//cell, which float coordinates cannot do reliably once they are thousands of cells large.
+	int W0 = levels[0].W;
+	int H0 = levels[0].H;
+	int ix = std::min(std::max((int)std::floor(o.x + d.x * tBegin), 0), W0 - 1);
+	int iz = std::min(std::max((int)std::floor(o.z + d.z * tBegin), 0), H0 - 1);
+	int topLevel = (int)levels.size() - 1;
+	int level = topLevel;
+	float t = tBegin;
+	//Every step either descends, ascends or leaves a cell, so this bound is never reached on sane input
+	int maxSteps = 4 * (W0 + H0) * (topLevel + 1) + 64;
+	for (int step = 0; step < maxSteps && t <= tEnd; ++step)
+	{
+		const Level& lvl = levels[level];
+		int cellSize = 1 << level;
+		int cx = ix >> level;
+		int cz = iz >> level;
+
+		//Where the ray leaves this cell
+		float tx = d.x > 0.0f ? ((cx + 1) * cellSize - o.x) / d.x : d.x < 0.0f ? (cx * cellSize - o.x) / d.x : FLT_MAX;
+		float tz = d.z > 0.0f ? ((cz + 1) * cellSize - o.z) / d.z : d.z < 0.0f ? (cz * cellSize - o.z) / d.z : FLT_MAX;
+		float tExit = std::max(std::min(std::min(tx, tz), tEnd), t);
+
+		const MinMax& bounds = lvl.cells[(size_t)cz * lvl.W + cx];
+		float rayLow = std::min(o.y + d.y * t, o.y + d.y * tExit);
+		bool above = rayLow > bounds.maxH;
+		if (!above && level > 0)
+		{
+			--level;
+			continue;
+		}
+		if (!above)
+		{
+			float tHit;
+			if (intersectCell(cx, cz, o, d, t, tExit, tHit))
+			{
+				hit.hit = true;
+				hit.t = tHit;
+				hit.position = origin + dir * tHit;
+				return true;
+			}
+		}
+		if (tExit >= tEnd)
+			return false;
+
+		//Step into the next cell: across the border(s) the ray crosses first, and along the other axis to where the
+		//ray is, kept inside the current cell
+		int firstX = cx * cellSize, lastX = std::min(firstX + cellSize, W0) - 1;
+		int firstZ = cz * cellSize, lastZ = std::min(firstZ + cellSize, H0) - 1;
+		if (tx <= tz)
+			ix = d.x > 0.0f ? lastX + 1 : firstX - 1;
+		else
+			ix = std::min(std::max((int)std::floor(o.x + d.x * tExit), firstX), lastX);
+		if (tz <= tx)
+			iz = d.z > 0.0f ? lastZ + 1 : firstZ - 1;
+		else
+			iz = std::min(std::max((int)std::floor(o.z + d.z * tExit), firstZ), lastZ);
+		if (ix < 0 || ix >= W0 || iz < 0 || iz >= H0)
+			return false;
+		t = tExit;
+		level = std::min(level + 1, topLevel);
+	}
+	return false;
+}
+
+bool TerrainQuery::raycastMarching(const glm::vec3& origin, const glm::vec3& dir, float maxT, float step, RayHit& hit) const
+{
+	hit.hit = false;
+	if (!isValid() || step <= 0.0f)
+		return false;
+
+	float dirLength = glm::length(dir);
+	if (dirLength <= 0.0f)
+		return false;
+	float dt = step / dirLength;
+
+	float tPrev = 0.0f;
+	for (float t = 0.0f; t <= maxT; t += dt)
+	{
+		glm::vec3 p = origin + dir * t;
+		if (contains(p.x, p.z) && p.y <= getHeight(p.x, p.z))
+		{
+			//Refine the crossing between the last point above and this one
+			float lo = tPrev, hi = t;
+			for (int i = 0; i < 24 && t > 0.0f; ++i)
+			{
+				float mid = 0.5f * (lo + hi);
+				glm::vec3 m = origin + dir * mid;
+				if (m.y <= getHeight(m.x, m.z))
+					hi = mid;
+				else
+					lo = mid;
+			}
+			hit.hit = true;
+			hit.t = hi;
+			hit.position = origin + dir * hi;
+			return true;
+		}
+		tPrev = t;
+	}
+	return false;
+}
+
+void TerrainQuery::getHeights(const glm::vec2* positions, float* out, size_t count) const
+{
+	if (count < PARALLEL_BATCH)
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = getHeight(positions[i].x, positions[i].y);
+		return;
+	}
+	ThreadPool::global().parallelFor(0, (int)count, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+			out[i] = getHeight(positions[i].x, positions[i].y);
+	}, 1024);
+}
+
+void TerrainQuery::raycast(const Ray* rays, RayHit* hits, size_t count) const
+{
+	//A ray costs orders of magnitude more than a height lookup, so much smaller batches are split
+	ThreadPool::global().parallelFor(0, (int)count, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+			raycast(rays[i].origin, rays[i].dir, rays[i].maxT, hits[i]);
+	}, 64);
+}
@@ -0,0 +1,91 @@
+#ifndef TERRAIN_QUERY_H
+#define TERRAIN_QUERY_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "HeightField.h"
+
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 dir; //Does not have to be normalized, t is measured in units of dir
+	float maxT;
+};
+
+struct RayHit
+{
+	bool hit;
+	float t;
+	glm::vec3 position;
+};
+
+
+/*
+	Answers "what is the terrain height at world (x, z)" and "where does this ray hit the ground" after the
+	terrain has been generated.
+
+	It keeps the final (curved and scaled) heights in the same layout as the mesh: sample (i, j) is at world
+	x = i / (numXVertices - 1) * W - W / 2, z = j / (numZVertices - 1) * L - L / 2.
+	Between the samples the surface is bilinear, both for getHeight and for raycast. For raycasts the terrain is
+	solid below the surface, so a ray starting under the ground hits immediately and a ray entering through a
+	side of the map below the surface hits that side.
+
+	Raycasts use a min/max pyramid over the cells: level 0 stores the min and max of the 4 corners of every cell and
+	every next level merges 2x2 cells of the previous one. Traversal starts at the top level. If the ray stays above
+	the max of a cell it skips the whole cell and goes one level up, otherwise it goes one level down until it reaches
+	a level 0 cell, where the ray is intersected with the bilinear patch exactly. The walk tracks its cell as integer
+	indices and steps them across the borders the ray crosses, so it stays exact on grids of any size.
+
+	REFERENCE: Tevs, Ihrke, Seidel - Maximum Mipmaps for Fast, Accurate, and Scalable Dynamic Height Field Rendering (2008)
+*/
+
+class TerrainQuery
+{
+public:
+	TerrainQuery();
+	//Takes over the scaled height plane. W and L are the world extents of the terrain, which is centered at the origin.
+	void build(HeightField scaledHeights, float W, float L);
+	bool isValid() const;
+	//Whether world (x, z) is over the terrain
+	bool contains(float x, float z) const;
+	float getHeight(float x, float z) const;
+	//Surface normal from central differences of the bilinear surface, one cell apart
+	glm::vec3 getNormal(float x, float z) const;
+	//Index (i, j) of the height sample nearest to world (x, z), clamped to the map. Used to look up per-sample maps (biomes).
+	glm::ivec2 getNearestSample(float x, float z) const;
+	bool raycast(const glm::vec3& origin, const glm::vec3& dir, float maxT, RayHit& hit) const;
+	//Brute force reference: marches the ray with a fixed step and refines the crossing with bisection
+	bool raycastMarching(const glm::vec3& origin, const glm::vec3& dir, float maxT, float step, RayHit& hit) const;
+	//Batched variants for thousands of queries per frame. Large batches are split over the ThreadPool.
+	void getHeights(const glm::vec2* positions, float* heights, size_t count) const;
+	void raycast(const Ray* rays, RayHit* hits, size_t count) const;
+	//Size of a cell in world units, useful for picking a marching step
+	glm::vec2 getCellSize() const;
+	//World extents (W, L) and number of samples in x and z
+	glm::vec2 getExtent() const;
+	glm::ivec2 getSampleCount() const;
+	//The final heights the queries run on
+	const HeightField& getHeights() const;
+private:
+	struct MinMax
+	{
+		float minH, maxH;
+	};
+	struct Level
+	{
+		int W, H; //Number of cells
+		std::vector<MinMax> cells;
+	};
+	void buildPyramid();
+	//Exact ray - bilinear patch test inside the cell over [tBegin, tEnd], in grid space
+	bool intersectCell(int cx, int cz, const glm::vec3& o, const glm::vec3& d, float tBegin, float tEnd, float& tHit) const;
+private:
+	HeightField heights;
+	std::vector<Level> levels;
+	float worldW, worldL;
+	glm::vec2 toGridScale; //World to grid (sample index) scale in x and z
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "TerrainTiles.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include "Hash.h"
+
+#include <algorithm>
+
+namespace
+{
+	void cutTile(const HeightField& heights, const std::vector<Vertex>& vertices, const std::vector<unsigned char>& biomeMap,
+		int x0, int z0, int W, int H, TerrainTile& tile)
+	{
+		int numX = heights.getWidth();
+		tile.heights.resize(W, H);
+		tile.normals.resize((size_t)W * H);
+		tile.biomes.resize((size_t)W * H);
+		tile.minimum.resize(0, 0);
+		tile.maximum.resize(0, 0);
+		for (int z = 0; z < H; ++z)
+		{
+			size_t source = (size_t)(z0 + z) * numX + x0;
+			std::copy(heights.row(z0 + z) + x0, heights.row(z0 + z) + x0 + W, tile.heights.row(z));
+			for (int x = 0; x < W; ++x)
+				tile.normals[(size_t)z * W + x] = vertices[source + x].normal;
+			std::copy(biomeMap.begin() + source, biomeMap.begin() + source + W, tile.biomes.begin() + (size_t)z * W);
+		}
+	}
+}
+
+TerrainTiles::TerrainTiles(TileCache& cache, const GenerationData& gData_in, const NoiseData& nData_in, int tileCells_in, int noiseLevel_in)
+	:
+	cache(cache),
+	gData(gData_in),
+	nData(nData_in),
+	tileCells(std::max(tileCells_in, 1)),
+	generations(0)
+{
+	nData.W = gData.numXVertices;
+	nData.H = gData.numZVertices;
+	tilesX = std::max((gData.numXVertices - 1 + tileCells - 1) / tileCells, 0);
+	tilesZ = std::max((gData.numZVertices - 1 + tileCells - 1) / tileCells, 0);
+	levels = TilePyramid::levelCount(gData.numXVertices, gData.numZVertices, tileCells);
+	//Level 0 is always the full terrain
+	noiseLevel = noiseLevel_in > 0 && noiseLevel_in < levels ? noiseLevel_in : 0;
+	parameters = TileCache::hashParameters(nData, gData, generator.getBiomes(), tileCells);
+	noiseParameters = hashBytes(&noiseLevel, sizeof(noiseLevel), parameters);
+}
+
+int TerrainTiles::getLevelCount() const
+{
+	return levels;
+}
+
+int TerrainTiles::getNoiseLevel() const
+{
+	return noiseLevel;
+}
+
+int TerrainTiles::getTilesX(int lod) const
+{
+	if (lod == 0)
+		return tilesX;
+	return lod > 0 && lod < levels ? (TilePyramid::levelSize(gData.numXVertices, lod) - 1 + tileCells - 1) / tileCells : 0;
+}
+
+int TerrainTiles::getTilesZ(int lod) const
+{
+	if (lod == 0)
+		return tilesZ;
+	return lod > 0 && lod < levels ? (TilePyramid::levelSize(gData.numZVertices, lod) - 1 + tileCells - 1) / tileCells : 0;
+}
+
+int TerrainTiles::getTileCells() const
+{
+	return tileCells;
+}
+
+uint64_t TerrainTiles::getParameterHash() const
+{
+	return parameters;
+}
+
+TileKey TerrainTiles::getKey(int x, int z, int lod) const
+{
+	TileKey key;
+	key.parameters = noiseLevel > 0 && lod >= noiseLevel ? noiseParameters : parameters;
+	key.lod = lod;
+	key.x = x;
+	key.z = z;
+	return key;
+}
+
+bool TerrainTiles::contains(int x, int z, int lod) const
+{
+	return x >= 0 && z >= 0 && x < getTilesX(lod) && z < getTilesZ(lod);
+}
+
+bool TerrainTiles::getTile(int x, int z, TerrainTile& tile, int lod)
+{
+	if (!contains(x, z, lod))
+		return false;
+	TileKey key = getKey(x, z, lod);
+	if (cache.read(key, tile))
+		return true;
+	std::lock_guard<std::mutex> lock(generateMutex);
+	//Another thread may have generated the terrain while this one waited
+	if (cache.contains(key) && cache.read(key, tile))
+		return true;
+	generate(lod, x, z, &tile);
+	return true;
+}
+
+bool TerrainTiles::cacheTile(int x, int z, int lod)
+{
+	if (!contains(x, z, lod))
+		return false;
+	TileKey key = getKey(x, z, lod);
+	if (cache.contains(key))
+		return true;
+	std::lock_guard<std::mutex> lock(generateMutex);
+	if (!cache.contains(key))
+		generate(lod, x, z, nullptr);
+	return cache.contains(key);
+}
+
+int TerrainTiles::getGenerationCount() const
+{
+	return generations.load();
+}
+
+void TerrainTiles::generate(int lod, int wantX, int wantZ, TerrainTile* wanted)
+{
+	PROFILE_ZONE("generate tiles");
+	if (noiseLevel > 0 && lod >= noiseLevel)
+	{
+		++generations;
+		pyramid.generate(gData, nData, generator.getBiomes(), noiseLevel, levels);
+		writeLevels(noiseLevel, levels, lod, wantX, wantZ, wanted);
+		return;
+	}
+	generator.generateHeights(gData, nData);
+	generator.applyHeightCurve(gData);
+	generator.buildMesh(gData);
+	++generations;
+	const HeightField& heights = generator.getScaledHeights();
+	ThreadPool::global().parallelFor(0, tilesX * tilesZ, [&](int begin, int end)
+	{
+		PROFILE_ZONE("cut tiles");
+		TerrainTile tile;
+		for (int t = begin; t < end; ++t)
+		{
+			int x = t % tilesX;
+			int z = t / tilesX;
+			int x0 = x * tileCells;
+			int z0 = z * tileCells;
+			//Tiles share the vertices on their borders
+			int W = std::min(tileCells + 1, gData.numXVertices - x0);
+			int H = std::min(tileCells + 1, gData.numZVertices - z0);
+			TerrainTile& out = lod == 0 && x == wantX && z == wantZ && wanted != nullptr ? *wanted : tile;
+			cutTile(heights, generator.getVertices(), generator.getBiomeMap(), x0, z0, W, H, out);
+			cache.write(getKey(x, z), out);
+		}
+	}, 1);
+	int reduced = noiseLevel > 0 ? noiseLevel : levels;
+	pyramid.build(heights, generator.getBiomeMap(), reduced);
+	writeLevels(1, reduced, lod, wantX, wantZ, wanted);
+}
+
+void TerrainTiles::writeLevels(int firstLod, int lastLod, int wantLod, int wantX, int wantZ, TerrainTile* wanted)
+{
+	//The tiles of all the levels in one list, the coarse levels alone are too few to keep the pool busy
+	std::vector<int> levelBegin(1, 0);
+	for (int lod = firstLod; lod < lastLod; ++lod)
+		levelBegin.push_back(levelBegin.back() + getTilesX(lod) * getTilesZ(lod));
+	float cellX = (float)gData.W / std::max(gData.numXVertices - 1, 1);
+	float cellZ = (float)gData.L / std::max(gData.numZVertices - 1, 1);
+	ThreadPool::global().parallelFor(0, levelBegin.back(), [&](int begin, int end)
+	{
+		PROFILE_ZONE("cut pyramid tiles");
+		TerrainTile tile;
+		for (int t = begin; t < end; ++t)
+		{
+			int level = (int)(std::upper_bound(levelBegin.begin(), levelBegin.end(), t) - levelBegin.begin()) - 1;
+			int lod = firstLod + level;
+			int levelTilesX = getTilesX(lod);
+			int x = (t - levelBegin[level]) % levelTilesX;
+			int z = (t - levelBegin[level]) / levelTilesX;
+			const PyramidLevel& source = pyramid.getLevel(lod);
+			int x0 = x * tileCells;
+			int z0 = z * tileCells;
+			int W = std::min(tileCells + 1, source.average.getWidth() - x0);
+			int H = std::min(tileCells + 1, source.average.getHeight() - z0);
+			TerrainTile& out = lod == wantLod && x == wantX && z == wantZ && wanted != nullptr ? *wanted : tile;
+			pyramid.cutTile(lod, x0, z0, W, H, cellX, cellZ, out);
+			cache.write(getKey(x, z, lod), out);
+		}
+	}, 1);
+}
@@ -0,0 +1,67 @@
+#ifndef TERRAIN_TILES_H
+#define TERRAIN_TILES_H
+
+#include <mutex>
+#include <atomic>
+
+#include "TileCache.h"
+#include "TerrainGenerator.h"
+#include "TilePyramid.h"
+
+/*
+	The tiles of one terrain (one parameter set), read from a TileCache or generated on a miss.
+
+	Tile (x, z) covers the cells [x * tileCells, (x + 1) * tileCells) of the grid, the last ones are smaller.
+	The stages before the mesh are global (the noise is normalized over the whole map, erosion and rivers move material
+	across it), so a tile cannot be generated on its own. A miss generates the whole terrain once and writes all of
+	its tiles to the cache, split over the ThreadPool. Concurrent misses wait for that one generation instead of
+	starting their own. A hit only reads and decodes the tile.
+
+	The tiles of the coarser levels (lod 1 and up, TilePyramid) have the same number of cells as the full resolution
+	ones, so a tile of level lod covers (2^lod)^2 full resolution tiles. The levels stop at the first one that fits in a
+	single tile. A generation of the full terrain writes the tiles of every level to the cache with it.
+	With a noise level, the levels from that one up are sampled from the noise with fewer octaves instead
+	(TilePyramid::generate), a miss on them only generates those levels, never the full terrain.
+*/
+
+class TerrainTiles
+{
+public:
+	//noiseLevel 0 reduces every level from the full terrain
+	TerrainTiles(TileCache& cache, const GenerationData& gData, const NoiseData& nData, int tileCells, int noiseLevel = 0);
+	int getLevelCount() const;
+	int getNoiseLevel() const;
+	int getTilesX(int lod = 0) const;
+	int getTilesZ(int lod = 0) const;
+	int getTileCells() const;
+	uint64_t getParameterHash() const;
+	TileKey getKey(int x, int z, int lod = 0) const;
+	//False if the tile is outside of the terrain or could not be generated
+	bool getTile(int x, int z, TerrainTile& tile, int lod = 0);
+	//Makes sure the tile is in the cache, generating the terrain on a miss. The tile is not decoded.
+	bool cacheTile(int x, int z, int lod = 0);
+	//Number of times the terrain had to be generated
+	int getGenerationCount() const;
+private:
+	bool contains(int x, int z, int lod) const;
+	//Needs generateMutex. Generates what level lod comes from and cuts tile (wantX, wantZ) into wanted on the way, if there is one.
+	void generate(int lod, int wantX, int wantZ, TerrainTile* wanted);
+	//Writes the tiles of pyramid levels [firstLod, lastLod)
+	void writeLevels(int firstLod, int lastLod, int wantLod, int wantX, int wantZ, TerrainTile* wanted);
+private:
+	TileCache& cache;
+	GenerationData gData;
+	NoiseData nData;
+	int tileCells;
+	int tilesX, tilesZ;
+	int levels;
+	int noiseLevel;
+	uint64_t parameters;
+	uint64_t noiseParameters; //Of the levels sampled from the noise
+	std::mutex generateMutex;
+	TerrainGenerator generator;
+	TilePyramid pyramid;
+	std::atomic<int> generations;
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include "ThermalErosion.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	//How far a sample of height c is above a neighbour of height n past the talus
+	inline float excess(float c, float n, float talus)
+	{
+		return std::max(c - n - talus, 0.0f);
+	}
+
+	//Share of its excess over a neighbour a sample gives to that neighbour: half of its largest excess leaves in
+	//total, split between the lower neighbours by their excess
+	inline float outflowFactor(const float* up, const float* mid, const float* down, int x, int W, float talus, float halfRate)
+	{
+		float c = mid[x];
+		float e[4] = { excess(c, x > 0 ? mid[x - 1] : c, talus), excess(c, x < W - 1 ? mid[x + 1] : c, talus), excess(c, up[x], talus), excess(c, down[x], talus) };
+		float total = e[0] + e[1] + e[2] + e[3];
+		float largest = std::max(std::max(e[0], e[1]), std::max(e[2], e[3]));
+		return total > 0.0f ? halfRate * largest / total : 0.0f;
+	}
+
+	//Net amount a sample of height c and outflow factor f receives from a neighbour of height n and factor fn
+	inline float exchange(float c, float f, float n, float fn, float talus)
+	{
+		return fn * excess(n, c, talus) - f * excess(c, n, talus);
+	}
+
+	inline float erodeSample(const float* up, const float* mid, const float* down, const float* upF, const float* midF, const float* downF,
+		int x, int W, float talus)
+	{
+		float c = mid[x];
+		float f = midF[x];
+		float gain = exchange(c, f, up[x], upF[x], talus) + exchange(c, f, down[x], downF[x], talus);
+		if (x > 0)
+			gain += exchange(c, f, mid[x - 1], midF[x - 1], talus);
+		if (x < W - 1)
+			gain += exchange(c, f, mid[x + 1], midF[x + 1], talus);
+		return c + gain;
+	}
+}
+
+ThermalErosion::ThermalErosion()
+{}
+
+int ThermalErosion::erode(HeightField& heightMap, const ThermalErosionData& eData)
+{
+	PROFILE_ZONE("erosion");
+	int W = heightMap.getWidth();
+	int H = heightMap.getHeight();
+	if (W < 2 || H < 2)
+		return 0;
+
+	float rate = std::min(std::max(eData.rate, 0.0f), 1.0f);
+	float talus = std::max(eData.talus, 0.0f);
+
+	if (scratch.getWidth() != W || scratch.getHeight() != H)
+		scratch.resize(W, H);
+
+	ThreadPool& pool = ThreadPool::global();
+	int pass = 0;
+	while (pass < eData.iterations)
+	{
+		float maxChange = 0.0f;
+		std::mutex maxMutex;
+		pool.parallelFor(0, H, [&](int zBegin, int zEnd)
+		{
+			PROFILE_ZONE("erosion rows");
+			float bandMax = erodeRows(heightMap, scratch, zBegin, zEnd, talus, 0.5f * rate);
+			std::lock_guard<std::mutex> lock(maxMutex);
+			maxChange = std::max(maxChange, bandMax);
+		}, 16);
+
+		//Result of this pass becomes the source of the next one
+		heightMap.swap(scratch);
+		++pass;
+
+		if (maxChange < eData.epsilon)
+			break;
+	}
+
+	return pass;
+}
+
+void ThermalErosion::computeOutflow(const HeightField& src, int z, float talus, float halfRate, float* out) const
+{
+	int W = src.getWidth();
+	int H = src.getHeight();
+	//Samples outside of the map are treated as the sample itself so no material leaves the map
+	const float* mid = src.row(z);
+	const float* up = z > 0 ? src.row(z - 1) : mid;
+	const float* down = z < H - 1 ? src.row(z + 1) : mid;
+
+	out[0] = outflowFactor(up, mid, down, 0, W, talus, halfRate);
+	int x = 1;
+#ifdef PROGEN_SSE2
+	const __m128 vTalus = _mm_set1_ps(talus);
+	const __m128 vHalfRate = _mm_set1_ps(halfRate);
+	const __m128 vZero = _mm_setzero_ps();
+	for (; x + 4 <= W - 1; x += 4)
+	{
+		__m128 c = _mm_loadu_ps(mid + x);
+		__m128 n[4] = { _mm_loadu_ps(mid + x - 1), _mm_loadu_ps(mid + x + 1), _mm_loadu_ps(up + x), _mm_loadu_ps(down + x) };
+		__m128 total = vZero, largest = vZero;
+		for (int k = 0; k < 4; ++k)
+		{
+			__m128 e = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(c, n[k]), vTalus), vZero);
+			total = _mm_add_ps(total, e);
+			largest = _mm_max_ps(largest, e);
+		}
+		//0 / 0 where nothing flows out, masked to 0
+		__m128 factor = _mm_div_ps(_mm_mul_ps(vHalfRate, largest), total);
+		_mm_storeu_ps(out + x, _mm_and_ps(factor, _mm_cmpgt_ps(total, vZero)));
+	}
+#endif
+	for (; x < W; ++x)
+		out[x] = outflowFactor(up, mid, down, x, W, talus, halfRate);
+}
+
+float ThermalErosion::erodeRows(const HeightField& src, HeightField& dst, int zBegin, int zEnd, float talus, float halfRate) const
+{
+	int W = src.getWidth();
+	int H = src.getHeight();
+	float maxChange = 0.0f;
+	//Outflow factors of the rows around the current one, computed one row ahead. The bands recompute the rows at their
+	//borders instead of sharing them, so a pass stays one parallelFor.
+	std::vector<float> factors(3 * (size_t)W);
+	auto factorRow = [&](int z) { return factors.data() + (size_t)((z + 3) % 3) * W; };
+	if (zBegin > 0)
+		computeOutflow(src, zBegin - 1, talus, halfRate, factorRow(zBegin - 1));
+	computeOutflow(src, zBegin, talus, halfRate, factorRow(zBegin));
+
+	for (int z = zBegin; z < zEnd; ++z)
+	{
+		if (z < H - 1)
+			computeOutflow(src, z + 1, talus, halfRate, factorRow(z + 1));
+		//Samples outside of the map are treated as the sample itself so no material leaves the map
+		const float* mid = src.row(z);
+		const float* up = z > 0 ? src.row(z - 1) : mid;
+		const float* down = z < H - 1 ? src.row(z + 1) : mid;
+		const float* midF = factorRow(z);
+		const float* upF = z > 0 ? factorRow(z - 1) : midF;
+		const float* downF = z < H - 1 ? factorRow(z + 1) : midF;
+		float* out = dst.row(z);
+
+		//First column is always scalar because of the missing left neighbour
+		out[0] = erodeSample(up, mid, down, upF, midF, downF, 0, W, talus);
+		maxChange = std::max(maxChange, std::fabs(out[0] - mid[0]));
+
+		int x = 1;
+#ifdef PROGEN_SSE2
+		const __m128 vTalus = _mm_set1_ps(talus);
+		const __m128 vNegTalus = _mm_set1_ps(-talus);
+		const __m128 vZero = _mm_setzero_ps();
+		const __m128 vAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 vMaxChange = vZero;
+		for (; x + 4 <= W - 1; x += 4)
+		{
+			__m128 c = _mm_loadu_ps(mid + x);
+			__m128 f = _mm_loadu_ps(midF + x);
+			__m128 n[4] = { _mm_loadu_ps(mid + x - 1), _mm_loadu_ps(mid + x + 1), _mm_loadu_ps(up + x), _mm_loadu_ps(down + x) };
+			__m128 nf[4] = { _mm_loadu_ps(midF + x - 1), _mm_loadu_ps(midF + x + 1), _mm_loadu_ps(upF + x), _mm_loadu_ps(downF + x) };
+			__m128 gain = vZero;
+			for (int k = 0; k < 4; ++k)
+			{
+				__m128 d = _mm_sub_ps(n[k], c);
+				__m128 in = _mm_max_ps(_mm_sub_ps(d, vTalus), vZero);
+				__m128 outFlow = _mm_max_ps(_mm_sub_ps(vNegTalus, d), vZero);
+				gain = _mm_add_ps(gain, _mm_sub_ps(_mm_mul_ps(nf[k], in), _mm_mul_ps(f, outFlow)));
+			}
+			_mm_storeu_ps(out + x, _mm_add_ps(c, gain));
+			vMaxChange = _mm_max_ps(vMaxChange, _mm_and_ps(gain, vAbsMask));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, vMaxChange);
+		maxChange = std::max(maxChange, std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3])));
+#endif
+		//Remaining columns (and the whole row when SSE2 is not available)
+		for (; x < W; ++x)
+		{
+			out[x] = erodeSample(up, mid, down, upF, midF, downF, x, W, talus);
+			maxChange = std::max(maxChange, std::fabs(out[x] - mid[x]));
+		}
+	}
+
+	return maxChange;
+}
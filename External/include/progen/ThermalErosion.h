@@ -0,0 +1,51 @@
+#ifndef THERMAL_EROSION_H
+#define THERMAL_EROSION_H
+
+#include "HeightField.h"
+
+/*
+	Necessary data needed for Thermal Erosion
+*/
+struct ThermalErosionData
+{
+	bool enabled;
+	int iterations; //Upper bound on the number of passes
+	float talus; //Largest stable height difference between 4-neighbours, in normalized height units
+	float rate; //Fraction of half its largest excess a sample gives away per pass. Clamped to [0, 1]
+	float epsilon; //Stop early once no sample changes more than this in a pass
+};
+
+
+/*
+	Thermal weathering: material slides down wherever the slope between two neighbouring samples exceeds the talus.
+
+	Every pass is a Jacobi-style stencil over the height plane. A sample whose height difference d_j to a 4-neighbour
+	exceeds the talus has the excess e_j = d_j - talus over it, and gives that neighbour
+		t_j = 0.5 * rate * max_k(e_k) * e_j / sum_k(e_k)
+	so it gives away at most half of its largest excess, split between its lower neighbours by their excess. A transfer
+	alone never takes a pair past the talus, so the differences settle at it instead of flipping sign. Each row
+	band computes the factor 0.5 * rate * max(e) / sum(e) of its samples a row ahead, then each sample adds what its
+	neighbours give it and subtracts what it gives them. The exchange of a pair is antisymmetric, so the total amount
+	of material is conserved. A pass reads one buffer and writes the other, rows are vectorized with SSE2 and row bands
+	run on the ThreadPool.
+
+	REFERENCE: Musgrave, Kolb, Mace - The Synthesis and Rendering of Eroded Fractal Terrains (1989)
+	REFERENCE: Olsen - Realtime Procedural Terrain Generation (2004), for the split of the outflow
+*/
+
+class ThermalErosion
+{
+public:
+	ThermalErosion();
+	//Returns the number of passes actually run
+	int erode(HeightField& heightMap, const ThermalErosionData& eData);
+private:
+	//Outflow factors of row z of src
+	void computeOutflow(const HeightField& src, int z, float talus, float halfRate, float* out) const;
+	//Writes rows [zBegin, zEnd) of dst from src. Returns the largest absolute change in those rows.
+	float erodeRows(const HeightField& src, HeightField& dst, int zBegin, int zEnd, float talus, float halfRate) const;
+private:
+	HeightField scratch; //Second buffer of the double buffering, kept to avoid reallocating on every generate
+};
+
+#endif
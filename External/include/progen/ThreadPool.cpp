@@ -0,0 +1,129 @@
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned numThreads)
+	:
+	stopping(false)
+{
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned i = 0; i < numThreads; ++i)
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+unsigned ThreadPool::getThreadCount() const
+{
+	return (unsigned)workers.size();
+}
+
+ThreadPool& ThreadPool::global()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::parallelFor(int begin, int end, const std::function<void(int, int)>& func, int minBand)
+{
+	int count = end - begin;
+	if (count <= 0)
+		return;
+
+	//A few bands per thread so that uneven bands even out
+	int numBands = std::min((int)(getThreadCount() + 1) * 4, (count + minBand - 1) / std::max(minBand, 1));
+	numBands = std::max(numBands, 1);
+	if (numBands == 1)
+	{
+		func(begin, end);
+		return;
+	}
+
+	//remaining is only touched under doneMutex. The waiter has to take the lock before it returns,
+	//otherwise the last job could still be inside notify_all while these locals go out of scope.
+	int remaining = numBands;
+	std::mutex doneMutex;
+	std::condition_variable done;
+
+	for (int b = 0; b < numBands; ++b)
+	{
+		int bandBegin = begin + (int)((long long)count * b / numBands);
+		int bandEnd = begin + (int)((long long)count * (b + 1) / numBands);
+		enqueue([&, bandBegin, bandEnd]()
+		{
+			func(bandBegin, bandEnd);
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (--remaining == 0)
+				done.notify_all();
+		});
+	}
+
+	//Help with the queue instead of idling, then sleep until the last band finishes
+	for (;;)
+	{
+		{
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (remaining == 0)
+				break;
+		}
+		if (!runPendingJob())
+		{
+			std::unique_lock<std::mutex> lock(doneMutex);
+			done.wait(lock, [&]() { return remaining == 0; });
+			break;
+		}
+	}
+}
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		jobs.push_back(std::move(job));
+	}
+	jobAvailable.notify_one();
+}
+
+bool ThreadPool::runPendingJob()
+{
+	std::function<void()> job;
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		if (jobs.empty())
+			return false;
+		job = std::move(jobs.front());
+		jobs.pop_front();
+	}
+	job();
+	return true;
+}
+
+void ThreadPool::workerLoop()
+{
+	PROFILE_THREAD("worker");
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping && jobs.empty())
+				return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/*
+	A fixed set of worker threads that the generation stages share.
+	Spawning threads per call is too expensive for iterative stages (erosion runs hundreds of passes),
+	so the workers are created once and fed with jobs.
+
+	parallelFor splits [begin, end) into contiguous bands (rows for the height plane stages) and blocks until
+	every band is done. The calling thread helps running the queued jobs while waiting, so a parallelFor issued
+	from inside a job cannot deadlock the pool.
+*/
+
+class ThreadPool
+{
+public:
+	//0 means one worker per hardware thread
+	explicit ThreadPool(unsigned numThreads = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	unsigned getThreadCount() const;
+	//func(bandBegin, bandEnd) is called for disjoint bands that cover [begin, end). minBand is the smallest band worth a job.
+	void parallelFor(int begin, int end, const std::function<void(int, int)>& func, int minBand = 1);
+	//Shared pool used by the generation stages
+	static ThreadPool& global();
+private:
+	void enqueue(std::function<void()> job);
+	bool runPendingJob();
+	void workerLoop();
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex jobMutex;
+	std::condition_variable jobAvailable;
+	bool stopping;
+};
+
+#endif
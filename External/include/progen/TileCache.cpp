@@ -0,0 +1,594 @@
+#include "TileCache.h"
+#include "TerrainGenerator.h"
+#include "MappedFile.h"
+#include "BufferedWriter.h"
+#include "Hash.h"
+#include "HeightCodec.h"
+#include "Profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#ifdef _WIN32
+#include <direct.h>
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+
+namespace
+{
+	const uint32_t TILE_MAGIC = 0x4C544750; //"PGTL"
+	const char* TILE_EXTENSION = ".tile";
+
+	struct TileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t heightBytes;
+		uint32_t normalBytes;
+		uint32_t biomeBytes;
+		uint32_t minimumBytes; //0 without height bounds
+		uint32_t maximumBytes;
+		uint32_t reserved;
+	};
+
+	struct CachedFile
+	{
+		uint64_t key;
+		uint64_t bytes;
+		int64_t modified;
+	};
+
+	void makeDirectory(const std::string& path)
+	{
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+
+	bool parseFileKey(const char* name, uint64_t& key)
+	{
+		if (std::strlen(name) != 16 + std::strlen(TILE_EXTENSION) || std::strcmp(name + 16, TILE_EXTENSION) != 0)
+			return false;
+		key = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			char c = name[i];
+			int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+			if (digit < 0)
+				return false;
+			key = key << 4 | (uint64_t)digit;
+		}
+		return true;
+	}
+
+	//Tile files in the directory with their size and last write time
+	void listTiles(const std::string& directory, std::vector<CachedFile>& files)
+	{
+		files.clear();
+		uint64_t key;
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((directory + "\\*" + TILE_EXTENSION).c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE)
+			return;
+		do
+		{
+			if (parseFileKey(data.cFileName, key))
+			{
+				uint64_t bytes = (uint64_t)data.nFileSizeHigh << 32 | data.nFileSizeLow;
+				int64_t modified = (int64_t)((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime);
+				files.push_back({ key, bytes, modified });
+			}
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+#else
+		DIR* dir = opendir(directory.c_str());
+		if (dir == nullptr)
+			return;
+		while (dirent* entry = readdir(dir))
+		{
+			struct stat info;
+			if (parseFileKey(entry->d_name, key) && stat((directory + "/" + entry->d_name).c_str(), &info) == 0)
+				files.push_back({ key, (uint64_t)info.st_size, (int64_t)info.st_mtime });
+		}
+		closedir(dir);
+#endif
+	}
+
+	float signNotZero(float v)
+	{
+		return v >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	//Octahedral mapping around the y axis, the one terrain normals lean towards
+	void encodeNormal(const glm::vec3& n, int16_t* out)
+	{
+		float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		float u = n.x / sum;
+		float v = n.z / sum;
+		if (n.y < 0.0f)
+		{
+			float foldedU = (1.0f - std::fabs(v)) * signNotZero(u);
+			v = (1.0f - std::fabs(u)) * signNotZero(v);
+			u = foldedU;
+		}
+		out[0] = (int16_t)std::lround(std::min(std::max(u, -1.0f), 1.0f) * 32767.0f);
+		out[1] = (int16_t)std::lround(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f);
+	}
+
+	glm::vec3 decodeNormal(const int16_t* in)
+	{
+		float u = in[0] / 32767.0f;
+		float v = in[1] / 32767.0f;
+		glm::vec3 n(u, 1.0f - std::fabs(u) - std::fabs(v), v);
+		if (n.y < 0.0f)
+		{
+			n.x = (1.0f - std::fabs(v)) * signNotZero(u);
+			n.z = (1.0f - std::fabs(u)) * signNotZero(v);
+		}
+		return glm::normalize(n);
+	}
+}
+
+const uint32_t TileCache::FORMAT_VERSION;
+
+uint64_t TileCache::hashParameters(const NoiseData& nData, const GenerationData& gData, const std::vector<Biome*>& biomes, int tileCells)
+{
+	//Field by field, the padding of the structs is not initialized
+	uint64_t h = hashBytes(&FORMAT_VERSION, sizeof(FORMAT_VERSION));
+	h = hashBytes(&tileCells, sizeof(tileCells), h);
+	h = hashBytes(&nData.W, sizeof(nData.W), h);
+	h = hashBytes(&nData.H, sizeof(nData.H), h);
+	h = hashBytes(&nData.seed, sizeof(nData.seed), h);
+	h = hashBytes(&nData.scale, sizeof(nData.scale), h);
+	h = hashBytes(&nData.octaves, sizeof(nData.octaves), h);
+	h = hashBytes(&nData.persistence, sizeof(nData.persistence), h);
+	h = hashBytes(&nData.lacunarity, sizeof(nData.lacunarity), h);
+	h = hashBytes(&nData.offset, sizeof(nData.offset), h);
+	h = hashBytes(&nData.octaveMode, sizeof(nData.octaveMode), h);
+	if (nData.octaveMode == OctaveMode::BandLimited)
+		h = hashBytes(&nData.fadeLastOctave, sizeof(nData.fadeLastOctave), h);
+	h = hashBytes(&nData.fractalMode, sizeof(nData.fractalMode), h);
+	if (nData.fractalMode == FractalMode::DomainWarp)
+		h = hashBytes(&nData.warpStrength, sizeof(nData.warpStrength), h);
+	h = hashBytes(&gData.W, sizeof(gData.W), h);
+	h = hashBytes(&gData.L, sizeof(gData.L), h);
+	h = hashBytes(&gData.numXVertices, sizeof(gData.numXVertices), h);
+	h = hashBytes(&gData.numZVertices, sizeof(gData.numZVertices), h);
+	h = hashBytes(&gData.heightMultiplier, sizeof(gData.heightMultiplier), h);
+	h = hashBytes(gData.controlPoints, sizeof(gData.controlPoints), h);
+	h = hashBytes(&gData.useFallOff, sizeof(gData.useFallOff), h);
+	h = hashBytes(&gData.analyticNormals, sizeof(gData.analyticNormals), h);
+	const ThermalErosionData& e = gData.erosion;
+	h = hashBytes(&e.enabled, sizeof(e.enabled), h);
+	if (e.enabled)
+	{
+		h = hashBytes(&e.iterations, sizeof(e.iterations), h);
+		h = hashBytes(&e.talus, sizeof(e.talus), h);
+		h = hashBytes(&e.rate, sizeof(e.rate), h);
+		h = hashBytes(&e.epsilon, sizeof(e.epsilon), h);
+	}
+	const HydrologyData& r = gData.hydrology;
+	h = hashBytes(&r.enabled, sizeof(r.enabled), h);
+	if (r.enabled)
+	{
+		h = hashBytes(&r.method, sizeof(r.method), h);
+		h = hashBytes(&r.fillEpsilon, sizeof(r.fillEpsilon), h);
+		h = hashBytes(&r.riverThreshold, sizeof(r.riverThreshold), h);
+	}
+	for (const Biome* biome : biomes)
+	{
+		double range[2] = { biome->getLowerHeight(), biome->getUpperHeight() };
+		glm::vec3 color = biome->getColor();
+		h = hashBytes(range, sizeof(range), h);
+		h = hashBytes(&color, sizeof(color), h);
+	}
+	return h;
+}
+
+TileCache::TileCache()
+	:
+	maxBytes(0),
+	heightError(0.0f),
+	totalBytes(0),
+	hits(0),
+	misses(0),
+	writes(0),
+	evictions(0),
+	bytesRead(0)
+{}
+
+void TileCache::setHeightError(float maxError)
+{
+	heightError = std::max(maxError, 0.0f);
+}
+
+float TileCache::getHeightError() const
+{
+	return heightError;
+}
+
+bool TileCache::open(const std::string& dir, uint64_t maxBytes_in, unsigned ioThreads)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	directory = dir;
+	maxBytes = maxBytes_in;
+	makeDirectory(directory);
+	ioPool.reset(new ThreadPool(std::max(ioThreads, 1u)));
+	entries.clear();
+	lru.clear();
+	pendingRemovals.clear();
+	totalBytes = 0;
+
+	std::vector<CachedFile> files;
+	listTiles(directory, files);
+	//Newest first, as they would be in the LRU order
+	std::sort(files.begin(), files.end(), [](const CachedFile& a, const CachedFile& b) { return a.modified > b.modified; });
+	for (const CachedFile& file : files)
+	{
+		lru.push_back(file.key);
+		entries[file.key] = { file.bytes, std::prev(lru.end()) };
+		totalBytes += file.bytes;
+	}
+	evict();
+	//A directory that cannot be listed is still usable if the files can be written
+	std::FILE* probe = std::fopen((directory + "/.probe").c_str(), "wb");
+	if (probe == nullptr)
+		return false;
+	std::fclose(probe);
+	std::remove((directory + "/.probe").c_str());
+	return true;
+}
+
+bool TileCache::isOpen() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return ioPool != nullptr;
+}
+
+uint64_t TileCache::fileKey(const TileKey& key) const
+{
+	uint64_t h = hashBytes(&key.parameters, sizeof(key.parameters));
+	h = hashBytes(&heightError, sizeof(heightError), h);
+	h = hashBytes(&key.lod, sizeof(key.lod), h);
+	h = hashBytes(&key.x, sizeof(key.x), h);
+	h = hashBytes(&key.z, sizeof(key.z), h);
+	return hashBytes(&FORMAT_VERSION, sizeof(FORMAT_VERSION), h);
+}
+
+std::string TileCache::pathOf(uint64_t key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+	return directory + "/" + name + TILE_EXTENSION;
+}
+
+std::string TileCache::getPath(const TileKey& key) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pathOf(fileKey(key));
+}
+
+bool TileCache::contains(const TileKey& key) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.count(fileKey(key)) != 0;
+}
+
+bool TileCache::read(const TileKey& key, TerrainTile& tile)
+{
+	PROFILE_ZONE("tile cache read");
+	uint64_t k = fileKey(key);
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto entry = entries.find(k);
+		if (entry == entries.end())
+		{
+			++misses;
+			PROFILE_COUNT("tile cache misses", 1);
+			return false;
+		}
+		lru.splice(lru.begin(), lru, entry->second.lru);
+		path = pathOf(k);
+	}
+	size_t fileSize = 0;
+	bool decoded;
+	{
+		MappedFile file;
+		decoded = file.open(path.c_str()) && decode(file.data(), file.size(), tile);
+		fileSize = file.size();
+	}
+	//The mapping is gone, files evicted while it was open can be deleted now
+	std::lock_guard<std::mutex> lock(mutex);
+	removePending();
+	if (!decoded)
+	{
+		//Removed or damaged behind the cache's back
+		auto entry = entries.find(k);
+		if (entry != entries.end())
+		{
+			totalBytes -= entry->second.bytes;
+			lru.erase(entry->second.lru);
+			entries.erase(entry);
+		}
+		++misses;
+		PROFILE_COUNT("tile cache misses", 1);
+		return false;
+	}
+	++hits;
+	bytesRead += fileSize;
+	PROFILE_COUNT("tile cache hits", 1);
+	PROFILE_COUNT("tile cache bytes read", fileSize);
+	return true;
+}
+
+size_t TileCache::read(const TileKey* keys, TerrainTile* tiles, bool* hitFlags, size_t count)
+{
+	std::atomic<size_t> found(0);
+	ThreadPool* pool = ioPool != nullptr ? ioPool.get() : &ThreadPool::global();
+	pool->parallelFor(0, (int)count, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			hitFlags[i] = read(keys[i], tiles[i]);
+			found += hitFlags[i] ? 1 : 0;
+		}
+	}, 1);
+	return found.load();
+}
+
+bool TileCache::write(const TileKey& key, const TerrainTile& tile)
+{
+	PROFILE_ZONE("tile cache write");
+	static std::atomic<unsigned> temporaryId(0);
+	std::vector<unsigned char> bytes;
+	encode(tile, bytes, heightError);
+	uint64_t k = fileKey(key);
+	std::string path, temporary;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (ioPool == nullptr)
+			return false;
+		path = pathOf(k);
+	}
+	temporary = path + "." + std::to_string(temporaryId++) + ".tmp";
+	BufferedWriter out(bytes.size());
+	if (!out.open(temporary.c_str()))
+		return false;
+	out.write(bytes.data(), bytes.size());
+	if (!out.close())
+	{
+		std::remove(temporary.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	//rename does not replace existing files on Windows
+	std::remove(path.c_str());
+#endif
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temporary.c_str());
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	insert(k, bytes.size());
+	evict();
+	++writes;
+	PROFILE_COUNT("tile cache writes", 1);
+	return true;
+}
+
+void TileCache::insert(uint64_t key, uint64_t bytes)
+{
+	//A new file replaced one that was waiting to be deleted
+	auto pending = pendingRemovals.find(key);
+	if (pending != pendingRemovals.end())
+	{
+		totalBytes -= pending->second;
+		pendingRemovals.erase(pending);
+	}
+	auto entry = entries.find(key);
+	if (entry != entries.end())
+	{
+		totalBytes -= entry->second.bytes;
+		entry->second.bytes = bytes;
+		lru.splice(lru.begin(), lru, entry->second.lru);
+	}
+	else
+	{
+		lru.push_front(key);
+		entries[key] = { bytes, lru.begin() };
+	}
+	totalBytes += bytes;
+}
+
+void TileCache::evict()
+{
+	removePending();
+	//The newest tile always stays, even if it is larger than the budget on its own
+	while (maxBytes > 0 && totalBytes > maxBytes && lru.size() > 1)
+	{
+		uint64_t key = lru.back();
+		lru.pop_back();
+		auto entry = entries.find(key);
+		uint64_t bytes = entry->second.bytes;
+		entries.erase(entry);
+		removeFile(key, bytes);
+		++evictions;
+		PROFILE_COUNT("tile cache evictions", 1);
+	}
+}
+
+void TileCache::removeFile(uint64_t key, uint64_t bytes)
+{
+	std::string path = pathOf(key);
+	if (std::remove(path.c_str()) != 0)
+	{
+		//Still there: mapped or sent by a reader (Windows), it keeps counting until it is gone
+		std::FILE* file = std::fopen(path.c_str(), "rb");
+		if (file != nullptr)
+		{
+			std::fclose(file);
+			pendingRemovals[key] = bytes;
+			return;
+		}
+	}
+	totalBytes -= bytes;
+}
+
+void TileCache::removePending()
+{
+	if (pendingRemovals.empty())
+		return;
+	//removeFile puts back the ones still in use
+	std::unordered_map<uint64_t, uint64_t> pending;
+	pending.swap(pendingRemovals);
+	for (const auto& file : pending)
+		removeFile(file.first, file.second);
+}
+
+TileCacheStats TileCache::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	TileCacheStats stats;
+	stats.hits = hits.load();
+	stats.misses = misses.load();
+	stats.writes = writes.load();
+	stats.evictions = evictions.load();
+	stats.bytesRead = bytesRead.load();
+	stats.tiles = entries.size();
+	stats.bytes = totalBytes;
+	return stats;
+}
+
+void TileCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	removePending();
+	for (uint64_t key : lru)
+		removeFile(key, entries[key].bytes);
+	entries.clear();
+	lru.clear();
+}
+
+void TileCache::encode(const TerrainTile& tile, std::vector<unsigned char>& bytes, float heightError)
+{
+	int W = tile.heights.getWidth();
+	int H = tile.heights.getHeight();
+	bytes.resize(sizeof(TileHeader));
+	HeightCodec::encode(tile.heights, heightError, bytes);
+	size_t heightBytes = bytes.size() - sizeof(TileHeader);
+
+	size_t normalsBegin = bytes.size();
+	bytes.resize(normalsBegin + tile.normals.size() * 2 * sizeof(int16_t));
+	for (size_t i = 0; i < tile.normals.size(); ++i)
+	{
+		int16_t packed[2];
+		encodeNormal(tile.normals[i], packed);
+		std::memcpy(&bytes[normalsBegin + i * sizeof(packed)], packed, sizeof(packed));
+	}
+	size_t normalBytes = bytes.size() - normalsBegin;
+
+	size_t biomesBegin = bytes.size();
+	for (size_t i = 0; i < tile.biomes.size();)
+	{
+		unsigned char id = tile.biomes[i];
+		size_t run = 1;
+		while (i + run < tile.biomes.size() && tile.biomes[i + run] == id && run < 255)
+			++run;
+		bytes.push_back((unsigned char)run);
+		bytes.push_back(id);
+		i += run;
+	}
+	size_t biomeBytes = bytes.size() - biomesBegin;
+
+	size_t minimumBytes = 0, maximumBytes = 0;
+	if (tile.minimum.size() != 0 && tile.maximum.size() != 0)
+	{
+		//The bounds are moved out by the error first, the decoded ones then still hold every height
+		HeightField bound;
+		for (int plane = 0; plane < 2; ++plane)
+		{
+			const HeightField& source = plane == 0 ? tile.minimum : tile.maximum;
+			float widen = plane == 0 ? -heightError : heightError;
+			bound.resize(source.getWidth(), source.getHeight());
+			for (size_t i = 0; i < source.size(); ++i)
+				bound.data()[i] = source.data()[i] + widen;
+			size_t begin = bytes.size();
+			HeightCodec::encode(bound, heightError, bytes);
+			(plane == 0 ? minimumBytes : maximumBytes) = bytes.size() - begin;
+		}
+	}
+
+	TileHeader header = {};
+	header.magic = TILE_MAGIC;
+	header.version = FORMAT_VERSION;
+	header.width = (uint32_t)W;
+	header.height = (uint32_t)H;
+	header.heightBytes = (uint32_t)heightBytes;
+	header.normalBytes = (uint32_t)normalBytes;
+	header.biomeBytes = (uint32_t)biomeBytes;
+	header.minimumBytes = (uint32_t)minimumBytes;
+	header.maximumBytes = (uint32_t)maximumBytes;
+	std::memcpy(bytes.data(), &header, sizeof(header));
+}
+
+bool TileCache::decode(const unsigned char* bytes, size_t size, TerrainTile& tile)
+{
+	TileHeader header;
+	if (size < sizeof(header))
+		return false;
+	std::memcpy(&header, bytes, sizeof(header));
+	size_t count = (size_t)header.width * header.height;
+	if (header.magic != TILE_MAGIC || header.version != FORMAT_VERSION ||
+		sizeof(header) + (size_t)header.heightBytes + header.normalBytes + header.biomeBytes + header.minimumBytes + header.maximumBytes != size ||
+		(header.minimumBytes == 0) != (header.maximumBytes == 0) ||
+		(header.normalBytes != 0 && header.normalBytes != count * 2 * sizeof(int16_t)))
+		return false;
+
+	const unsigned char* in = bytes + sizeof(header);
+	const unsigned char* end = in + header.heightBytes;
+	if (!HeightCodec::decode(in, header.heightBytes, tile.heights) ||
+		tile.heights.getWidth() != (int)header.width || tile.heights.getHeight() != (int)header.height)
+		return false;
+
+	in = end;
+	tile.normals.resize(header.normalBytes / (2 * sizeof(int16_t)));
+	for (size_t i = 0; i < tile.normals.size(); ++i)
+	{
+		int16_t packed[2];
+		std::memcpy(packed, in + i * sizeof(packed), sizeof(packed));
+		tile.normals[i] = decodeNormal(packed);
+	}
+
+	in += header.normalBytes;
+	end = in + header.biomeBytes;
+	tile.biomes.clear();
+	tile.biomes.reserve(count);
+	for (; in + 2 <= end; in += 2)
+		tile.biomes.insert(tile.biomes.end(), in[0], in[1]);
+	if (tile.biomes.size() != count && !tile.biomes.empty())
+		return false;
+
+	in = end;
+	if (header.minimumBytes == 0)
+	{
+		tile.minimum.resize(0, 0);
+		tile.maximum.resize(0, 0);
+		return true;
+	}
+	return HeightCodec::decode(in, header.minimumBytes, tile.minimum) &&
+		HeightCodec::decode(in + header.minimumBytes, header.maximumBytes, tile.maximum) &&
+		tile.minimum.getWidth() == (int)header.width && tile.minimum.getHeight() == (int)header.height &&
+		tile.maximum.getWidth() == (int)header.width && tile.maximum.getHeight() == (int)header.height;
+}
@@ -0,0 +1,128 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <glm/glm.hpp>
+
+#include "HeightField.h"
+#include "PerlinNoise.h"
+#include "Biome.h"
+#include "ThreadPool.h"
+
+struct GenerationData;
+
+/*
+	A tile of the final terrain: a window of (W x H) vertices with the heights in world units, the normals and the
+	biome IDs. Neighbouring tiles share their border vertices.
+	Tiles of the coarser levels of a TilePyramid also carry the lowest and highest height under each vertex,
+	the full resolution tiles leave them empty.
+*/
+struct TerrainTile
+{
+	HeightField heights;
+	std::vector<glm::vec3> normals;
+	std::vector<unsigned char> biomes;
+	HeightField minimum;
+	HeightField maximum;
+};
+
+struct TileKey
+{
+	uint64_t parameters; //TileCache::hashParameters of the terrain the tile belongs to
+	int lod; //0 is the full resolution
+	int x, z;
+};
+
+struct TileCacheStats
+{
+	uint64_t hits, misses;
+	uint64_t writes, evictions;
+	uint64_t bytesRead; //Compressed bytes
+	uint64_t tiles, bytes; //Currently in the cache
+};
+
+
+/*
+	Generated tiles kept on disk between runs, so revisiting a terrain skips the noise, the erosion and the normals.
+
+	Every tile is one file in the cache directory, named after the hash of its key and the format version. Any change
+	to the parameters, the biome table or the encoding gives new names, so stale tiles are never read, they just age out.
+	Tiles are stored compressed: the heights with HeightCodec (exact unless a height error is set), the normals
+	octahedral in two 16-bit values and the biome IDs run length encoded. The height bounds of pyramid tiles are
+	two more HeightCodec planes, widened by the height error so they still bound the heights once decoded.
+
+	The cache keeps an index of its files in least recently used order and removes the oldest ones whenever its size
+	goes over the budget. Opening a directory indexes the files already there, oldest written first.
+	On Windows a file cannot be deleted while a reader still maps it. Such a tile leaves the index but stays counted
+	in the size, and its deletion is retried after each read and before each eviction until it succeeds.
+	The height error is part of the file names, so tiles stored with another bound are not read either.
+	Reads map the file (MappedFile) and decode straight from the mapping. Batched reads are split over a small pool of
+	IO threads owned by the cache, separate from the generation pool. Writes go to a temporary file that is renamed
+	into place, so a tile is never seen half written.
+
+	Hits, misses, evictions and compressed bytes read are counted in the profiler ("tile cache ..." counters) and in
+	getStats. All methods are thread safe.
+*/
+
+class TileCache
+{
+public:
+	static const uint32_t FORMAT_VERSION = 4;
+	//Hash of everything the tiles of a terrain depend on
+	static uint64_t hashParameters(const NoiseData& nData, const GenerationData& gData, const std::vector<Biome*>& biomes, int tileCells);
+	TileCache();
+	//Creates the directory if needed and indexes the tiles in it. maxBytes of 0 is unbounded.
+	bool open(const std::string& directory, uint64_t maxBytes, unsigned ioThreads = 2);
+	bool isOpen() const;
+	//Largest difference of a stored height to the generated one, 0 keeps them exact. Set it before use.
+	void setHeightError(float maxError);
+	float getHeightError() const;
+	bool contains(const TileKey& key) const;
+	bool read(const TileKey& key, TerrainTile& tile);
+	//hits[i] tells whether tiles[i] was read. Returns the number of hits.
+	size_t read(const TileKey* keys, TerrainTile* tiles, bool* hits, size_t count);
+	bool write(const TileKey& key, const TerrainTile& tile);
+	//File of a tile in the cache, it exists as long as the tile is not evicted
+	std::string getPath(const TileKey& key) const;
+	TileCacheStats getStats() const;
+	//Removes every tile of the index
+	void clear();
+	//The encoding on its own, for tools and measurements
+	static void encode(const TerrainTile& tile, std::vector<unsigned char>& bytes, float heightError = 0.0f);
+	static bool decode(const unsigned char* bytes, size_t size, TerrainTile& tile);
+private:
+	struct Entry
+	{
+		uint64_t bytes;
+		std::list<uint64_t>::iterator lru;
+	};
+	uint64_t fileKey(const TileKey& key) const;
+	std::string pathOf(uint64_t fileKey) const;
+	//Needs the mutex
+	void insert(uint64_t fileKey, uint64_t bytes);
+	void evict();
+	//Deletes the file of a tile that left the index, or keeps it pending if it is still in use. Needs the mutex.
+	void removeFile(uint64_t fileKey, uint64_t bytes);
+	//Retries the pending deletions. Needs the mutex.
+	void removePending();
+private:
+	std::string directory;
+	uint64_t maxBytes;
+	float heightError;
+	std::unique_ptr<ThreadPool> ioPool;
+	mutable std::mutex mutex;
+	std::unordered_map<uint64_t, Entry> entries;
+	std::list<uint64_t> lru; //Most recently used first
+	uint64_t totalBytes; //Indexed tiles and pending deletions
+	std::unordered_map<uint64_t, uint64_t> pendingRemovals; //File key to bytes
+	std::atomic<uint64_t> hits, misses, writes, evictions, bytesRead;
+};
+
+#endif
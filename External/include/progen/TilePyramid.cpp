@@ -0,0 +1,277 @@
+#include "TilePyramid.h"
+#include "TerrainGenerator.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include "Simd.h"
+
+#include <algorithm>
+
+namespace
+{
+	//Min, max and the (1, 2, 1) sum of fine rows r0, r1 and r2, written from out[1] on. The borders are repeated into
+	//out[0] and out[W + 1] up to the end of the buffers, which the horizontal pass reads as the clamped neighbours.
+	void reduceRows(const HeightField& minimum, const HeightField& maximum, const HeightField& average, int r0, int r1, int r2,
+		std::vector<float>& lowest, std::vector<float>& highest, std::vector<float>& sum)
+	{
+		int W = average.getWidth();
+		const float* min0 = minimum.row(r0); const float* min1 = minimum.row(r1); const float* min2 = minimum.row(r2);
+		const float* max0 = maximum.row(r0); const float* max1 = maximum.row(r1); const float* max2 = maximum.row(r2);
+		const float* avg0 = average.row(r0); const float* avg1 = average.row(r1); const float* avg2 = average.row(r2);
+		float* outMin = lowest.data() + 1;
+		float* outMax = highest.data() + 1;
+		float* outSum = sum.data() + 1;
+		int x = 0;
+#ifdef PROGEN_SSE2
+		for (; x + 4 <= W; x += 4)
+		{
+			__m128 low = _mm_min_ps(_mm_min_ps(_mm_loadu_ps(min0 + x), _mm_loadu_ps(min1 + x)), _mm_loadu_ps(min2 + x));
+			__m128 high = _mm_max_ps(_mm_max_ps(_mm_loadu_ps(max0 + x), _mm_loadu_ps(max1 + x)), _mm_loadu_ps(max2 + x));
+			__m128 center = _mm_loadu_ps(avg1 + x);
+			__m128 total = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(avg0 + x), _mm_loadu_ps(avg2 + x)), _mm_add_ps(center, center));
+			_mm_storeu_ps(outMin + x, low);
+			_mm_storeu_ps(outMax + x, high);
+			_mm_storeu_ps(outSum + x, total);
+		}
+#endif
+		for (; x < W; ++x)
+		{
+			outMin[x] = std::min(std::min(min0[x], min1[x]), min2[x]);
+			outMax[x] = std::max(std::max(max0[x], max1[x]), max2[x]);
+			outSum[x] = avg0[x] + avg2[x] + 2.0f * avg1[x];
+		}
+		lowest[0] = outMin[0]; highest[0] = outMax[0]; sum[0] = outSum[0];
+		std::fill(lowest.begin() + W + 1, lowest.end(), outMin[W - 1]);
+		std::fill(highest.begin() + W + 1, highest.end(), outMax[W - 1]);
+		std::fill(sum.begin() + W + 1, sum.end(), outSum[W - 1]);
+	}
+
+	//Coarse vertex x from the padded fine vertices 2x, 2x + 1 and 2x + 2 of the vertical pass
+	void reduceColumns(const float* lowest, const float* highest, const float* sum, int coarseW, float* outMin, float* outMax, float* outAvg)
+	{
+		int x = 0;
+#ifdef PROGEN_SSE2
+		const __m128 sixteenth = _mm_set1_ps(1.0f / 16.0f);
+		for (; x + 4 <= coarseW; x += 4)
+		{
+			//Even and odd vertices of two loads give (2x, 2x + 2, ...) and (2x + 1, 2x + 3, ...), the evens of two loads a pair further give (2x + 2, ...)
+			__m128 a = _mm_loadu_ps(lowest + 2 * x), b = _mm_loadu_ps(lowest + 2 * x + 4);
+			__m128 c = _mm_loadu_ps(lowest + 2 * x + 2), d = _mm_loadu_ps(lowest + 2 * x + 6);
+			__m128 low = _mm_min_ps(_mm_min_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))),
+				_mm_shuffle_ps(c, d, _MM_SHUFFLE(2, 0, 2, 0)));
+			a = _mm_loadu_ps(highest + 2 * x); b = _mm_loadu_ps(highest + 2 * x + 4);
+			c = _mm_loadu_ps(highest + 2 * x + 2); d = _mm_loadu_ps(highest + 2 * x + 6);
+			__m128 high = _mm_max_ps(_mm_max_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))),
+				_mm_shuffle_ps(c, d, _MM_SHUFFLE(2, 0, 2, 0)));
+			a = _mm_loadu_ps(sum + 2 * x); b = _mm_loadu_ps(sum + 2 * x + 4);
+			c = _mm_loadu_ps(sum + 2 * x + 2); d = _mm_loadu_ps(sum + 2 * x + 6);
+			__m128 center = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			__m128 total = _mm_add_ps(_mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c, d, _MM_SHUFFLE(2, 0, 2, 0))),
+				_mm_add_ps(center, center));
+			_mm_storeu_ps(outMin + x, low);
+			_mm_storeu_ps(outMax + x, high);
+			_mm_storeu_ps(outAvg + x, _mm_mul_ps(total, sixteenth));
+		}
+#endif
+		for (; x < coarseW; ++x)
+		{
+			outMin[x] = std::min(std::min(lowest[2 * x], lowest[2 * x + 1]), lowest[2 * x + 2]);
+			outMax[x] = std::max(std::max(highest[2 * x], highest[2 * x + 1]), highest[2 * x + 2]);
+			outAvg[x] = (sum[2 * x] + 2.0f * sum[2 * x + 1] + sum[2 * x + 2]) * (1.0f / 16.0f);
+		}
+	}
+
+	//Biome with the largest tent weight around fine vertex (2x, 2z), the center wins ties
+	unsigned char modeBiome(const std::vector<unsigned char>& biomes, int W, int H, int fx, int fz)
+	{
+		//Inside a biome, which is nearly everywhere, the 3 x 3 vertices agree
+		unsigned char center = biomes[(size_t)fz * W + fx];
+		if (fx > 0 && fz > 0 && fx + 1 < W && fz + 1 < H)
+		{
+			const unsigned char* above = biomes.data() + (size_t)(fz - 1) * W + fx - 1;
+			const unsigned char* below = above + 2 * (size_t)W;
+			if (((above[0] ^ center) | (above[1] ^ center) | (above[2] ^ center) | (above[W] ^ center) | (above[W + 2] ^ center) |
+				(below[0] ^ center) | (below[1] ^ center) | (below[2] ^ center)) == 0)
+				return center;
+		}
+		unsigned char ids[9];
+		int weights[9];
+		int distinct = 0;
+		for (int dz = -1; dz <= 1; ++dz)
+		{
+			const unsigned char* row = biomes.data() + (size_t)std::min(std::max(fz + dz, 0), H - 1) * W;
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				unsigned char id = row[std::min(std::max(fx + dx, 0), W - 1)];
+				int weight = (dx == 0 ? 2 : 1) * (dz == 0 ? 2 : 1);
+				int i = 0;
+				while (i < distinct && ids[i] != id)
+					++i;
+				if (i == distinct)
+				{
+					ids[distinct] = id;
+					weights[distinct++] = 0;
+				}
+				weights[i] += weight;
+			}
+		}
+		unsigned char best = center;
+		int bestWeight = 0;
+		for (int i = 0; i < distinct; ++i)
+		{
+			if (weights[i] > bestWeight || (weights[i] == bestWeight && ids[i] == center))
+			{
+				best = ids[i];
+				bestWeight = weights[i];
+			}
+		}
+		return best;
+	}
+
+	void reduceLevel(const HeightField& minimum, const HeightField& maximum, const HeightField& average,
+		const std::vector<unsigned char>& biomes, PyramidLevel& coarse)
+	{
+		PROFILE_ZONE("pyramid reduce");
+		int W = average.getWidth();
+		int H = average.getHeight();
+		int coarseW = TilePyramid::levelSize(W, 1);
+		int coarseH = TilePyramid::levelSize(H, 1);
+		coarse.minimum.resize(coarseW, coarseH);
+		coarse.maximum.resize(coarseW, coarseH);
+		coarse.average.resize(coarseW, coarseH);
+		coarse.biomes.resize((size_t)coarseW * coarseH);
+		bool hasBiomes = biomes.size() == average.size();
+		ThreadPool::global().parallelFor(0, coarseH, [&](int zBegin, int zEnd)
+		{
+			//Room for the clamped borders and the overreach of the last vector
+			size_t padded = (size_t)2 * coarseW + 8;
+			std::vector<float> lowest(padded), highest(padded), sum(padded);
+			for (int z = zBegin; z < zEnd; ++z)
+			{
+				int fz = 2 * z;
+				reduceRows(minimum, maximum, average, std::max(fz - 1, 0), fz, std::min(fz + 1, H - 1), lowest, highest, sum);
+				reduceColumns(lowest.data(), highest.data(), sum.data(), coarseW, coarse.minimum.row(z), coarse.maximum.row(z), coarse.average.row(z));
+				unsigned char* ids = coarse.biomes.data() + (size_t)z * coarseW;
+				for (int x = 0; x < coarseW; ++x)
+					ids[x] = hasBiomes ? modeBiome(biomes, W, H, 2 * x, fz) : 0;
+			}
+		}, 8);
+	}
+}
+
+int TilePyramid::levelSize(int size, int lod)
+{
+	return ((std::max(size, 1) - 1) >> lod) + 1;
+}
+
+int TilePyramid::levelCount(int W, int H, int tileCells)
+{
+	int lod = 0;
+	while (levelSize(W, lod) - 1 > tileCells || levelSize(H, lod) - 1 > tileCells)
+		++lod;
+	return lod + 1;
+}
+
+void TilePyramid::reduce(const PyramidLevel& fine, PyramidLevel& coarse)
+{
+	reduceLevel(fine.minimum, fine.maximum, fine.average, fine.biomes, coarse);
+}
+
+TilePyramid::TilePyramid()
+	:
+	first(1)
+{}
+
+void TilePyramid::build(const HeightField& heights, const std::vector<unsigned char>& biomeMap, int levelCount)
+{
+	PROFILE_ZONE("pyramid build");
+	first = 1;
+	levels.resize(std::max(levelCount - 1, 0));
+	for (size_t i = 0; i < levels.size(); ++i)
+	{
+		//The full terrain is its own minimum, maximum and average
+		if (i == 0)
+			reduceLevel(heights, heights, heights, biomeMap, levels[0]);
+		else
+			reduce(levels[i - 1], levels[i]);
+	}
+}
+
+void TilePyramid::generate(const GenerationData& gData, const NoiseData& nData, const std::vector<Biome*>& biomes, int firstLod, int levelCount)
+{
+	PROFILE_ZONE("pyramid generate");
+	first = std::max(firstLod, 0);
+	levels.resize(std::max(levelCount - first, 0));
+	if (levels.empty())
+		return;
+	//Whatever the terrain uses, the octaves finer than the level would only alias
+	NoiseData limited = nData;
+	limited.octaveMode = OctaveMode::BandLimited;
+	noise.generateNoiseMap(limited, 1 << first, noiseMap);
+	if (gData.useFallOff)
+	{
+		//The falloff only depends on where the vertex is in the map, so it is generated at the level's size
+		std::vector<std::vector<double>> fallOffMap = fallOff.generate(noiseMap.getWidth(), noiseMap.getHeight());
+		for (int z = 0; z < noiseMap.getHeight(); ++z)
+		{
+			float* row = noiseMap.row(z);
+			for (int x = 0; x < noiseMap.getWidth(); ++x)
+				row[x] -= (float)fallOffMap[z][x];
+		}
+	}
+	PyramidLevel& level = levels[0];
+	Biome::classify(noiseMap, biomes, level.biomes);
+	MeshBuilder::applyHeightCurve(noiseMap, HeightCurve(gData.controlPoints), gData.heightMultiplier, level.average);
+	//Point samples, the level bounds nothing finer
+	level.minimum = level.average;
+	level.maximum = level.average;
+	for (size_t i = 1; i < levels.size(); ++i)
+		reduce(levels[i - 1], levels[i]);
+}
+
+int TilePyramid::getFirstLevel() const
+{
+	return first;
+}
+
+int TilePyramid::getLevelCount() const
+{
+	return first + (int)levels.size();
+}
+
+const PyramidLevel& TilePyramid::getLevel(int lod) const
+{
+	return levels[lod - first];
+}
+
+void TilePyramid::cutTile(int lod, int x0, int z0, int W, int H, float cellX, float cellZ, TerrainTile& tile) const
+{
+	const PyramidLevel& level = getLevel(lod);
+	int levelW = level.average.getWidth();
+	int levelH = level.average.getHeight();
+	tile.heights.resize(W, H);
+	tile.minimum.resize(W, H);
+	tile.maximum.resize(W, H);
+	tile.normals.resize((size_t)W * H);
+	tile.biomes.resize((size_t)W * H);
+	float spacingX = cellX * (float)(1 << lod);
+	float spacingZ = cellZ * (float)(1 << lod);
+	for (int z = 0; z < H; ++z)
+	{
+		int lz = z0 + z;
+		size_t source = (size_t)lz * levelW + x0;
+		std::copy(level.average.row(lz) + x0, level.average.row(lz) + x0 + W, tile.heights.row(z));
+		std::copy(level.minimum.row(lz) + x0, level.minimum.row(lz) + x0 + W, tile.minimum.row(z));
+		std::copy(level.maximum.row(lz) + x0, level.maximum.row(lz) + x0 + W, tile.maximum.row(z));
+		std::copy(level.biomes.begin() + source, level.biomes.begin() + source + W, tile.biomes.begin() + (size_t)z * W);
+		//Central differences of the averages, one sided on the borders of the level
+		int up = std::max(lz - 1, 0), down = std::min(lz + 1, levelH - 1);
+		for (int x = 0; x < W; ++x)
+		{
+			int lx = x0 + x;
+			int left = std::max(lx - 1, 0), right = std::min(lx + 1, levelW - 1);
+			float dx = right > left ? (level.average.at(right, lz) - level.average.at(left, lz)) / ((right - left) * spacingX) : 0.0f;
+			float dz = down > up ? (level.average.at(lx, down) - level.average.at(lx, up)) / ((down - up) * spacingZ) : 0.0f;
+			tile.normals[(size_t)z * W + x] = glm::normalize(glm::vec3(-dx, 1.0f, -dz));
+		}
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef TILE_PYRAMID_H
+#define TILE_PYRAMID_H
+
+#include <vector>
+
+#include "HeightField.h"
+#include "PerlinNoise.h"
+#include "FalloffMap.h"
+#include "Biome.h"
+#include "TileCache.h"
+
+struct GenerationData;
+
+/*
+	One level of a TilePyramid: the average height of every vertex in world units, the lowest and highest height
+	under it, and the biome covering most of it.
+*/
+struct PyramidLevel
+{
+	HeightField minimum;
+	HeightField maximum;
+	HeightField average;
+	std::vector<unsigned char> biomes;
+};
+
+/*
+	Successively halved levels of a terrain for overview maps and far away tiles (heightfield mipmaps).
+
+	Level lod keeps every (2^lod)-th vertex of the full terrain, ((W - 1) >> lod) + 1 of them across, so the vertices of
+	a level lie on vertices of every finer level and the corners of the terrain stay where they are. Vertex x of the
+	next level sums the fine vertices 2x - 1, 2x and 2x + 1 on both axes (clamped at the borders):
+		minimum, maximum  over the 3 x 3 vertices, so a coarse cell bounds every fine cell it covers
+		average           tent weighted (1/4, 1/2, 1/4), centered on the vertex
+		biomes            the ID with the largest tent weight, the center one on ties
+	The rows of a level are split over the ThreadPool, the height reductions run 4 vertices at a time (SSE2).
+
+	build reduces the levels from a generated terrain. generate samples its first level straight from the noise instead,
+	with only the octaves that level can resolve (PerlinNoise::bandLimitedOctaves) and the falloff, then reduces the
+	coarser levels from it, so far tiles never need the full terrain. Those levels are approximations: the noise is
+	normalized over the level instead of the full map, and erosion and rivers are not run.
+	A pyramid keeps its buffers for the next build, like the TerrainGenerator.
+*/
+
+class TilePyramid
+{
+public:
+	//Number of vertices of a level along a side of size vertices
+	static int levelSize(int size, int lod);
+	//Levels, from the full terrain, until one fits in a single tile of tileCells cells
+	static int levelCount(int W, int H, int tileCells);
+	//The level after fine
+	static void reduce(const PyramidLevel& fine, PyramidLevel& coarse);
+
+	TilePyramid();
+	//Levels 1 to levels - 1 of a terrain with these final heights and biome map
+	void build(const HeightField& heights, const std::vector<unsigned char>& biomeMap, int levels);
+	//Levels firstLod to levels - 1, the first one sampled from the noise. nData.W and nData.H are the full terrain's.
+	void generate(const GenerationData& gData, const NoiseData& nData, const std::vector<Biome*>& biomes, int firstLod, int levels);
+	int getFirstLevel() const;
+	//One past the last level
+	int getLevelCount() const;
+	const PyramidLevel& getLevel(int lod) const;
+	//Cuts a window of (W x H) vertices of a level into tile. The normals come from the averages, cellX and cellZ are the
+	//size of a cell of the full terrain in world units.
+	void cutTile(int lod, int x0, int z0, int W, int H, float cellX, float cellZ, TerrainTile& tile) const;
+private:
+	std::vector<PyramidLevel> levels; //levels[i] is lod first + i
+	int first;
+	PerlinNoise noise;
+	FalloffMap fallOff;
+	HeightField noiseMap;
+};
+
+#endif
@@ -0,0 +1,804 @@
+#include "TileServer.h"
+#include "Hash.h"
+#include "Profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mswsock.h>
+#include <windows.h>
+#pragma comment(lib, "Ws2_32.lib")
+#pragma comment(lib, "Mswsock.lib")
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
+
+namespace
+{
+#ifdef _WIN32
+	typedef SOCKET Socket;
+	const Socket NO_SOCKET = INVALID_SOCKET;
+#else
+	typedef int Socket;
+	const Socket NO_SOCKET = -1;
+#endif
+#ifdef MSG_NOSIGNAL
+	const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+	const int SEND_FLAGS = 0;
+#endif
+	const size_t MAX_REQUEST = 8192; //Request line and headers
+	const int RECEIVE_TIMEOUT_MS = 1000; //Workers only get readable connections, this bounds a read that blocks anyway
+	const int KEEP_ALIVE_SECONDS = 30;
+	const size_t MAX_IDLE_CONNECTIONS = 1024;
+	const int POLL_MS = 100; //How often the accepting thread checks whether the server stops
+#ifdef _WIN32
+	typedef WSAPOLLFD PollEntry;
+#else
+	typedef pollfd PollEntry;
+#endif
+
+	//The servers and clients only exist between a WSAStartup and the end of the process
+	void initSockets()
+	{
+#ifdef _WIN32
+		static bool started = []()
+		{
+			WSADATA data;
+			return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		}();
+		(void)started;
+#endif
+	}
+
+	void closeSocket(Socket s)
+	{
+#ifdef _WIN32
+		closesocket(s);
+#else
+		::close(s);
+#endif
+	}
+
+	bool timedOut()
+	{
+#ifdef _WIN32
+		return WSAGetLastError() == WSAETIMEDOUT;
+#else
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+	}
+
+	void setReceiveTimeout(Socket s, int milliseconds)
+	{
+#ifdef _WIN32
+		DWORD timeout = (DWORD)milliseconds;
+#else
+		timeval timeout;
+		timeout.tv_sec = milliseconds / 1000;
+		timeout.tv_usec = (milliseconds % 1000) * 1000;
+#endif
+		setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	}
+
+	int pollSockets(std::vector<PollEntry>& entries, int milliseconds)
+	{
+#ifdef _WIN32
+		return WSAPoll(entries.data(), (ULONG)entries.size(), milliseconds);
+#else
+		return poll(entries.data(), (nfds_t)entries.size(), milliseconds);
+#endif
+	}
+
+	/*
+		A UDP socket on the loopback interface connected to itself, what is sent on it can be polled on it. Wakes the
+		accepting thread without a pipe, which Windows does not poll.
+	*/
+	Socket openWakeSocket()
+	{
+		Socket s = socket(AF_INET, SOCK_DGRAM, 0);
+		if (s == NO_SOCKET)
+			return NO_SOCKET;
+		sockaddr_in local;
+		std::memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t length = sizeof(local);
+		if (bind(s, (const sockaddr*)&local, length) != 0 || getsockname(s, (sockaddr*)&local, &length) != 0 ||
+			::connect(s, (const sockaddr*)&local, length) != 0)
+		{
+			closeSocket(s);
+			return NO_SOCKET;
+		}
+		return s;
+	}
+
+	bool sendAll(Socket s, const char* data, size_t size)
+	{
+		while (size > 0)
+		{
+			int sent = (int)send(s, data, (int)std::min(size, (size_t)1 << 30), SEND_FLAGS);
+			if (sent <= 0)
+				return false;
+			data += sent;
+			size -= (size_t)sent;
+		}
+		return true;
+	}
+
+	/*
+		Opens a socket for an address in the TileServer format. Unix domain sockets are not available on Windows here.
+	*/
+	Socket openSocket(const std::string& address, sockaddr_storage& storage, socklen_t& length)
+	{
+		std::memset(&storage, 0, sizeof(storage));
+		if (address.compare(0, 5, "unix:") == 0)
+		{
+#ifdef _WIN32
+			return NO_SOCKET;
+#else
+			sockaddr_un* local = (sockaddr_un*)&storage;
+			std::string path = address.substr(5);
+			if (path.empty() || path.size() >= sizeof(local->sun_path))
+				return NO_SOCKET;
+			local->sun_family = AF_UNIX;
+			std::memcpy(local->sun_path, path.c_str(), path.size() + 1);
+			length = (socklen_t)sizeof(sockaddr_un);
+			return socket(AF_UNIX, SOCK_STREAM, 0);
+#endif
+		}
+		char* end;
+		long port = std::strtol(address.c_str(), &end, 10);
+		if (address.empty() || *end != '\0' || port < 0 || port > 65535)
+			return NO_SOCKET;
+		sockaddr_in* loopback = (sockaddr_in*)&storage;
+		loopback->sin_family = AF_INET;
+		loopback->sin_port = htons((unsigned short)port);
+		loopback->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		length = (socklen_t)sizeof(sockaddr_in);
+		Socket s = socket(AF_INET, SOCK_STREAM, 0);
+		if (s != NO_SOCKET)
+		{
+			//Responses are written whole, small ones should not wait for more data
+			int on = 1;
+			setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+		}
+		return s;
+	}
+
+	/*
+		Sends a whole file after the header, without copying it through user memory where the platform allows it.
+	*/
+	bool sendFile(Socket s, const std::string& path, const std::string& headerFormat, uint64_t& sent)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		bool ok = GetFileSizeEx(file, &size) != 0;
+		char header[256];
+		int headerSize = ok ? std::snprintf(header, sizeof(header), headerFormat.c_str(), (unsigned long long)size.QuadPart) : 0;
+		ok = ok && sendAll(s, header, (size_t)headerSize) && TransmitFile(s, file, 0, 0, nullptr, nullptr, TF_USE_KERNEL_APC) != 0;
+		CloseHandle(file);
+		if (ok)
+			sent = (uint64_t)size.QuadPart;
+		return ok;
+#else
+		//The descriptor keeps the file alive even if the cache evicts it while it is sent
+		int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat info;
+		bool ok = fstat(file, &info) == 0;
+		char header[256];
+		int headerSize = ok ? std::snprintf(header, sizeof(header), headerFormat.c_str(), (unsigned long long)info.st_size) : 0;
+		ok = ok && sendAll(s, header, (size_t)headerSize);
+		off_t offset = 0;
+#ifdef __linux__
+		while (ok && offset < info.st_size)
+		{
+			ssize_t n = sendfile(s, file, &offset, (size_t)(info.st_size - offset));
+			ok = n > 0 || (n < 0 && errno == EINTR);
+		}
+#else
+		char chunk[65536];
+		while (ok && offset < info.st_size)
+		{
+			ssize_t n = read(file, chunk, sizeof(chunk));
+			ok = n > 0 && sendAll(s, chunk, (size_t)n);
+			offset += n > 0 ? n : 0;
+		}
+#endif
+		::close(file);
+		if (ok)
+			sent = (uint64_t)info.st_size;
+		return ok;
+#endif
+	}
+
+	const char* statusText(int status)
+	{
+		switch (status)
+		{
+		case 200: return "OK";
+		case 400: return "Bad Request";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 503: return "Service Unavailable";
+		default: return "Internal Server Error";
+		}
+	}
+
+	std::string toLower(std::string text)
+	{
+		for (char& c : text)
+			c = (char)std::tolower((unsigned char)c);
+		return text;
+	}
+
+	//Splits the path into its segments, the query is ignored
+	std::vector<std::string> splitPath(const std::string& target)
+	{
+		std::vector<std::string> segments;
+		size_t end = std::min(target.find('?'), target.size());
+		size_t begin = 1;
+		while (begin < end)
+		{
+			size_t slash = std::min(target.find('/', begin), end);
+			if (slash > begin)
+				segments.push_back(target.substr(begin, slash - begin));
+			begin = slash + 1;
+		}
+		return segments;
+	}
+
+	bool parseInt(const std::string& text, int& value)
+	{
+		char* end;
+		long parsed = std::strtol(text.c_str(), &end, 10);
+		if (text.empty() || *end != '\0' || parsed < -(1L << 30) || parsed > (1L << 30))
+			return false;
+		value = (int)parsed;
+		return true;
+	}
+
+	bool parseHash(const std::string& text, uint64_t& value)
+	{
+		char* end;
+		value = std::strtoull(text.c_str(), &end, 16);
+		return text.size() == 16 && *end == '\0';
+	}
+
+	std::string hexString(uint64_t value)
+	{
+		char text[32];
+		std::snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+		return text;
+	}
+
+	//Like the Profiler's Chrome traces: quotes and backslashes escaped, control characters dropped
+	void appendJsonString(std::string& json, const std::string& text)
+	{
+		json += '"';
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				json += '\\';
+			if ((unsigned char)c >= 0x20)
+				json += c;
+		}
+		json += '"';
+	}
+}
+
+TileServer::TileServer(TileCache& cache, unsigned workerCount_in)
+	:
+	cache(cache),
+	workerCount(std::max(workerCount_in, 1u)),
+	listener((intptr_t)NO_SOCKET),
+	wakeSocket((intptr_t)NO_SOCKET),
+	running(false),
+	requests(0),
+	hits(0),
+	misses(0),
+	coalesced(0),
+	errors(0),
+	bytesSent(0)
+{
+	initSockets();
+}
+
+TileServer::~TileServer()
+{
+	stop();
+	if (listener != (intptr_t)NO_SOCKET)
+		closeSocket((Socket)listener);
+#ifndef _WIN32
+	if (!unixPath.empty())
+		unlink(unixPath.c_str());
+#endif
+}
+
+uint64_t TileServer::addTerrain(const std::string& name, const GenerationData& gData, const NoiseData& nData, int tileCells, int noiseLevel)
+{
+	Terrain terrain;
+	terrain.name = name;
+	terrain.gData = gData;
+	terrain.tiles.reset(new TerrainTiles(cache, gData, nData, tileCells, noiseLevel));
+	uint64_t parameters = terrain.tiles->getParameterHash();
+	std::lock_guard<std::mutex> lock(terrainMutex);
+	//The same parameters give the same tiles, the first name is kept
+	if (terrains.find(parameters) == terrains.end())
+		terrains[parameters] = std::move(terrain);
+	return parameters;
+}
+
+bool TileServer::listen(const std::string& address_in)
+{
+	sockaddr_storage storage;
+	socklen_t length = 0;
+	Socket s = openSocket(address_in, storage, length);
+	if (s == NO_SOCKET)
+	{
+		std::cout << "ERROR::TILE_SERVER::INVALID_ADDRESS->" << address_in << std::endl;
+		return false;
+	}
+#ifndef _WIN32
+	signal(SIGPIPE, SIG_IGN);
+	if (storage.ss_family == AF_UNIX)
+	{
+		//A socket file left by a server that did not shut down
+		unixPath = address_in.substr(5);
+		unlink(unixPath.c_str());
+	}
+	else
+	{
+		int on = 1;
+		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	}
+#endif
+	if (bind(s, (const sockaddr*)&storage, length) != 0 || ::listen(s, SOMAXCONN) != 0)
+	{
+		std::cout << "ERROR::TILE_SERVER::LISTEN_FAILED->" << address_in << std::endl;
+		closeSocket(s);
+		unixPath.clear();
+		return false;
+	}
+	address = address_in;
+	if (storage.ss_family == AF_INET)
+	{
+		sockaddr_in bound;
+		socklen_t boundLength = sizeof(bound);
+		if (getsockname(s, (sockaddr*)&bound, &boundLength) == 0)
+			address = std::to_string(ntohs(bound.sin_port));
+	}
+	listener = (intptr_t)s;
+	running = true;
+	return true;
+}
+
+std::string TileServer::getAddress() const
+{
+	return address;
+}
+
+void TileServer::run()
+{
+	//Also returns right away if stop came first
+	if (listener == (intptr_t)NO_SOCKET || !running)
+		return;
+	//Without it a returned connection waits for the next poll timeout
+	wakeSocket = (intptr_t)openWakeSocket();
+	for (unsigned i = 0; i < workerCount; ++i)
+		workers.emplace_back(&TileServer::workerLoop, this);
+	PROFILE_THREAD("tile server");
+	Socket s = (Socket)listener;
+	//Connections between requests, the longest idle first
+	std::deque<Connection> idle;
+	std::vector<PollEntry> polled;
+	while (running)
+	{
+		{
+			std::lock_guard<std::mutex> lock(connectionMutex);
+			for (Connection& connection : returned)
+				idle.push_back(std::move(connection));
+			returned.clear();
+		}
+		for (; idle.size() > MAX_IDLE_CONNECTIONS; idle.pop_front())
+			closeSocket((Socket)idle.front().socket);
+		//Polled, so stop does not need to close the listener under the accept
+		polled.resize(idle.size() + 2);
+		polled[0].fd = s;
+		polled[1].fd = (Socket)wakeSocket;
+		for (size_t i = 0; i < idle.size(); ++i)
+			polled[i + 2].fd = (Socket)idle[i].socket;
+		for (PollEntry& entry : polled)
+		{
+			entry.events = POLLIN;
+			entry.revents = 0;
+		}
+		if (wakeSocket == (intptr_t)NO_SOCKET)
+			polled[1].events = 0;
+		int ready = pollSockets(polled, POLL_MS);
+		if (ready > 0 && polled[1].revents != 0)
+		{
+			char drained[64];
+			recv((Socket)wakeSocket, drained, sizeof(drained), 0);
+		}
+		//A request arrived, or the client closed, the worker finds out which
+		auto now = std::chrono::steady_clock::now();
+		size_t kept = 0;
+		for (size_t i = 0; i < idle.size(); ++i)
+		{
+			if (ready > 0 && polled[i + 2].revents != 0)
+			{
+				std::lock_guard<std::mutex> lock(connectionMutex);
+				connections.push_back(std::move(idle[i]));
+				connectionAvailable.notify_one();
+			}
+			else if (now - idle[i].idleSince >= std::chrono::seconds(KEEP_ALIVE_SECONDS))
+				closeSocket((Socket)idle[i].socket);
+			else if (kept++ != i)
+				idle[kept - 1] = std::move(idle[i]);
+		}
+		idle.resize(kept);
+		if (ready <= 0 || polled[0].revents == 0)
+			continue;
+		Socket accepted = accept(s, nullptr, nullptr);
+		if (accepted == NO_SOCKET)
+			continue;
+		//A worker only gets it once the request is there
+		setReceiveTimeout(accepted, RECEIVE_TIMEOUT_MS);
+		Connection connection;
+		connection.socket = (intptr_t)accepted;
+		connection.idleSince = now;
+		idle.push_back(std::move(connection));
+	}
+	connectionAvailable.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+	for (Connection& connection : connections)
+		closeSocket((Socket)connection.socket);
+	connections.clear();
+	for (Connection& connection : returned)
+		closeSocket((Socket)connection.socket);
+	returned.clear();
+	for (Connection& connection : idle)
+		closeSocket((Socket)connection.socket);
+	if (wakeSocket != (intptr_t)NO_SOCKET)
+		closeSocket((Socket)wakeSocket);
+	wakeSocket = (intptr_t)NO_SOCKET;
+}
+
+void TileServer::stop()
+{
+	//Only an atomic store, signal handlers may call it
+	running = false;
+}
+
+TileServerStats TileServer::getStats() const
+{
+	TileServerStats stats;
+	stats.requests = requests.load();
+	stats.hits = hits.load();
+	stats.misses = misses.load();
+	stats.coalesced = coalesced.load();
+	stats.errors = errors.load();
+	stats.bytesSent = bytesSent.load();
+	stats.generations = 0;
+	std::lock_guard<std::mutex> lock(terrainMutex);
+	for (const auto& entry : terrains)
+		stats.generations += (uint64_t)entry.second.tiles->getGenerationCount();
+	return stats;
+}
+
+void TileServer::workerLoop()
+{
+	PROFILE_THREAD("tile server worker");
+	while (true)
+	{
+		Connection connection;
+		{
+			std::unique_lock<std::mutex> lock(connectionMutex);
+			//Wakes up now and then, stop does not notify
+			connectionAvailable.wait_for(lock, std::chrono::milliseconds(100), [this]() { return !connections.empty() || !running; });
+			if (!running)
+				return;
+			if (connections.empty())
+				continue;
+			connection = std::move(connections.front());
+			connections.pop_front();
+		}
+		if (!serveConnection(connection))
+		{
+			closeSocket((Socket)connection.socket);
+			continue;
+		}
+		//Back to the accepting thread until the next request arrives
+		connection.idleSince = std::chrono::steady_clock::now();
+		{
+			std::lock_guard<std::mutex> lock(connectionMutex);
+			returned.push_back(std::move(connection));
+		}
+		if (wakeSocket != (intptr_t)NO_SOCKET)
+			send((Socket)wakeSocket, "w", 1, 0);
+	}
+}
+
+bool TileServer::serveConnection(Connection& connection)
+{
+	//Only called when the socket is readable, the receive timeout is there in case it was not after all
+	char chunk[4096];
+	int n = (int)recv((Socket)connection.socket, chunk, sizeof(chunk), 0);
+	if (n == 0 || (n < 0 && !timedOut()))
+		return false;
+	if (n > 0)
+		connection.received.append(chunk, (size_t)n);
+	while (running)
+	{
+		size_t end = connection.received.find("\r\n\r\n");
+		//The rest of a partial request arrives while the connection waits with the others
+		if (end == std::string::npos)
+			return connection.received.size() <= MAX_REQUEST;
+		std::string request = connection.received.substr(0, end);
+		connection.received.erase(0, end + 4);
+		if (!handleRequest(connection.socket, request))
+			return false;
+	}
+	return false;
+}
+
+bool TileServer::handleRequest(intptr_t connection, const std::string& request)
+{
+	PROFILE_ZONE("tile request");
+	++requests;
+	PROFILE_COUNT("tile server requests", 1);
+	size_t lineEnd = std::min(request.find("\r\n"), request.size());
+	std::string line = request.substr(0, lineEnd);
+	size_t space1 = line.find(' ');
+	size_t space2 = space1 == std::string::npos ? std::string::npos : line.find(' ', space1 + 1);
+	if (space2 == std::string::npos)
+		return sendError(connection, 400, "Malformed request line", false);
+	std::string method = line.substr(0, space1);
+	std::string target = line.substr(space1 + 1, space2 - space1 - 1);
+	std::string version = line.substr(space2 + 1);
+	//HTTP/1.1 keeps the connection unless asked not to, 1.0 only when asked
+	std::string headers = toLower(request.substr(lineEnd));
+	bool keepAlive = version == "HTTP/1.1" ? headers.find("connection: close") == std::string::npos :
+		headers.find("connection: keep-alive") != std::string::npos;
+	if (method != "GET")
+		return sendError(connection, 405, "Only GET is served", false);
+
+	std::vector<std::string> segments = splitPath(target);
+	if (segments.size() == 1 && segments[0] == "terrains")
+		return sendTerrains(connection, keepAlive);
+	uint64_t parameters;
+	int lod, x, z;
+	if (segments.size() != 5 || segments[0] != "tiles" || !parseHash(segments[1], parameters) ||
+		!parseInt(segments[2], lod) || !parseInt(segments[3], x) || !parseInt(segments[4], z))
+		return sendError(connection, 404, "Unknown path, tiles are at /tiles/<parameters>/<lod>/<x>/<z>", keepAlive);
+	Terrain* terrain = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(terrainMutex);
+		auto it = terrains.find(parameters);
+		if (it != terrains.end())
+			terrain = &it->second;
+	}
+	if (terrain == nullptr)
+		return sendError(connection, 404, "Unknown parameters", keepAlive);
+	if (lod < 0 || x < 0 || z < 0 || x >= terrain->tiles->getTilesX(lod) || z >= terrain->tiles->getTilesZ(lod))
+		return sendError(connection, 404, "No such tile", keepAlive);
+	return sendTile(connection, *terrain, lod, x, z, keepAlive);
+}
+
+bool TileServer::sendTerrains(intptr_t connection, bool keepAlive)
+{
+	std::string json = "[";
+	{
+		std::lock_guard<std::mutex> lock(terrainMutex);
+		for (auto& entry : terrains)
+		{
+			const Terrain& terrain = entry.second;
+			json += json.size() > 1 ? ",\n{\"name\":" : "\n{\"name\":";
+			appendJsonString(json, terrain.name);
+			json += ",\"parameters\":\"" + hexString(entry.first) + "\"";
+			json += ",\"width\":" + std::to_string(terrain.gData.numXVertices);
+			json += ",\"height\":" + std::to_string(terrain.gData.numZVertices);
+			json += ",\"tilesX\":" + std::to_string(terrain.tiles->getTilesX());
+			json += ",\"tilesZ\":" + std::to_string(terrain.tiles->getTilesZ());
+			json += ",\"tileCells\":" + std::to_string(terrain.tiles->getTileCells());
+			json += ",\"levels\":" + std::to_string(terrain.tiles->getLevelCount());
+			json += ",\"noiseLevel\":" + std::to_string(terrain.tiles->getNoiseLevel()) + "}";
+		}
+	}
+	json += "\n]\n";
+	char header[256];
+	int headerSize = std::snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n%s\r\n",
+		json.size(), keepAlive ? "" : "Connection: close\r\n");
+	Socket s = (Socket)connection;
+	return sendAll(s, header, (size_t)headerSize) && sendAll(s, json.data(), json.size()) && keepAlive;
+}
+
+bool TileServer::sendTile(intptr_t connection, Terrain& terrain, int lod, int x, int z, bool keepAlive)
+{
+	TileKey key = terrain.tiles->getKey(x, z, lod);
+	std::string header = std::string("HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %llu\r\n") +
+		"X-Tile-Format: PGTL " + std::to_string(TileCache::FORMAT_VERSION) + "\r\n" + (keepAlive ? "" : "Connection: close\r\n") + "\r\n";
+	//The cache may evict the tile between the check and the open, then it is generated again
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		if (!ensureCached(terrain, lod, x, z))
+			break;
+		uint64_t sent = 0;
+		if (sendFile((Socket)connection, cache.getPath(key), header, sent))
+		{
+			bytesSent += sent;
+			return keepAlive;
+		}
+		//Headers already sent cannot be taken back, the connection is lost either way
+		if (cache.contains(key))
+			return false;
+	}
+	return sendError(connection, 503, "The tile could not be generated", false);
+}
+
+bool TileServer::sendError(intptr_t connection, int status, const char* message, bool keepAlive)
+{
+	++errors;
+	char response[512];
+	int size = std::snprintf(response, sizeof(response), "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n%s\r\n%s\n",
+		status, statusText(status), std::strlen(message) + 1, keepAlive ? "" : "Connection: close\r\n", message);
+	return sendAll((Socket)connection, response, (size_t)size) && keepAlive;
+}
+
+bool TileServer::ensureCached(Terrain& terrain, int lod, int x, int z)
+{
+	TileKey key = terrain.tiles->getKey(x, z, lod);
+	if (cache.contains(key))
+	{
+		++hits;
+		return true;
+	}
+	uint64_t id = hashBytes(&key.parameters, sizeof(key.parameters));
+	id = hashBytes(&key.lod, sizeof(key.lod), id);
+	id = hashBytes(&key.x, sizeof(key.x), id);
+	id = hashBytes(&key.z, sizeof(key.z), id);
+	std::shared_ptr<Pending> wait;
+	{
+		std::unique_lock<std::mutex> lock(pendingMutex);
+		auto it = pending.find(id);
+		if (it != pending.end())
+		{
+			wait = it->second;
+			++coalesced;
+			PROFILE_COUNT("tile server coalesced", 1);
+			pendingDone.wait(lock, [&]() { return wait->done; });
+			return wait->cached;
+		}
+		wait = std::make_shared<Pending>();
+		wait->done = false;
+		wait->cached = false;
+		pending[id] = wait;
+	}
+	++misses;
+	bool cached = terrain.tiles->cacheTile(x, z, lod);
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	wait->done = true;
+	wait->cached = cached;
+	pending.erase(id);
+	pendingDone.notify_all();
+	return cached;
+}
+
+TileClient::TileClient()
+	:
+	socket((intptr_t)NO_SOCKET)
+{
+	initSockets();
+}
+
+TileClient::~TileClient()
+{
+	close();
+}
+
+bool TileClient::connect(const std::string& address_in)
+{
+	close();
+	address = address_in;
+	sockaddr_storage storage;
+	socklen_t length = 0;
+	Socket s = openSocket(address, storage, length);
+	if (s == NO_SOCKET)
+		return false;
+	if (::connect(s, (const sockaddr*)&storage, length) != 0)
+	{
+		closeSocket(s);
+		return false;
+	}
+	socket = (intptr_t)s;
+	return true;
+}
+
+void TileClient::close()
+{
+	if (socket != (intptr_t)NO_SOCKET)
+		closeSocket((Socket)socket);
+	socket = (intptr_t)NO_SOCKET;
+	buffer.clear();
+}
+
+int TileClient::get(const std::string& target, std::vector<unsigned char>& body)
+{
+	body.clear();
+	if (socket == (intptr_t)NO_SOCKET && (address.empty() || !connect(address)))
+		return 0;
+	Socket s = (Socket)socket;
+	std::string request = "GET " + target + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	char chunk[65536];
+	size_t end;
+	bool ok = sendAll(s, request.data(), request.size());
+	while (ok && (end = buffer.find("\r\n\r\n")) == std::string::npos)
+	{
+		int n = (int)recv(s, chunk, sizeof(chunk), 0);
+		ok = n > 0;
+		if (ok)
+			buffer.append(chunk, (size_t)n);
+	}
+	int status = 0;
+	std::string headers;
+	if (ok)
+	{
+		headers = toLower(buffer.substr(0, end));
+		buffer.erase(0, end + 4);
+		ok = std::sscanf(headers.c_str(), "http/1.%*d %d", &status) == 1;
+	}
+	size_t contentLength = 0;
+	size_t field = headers.find("content-length:");
+	ok = ok && field != std::string::npos && std::sscanf(headers.c_str() + field, "content-length: %zu", &contentLength) == 1;
+	if (ok)
+	{
+		body.reserve(contentLength);
+		size_t fromBuffer = std::min(buffer.size(), contentLength);
+		body.insert(body.end(), buffer.begin(), buffer.begin() + fromBuffer);
+		buffer.erase(0, fromBuffer);
+		while (ok && body.size() < contentLength)
+		{
+			size_t want = std::min(contentLength - body.size(), sizeof(chunk));
+			int n = (int)recv(s, chunk, (int)want, 0);
+			ok = n > 0;
+			if (ok)
+				body.insert(body.end(), chunk, chunk + n);
+		}
+	}
+	if (!ok || headers.find("connection: close") != std::string::npos)
+		close();
+	return ok ? status : 0;
+}
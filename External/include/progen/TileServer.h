@@ -0,0 +1,144 @@
+#ifndef TILE_SERVER_H
+#define TILE_SERVER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include "TileCache.h"
+#include "TerrainTiles.h"
+
+struct TileServerStats
+{
+	uint64_t requests;
+	uint64_t hits; //Tile already in the cache
+	uint64_t misses; //Tile not in the cache, the request waited for a generation
+	uint64_t coalesced; //Waited for another request of the same tile
+	uint64_t generations; //Terrains generated, a miss that came while its terrain was generated does not add one
+	uint64_t errors; //Answered with an error status
+	uint64_t bytesSent; //Tile bytes, without the HTTP headers
+};
+
+/*
+	Serves the tiles of a set of terrains to other local processes (map viewers, navmesh builders), over HTTP/1.1 on
+	the loopback interface or on a Unix domain socket.
+
+	Every terrain added is served under the hex parameter hash addTerrain returns:
+		GET /terrains                          JSON list of the terrains: name, parameters, size, tiles, tile cells, levels
+		GET /tiles/<parameters>/<lod>/<x>/<z>  the tile as stored in the TileCache (TileCache::decode reads it)
+	Every level of the terrain's TilePyramid is served, lod 0 is the full resolution.
+
+	Tiles are sent straight from the cache files with sendfile (TransmitFile on Windows), the bytes never go through
+	the server. A miss generates the terrain of the tile through its TerrainTiles, which fills the cache with every tile
+	of that terrain. Requests for a tile that is being generated wait for that generation instead of starting their
+	own, so a burst of requests after a parameter change costs one generation.
+
+	Connections are accepted by the thread that calls run and handed to a fixed set of worker threads when a request
+	arrives. Between requests a keep-alive connection goes back to the accepting thread, which polls it with the others,
+	so idle clients do not hold a worker. Idle connections are closed after 30 seconds without a request, and past 1024
+	of them the longest idle one is closed first. The generation itself runs on the ThreadPool like everywhere else. stop can be called from any thread, or from a signal handler.
+	The server ignores SIGPIPE on POSIX, a client closing early must not end the process.
+*/
+
+class TileServer
+{
+public:
+	explicit TileServer(TileCache& cache, unsigned workers = 8);
+	~TileServer();
+	TileServer(const TileServer&) = delete;
+	TileServer& operator=(const TileServer&) = delete;
+	//Returns the parameter hash the tiles are served under. noiseLevel as in TerrainTiles.
+	uint64_t addTerrain(const std::string& name, const GenerationData& gData, const NoiseData& nData, int tileCells, int noiseLevel = 0);
+	//"unix:<path>" for a Unix domain socket, otherwise a port on 127.0.0.1 (0 picks a free one)
+	bool listen(const std::string& address);
+	//The address clients connect to, with the port that was picked
+	std::string getAddress() const;
+	//Serves until stop is called
+	void run();
+	void stop();
+	TileServerStats getStats() const;
+private:
+	struct Terrain
+	{
+		std::string name;
+		GenerationData gData;
+		std::unique_ptr<TerrainTiles> tiles;
+	};
+	struct Pending
+	{
+		bool done;
+		bool cached;
+	};
+	struct Connection
+	{
+		intptr_t socket;
+		std::string received; //Past the last complete request
+		std::chrono::steady_clock::time_point idleSince;
+	};
+	void workerLoop();
+	//Reads what arrived and answers the complete requests, false if the connection has to be closed
+	bool serveConnection(Connection& connection);
+	//Answers one request, false if the connection has to be closed
+	bool handleRequest(intptr_t socket, const std::string& request);
+	bool sendTerrains(intptr_t socket, bool keepAlive);
+	bool sendTile(intptr_t socket, Terrain& terrain, int lod, int x, int z, bool keepAlive);
+	bool sendError(intptr_t socket, int status, const char* message, bool keepAlive);
+	//Coalesces concurrent misses of one tile
+	bool ensureCached(Terrain& terrain, int lod, int x, int z);
+private:
+	TileCache& cache;
+	unsigned workerCount;
+	std::vector<std::thread> workers;
+	intptr_t listener;
+	intptr_t wakeSocket; //Workers send a datagram to it when they return a connection
+	std::string address;
+	std::string unixPath;
+	std::atomic<bool> running;
+
+	std::mutex connectionMutex;
+	std::condition_variable connectionAvailable;
+	std::deque<Connection> connections; //Readable, waiting for a worker
+	std::deque<Connection> returned; //Served by a worker, waiting for the next request
+
+	mutable std::mutex terrainMutex;
+	std::map<uint64_t, Terrain> terrains;
+
+	std::mutex pendingMutex;
+	std::condition_variable pendingDone;
+	std::unordered_map<uint64_t, std::shared_ptr<Pending>> pending;
+
+	std::atomic<uint64_t> requests, hits, misses, coalesced, errors, bytesSent;
+};
+
+/*
+	A keep-alive connection to a TileServer, for tools written against the library and for the benchmarks.
+*/
+
+class TileClient
+{
+public:
+	TileClient();
+	~TileClient();
+	TileClient(const TileClient&) = delete;
+	TileClient& operator=(const TileClient&) = delete;
+	//Same address format as TileServer::listen
+	bool connect(const std::string& address);
+	void close();
+	//Returns the HTTP status, 0 if the connection failed. The connection is reopened on the next get after a failure.
+	int get(const std::string& target, std::vector<unsigned char>& body);
+private:
+	intptr_t socket;
+	std::string address;
+	std::string buffer; //Received past the last response
+};
+
+#endif
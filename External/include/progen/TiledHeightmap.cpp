@@ -0,0 +1,246 @@
+#include "TiledHeightmap.h"
+#include "HeightmapIO.h"
+#include "BufferedWriter.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+namespace
+{
+	const uint32_t TILED_MAGIC = 0x48544750; //"PGTH"
+	const uint32_t TILED_VERSION = 1;
+	const uint32_t FLAG_BIOMES = 1;
+
+	struct TiledHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t tileSize;
+		uint32_t flags;
+		float low;
+		float high;
+		uint32_t reserved[8];
+	};
+	static_assert(sizeof(TiledHeader) == 64, "The tiled header is 64 bytes");
+
+	//Calls func(tile, x0, x1) for the parts of row z in every tile it crosses between x0 and x1
+	template<class Func>
+	void forEachTileSpan(int z, int x0, int x1, int tileSize, int tilesX, Func func)
+	{
+		size_t tileRow = (size_t)(z / tileSize) * tilesX;
+		size_t rowInTile = (size_t)(z % tileSize) * tileSize;
+		for (int x = x0; x < x1;)
+		{
+			int tx = x / tileSize;
+			int end = std::min(x1, (tx + 1) * tileSize);
+			func((tileRow + tx) * tileSize * tileSize + rowInTile + (x - tx * tileSize), x, end);
+			x = end;
+		}
+	}
+}
+
+bool TiledHeightmap::write(const char* path, const HeightField& heights, float low, float high, const std::vector<unsigned char>* biomeMap, int tileSize)
+{
+	PROFILE_ZONE("write tiled");
+	int W = heights.getWidth();
+	int H = heights.getHeight();
+	if (W == 0 || H == 0 || tileSize <= 0 || (biomeMap != nullptr && biomeMap->size() != heights.size()))
+		return false;
+	//A tile never needs to be larger than the map, open rejects such files
+	tileSize = std::min(tileSize, std::max(W, H));
+	BufferedWriter out;
+	if (!out.open(path))
+		return false;
+	TiledHeader header = {};
+	header.magic = TILED_MAGIC;
+	header.version = TILED_VERSION;
+	header.width = (uint32_t)W;
+	header.height = (uint32_t)H;
+	header.tileSize = (uint32_t)tileSize;
+	header.flags = biomeMap != nullptr ? FLAG_BIOMES : 0;
+	header.low = low;
+	header.high = high;
+	out.writeValue(header);
+
+	int tilesX = (W + tileSize - 1) / tileSize;
+	int tilesZ = (H + tileSize - 1) / tileSize;
+	float scale = high > low ? 65535.0f / (high - low) : 0.0f;
+	std::vector<uint16_t> tileRow(tileSize);
+	for (int tz = 0; tz < tilesZ; ++tz)
+		for (int tx = 0; tx < tilesX; ++tx)
+			for (int r = 0; r < tileSize; ++r)
+			{
+				int z = tz * tileSize + r;
+				std::fill(tileRow.begin(), tileRow.end(), (uint16_t)0);
+				if (z < H)
+				{
+					const float* in = heights.row(z);
+					for (int x = tx * tileSize; x < std::min(W, (tx + 1) * tileSize); ++x)
+						tileRow[x - tx * tileSize] = HeightmapIO::toSample(in[x], low, scale);
+				}
+				out.write(tileRow.data(), tileRow.size() * sizeof(uint16_t));
+			}
+	if (biomeMap != nullptr)
+	{
+		std::vector<unsigned char> biomeRow(tileSize);
+		for (int tz = 0; tz < tilesZ; ++tz)
+			for (int tx = 0; tx < tilesX; ++tx)
+				for (int r = 0; r < tileSize; ++r)
+				{
+					int z = tz * tileSize + r;
+					std::fill(biomeRow.begin(), biomeRow.end(), (unsigned char)0);
+					if (z < H)
+					{
+						int x0 = tx * tileSize;
+						int x1 = std::min(W, x0 + tileSize);
+						std::memcpy(biomeRow.data(), biomeMap->data() + (size_t)z * W + x0, (size_t)(x1 - x0));
+					}
+					out.write(biomeRow.data(), biomeRow.size());
+				}
+	}
+	return out.close();
+}
+
+TiledHeightmap::TiledHeightmap()
+	:
+	W(0),
+	H(0),
+	tileSize(0),
+	tilesX(0),
+	low(0.0f),
+	step(0.0f),
+	samples(nullptr),
+	biomes(nullptr)
+{}
+
+bool TiledHeightmap::open(const char* path)
+{
+	close();
+	if (!file.open(path))
+		return false;
+	TiledHeader header;
+	if (file.size() < sizeof(header))
+	{
+		file.close();
+		return false;
+	}
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != TILED_MAGIC || header.version != TILED_VERSION || header.width == 0 || header.height == 0 || header.tileSize == 0 ||
+		header.width > (uint32_t)INT_MAX || header.height > (uint32_t)INT_MAX || header.tileSize > std::max(header.width, header.height))
+	{
+		file.close();
+		return false;
+	}
+	//In size_t, the sizes of a corrupt header would wrap around in 32 bits
+	size_t tileSide = header.tileSize;
+	size_t tilesX = ((size_t)header.width + tileSide - 1) / tileSide;
+	size_t tilesZ = ((size_t)header.height + tileSide - 1) / tileSide;
+	size_t paddedW = tilesX * tileSide;
+	size_t paddedH = tilesZ * tileSide;
+	if (paddedW > file.size() / paddedH)
+	{
+		file.close();
+		return false;
+	}
+	size_t tileSamples = paddedW * paddedH;
+	size_t expected = sizeof(header) + tileSamples * sizeof(uint16_t) + ((header.flags & FLAG_BIOMES) ? tileSamples : 0);
+	if (file.size() != expected)
+	{
+		file.close();
+		return false;
+	}
+	W = (int)header.width;
+	H = (int)header.height;
+	tileSize = (int)header.tileSize;
+	this->tilesX = (int)tilesX;
+	low = header.low;
+	step = (header.high - header.low) / 65535.0f;
+	samples = (const uint16_t*)(file.data() + sizeof(header));
+	biomes = (header.flags & FLAG_BIOMES) ? file.data() + sizeof(header) + tileSamples * sizeof(uint16_t) : nullptr;
+	return true;
+}
+
+void TiledHeightmap::close()
+{
+	file.close();
+	W = H = 0;
+	samples = nullptr;
+	biomes = nullptr;
+}
+
+int TiledHeightmap::getWidth() const
+{
+	return W;
+}
+
+int TiledHeightmap::getHeight() const
+{
+	return H;
+}
+
+int TiledHeightmap::getTileSize() const
+{
+	return tileSize;
+}
+
+bool TiledHeightmap::hasBiomes() const
+{
+	return biomes != nullptr;
+}
+
+void TiledHeightmap::readRow(int z, int x0, int x1, float* out) const
+{
+	forEachTileSpan(z, x0, x1, tileSize, tilesX, [&](size_t offset, int begin, int end)
+	{
+		const uint16_t* in = samples + offset;
+		float* dst = out + (begin - x0);
+		for (int i = 0; i < end - begin; ++i)
+			dst[i] = HeightmapIO::fromSample(in[i], low, step);
+	});
+}
+
+void TiledHeightmap::readBiomeRow(int z, int x0, int x1, unsigned char* out) const
+{
+	forEachTileSpan(z, x0, x1, tileSize, tilesX, [&](size_t offset, int begin, int end)
+	{
+		std::memcpy(out + (begin - x0), biomes + offset, (size_t)(end - begin));
+	});
+}
+
+void TiledHeightmap::read(HeightField& heights) const
+{
+	PROFILE_ZONE("read tiled");
+	heights.resize(W, H);
+	int tilesZ = (H + tileSize - 1) / tileSize;
+	//A band of whole tile rows reads its tiles front to back
+	ThreadPool::global().parallelFor(0, tilesZ, [&](int begin, int end)
+	{
+		PROFILE_ZONE("read tile rows");
+		for (int tz = begin; tz < end; ++tz)
+			for (int tx = 0; tx < tilesX; ++tx)
+			{
+				int x0 = tx * tileSize;
+				int x1 = std::min(W, x0 + tileSize);
+				for (int z = tz * tileSize; z < std::min(H, (tz + 1) * tileSize); ++z)
+					readRow(z, x0, x1, heights.row(z) + x0);
+			}
+	}, 1);
+}
+
+void TiledHeightmap::readBiomes(std::vector<unsigned char>& biomeMap) const
+{
+	biomeMap.resize((size_t)W * H);
+	if (biomes == nullptr)
+		return;
+	int tilesZ = (H + tileSize - 1) / tileSize;
+	ThreadPool::global().parallelFor(0, tilesZ, [&](int begin, int end)
+	{
+		for (int z = begin * tileSize; z < std::min(H, end * tileSize); ++z)
+			readBiomeRow(z, 0, W, biomeMap.data() + (size_t)z * W);
+	}, 1);
+}
@@ -0,0 +1,50 @@
+#ifndef TILED_HEIGHTMAP_H
+#define TILED_HEIGHTMAP_H
+
+#include <vector>
+#include <cstdint>
+
+#include "HeightField.h"
+#include "MappedFile.h"
+
+/*
+	Raster format for maps too large to handle as images (16k x 16k and up).
+
+	After a 64 byte header the heights are stored as 16-bit little endian samples in square tiles, tile after tile in
+	row-major order, every tile row-major inside. Edge tiles are padded to the full size, so every tile is at a fixed
+	offset. The biome IDs follow in the same layout with a byte per sample when the file has them.
+	A window of the map (a chunk) only touches the tiles under it.
+
+	The file is memory mapped when opened, nothing is read until rows are asked for. read converts the whole map on
+	the ThreadPool in bands of whole tile rows, so the cost is the page faults of the file and a conversion per sample.
+*/
+
+class TiledHeightmap
+{
+public:
+	static const int DEFAULT_TILE_SIZE = 256;
+	static bool write(const char* path, const HeightField& heights, float low, float high,
+		const std::vector<unsigned char>* biomeMap = nullptr, int tileSize = DEFAULT_TILE_SIZE);
+	TiledHeightmap();
+	bool open(const char* path);
+	void close();
+	int getWidth() const;
+	int getHeight() const;
+	int getTileSize() const;
+	bool hasBiomes() const;
+	//Samples [x0, x1) of row z
+	void readRow(int z, int x0, int x1, float* out) const;
+	void readBiomeRow(int z, int x0, int x1, unsigned char* out) const;
+	void read(HeightField& heights) const;
+	void readBiomes(std::vector<unsigned char>& biomeMap) const;
+private:
+	MappedFile file;
+	int W, H;
+	int tileSize;
+	int tilesX;
+	float low, step;
+	const uint16_t* samples;
+	const unsigned char* biomes; //nullptr without biome IDs
+};
+
+#endif
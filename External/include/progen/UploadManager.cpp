@@ -0,0 +1,255 @@
+#include "UploadManager.h"
+#include "GLExtensions.h"
+
+#include <algorithm>
+#include <cstring>
+
+UploadManager::UploadManager(size_t vertexCapacity, size_t indexCapacity, size_t ringSize)
+	:
+	vertexAllocator(vertexCapacity),
+	indexAllocator(indexCapacity),
+	bufferGeneration(0),
+	ringSize(ringSize),
+	ringMapping(nullptr),
+	ringHead(0),
+	openBegin(0),
+	frameBytes(0),
+	stats()
+{
+	vertexBuffer = createBuffer(vertexCapacity * sizeof(Vertex));
+	indexBuffer = createBuffer(indexCapacity * sizeof(GLuint));
+
+	glGenBuffers(1, &ringBuffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, ringBuffer);
+	if (GLExtensions::get().bufferStorage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLExtensions::get().bufferStorageAlloc(GL_COPY_READ_BUFFER, ringSize, nullptr, flags);
+		ringMapping = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, ringSize, flags);
+	}
+	if (ringMapping == nullptr)
+		glBufferData(GL_COPY_READ_BUFFER, ringSize, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+UploadManager::~UploadManager()
+{
+	for (RingFence& f : fences)
+		glDeleteSync(f.fence);
+	if (ringMapping)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, ringBuffer);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &ringBuffer);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+}
+
+GLuint UploadManager::createBuffer(size_t bytes) const
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	//Only ever written by copies on the GPU, so immutable storage without any CPU access is enough
+	if (GLExtensions::get().bufferStorage)
+		GLExtensions::get().bufferStorageAlloc(GL_COPY_WRITE_BUFFER, std::max(bytes, (size_t)1), nullptr, 0);
+	else
+		glBufferData(GL_COPY_WRITE_BUFFER, std::max(bytes, (size_t)1), nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return buffer;
+}
+
+void UploadManager::growBuffer(GLuint& buffer, size_t oldBytes, size_t newBytes)
+{
+	GLuint grown = createBuffer(newBytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
+	buffer = grown;
+	++bufferGeneration;
+	++stats.growths;
+}
+
+GeometryAllocation UploadManager::allocate(size_t vertexCount, size_t indexCount)
+{
+	GeometryAllocation allocation;
+	//Empty ranges sit at offset 0, the allocator has nothing to hand out for them
+	allocation.firstVertex = vertexCount > 0 ? vertexAllocator.allocate(vertexCount) : 0;
+	if (allocation.firstVertex == BufferAllocator::INVALID_OFFSET)
+	{
+		size_t oldCapacity = vertexAllocator.getCapacity();
+		size_t newCapacity = std::max(2 * oldCapacity, oldCapacity + vertexCount);
+		growBuffer(vertexBuffer, oldCapacity * sizeof(Vertex), newCapacity * sizeof(Vertex));
+		vertexAllocator.grow(newCapacity);
+		allocation.firstVertex = vertexAllocator.allocate(vertexCount);
+	}
+	allocation.vertexCount = vertexCount;
+
+	allocation.firstIndex = indexCount > 0 ? indexAllocator.allocate(indexCount) : 0;
+	if (allocation.firstIndex == BufferAllocator::INVALID_OFFSET)
+	{
+		size_t oldCapacity = indexAllocator.getCapacity();
+		size_t newCapacity = std::max(2 * oldCapacity, oldCapacity + indexCount);
+		growBuffer(indexBuffer, oldCapacity * sizeof(GLuint), newCapacity * sizeof(GLuint));
+		indexAllocator.grow(newCapacity);
+		allocation.firstIndex = indexAllocator.allocate(indexCount);
+	}
+	allocation.indexCount = indexCount;
+	return allocation;
+}
+
+void UploadManager::free(GeometryAllocation& allocation)
+{
+	//Draws issued before are ordered before any later copy into the range, so it can be reused right away
+	vertexAllocator.free(allocation.firstVertex, allocation.vertexCount);
+	indexAllocator.free(allocation.firstIndex, allocation.indexCount);
+	allocation = GeometryAllocation();
+}
+
+void UploadManager::uploadVertices(const GeometryAllocation& allocation, const Vertex* vertices, size_t count, size_t offset)
+{
+	if (count == 0 || offset + count > allocation.vertexCount)
+		return;
+	upload(vertexBuffer, (allocation.firstVertex + offset) * sizeof(Vertex), vertices, count * sizeof(Vertex));
+}
+
+void UploadManager::uploadIndices(const GeometryAllocation& allocation, const GLuint* indices, size_t count, size_t offset)
+{
+	if (count == 0 || offset + count > allocation.indexCount)
+		return;
+	upload(indexBuffer, (allocation.firstIndex + offset) * sizeof(GLuint), indices, count * sizeof(GLuint));
+}
+
+void UploadManager::upload(GLuint destination, size_t destinationOffset, const void* data, size_t bytes)
+{
+	const unsigned char* src = (const unsigned char*)data;
+	size_t maxPiece = std::max(ringSize / 4, (size_t)1);
+	glBindBuffer(GL_COPY_READ_BUFFER, ringBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+	while (bytes > 0)
+	{
+		size_t piece = std::min(bytes, maxPiece);
+		size_t ringOffset = reserveRing(piece);
+		if (ringMapping)
+			std::memcpy(ringMapping + ringOffset, src, piece);
+		else
+			glBufferSubData(GL_COPY_READ_BUFFER, ringOffset, piece, src);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, ringOffset, destinationOffset, piece);
+		ringHead = ringOffset + piece;
+
+		src += piece;
+		destinationOffset += piece;
+		bytes -= piece;
+		frameBytes += piece;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+size_t UploadManager::reserveRing(size_t bytes)
+{
+	if (ringHead + bytes > ringSize)
+	{
+		if (!ringMapping)
+		{
+			//Orphan: the pending copies keep the old storage, the ring continues in a fresh one
+			glBufferData(GL_COPY_READ_BUFFER, ringSize, nullptr, GL_STREAM_DRAW);
+			ringHead = 0;
+			return 0;
+		}
+		fenceOpenStretch();
+		ringHead = 0;
+		openBegin = 0;
+	}
+	if (!ringMapping)
+		return ringHead;
+
+	//Fenced stretches are in ring order, the oldest one is the first ahead of the head
+	size_t end = ringHead + bytes;
+	while (!fences.empty() && fences.front().begin < end && ringHead < fences.front().end)
+	{
+		GLenum result = glClientWaitSync(fences.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (result == GL_TIMEOUT_EXPIRED)
+		{
+			++stats.fenceWaits;
+			do
+			{
+				result = glClientWaitSync(fences.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			} while (result == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fences.front().fence);
+		fences.pop_front();
+	}
+	return ringHead;
+}
+
+void UploadManager::fenceOpenStretch()
+{
+	if (!ringMapping || ringHead == openBegin)
+		return;
+	RingFence f;
+	f.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	f.begin = openBegin;
+	f.end = ringHead;
+	fences.push_back(f);
+	openBegin = ringHead;
+}
+
+void UploadManager::retireSignaledFences()
+{
+	while (!fences.empty() && glClientWaitSync(fences.front().fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+	{
+		glDeleteSync(fences.front().fence);
+		fences.pop_front();
+	}
+}
+
+void UploadManager::endFrame()
+{
+	fenceOpenStretch();
+	retireSignaledFences();
+	stats.lastFrameBytes = frameBytes;
+	stats.peakFrameBytes = std::max(stats.peakFrameBytes, frameBytes);
+	stats.totalBytes += frameBytes;
+	frameBytes = 0;
+}
+
+GLuint UploadManager::getVertexBuffer() const
+{
+	return vertexBuffer;
+}
+
+GLuint UploadManager::getIndexBuffer() const
+{
+	return indexBuffer;
+}
+
+unsigned UploadManager::getBufferGeneration() const
+{
+	return bufferGeneration;
+}
+
+bool UploadManager::isPersistent() const
+{
+	return ringMapping != nullptr;
+}
+
+const UploadStats& UploadManager::getStats() const
+{
+	return stats;
+}
+
+size_t UploadManager::getUsedVertices() const
+{
+	return vertexAllocator.getUsed();
+}
+
+size_t UploadManager::getUsedIndices() const
+{
+	return indexAllocator.getUsed();
+}
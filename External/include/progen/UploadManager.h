@@ -0,0 +1,104 @@
+#ifndef UPLOAD_MANAGER_H
+#define UPLOAD_MANAGER_H
+
+#include <glad/glad.h>
+#include <deque>
+#include <cstddef>
+
+#include "Vertex.h"
+#include "BufferAllocator.h"
+
+/*
+	Owns the large vertex and index buffers that chunk geometry lives in, and streams data into them.
+
+	Chunks get ranges of the shared buffers from a BufferAllocator instead of buffers of their own, so regenerating a
+	chunk never reallocates GPU memory (unless the buffers have to grow, see getBufferGeneration()). Vertex ranges
+	are drawn with a base vertex, index ranges with a byte offset.
+
+	Data reaches the buffers through a staging ring and glCopyBufferSubData:
+	- With ARB_buffer_storage the ring is persistently mapped and written with memcpy. Each stretch of the ring is
+	  guarded by a fence placed after the copies that read it, and the CPU only waits when it catches up with a
+	  stretch the GPU has not consumed yet.
+	- Otherwise the ring is a plain buffer filled with glBufferSubData and orphaned every time it wraps around,
+	  so the driver hands out fresh storage instead of waiting for the pending copies.
+	Large uploads are split into pieces of at most a quarter of the ring.
+*/
+
+struct GeometryAllocation
+{
+	size_t firstVertex; //In vertices, the base vertex of the draw calls
+	size_t vertexCount;
+	size_t firstIndex; //In indices
+	size_t indexCount;
+
+	GeometryAllocation() : firstVertex(BufferAllocator::INVALID_OFFSET), vertexCount(0), firstIndex(BufferAllocator::INVALID_OFFSET), indexCount(0) {}
+	bool isValid() const { return firstVertex != BufferAllocator::INVALID_OFFSET && firstIndex != BufferAllocator::INVALID_OFFSET; }
+};
+
+struct UploadStats
+{
+	size_t lastFrameBytes; //Uploaded during the last finished frame
+	size_t peakFrameBytes;
+	size_t totalBytes;
+	size_t fenceWaits; //Times the CPU had to wait for the GPU to free a part of the ring
+	size_t growths; //Times a shared buffer was reallocated because it was full
+};
+
+class UploadManager
+{
+public:
+	static const size_t DEFAULT_VERTEX_CAPACITY = 1 << 20; //Vertices
+	static const size_t DEFAULT_INDEX_CAPACITY = 6 << 20; //Indices
+	static const size_t DEFAULT_RING_SIZE = 16 << 20; //Bytes
+
+	explicit UploadManager(size_t vertexCapacity = DEFAULT_VERTEX_CAPACITY, size_t indexCapacity = DEFAULT_INDEX_CAPACITY, size_t ringSize = DEFAULT_RING_SIZE);
+	~UploadManager();
+	UploadManager(const UploadManager&) = delete;
+	UploadManager& operator=(const UploadManager&) = delete;
+	//Ranges for vertexCount vertices and indexCount indices. Grows the buffers if they are full.
+	GeometryAllocation allocate(size_t vertexCount, size_t indexCount);
+	void free(GeometryAllocation& allocation);
+	//Offsets are relative to the start of the allocation, in elements
+	void uploadVertices(const GeometryAllocation& allocation, const Vertex* vertices, size_t count, size_t offset = 0);
+	void uploadIndices(const GeometryAllocation& allocation, const GLuint* indices, size_t count, size_t offset = 0);
+	//Closes the frame: fences the ring writes of the frame and updates the statistics
+	void endFrame();
+	GLuint getVertexBuffer() const;
+	GLuint getIndexBuffer() const;
+	//Changes whenever a buffer is reallocated, VAOs that reference the buffers have to be set up again
+	unsigned getBufferGeneration() const;
+	bool isPersistent() const;
+	const UploadStats& getStats() const;
+	size_t getUsedVertices() const;
+	size_t getUsedIndices() const;
+private:
+	struct RingFence
+	{
+		GLsync fence;
+		size_t begin, end; //Ring bytes read by the copies issued before the fence
+	};
+	GLuint createBuffer(size_t bytes) const;
+	//Reallocates a shared buffer with room for at least the given number of bytes, keeping its contents
+	void growBuffer(GLuint& buffer, size_t oldBytes, size_t newBytes);
+	void upload(GLuint destination, size_t destinationOffset, const void* data, size_t bytes);
+	//Start of a free stretch of the ring for the given number of bytes
+	size_t reserveRing(size_t bytes);
+	void fenceOpenStretch();
+	void retireSignaledFences();
+private:
+	GLuint vertexBuffer, indexBuffer;
+	BufferAllocator vertexAllocator, indexAllocator;
+	unsigned bufferGeneration;
+
+	GLuint ringBuffer;
+	size_t ringSize;
+	unsigned char* ringMapping; //Persistent mapping, null on the fallback path
+	size_t ringHead;
+	size_t openBegin; //Start of the ring bytes written since the last fence
+	std::deque<RingFence> fences;
+
+	size_t frameBytes;
+	UploadStats stats;
+};
+
+#endif
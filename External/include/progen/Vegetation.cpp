@@ -0,0 +1,191 @@
+#include "Vegetation.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+
+	//Flat shaded triangle. The winding is picked so the normal points away from inside.
+	void addFace(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, glm::vec3 a, glm::vec3 b, glm::vec3 c, const glm::vec3& inside, const glm::vec3& color)
+	{
+		glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
+		if (glm::dot(n, (a + b + c) / 3.0f - inside) < 0.0f)
+		{
+			std::swap(b, c);
+			n = -n;
+		}
+		for (const glm::vec3& p : { a, b, c })
+		{
+			Vertex v;
+			v.pos = p;
+			v.normal = n;
+			v.color = color;
+			indices.push_back((GLuint)vertices.size());
+			vertices.push_back(v);
+		}
+	}
+
+	//Hexagonal trunk under a cone shaped crown, standing on the origin
+	void buildTree(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+	{
+		const int SEGMENTS = 6;
+		const glm::vec3 trunkColor(0.35f, 0.22f, 0.1f);
+		const glm::vec3 crownColor(0.13f, 0.35f, 0.12f);
+		const float trunkRadius = 0.04f, trunkHeight = 0.25f;
+		const float crownRadius = 0.2f, crownBase = 0.2f, crownTop = 0.8f;
+
+		for (int i = 0; i < SEGMENTS; ++i)
+		{
+			float a0 = 2.0f * PI * i / SEGMENTS;
+			float a1 = 2.0f * PI * (i + 1) / SEGMENTS;
+			glm::vec3 d0(std::cos(a0), 0.0f, std::sin(a0));
+			glm::vec3 d1(std::cos(a1), 0.0f, std::sin(a1));
+
+			glm::vec3 trunkInside(0.0f, 0.5f * trunkHeight, 0.0f);
+			glm::vec3 up(0.0f, trunkHeight, 0.0f);
+			addFace(vertices, indices, d0 * trunkRadius, d1 * trunkRadius, d1 * trunkRadius + up, trunkInside, trunkColor);
+			addFace(vertices, indices, d0 * trunkRadius, d1 * trunkRadius + up, d0 * trunkRadius + up, trunkInside, trunkColor);
+
+			glm::vec3 base(0.0f, crownBase, 0.0f);
+			glm::vec3 apex(0.0f, crownTop, 0.0f);
+			glm::vec3 crownInside(0.0f, 0.5f * (crownBase + crownTop), 0.0f);
+			addFace(vertices, indices, base + d0 * crownRadius, base + d1 * crownRadius, apex, crownInside, crownColor);
+			addFace(vertices, indices, base + d0 * crownRadius, base + d1 * crownRadius, base, apex, crownColor);
+		}
+	}
+
+	//Flattened, slightly irregular octahedron half sunk into the ground
+	void buildRock(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+	{
+		const glm::vec3 rockColor(0.45f, 0.43f, 0.4f);
+		const glm::vec3 center(0.0f, 0.03f, 0.0f);
+		glm::vec3 ring[4] =
+		{
+			glm::vec3(0.15f, 0.0f, 0.02f),
+			glm::vec3(-0.01f, 0.01f, 0.12f),
+			glm::vec3(-0.14f, -0.01f, -0.02f),
+			glm::vec3(0.02f, 0.0f, -0.13f)
+		};
+		glm::vec3 top = center + glm::vec3(0.02f, 0.1f, 0.01f);
+		glm::vec3 bottom = center - glm::vec3(0.0f, 0.08f, 0.0f);
+		for (int i = 0; i < 4; ++i)
+		{
+			glm::vec3 a = center + ring[i];
+			glm::vec3 b = center + ring[(i + 1) % 4];
+			addFace(vertices, indices, a, b, top, center, rockColor);
+			addFace(vertices, indices, a, b, bottom, center, rockColor);
+		}
+	}
+}
+
+Vegetation::Vegetation()
+	:
+	visibleCount(0)
+{
+	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
+	buildTree(vertices, indices);
+	meshes[TREE].setMesh(vertices, indices);
+
+	vertices.clear();
+	indices.clear();
+	buildRock(vertices, indices);
+	meshes[ROCK].setMesh(vertices, indices);
+}
+
+void Vegetation::scatter(const VegetationData& vData, const TerrainQuery& query, const std::vector<unsigned char>& biomeIDs)
+{
+	PROFILE_ZONE("scatter");
+	const ScatterLayer* layers[MESH_TYPE_COUNT] = { &vData.trees, &vData.rocks };
+	size_t maxCount = 0;
+	for (int type = 0; type < MESH_TYPE_COUNT; ++type)
+	{
+		//Different seed per layer, so rocks do not follow the trees
+		maxCount = std::max(maxCount, scatters[type].scatter(*layers[type], vData.seed * 31u + (unsigned int)type, query, biomeIDs));
+	}
+	if (visible.size() < maxCount)
+		visible.resize(maxCount);
+}
+
+void Vegetation::clear()
+{
+	for (PoissonScatter& s : scatters)
+		s.clear();
+	visibleCount = 0;
+}
+
+size_t Vegetation::cull(int type, const Frustum& frustum)
+{
+	const PoissonScatter& layer = scatters[type];
+	const ScatterInstance* instances = layer.getInstances();
+	float radius = meshes[type].getBoundingRadius();
+	size_t count = 0;
+	for (const ScatterTile& tile : layer.getTiles())
+	{
+		glm::vec3 grow(radius * tile.maxScale);
+		FrustumTest test = frustum.testAABB(tile.boundsMin - grow, tile.boundsMax + grow);
+		if (test == FrustumTest::OUTSIDE)
+			continue;
+		if (test == FrustumTest::INSIDE)
+		{
+			std::copy(instances + tile.begin, instances + tile.begin + tile.count, visible.begin() + count);
+			count += tile.count;
+			continue;
+		}
+		for (size_t i = tile.begin; i < tile.begin + tile.count; ++i)
+		{
+			if (frustum.intersectsSphere(instances[i].position, radius * instances[i].scale))
+				visible[count++] = instances[i];
+		}
+	}
+	return count;
+}
+
+void Vegetation::render(Shader& shader, const Camera& camera)
+{
+	PROFILE_ZONE("vegetation draw");
+	if (getInstanceCount() == 0)
+	{
+		visibleCount = 0;
+		return;
+	}
+
+	glm::mat4 PV = camera.getProjectionMatrix() * camera.getViewMatrix();
+	Frustum frustum(PV);
+
+	//Everything else comes from the per frame uniform block
+	shader.use();
+
+	visibleCount = 0;
+	for (int type = 0; type < MESH_TYPE_COUNT; ++type)
+	{
+		size_t count = cull(type, frustum);
+		meshes[type].setInstances(visible.data(), count);
+		meshes[type].render();
+		visibleCount += count;
+	}
+}
+
+size_t Vegetation::getInstanceCount() const
+{
+	size_t count = 0;
+	for (const PoissonScatter& s : scatters)
+		count += s.getInstanceCount();
+	return count;
+}
+
+size_t Vegetation::getCandidateCount() const
+{
+	size_t count = 0;
+	for (const PoissonScatter& s : scatters)
+		count += s.getCandidateCount();
+	return count;
+}
+
+size_t Vegetation::getVisibleCount() const
+{
+	return visibleCount;
+}
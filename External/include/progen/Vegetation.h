@@ -0,0 +1,58 @@
+#ifndef VEGETATION_H
+#define VEGETATION_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "Shader.h"
+#include "Frustum.h"
+#include "TerrainQuery.h"
+#include "PoissonScatter.h"
+#include "InstancedMesh.h"
+
+struct VegetationData
+{
+	bool enabled;
+	unsigned int seed;
+	ScatterLayer trees;
+	ScatterLayer rocks;
+};
+
+
+/*
+	Trees and rocks scattered over the terrain.
+
+	Every kind has its own Poisson-disk layer and its own low-poly mesh. Each frame the tiles of a layer are tested
+	against the view frustum first; tiles that are fully inside are copied as a whole, tiles that are cut are tested
+	per instance. The survivors are uploaded to the instance buffer and every kind is drawn with one instanced call.
+*/
+
+class Vegetation
+{
+public:
+	Vegetation();
+	void scatter(const VegetationData& vData, const TerrainQuery& query, const std::vector<unsigned char>& biomeIDs);
+	void clear();
+	void render(Shader& shader, const Camera& camera);
+	size_t getInstanceCount() const;
+	size_t getCandidateCount() const;
+	//Instances that passed culling in the last rendered frame
+	size_t getVisibleCount() const;
+private:
+	enum MeshType
+	{
+		TREE,
+		ROCK,
+		MESH_TYPE_COUNT
+	};
+	size_t cull(int type, const Frustum& frustum);
+private:
+	PoissonScatter scatters[MESH_TYPE_COUNT];
+	InstancedMesh meshes[MESH_TYPE_COUNT];
+	std::vector<ScatterInstance> visible; //Culling output, sized once per scatter
+	size_t visibleCount;
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <glm/glm.hpp>
+
+/*	
+	Vertex data for OpenGL
+*/
+struct Vertex
+{
+	glm::vec3 pos;
+	glm::vec3 normal;
+	glm::vec3 color;
+};
+
+#endif
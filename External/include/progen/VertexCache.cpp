@@ -0,0 +1,237 @@
+#include "VertexCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	//Forsyth's constants. The modeled cache is LRU; the 3 vertices of the last triangle get a fixed score
+	//so the next triangle does not simply reuse the same edge forever.
+	const int MODEL_CACHE_SIZE = 32;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+	const int VALENCE_TABLE_SIZE = 32;
+
+	struct ScoreTables
+	{
+		float cache[MODEL_CACHE_SIZE];
+		float valence[VALENCE_TABLE_SIZE];
+
+		ScoreTables()
+		{
+			for (int i = 0; i < MODEL_CACHE_SIZE; ++i)
+				cache[i] = i < 3 ? LAST_TRIANGLE_SCORE : std::pow(1.0f - (i - 3) / (float)(MODEL_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+			valence[0] = 0.0f;
+			for (int i = 1; i < VALENCE_TABLE_SIZE; ++i)
+				valence[i] = VALENCE_BOOST_SCALE * std::pow((float)i, -VALENCE_BOOST_POWER);
+		}
+	};
+
+	const ScoreTables& scoreTables()
+	{
+		static const ScoreTables tables;
+		return tables;
+	}
+}
+
+VertexCache::VertexCache()
+{}
+
+float VertexCache::vertexScore(int position, int remainingTriangles) const
+{
+	//Nothing left to gain from this vertex
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	const ScoreTables& tables = scoreTables();
+	float score = position >= 0 ? tables.cache[position] : 0.0f;
+	if (remainingTriangles < VALENCE_TABLE_SIZE)
+		score += tables.valence[remainingTriangles];
+	else
+		score += VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -VALENCE_BOOST_POWER);
+	return score;
+}
+
+VertexCacheStats VertexCache::simulate(const std::vector<glm::ivec3>& tris, size_t vertexCount, int cacheSize)
+{
+	//FIFO: a vertex is cached while fewer than cacheSize misses happened since it was loaded. Hits do not refresh it.
+	std::vector<size_t> loadedAt(vertexCount, 0);
+	std::vector<char> used(vertexCount, 0);
+	size_t misses = 0;
+	size_t unique = 0;
+	for (const glm::ivec3& tri : tris)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			int v = tri[k];
+			if (!used[v])
+			{
+				used[v] = 1;
+				++unique;
+			}
+			else if (misses - loadedAt[v] < (size_t)cacheSize)
+			{
+				continue;
+			}
+			++misses;
+			loadedAt[v] = misses;
+		}
+	}
+
+	VertexCacheStats stats;
+	stats.transforms = misses;
+	stats.acmr = tris.empty() ? 0.0 : (double)misses / tris.size();
+	stats.atvr = unique == 0 ? 0.0 : (double)misses / unique;
+	return stats;
+}
+
+void VertexCache::optimize(std::vector<glm::ivec3>& tris, size_t vertexCount)
+{
+	int triangleCount = (int)tris.size();
+	if (triangleCount == 0)
+		return;
+
+	//Triangles of every vertex, compacted into one array
+	triangleOffsets.assign(vertexCount + 1, 0);
+	for (const glm::ivec3& tri : tris)
+		for (int k = 0; k < 3; ++k)
+			++triangleOffsets[tri[k] + 1];
+	for (size_t v = 0; v < vertexCount; ++v)
+		triangleOffsets[v + 1] += triangleOffsets[v];
+	remaining.assign(vertexCount, 0);
+	vertexTriangles.resize(triangleOffsets[vertexCount]);
+	for (int t = 0; t < triangleCount; ++t)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			int v = tris[t][k];
+			vertexTriangles[triangleOffsets[v] + remaining[v]++] = t;
+		}
+	}
+
+	cachePosition.assign(vertexCount, -1);
+	scores.resize(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+		scores[v] = vertexScore(-1, remaining[v]);
+	triangleScores.resize(triangleCount);
+	int bestTriangle = 0;
+	for (int t = 0; t < triangleCount; ++t)
+	{
+		triangleScores[t] = scores[tris[t].x] + scores[tris[t].y] + scores[tris[t].z];
+		if (triangleScores[t] > triangleScores[bestTriangle])
+			bestTriangle = t;
+	}
+	emitted.assign(triangleCount, 0);
+	output.clear();
+	output.reserve(triangleCount);
+
+	//The modeled LRU cache, with room for the 3 vertices pushed in front before the overflow is dropped
+	int cache[MODEL_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	int cursor = 0; //Where to look for a triangle when nothing in the cache has one left
+	while ((int)output.size() < triangleCount)
+	{
+		if (bestTriangle < 0)
+		{
+			while (emitted[cursor])
+				++cursor;
+			bestTriangle = cursor;
+		}
+
+		const glm::ivec3 tri = tris[bestTriangle];
+		output.push_back(tri);
+		emitted[bestTriangle] = 1;
+
+		//Remove the triangle from its vertices' lists, the live part of a list is its first remaining[v] entries
+		for (int k = 0; k < 3; ++k)
+		{
+			int v = tri[k];
+			int* list = vertexTriangles.data() + triangleOffsets[v];
+			int last = --remaining[v];
+			for (int i = 0; i <= last; ++i)
+			{
+				if (list[i] == bestTriangle)
+				{
+					std::swap(list[i], list[last]);
+					break;
+				}
+			}
+		}
+
+		//Move the triangle's vertices to the front of the cache
+		int newCache[MODEL_CACHE_SIZE + 3];
+		int newCount = 0;
+		for (int k = 0; k < 3; ++k)
+			newCache[newCount++] = tri[k];
+		for (int i = 0; i < cacheCount; ++i)
+		{
+			int v = cache[i];
+			if (v != tri.x && v != tri.y && v != tri.z)
+				newCache[newCount++] = v;
+		}
+
+		//Rescore everything whose cache position changed and spread the change to the live triangles
+		for (int i = 0; i < newCount; ++i)
+		{
+			int v = newCache[i];
+			int position = i < MODEL_CACHE_SIZE ? i : -1;
+			cachePosition[v] = position;
+			float score = vertexScore(position, remaining[v]);
+			float delta = score - scores[v];
+			scores[v] = score;
+			const int* list = vertexTriangles.data() + triangleOffsets[v];
+			for (int j = 0; j < remaining[v]; ++j)
+				triangleScores[list[j]] += delta;
+		}
+		cacheCount = std::min(newCount, MODEL_CACHE_SIZE);
+		for (int i = 0; i < cacheCount; ++i)
+			cache[i] = newCache[i];
+
+		//Next triangle: the best one that uses a cached vertex
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < cacheCount; ++i)
+		{
+			int v = cache[i];
+			const int* list = vertexTriangles.data() + triangleOffsets[v];
+			for (int j = 0; j < remaining[v]; ++j)
+			{
+				if (triangleScores[list[j]] > bestScore)
+				{
+					bestScore = triangleScores[list[j]];
+					bestTriangle = list[j];
+				}
+			}
+		}
+	}
+	tris.swap(output);
+}
+
+void VertexCache::buildGridStrips(int numX, int numZ, std::vector<glm::ivec3>& tris, int cacheSize)
+{
+	tris.clear();
+	if (numX < 2 || numZ < 2)
+		return;
+	tris.reserve((size_t)(numX - 1) * (numZ - 1) * 2);
+
+	//In the first row of a strip the two rows are loaded interleaved, so a vertex of the lower row is loaded about
+	//2 * stripCells + 3 - x misses before the next row reuses it. Keeping that under the FIFO size keeps every
+	//later row down to one load per vertex.
+	int stripCells = std::max((cacheSize - 3) / 2, 1);
+	for (int x0 = 0; x0 < numX - 1; x0 += stripCells)
+	{
+		int x1 = std::min(x0 + stripCells, numX - 1);
+		for (int z = 0; z < numZ - 1; ++z)
+		{
+			for (int x = x0; x < x1; ++x)
+			{
+				//Same triangles as the row-major generation, oriented counter-clockwise
+				int vi = z * numX + x;
+				tris.push_back(glm::ivec3(vi, vi + numX, vi + numX + 1));
+				tris.push_back(glm::ivec3(vi, vi + numX + 1, vi + 1));
+			}
+		}
+	}
+}
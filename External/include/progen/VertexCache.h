@@ -0,0 +1,64 @@
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/*
+	Result of running an index buffer through a simulated post-transform cache.
+	ACMR: vertex shader runs per triangle (0.5 is the ideal for a large grid, 3 means no reuse at all).
+	ATVR: vertex shader runs per unique vertex (1 is ideal).
+*/
+struct VertexCacheStats
+{
+	size_t transforms;
+	double acmr;
+	double atvr;
+};
+
+
+/*
+	Triangle orders that make the GPU's post-transform vertex cache hit more often.
+
+	simulate() models the cache as a FIFO of cacheSize vertices, like most hardware, so the numbers can be compared
+	without a GPU.
+
+	optimize() is Forsyth's greedy algorithm for arbitrary meshes (used for the RTIN output). Every vertex gets a score
+	from its position in a modeled LRU cache and from how many of its triangles are still not emitted. The next
+	triangle is the best scored one among the triangles of the vertices in the cache, so the cost is linear in the
+	number of triangles.
+
+	buildGridStrips() gives the same kind of order for a regular grid analytically: the grid is cut into vertical strips
+	narrow enough that two rows of a strip fit into the cache, and every strip is walked row by row.
+
+	REFERENCE: Forsyth - Linear-Speed Vertex Cache Optimisation (2006)
+*/
+
+class VertexCache
+{
+public:
+	static const int DEFAULT_CACHE_SIZE = 32;
+
+	VertexCache();
+	static VertexCacheStats simulate(const std::vector<glm::ivec3>& tris, size_t vertexCount, int cacheSize = DEFAULT_CACHE_SIZE);
+	//Reorders the triangles in place. Scratch memory is kept for the next call.
+	void optimize(std::vector<glm::ivec3>& tris, size_t vertexCount);
+	//Triangles of a numX x numZ vertex grid with the same winding as the row-major ones, ordered in strips
+	static void buildGridStrips(int numX, int numZ, std::vector<glm::ivec3>& tris, int cacheSize = DEFAULT_CACHE_SIZE);
+private:
+	float vertexScore(int cachePosition, int remaining) const;
+private:
+	//Per vertex: triangles using it (CSR), how many are not emitted yet, position in the modeled cache, score
+	std::vector<int> triangleOffsets;
+	std::vector<int> vertexTriangles;
+	std::vector<int> remaining;
+	std::vector<int> cachePosition;
+	std::vector<float> scores;
+	//Per triangle
+	std::vector<float> triangleScores;
+	std::vector<char> emitted;
+	std::vector<glm::ivec3> output;
+};
+
+#endif
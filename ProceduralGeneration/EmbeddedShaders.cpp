@@ -0,0 +1,12 @@
+#include "EmbeddedShaders.h"
+
+//The table is generated by the pre-build step (Tools/embed_shaders.ps1) into the intermediate directory
+static const EmbeddedShader EMBEDDED_SHADERS[] =
+{
+#include "EmbeddedShaders.inc"
+};
+
+void registerEmbeddedShaders()
+{
+	ShaderSources::global().setEmbedded(EMBEDDED_SHADERS, sizeof(EMBEDDED_SHADERS) / sizeof(EMBEDDED_SHADERS[0]));
+}
@@ -0,0 +1,9 @@
+#ifndef EMBEDDED_SHADERS_H
+#define EMBEDDED_SHADERS_H
+
+#include "progen/ShaderSources.h"
+
+//Hands the shader sources compiled into the executable to ShaderSources::global()
+void registerEmbeddedShaders();
+
+#endif
@@ -9,6 +9,12 @@
 //My headers
 #include "progen/Utilities.h"
 #include "progen/Shader.h"
+#include "progen/FrameUniforms.h"
+#include "progen/GLExtensions.h"
+#include "progen/Profiler.h"
+#include "progen/GpuProfiler.h"
+#include "progen/ProgramCache.h"
+#include "EmbeddedShaders.h"
 #include "progen/Camera.h"
 #include "progen/PerlinNoise.h"
 #include "progen/Terrain.h"
@@ -19,6 +25,8 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <chrono>
+#include <cstdlib>
 
 
 //ImGui
@@ -26,10 +34,14 @@
 #include <ImGui/imgui_impl_glfw.h> 
 #include <ImGui/imgui_impl_opengl3.h>
 #include "progen/curveEditor.h"
+#include "progen/ProfilerPanel.h"
 
 
 //Camera
 Camera camera(glm::vec3(0.0f, 5.0f, 15.0f));
+//If enabled the camera can not go below the terrain surface
+bool cameraCollision = false;
+constexpr float CAMERA_CLEARANCE = 0.2f;
 
 
 //Light Properties (For now, we only have directional light)
@@ -106,6 +118,43 @@ void processInput(GLFWwindow* window)
 
 }
 
+//Keeps the camera above the ground while it is over the terrain
+void resolveCameraCollision()
+{
+	const TerrainQuery& query = terrain->getQuery();
+	glm::vec3 pos = camera.getPosition();
+	if (!cameraCollision || !query.contains(pos.x, pos.z))
+		return;
+
+	float ground = query.getHeight(pos.x, pos.z) + CAMERA_CLEARANCE;
+	if (pos.y < ground)
+	{
+		pos.y = ground;
+		camera.setPosition(pos);
+	}
+}
+
+//Casts a ray from the camera through the mouse cursor onto the terrain
+RayHit pickTerrain()
+{
+	RayHit hit;
+	hit.hit = false;
+	if (io->WantCaptureMouse)
+		return hit;
+
+	double xPos, yPos;
+	glfwGetCursorPos(window, &xPos, &yPos);
+	//Cursor to NDC, GLFW's y axis points down
+	glm::vec2 ndc(2.0 * xPos / SCR_WIDTH - 1.0, 1.0 - 2.0 * yPos / SCR_HEIGHT);
+	glm::mat4 invPV = glm::inverse(camera.getProjectionMatrix() * camera.getViewMatrix());
+	glm::vec4 nearPoint = invPV * glm::vec4(ndc, -1.0f, 1.0f);
+	glm::vec4 farPoint = invPV * glm::vec4(ndc, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 dir = glm::vec3(farPoint) / farPoint.w - origin;
+	terrain->getQuery().raycast(origin, dir, 1.0f, hit);
+	return hit;
+}
+
 //Callback function for mouse position inputs
 void mouse_callback(GLFWwindow* window, double xPos, double yPos)
 {
@@ -150,6 +199,7 @@ int setupDependencies()
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	GLExtensions::load((GLADloadproc)glfwGetProcAddress);
 
 	//Specify the actual window rectangle for renderings.
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
@@ -252,12 +302,44 @@ void setupData()
 	tData.numZVertices = 256;
 	tData.heightMultiplier = 1.0f;
 	tData.useFallOff = false;
+	tData.analyticNormals = false;
+	tData.meshType = MeshType::GRID;
+	tData.maxMeshError = 0.01f;
+	tData.optimizeVertexCache = true;
+	tData.clusterCulling = true;
+	tData.horizonCulling = true;
 	//Set the control point coordinates
 	//The curve is near zero in [0, 0.3] range (Water) then it increases
 	tData.controlPoints[0] = 1.00f;
 	tData.controlPoints[1] = 0.0f;
 	tData.controlPoints[2] = WATER.getUpperHeight();
 	tData.controlPoints[3] = 0.0f;
+	//Thermal erosion is off by default
+	tData.erosion.enabled = false;
+	tData.erosion.iterations = 50;
+	tData.erosion.talus = 0.01f;
+	tData.erosion.rate = 1.0f;
+	tData.erosion.epsilon = 1e-5f;
+	//Rivers are off by default
+	tData.hydrology.enabled = false;
+	tData.hydrology.method = FlowMethod::D8;
+	tData.hydrology.fillEpsilon = 1e-6f;
+	tData.hydrology.riverThreshold = 0.002f;
+	//Vegetation is off by default. Trees grow on grass, rocks lie on grass and land.
+	tData.vegetation.enabled = false;
+	tData.vegetation.seed = 7;
+	tData.vegetation.trees.minDistance = 0.3f;
+	tData.vegetation.trees.density = 2.0f;
+	tData.vegetation.trees.maxSlope = 30.0f;
+	tData.vegetation.trees.biomeMask = 1u << GRASS_ID;
+	tData.vegetation.trees.minScale = 0.6f;
+	tData.vegetation.trees.maxScale = 1.2f;
+	tData.vegetation.rocks.minDistance = 0.6f;
+	tData.vegetation.rocks.density = 1.0f;
+	tData.vegetation.rocks.maxSlope = 45.0f;
+	tData.vegetation.rocks.biomeMask = (1u << GRASS_ID) | (1u << LAND_ID);
+	tData.vegetation.rocks.minScale = 0.5f;
+	tData.vegetation.rocks.maxScale = 1.5f;
 	//-----------------------NOISE DATA------------------------------------//
 	nData.scale = 0.3;
 	nData.octaves = 3;
@@ -265,6 +347,10 @@ void setupData()
 	nData.lacunarity = 2.0;
 	nData.seed = 21;
 	nData.offset = glm::vec2(0.0, 0.0);
+	nData.octaveMode = OctaveMode::Fixed;
+	nData.fadeLastOctave = true;
+	nData.fractalMode = FractalMode::Fbm;
+	nData.warpStrength = 1.0;
 }
 
 //Implemented Slider Double implementation for ImGui 
@@ -275,6 +361,7 @@ bool sliderDouble(const char* label, double* v, double v_min, double v_max)
 
 void handleImGui()
 {
+	PROFILE_ZONE("imgui");
 	//Set the new ImGui Frame
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
@@ -296,6 +383,18 @@ void handleImGui()
 	sliderDouble("Scale", &nData.scale, 0.1, 1.0);
 	//Number of Octaves
 	ImGui::SliderInt("Number of Octaves", &nData.octaves, 1, 5);
+	//Drops the octaves finer than the vertices, on small maps they only add aliasing
+	bool bandLimited = nData.octaveMode == OctaveMode::BandLimited;
+	ImGui::Checkbox("Band Limited Octaves", &bandLimited);
+	nData.octaveMode = bandLimited ? OctaveMode::BandLimited : OctaveMode::Fixed;
+	if (bandLimited)
+		ImGui::Checkbox("Fade Last Octave", &nData.fadeLastOctave);
+	//Ridged and hybrid multifractals, or fBm with its sample points warped by two more fBm fields
+	int fractalMode = (int)nData.fractalMode;
+	ImGui::Combo("Fractal", &fractalMode, "fBm\0Ridged Multifractal\0Hybrid Multifractal\0Domain Warp\0");
+	nData.fractalMode = (FractalMode)fractalMode;
+	if (nData.fractalMode == FractalMode::DomainWarp)
+		sliderDouble("Warp Strength", &nData.warpStrength, 0.0, 4.0);
 	//Persistence
 	sliderDouble("Persistence", &nData.persistence, 0.1, 0.9);
 	//Lacunarity
@@ -313,11 +412,90 @@ void handleImGui()
     float y = ImGui::BezierValue( 0.5f, tData.controlPoints ); // x delta in [0..1] range
 	//Control Falloff effect
 	ImGui::Checkbox("Use Falloff", &tData.useFallOff);
+	//Exact normals from the noise derivatives, without erosion and rivers
+	ImGui::Checkbox("Analytic Normals", &tData.analyticNormals);
+	ImGui::Checkbox("Camera Collision", &cameraCollision);
+	//Mesh type
+	int meshType = (int)tData.meshType;
+	ImGui::Combo("Mesh", &meshType, "Grid\0RTIN\0");
+	tData.meshType = (MeshType)meshType;
+	if (tData.meshType == MeshType::RTIN)
+	{
+		ImGui::SliderFloat("Max Mesh Error", &tData.maxMeshError, 0.0f, 0.5f, "%.4f");
+		if (!RTINMesher::supports(tData.numXVertices, tData.numZVertices))
+			ImGui::Text("RTIN needs (2^k + 1) x (2^k + 1) vertices, the grid is used");
+	}
+	const RTINStats& meshStats = terrain->getMeshStats();
+	ImGui::Text("Triangles: %zu (grid: %zu), vertices: %zu", meshStats.triangles, meshStats.gridTriangles, meshStats.vertices);
+	ImGui::Text("Mesh error: max %.4f, rms %.4f", meshStats.maxError, meshStats.rmsError);
+	ImGui::Checkbox("Optimize Vertex Cache", &tData.optimizeVertexCache);
+	ImGui::Text("ACMR: %.3f, ATVR: %.3f", terrain->getCacheStats().acmr, terrain->getCacheStats().atvr);
+	const UploadStats& uploadStats = terrain->getUploads().getStats();
+	ImGui::Text("Uploads (%s): %.1f KB/frame, peak %.1f MB", terrain->getUploads().isPersistent() ? "persistent ring" : "orphaning",
+		uploadStats.lastFrameBytes / 1024.0, uploadStats.peakFrameBytes / (1024.0 * 1024.0));
+	ImGui::Text("Draw submission (%s): %.3f ms, %zu draws", terrain->isIndirectSubmission() ? "multi-draw indirect" : "loop",
+		terrain->getSubmitTime(), terrain->getDrawCount());
+	ImGui::Checkbox("Cluster Culling", &tData.clusterCulling);
+	if (tData.clusterCulling)
+	{
+		ImGui::Text("Clusters: %zu of %zu visible", terrain->getVisibleClusterCount(), terrain->getClusters().getClusters().size());
+		ImGui::Checkbox("Horizon Culling", &tData.horizonCulling);
+		const HorizonCuller& horizon = terrain->getHorizonCuller();
+		if (tData.horizonCulling && horizon.isValid())
+			ImGui::Text("Occlusion patches: %zu of %d visible", terrain->getVisiblePatchCount(), horizon.getPatchCountX() * horizon.getPatchCountZ());
+	}
+	//Thermal Erosion
+	ImGui::Checkbox("Thermal Erosion", &tData.erosion.enabled);
+	if (tData.erosion.enabled)
+	{
+		ImGui::SliderInt("Erosion Iterations", &tData.erosion.iterations, 1, 500);
+		ImGui::SliderFloat("Talus", &tData.erosion.talus, 0.0f, 0.05f, "%.4f");
+		ImGui::SliderFloat("Erosion Rate", &tData.erosion.rate, 0.0f, 1.0f);
+	}
+	//Rivers
+	ImGui::Checkbox("Rivers", &tData.hydrology.enabled);
+	if (tData.hydrology.enabled)
+	{
+		int method = (int)tData.hydrology.method;
+		ImGui::Combo("Flow Method", &method, "D8\0D-Infinity\0");
+		tData.hydrology.method = (FlowMethod)method;
+		ImGui::SliderFloat("River Threshold", &tData.hydrology.riverThreshold, 0.0001f, 0.02f, "%.4f");
+	}
+	//Vegetation
+	ImGui::Checkbox("Vegetation", &tData.vegetation.enabled);
+	if (tData.vegetation.enabled)
+	{
+		ImGui::SliderFloat("Tree Spacing", &tData.vegetation.trees.minDistance, 0.05f, 2.0f);
+		ImGui::SliderFloat("Max Tree Slope", &tData.vegetation.trees.maxSlope, 0.0f, 90.0f);
+		ImGui::SliderFloat("Rock Spacing", &tData.vegetation.rocks.minDistance, 0.05f, 2.0f);
+		ImGui::Text("Instances: %zu of %zu candidates, %zu visible", terrain->getVegetation().getInstanceCount(),
+			terrain->getVegetation().getCandidateCount(), terrain->getVegetation().getVisibleCount());
+	}
 	if (ImGui::Button("Generate"))
 	{
 		terrain->generate(tData, nData);
 	}
+	//Full resolution grid mesh into the working directory
+	ImGui::SameLine();
+	if (ImGui::Button("Export PLY") && !terrain->exportMesh("terrain.ply", MeshFormat::PLY))
+		std::cout << "ERROR::EXPORT::FILE_NOT_WRITTEN->terrain.ply" << std::endl;
+	ImGui::SameLine();
+	if (ImGui::Button("Export GLB") && !terrain->exportMesh("terrain.glb", MeshFormat::GLB))
+		std::cout << "ERROR::EXPORT::FILE_NOT_WRITTEN->terrain.glb" << std::endl;
+	//Height map with its biome IDs, loaded back without running the noise
+	if (ImGui::Button("Save Heights") && !terrain->saveHeights("terrain.pgth"))
+		std::cout << "ERROR::EXPORT::FILE_NOT_WRITTEN->terrain.pgth" << std::endl;
+	ImGui::SameLine();
+	if (ImGui::Button("Load Heights") && !terrain->load(tData, "terrain.pgth"))
+		std::cout << "ERROR::IMPORT::FILE_NOT_READ->terrain.pgth" << std::endl;
+	//Terrain point under the cursor
+	RayHit pick = pickTerrain();
+	if (pick.hit)
+		ImGui::Text("Cursor: (%.2f, %.2f, %.2f)", pick.position.x, pick.position.y, pick.position.z);
+	else
+		ImGui::Text("Cursor: -");
 	ImGui::End();
+	drawProfilerPanel();
 
 
 	//Render the ImGui Window
@@ -327,9 +505,41 @@ void handleImGui()
 
 int main()
 {
+	auto startupBegin = std::chrono::steady_clock::now();
+	PROFILE_THREAD("main");
+#ifdef PROGEN_PROFILING
+	//PROGEN_TRACE=<file> traces the whole run from startup and writes it at exit
+	const char* tracePath = std::getenv("PROGEN_TRACE");
+	if (tracePath != nullptr)
+		Profiler::global().setTracing(true);
+#endif
 	setupDependencies();
+	//Shaders are embedded into the executable. PROGEN_SHADER_DIR (or ../Shaders in debug builds) overrides them for editing.
+	registerEmbeddedShaders();
+	if (const char* shaderDir = std::getenv("PROGEN_SHADER_DIR"))
+		ShaderSources::global().setOverrideDirectory(shaderDir);
+#ifdef _DEBUG
+	else
+		ShaderSources::global().setOverrideDirectory("../Shaders");
+#endif
+	ProgramCache::global().setDirectory("shader_cache");
+	auto shadersBegin = std::chrono::steady_clock::now();
+	Shader terrainShader("basicLighting/basicLighting.vert", "basicLighting/basicLighting.frag");
+	Shader vegetationShader("instanced/instanced.vert", "basicLighting/basicLighting.frag");
+	auto shadersEnd = std::chrono::steady_clock::now();
 	setupData();
-	Shader terrainShader("../Shaders/basicLighting/basicLighting.vert", "../Shaders/basicLighting/basicLighting.frag");
+	//All visible chunks in one glMultiDrawElementsIndirect where the driver supports it
+	std::unique_ptr<Shader> terrainIndirectShader;
+	if (IndirectDrawList::isIndirectSupported())
+		terrainIndirectShader.reset(new Shader("terrainIndirect/terrainIndirect.vert", "basicLighting/basicLighting.frag"));
+	FrameUniforms frameUniforms;
+	frameUniforms.attach(terrainShader);
+	frameUniforms.attach(vegetationShader);
+	if (terrainIndirectShader)
+		frameUniforms.attach(*terrainIndirectShader);
+
+	std::cout << "Startup: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count()
+		<< " ms, shaders " << std::chrono::duration<double, std::milli>(shadersEnd - shadersBegin).count() << " ms" << std::endl;
 
 	// render loop
 	// -----------
@@ -339,6 +549,7 @@ int main()
 		updateDeltaTime();
 		// input
 		processInput(window);
+		resolveCameraCollision();
 
 		// render
 		// ------
@@ -346,10 +557,15 @@ int main()
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		//Render Shapes
-		terrain->renderTerrain(terrainShader, camera, lightDir, lightColor);
+		frameUniforms.update(camera, lightDir, lightColor);
+		terrain->renderTerrain(terrainShader, camera, terrainIndirectShader.get());
+		terrain->renderVegetation(vegetationShader, camera);
 
 		//Handle ImGui
 		handleImGui();
+		terrain->endFrame();
+		PROFILE_GPU_FRAME();
+		PROFILE_FRAME();
 
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 		// -------------------------------------------------------------------------------
@@ -357,6 +573,16 @@ int main()
 		glfwPollEvents();
 	}
 
+#ifdef PROGEN_PROFILING
+	if (tracePath != nullptr)
+	{
+		if (Profiler::global().writeChromeTrace(tracePath))
+			std::cout << "Trace written to " << tracePath << std::endl;
+		else
+			std::cout << "ERROR::PROFILER::TRACE_NOT_WRITTEN->" << tracePath << std::endl;
+	}
+#endif
+
 	//Terminate ImGui
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
@@ -7,18 +7,24 @@ in vec3 norm;
 in vec3 color;
 
 
-uniform vec3 lightColor;
-uniform vec3 lightDir;
+//Shared per frame data, see FrameUniforms
+layout (std140) uniform FrameData
+{
+	mat4 PV;
+	vec4 cameraPos;
+	vec4 lightDir;
+	vec4 lightColor;
+};
 
 void main()
 {
 	//Ambient Lighting
 	float ambientStrength = 0.1f;
-	vec3 ambient = ambientStrength * lightColor;
+	vec3 ambient = ambientStrength * lightColor.rgb;
 	//Diffuse
-	vec3 lDir = normalize(-lightDir);
+	vec3 lDir = normalize(-lightDir.xyz);
 	float diffCoefficient = max(dot(norm, lDir), 0.0f);
-	vec3 diffuse = diffCoefficient * lightColor;
+	vec3 diffuse = diffCoefficient * lightColor.rgb;
 
 	vec3 result = (ambient + diffuse) * color;
 	FragColor = vec4(result, 1.0); //Constant white for now
@@ -9,14 +9,22 @@ out vec3 fragPos; //World position of the Fragment
 out vec3 color;
 
 
-uniform mat4 PVM;
+//Shared per frame data, see FrameUniforms
+layout (std140) uniform FrameData
+{
+	mat4 PV;
+	vec4 cameraPos;
+	vec4 lightDir;
+	vec4 lightColor;
+};
+
 uniform mat4 modelMat;
 uniform mat3 normalTransformation;
 
 void main()
 {
-	gl_Position = PVM * vec4(pos_in, 1.0);
 	fragPos = vec3(modelMat * vec4(pos_in, 1.0));
+	gl_Position = PV * vec4(fragPos, 1.0);
 	norm = normalTransformation * norm_in;
 	color = color_in;
 }
\ No newline at end of file
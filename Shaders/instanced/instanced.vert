@@ -0,0 +1,38 @@
+#version 330 core
+layout (location = 0) in vec3 pos_in;
+layout (location = 1) in vec3 norm_in;
+layout (location = 2) in vec3 color_in;
+//Per instance
+layout (location = 3) in vec4 instancePosScale; //World position of the base, uniform scale
+layout (location = 4) in float instanceYaw;
+
+
+out vec3 norm;
+out vec3 fragPos; //World position of the Fragment
+out vec3 color;
+
+
+//Shared per frame data, see FrameUniforms
+layout (std140) uniform FrameData
+{
+	mat4 PV;
+	vec4 cameraPos;
+	vec4 lightDir;
+	vec4 lightColor;
+};
+
+void main()
+{
+	//Rotation around the y axis
+	float c = cos(instanceYaw);
+	float s = sin(instanceYaw);
+	mat3 rotation = mat3(c, 0.0, -s,
+						 0.0, 1.0, 0.0,
+						 s, 0.0, c);
+	vec3 worldPos = rotation * (pos_in * instancePosScale.w) + instancePosScale.xyz;
+	gl_Position = PV * vec4(worldPos, 1.0);
+	fragPos = worldPos;
+	//Uniform scale and rotation only, so the normal transforms with the rotation
+	norm = rotation * norm_in;
+	color = color_in;
+}
@@ -0,0 +1,41 @@
+#version 430 core
+layout (location = 0) in vec3 pos_in;
+layout (location = 1) in vec3 norm_in;
+layout (location = 2) in vec3 color_in;
+//Per draw: index into the draw data, see IndirectDrawList
+layout (location = 3) in uint drawIndex;
+
+
+out vec3 norm;
+out vec3 fragPos; //World position of the Fragment
+out vec3 color;
+
+
+//Shared per frame data, see FrameUniforms
+layout (std140) uniform FrameData
+{
+	mat4 PV;
+	vec4 cameraPos;
+	vec4 lightDir;
+	vec4 lightColor;
+};
+
+struct DrawData
+{
+	vec4 translationScale;
+};
+
+layout (std430, binding = 1) readonly buffer DrawDataBuffer
+{
+	DrawData draws[];
+};
+
+void main()
+{
+	vec4 translationScale = draws[drawIndex].translationScale;
+	fragPos = pos_in * translationScale.w + translationScale.xyz;
+	gl_Position = PV * vec4(fragPos, 1.0);
+	//Translation and uniform scale leave the normal as it is
+	norm = norm_in;
+	color = color_in;
+}
@@ -0,0 +1,47 @@
+# Turns every file under the Shaders folder into an entry of the embedded shader table (see ShaderSources.h).
+# Runs as the pre-build step of ProceduralGeneration. The output is only rewritten when it changes, so an
+# unchanged shader folder does not trigger a rebuild.
+param(
+	[Parameter(Mandatory = $true)][string]$ShaderDir,
+	[Parameter(Mandatory = $true)][string]$Output
+)
+
+$ErrorActionPreference = "Stop"
+$root = (Resolve-Path $ShaderDir).Path.TrimEnd('\', '/')
+$delimiter = "__progen_glsl__"
+# MSVC limits a single string literal to ~16K characters, longer sources are split into adjacent literals
+$chunkSize = 8000
+
+$builder = New-Object System.Text.StringBuilder
+[void]$builder.AppendLine("// Generated by Tools/embed_shaders.ps1 from the Shaders folder. Do not edit.")
+foreach ($file in Get-ChildItem -Path $root -Recurse -File | Sort-Object FullName)
+{
+	$name = $file.FullName.Substring($root.Length + 1).Replace('\', '/')
+	$source = [System.IO.File]::ReadAllText($file.FullName).Replace("`r`n", "`n")
+	if ($source.Contains(")" + $delimiter + '"'))
+	{
+		throw "$name contains the raw string delimiter"
+	}
+	[void]$builder.Append("{ `"$name`",")
+	for ($i = 0; $i -lt $source.Length; $i += $chunkSize)
+	{
+		$chunk = $source.Substring($i, [Math]::Min($chunkSize, $source.Length - $i))
+		[void]$builder.Append("`nR`"$delimiter($chunk)$delimiter`"")
+	}
+	if ($source.Length -eq 0)
+	{
+		[void]$builder.Append(" `"`"")
+	}
+	[void]$builder.AppendLine(" },")
+}
+
+$text = $builder.ToString()
+$directory = Split-Path -Parent $Output
+if ($directory -and -not (Test-Path $directory))
+{
+	New-Item -ItemType Directory -Path $directory | Out-Null
+}
+if (-not (Test-Path $Output) -or [System.IO.File]::ReadAllText($Output) -ne $text)
+{
+	[System.IO.File]::WriteAllText($Output, $text)
+}